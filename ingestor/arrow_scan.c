@@ -0,0 +1,887 @@
+#include <dirent.h>
+
+/* Header for arrow parquet */
+#include <arrow-glib/arrow-glib.h>
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "arrow_scan.h"
+#include "catalog/pg_type_d.h"
+#include "column_cache.h"
+#include "column_types.h"
+#include "constants.h"
+#include "export_access.h"
+#include "export_generation.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/lsyscache.h"
+#include "utils/timestamp.h"
+#include "utils/uuid.h"
+
+PG_FUNCTION_INFO_V1(analytica_scan);
+
+/* Postgres type a column of the Arrow files is returned as. */
+typedef struct _ScanColumn {
+  Oid type_oid;
+  int32 typmod;
+  // Scale of numeric columns.
+  int32 scale;
+  Oid input_function;
+  Oid typioparam;
+  // Element type of array columns.
+  struct _ScanColumn *element;
+  int16 element_length;
+  bool element_by_value;
+  char element_align;
+} ScanColumn;
+
+typedef struct _ArrowValues ArrowValues;
+
+/* Reads the value at index of an array as a Datum of the column type. */
+typedef Datum (*ValueReader)(const ArrowValues *values, int64 index,
+                             const ScanColumn *column);
+
+/*
+ * Values of an array with their buffers resolved once so that rows are read
+ * straight from the memory mapped file or cached column.
+ */
+struct _ArrowValues {
+  GArrowArray *array;
+  ValueReader read;
+  // Validity bitmap or NULL when no value is null.
+  const uint8 *validity;
+  // Offset of the array into its bitmaps.
+  int64 offset;
+  // Values of fixed width arrays, the bitmap of boolean arrays.
+  const void *fixed;
+  // Offsets and data of binary and list arrays.
+  const gint32 *offsets;
+  const char *data;
+  // Values of list elements.
+  ArrowValues *element;
+};
+
+/* Column of a record batch with dictionaries resolved once per batch. */
+typedef struct _BatchColumn {
+  GArrowArray *array;
+  // Memory referenced by array when it was read from the column cache.
+  char *cached_data;
+  // Validity of rows, the indices' for dictionary arrays.
+  const uint8 *validity;
+  int64 validity_offset;
+  // Dictionary indices or NULL.
+  const gint32 *indices;
+  ArrowValues values;
+} BatchColumn;
+
+static void init_scan_column(ScanColumn *column, Oid type_oid, int32 typmod) {
+  memset(column, 0, sizeof(ScanColumn));
+  column->type_oid = type_oid;
+  column->typmod = typmod;
+  if (type_oid == NUMERICOID && typmod >= (int32)VARHDRSZ) {
+    int32 precision;
+    decimal_precision_and_scale(typmod, &precision, &column->scale);
+  }
+  getTypeInputInfo(type_oid, &column->input_function, &column->typioparam);
+  Oid element_type = get_element_type(type_oid);
+  if (OidIsValid(element_type)) {
+    get_typlenbyvalalign(element_type, &column->element_length,
+                         &column->element_by_value, &column->element_align);
+    column->element = palloc(sizeof(ScanColumn));
+    init_scan_column(column->element, element_type, -1);
+  }
+}
+
+static inline bool bit_is_unset(const uint8 *bitmap, int64 offset,
+                                int64 index) {
+  int64 bit = offset + index;
+  return bitmap != NULL && (bitmap[bit / 8] & (1 << (bit % 8))) == 0;
+}
+
+/*
+ * Returns data of buffer, which stays valid while an array referencing the
+ * buffer is alive, and releases the buffer.
+ */
+static const void *buffer_data(GArrowBuffer *buffer) {
+  if (buffer == NULL) {
+    return NULL;
+  }
+  GBytes *bytes = garrow_buffer_get_data(buffer);
+  const void *data = g_bytes_get_data(bytes, NULL);
+  g_bytes_unref(bytes);
+  g_object_unref(buffer);
+  return data;
+}
+
+static void init_validity(GArrowArray *array, const uint8 **validity,
+                          int64 *offset) {
+  *validity = NULL;
+  *offset = garrow_array_get_offset(array);
+  if (garrow_array_get_n_nulls(array) > 0) {
+    *validity = buffer_data(garrow_array_get_null_bitmap(array));
+  }
+}
+
+static Datum read_int16(const ArrowValues *values, int64 index,
+                        const ScanColumn *column) {
+  return Int16GetDatum((int16)((const gint64 *)values->fixed)[index]);
+}
+
+static Datum read_int32(const ArrowValues *values, int64 index,
+                        const ScanColumn *column) {
+  return Int32GetDatum((int32)((const gint64 *)values->fixed)[index]);
+}
+
+static Datum read_int64(const ArrowValues *values, int64 index,
+                        const ScanColumn *column) {
+  return Int64GetDatum(((const gint64 *)values->fixed)[index]);
+}
+
+static Datum read_float4(const ArrowValues *values, int64 index,
+                         const ScanColumn *column) {
+  return Float4GetDatum((float4)((const gdouble *)values->fixed)[index]);
+}
+
+static Datum read_float8(const ArrowValues *values, int64 index,
+                         const ScanColumn *column) {
+  return Float8GetDatum(((const gdouble *)values->fixed)[index]);
+}
+
+static Datum read_boolean(const ArrowValues *values, int64 index,
+                          const ScanColumn *column) {
+  int64 bit = values->offset + index;
+  return BoolGetDatum((((const uint8 *)values->fixed)[bit / 8] &
+                       (1 << (bit % 8))) != 0);
+}
+
+static Datum read_timestamp(const ArrowValues *values, int64 index,
+                            const ScanColumn *column) {
+  return TimestampGetDatum(((const gint64 *)values->fixed)[index] -
+                           UNIX_EPOCH_OFFSET_USECS);
+}
+
+static Datum read_date(const ArrowValues *values, int64 index,
+                       const ScanColumn *column) {
+  return DateADTGetDatum(((const gint32 *)values->fixed)[index] -
+                         UNIX_EPOCH_OFFSET_DAYS);
+}
+
+static Datum read_numeric(const ArrowValues *values, int64 index,
+                          const ScanColumn *column) {
+  int128 value;
+  memcpy(&value, (const char *)values->fixed + index * sizeof(int128),
+         sizeof(int128));
+  return int128_to_numeric(value, column->scale);
+}
+
+static Datum read_uuid(const ArrowValues *values, int64 index,
+                       const ScanColumn *column) {
+  // Tuples copy the value, so it can point into the array.
+  return UUIDPGetDatum(
+      (pg_uuid_t *)((const char *)values->fixed + index * UUID_LEN));
+}
+
+static Datum read_varlena(const ArrowValues *values, int64 index,
+                          const ScanColumn *column) {
+  // Text like types and bytea share the varlena representation.
+  int32 length = values->offsets[index + 1] - values->offsets[index];
+  struct varlena *result = palloc(length + VARHDRSZ);
+  SET_VARSIZE(result, length + VARHDRSZ);
+  memcpy(VARDATA(result), values->data + values->offsets[index], length);
+  return PointerGetDatum(result);
+}
+
+static Datum read_jsonb(const ArrowValues *values, int64 index,
+                        const ScanColumn *column) {
+  char *json =
+      pnstrdup(values->data + values->offsets[index],
+               values->offsets[index + 1] - values->offsets[index]);
+  Datum result = OidInputFunctionCall(column->input_function, json,
+                                      column->typioparam, column->typmod);
+  pfree(json);
+  return result;
+}
+
+static Datum read_list(const ArrowValues *values, int64 index,
+                       const ScanColumn *column) {
+  const ArrowValues *element = values->element;
+  int64 first = values->offsets[index];
+  int64 num_of_elements = values->offsets[index + 1] - first;
+  Datum *elements = palloc(Max(num_of_elements, 1) * sizeof(Datum));
+  bool *nulls = palloc(Max(num_of_elements, 1) * sizeof(bool));
+  for (int64 i = 0; i < num_of_elements; i += 1) {
+    nulls[i] = bit_is_unset(element->validity, element->offset,
+                            first + i);
+    elements[i] = nulls[i] ? (Datum)0
+                           : element->read(element, first + i,
+                                           column->element);
+  }
+  int dims[1] = {(int)num_of_elements};
+  int lbs[1] = {1};
+  ArrayType *result = construct_md_array(
+      elements, nulls, 1, dims, lbs, column->element->type_oid,
+      column->element_length, column->element_by_value,
+      column->element_align);
+  pfree(elements);
+  pfree(nulls);
+  return PointerGetDatum(result);
+}
+
+/*
+ * Resolves the buffers and reader of values of array, which is released
+ * with the values.
+ */
+static void init_arrow_values(ArrowValues *values, GArrowArray *array,
+                              const ScanColumn *column) {
+  memset(values, 0, sizeof(ArrowValues));
+  values->array = array;
+  init_validity(array, &values->validity, &values->offset);
+  gint64 length;
+  switch (garrow_array_get_value_type(array)) {
+  case GARROW_TYPE_INT64:
+    values->fixed =
+        garrow_int64_array_get_values(GARROW_INT64_ARRAY(array), &length);
+    values->read = column->type_oid == INT2OID   ? read_int16
+                   : column->type_oid == INT4OID ? read_int32
+                                                 : read_int64;
+    break;
+  case GARROW_TYPE_DOUBLE:
+    values->fixed =
+        garrow_double_array_get_values(GARROW_DOUBLE_ARRAY(array), &length);
+    values->read = column->type_oid == FLOAT4OID ? read_float4 : read_float8;
+    break;
+  case GARROW_TYPE_BOOLEAN:
+    values->fixed = buffer_data(
+        garrow_primitive_array_get_data_buffer(GARROW_PRIMITIVE_ARRAY(array)));
+    values->read = read_boolean;
+    break;
+  case GARROW_TYPE_TIMESTAMP:
+    values->fixed = garrow_timestamp_array_get_values(
+        GARROW_TIMESTAMP_ARRAY(array), &length);
+    values->read = read_timestamp;
+    break;
+  case GARROW_TYPE_DATE32:
+    values->fixed =
+        garrow_date32_array_get_values(GARROW_DATE32_ARRAY(array), &length);
+    values->read = read_date;
+    break;
+  case GARROW_TYPE_DECIMAL128:
+  case GARROW_TYPE_FIXED_SIZE_BINARY: {
+    // Decimal128 arrays are fixed size binary arrays of int128 values.
+    GBytes *bytes = garrow_fixed_size_binary_array_get_values_bytes(
+        GARROW_FIXED_SIZE_BINARY_ARRAY(array));
+    values->fixed = g_bytes_get_data(bytes, NULL);
+    g_bytes_unref(bytes);
+    values->read = garrow_array_get_value_type(array) ==
+                           GARROW_TYPE_DECIMAL128
+                       ? read_numeric
+                       : read_uuid;
+    break;
+  }
+  case GARROW_TYPE_STRING:
+  case GARROW_TYPE_BINARY: {
+    GArrowBinaryArray *binary_array = GARROW_BINARY_ARRAY(array);
+    const gint32 *offsets = buffer_data(
+        garrow_binary_array_get_offsets_buffer(binary_array));
+    values->offsets = offsets + values->offset;
+    values->data =
+        buffer_data(garrow_binary_array_get_data_buffer(binary_array));
+    values->read = column->type_oid == JSONBOID ? read_jsonb : read_varlena;
+    break;
+  }
+  case GARROW_TYPE_LIST: {
+    GArrowListArray *list_array = GARROW_LIST_ARRAY(array);
+    values->offsets =
+        garrow_list_array_get_value_offsets(list_array, &length);
+    values->element = palloc0(sizeof(ArrowValues));
+    init_arrow_values(values->element,
+                      garrow_list_array_get_values(list_array),
+                      column->element);
+    values->read = read_list;
+    break;
+  }
+  default:
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("Unsupported arrow type in exported file")));
+  }
+}
+
+static void release_arrow_values(ArrowValues *values) {
+  if (values->element != NULL) {
+    release_arrow_values(values->element);
+    pfree(values->element);
+  }
+  if (values->array != NULL) {
+    g_object_unref(values->array);
+  }
+  memset(values, 0, sizeof(ArrowValues));
+}
+
+/*
+ * Resolves dictionary, buffers and reader of array, which was read for a
+ * column of a record batch.
+ */
+static void init_batch_column(BatchColumn *column, GArrowArray *array,
+                              const ScanColumn *scan_column) {
+  column->array = array;
+  if (!GARROW_IS_DICTIONARY_ARRAY(array)) {
+    init_arrow_values(&column->values, g_object_ref(array), scan_column);
+    column->validity = column->values.validity;
+    column->validity_offset = column->values.offset;
+    return;
+  }
+  GArrowDictionaryArray *dictionary_array = GARROW_DICTIONARY_ARRAY(array);
+  // Indices share their buffers with the dictionary array.
+  GArrowArray *indices = garrow_dictionary_array_get_indices(dictionary_array);
+  gint64 length;
+  column->indices =
+      garrow_int32_array_get_values(GARROW_INT32_ARRAY(indices), &length);
+  init_validity(indices, &column->validity, &column->validity_offset);
+  g_object_unref(indices);
+  init_arrow_values(&column->values,
+                    garrow_dictionary_array_get_dictionary(dictionary_array),
+                    scan_column);
+}
+
+static void release_batch_column(BatchColumn *column) {
+  release_arrow_values(&column->values);
+  if (column->array != NULL) {
+    g_object_unref(column->array);
+  }
+  if (column->cached_data != NULL) {
+    pfree(column->cached_data);
+  }
+  memset(column, 0, sizeof(BatchColumn));
+}
+
+static Datum batch_column_datum(const BatchColumn *column, int64 row,
+                                const ScanColumn *scan_column, bool *isnull) {
+  *isnull = column->array == NULL ||
+            bit_is_unset(column->validity, column->validity_offset, row);
+  if (*isnull) {
+    return (Datum)0;
+  }
+  int64 index = column->indices != NULL ? column->indices[row] : row;
+  const ArrowValues *values = &column->values;
+  if (column->indices != NULL &&
+      bit_is_unset(values->validity, values->offset, index)) {
+    *isnull = true;
+    return (Datum)0;
+  }
+  return values->read(values, index, scan_column);
+}
+
+/*
+ * Raises an error if values of the field can't be returned as the type of
+ * the result column.
+ */
+static void check_field_type(GArrowField *field, Form_pg_attribute attribute) {
+  GArrowDataType *field_type = garrow_field_get_data_type(field);
+  GArrowDataType *value_type = g_object_ref(field_type);
+  if (GARROW_IS_DICTIONARY_DATA_TYPE(field_type)) {
+    g_object_unref(value_type);
+    value_type = garrow_dictionary_data_type_get_value_data_type(
+        GARROW_DICTIONARY_DATA_TYPE(field_type));
+  }
+  GArrowDataType *expected_type =
+      arrow_data_type_for_column(attribute->atttypid, attribute->atttypmod);
+  bool is_compatible =
+      expected_type != NULL && garrow_data_type_equal(value_type,
+                                                      expected_type);
+  if (expected_type != NULL) {
+    g_object_unref(expected_type);
+  }
+  g_object_unref(value_type);
+  if (!is_compatible) {
+    ereport(ERROR,
+            (errcode(ERRCODE_DATATYPE_MISMATCH),
+             errmsg("Column %s of type %s doesn't match the exported files",
+                    NameStr(attribute->attname),
+                    format_type_with_typemod(attribute->atttypid,
+                                             attribute->atttypmod))));
+  }
+}
+
+/*
+ * Only decompressing files is expensive enough to be worth caching,
+ * uncompressed files are memory mapped and shared through the page cache.
+ */
+static bool file_is_compressed(const char *file_name) {
+  size_t name_length = strlen(file_name);
+  size_t extension_length = strlen(COMPRESSED_ARROW_FILE_EXTENSION);
+  return name_length > extension_length &&
+         strcmp(file_name + name_length - extension_length,
+                COMPRESSED_ARROW_FILE_EXTENSION) == 0;
+}
+
+/*
+ * Populates key of a column of a record batch in the column cache.
+ * Keys start with the database oid and table name so they can be removed per
+ * table.
+ */
+static void populate_column_cache_key(StringInfo key, const char *table_name,
+                                      const char *file_name, guint batch_num,
+                                      const char *column_name,
+                                      uint64 generation) {
+  resetStringInfo(key);
+  appendStringInfo(key, "%u/%s/%s/%u/%s@" UINT64_FORMAT, MyDatabaseId,
+                   table_name, file_name, batch_num, column_name, generation);
+}
+
+/*
+ * Orders files by the chunk they belong to. Files of the row layout are a
+ * chunk of their own while column groups of the same blocks share a chunk.
+ */
+static int compare_chunk_files(const void *a, const void *b) {
+  const char *name_a = *(const char *const *)a;
+  const char *name_b = *(const char *const *)b;
+  const char *chunk_a = strrchr(name_a, COLUMN_GROUP_SEPARATOR);
+  const char *chunk_b = strrchr(name_b, COLUMN_GROUP_SEPARATOR);
+  return strcmp(chunk_a != NULL ? chunk_a : name_a,
+                chunk_b != NULL ? chunk_b : name_b);
+}
+
+/* Arrow file scanned along with the other files of a chunk. */
+typedef struct _ScanFile {
+  const char *file_name;
+  char path[MAXPGPATH];
+  GArrowMemoryMappedInputStream *input;
+  GArrowRecordBatchFileReader *reader;
+  // Record batch being scanned, read when a column isn't cached.
+  GArrowRecordBatch *batch;
+} ScanFile;
+
+/*
+ * Maps the file at the path of file and opens its reader. Objects are
+ * stored in file as soon as they are created so that they can be released
+ * if opening fails.
+ */
+static void open_arrow_file(ScanFile *file) {
+  GError *error = NULL;
+  file->input = garrow_memory_mapped_input_stream_new(file->path, &error);
+  if (file->input == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not map file \"%s\": %s", file->path,
+                           error->message)));
+  }
+  file->reader = garrow_record_batch_file_reader_new(
+      GARROW_SEEKABLE_INPUT_STREAM(file->input), &error);
+  if (file->reader == NULL) {
+    ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+                    errmsg("could not read arrow file \"%s\": %s",
+                           file->path, error->message)));
+  }
+}
+
+static void read_record_batch(ScanFile *file, guint batch_num) {
+  GError *error = NULL;
+  file->batch = garrow_record_batch_file_reader_read_record_batch(
+      file->reader, batch_num, &error);
+  if (file->batch == NULL) {
+    ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+                    errmsg("could not read record batch of \"%s\": %s",
+                           file->path, error->message)));
+  }
+}
+
+static void release_record_batch(ScanFile *file) {
+  if (file->batch != NULL) {
+    g_object_unref(file->batch);
+    file->batch = NULL;
+  }
+}
+
+static void close_arrow_file(ScanFile *file) {
+  release_record_batch(file);
+  if (file->reader != NULL) {
+    g_object_unref(file->reader);
+    file->reader = NULL;
+  }
+  if (file->input != NULL) {
+    g_object_unref(file->input);
+    file->input = NULL;
+  }
+}
+
+/*
+ * State of a scan kept across calls. Rows are returned from one record
+ * batch of the memory mapped Arrow files of a chunk at a time. Files of the
+ * row layout hold every column, files of the column group layout hold a
+ * column each and are stitched back together by row position. Columns of
+ * compressed files are served from the column cache when possible and
+ * cached after being decoded otherwise, keyed by generation, the export
+ * generation of the table read before the files were listed.
+ */
+typedef struct _ScanState {
+  const char *table_name;
+  char data_path[MAXPGPATH];
+  uint64 generation;
+  TupleDesc tupdesc;
+  ScanColumn *scan_columns;
+  char **file_names;
+  int num_of_files;
+  // First file of the next chunk.
+  int next_file;
+  // Files of the chunk being scanned or NULL.
+  ScanFile *files;
+  int num_of_chunk_files;
+  // File and field index of each result column.
+  int *file_indexes;
+  int *field_indexes;
+  guint num_of_batches;
+  guint next_batch;
+  BatchColumn *columns;
+  int64 num_of_rows;
+  int64 next_row;
+  Datum *values;
+  bool *nulls;
+  StringInfoData key;
+  // Releases the Arrow objects when the scan ends or fails.
+  MemoryContextCallback release_callback;
+} ScanState;
+
+static void release_batch(ScanState *state) {
+  for (int i = 0; i < state->tupdesc->natts; i += 1) {
+    release_batch_column(&state->columns[i]);
+  }
+  for (int f = 0; f < state->num_of_chunk_files; f += 1) {
+    release_record_batch(&state->files[f]);
+  }
+}
+
+static void close_chunk(ScanState *state) {
+  release_batch(state);
+  for (int f = 0; f < state->num_of_chunk_files; f += 1) {
+    close_arrow_file(&state->files[f]);
+  }
+  pfree(state->files);
+  pfree(state->file_indexes);
+  pfree(state->field_indexes);
+  state->files = NULL;
+  state->num_of_chunk_files = 0;
+}
+
+static void release_scan(void *arg) {
+  ScanState *state = (ScanState *)arg;
+  if (state->files != NULL) {
+    close_chunk(state);
+  }
+}
+
+/*
+ * Opens the files of the next chunk and maps result columns to their
+ * fields.
+ */
+static void open_chunk(ScanState *state) {
+  int first = state->next_file;
+  int last = first + 1;
+  while (last < state->num_of_files &&
+         compare_chunk_files(&state->file_names[first],
+                             &state->file_names[last]) == 0) {
+    last += 1;
+  }
+  state->next_file = last;
+  int num_of_files = last - first;
+  state->files = palloc0(num_of_files * sizeof(ScanFile));
+  state->file_indexes = palloc(state->tupdesc->natts * sizeof(int));
+  state->field_indexes = palloc(state->tupdesc->natts * sizeof(int));
+  state->num_of_chunk_files = num_of_files;
+  ScanFile *files = state->files;
+  for (int f = 0; f < num_of_files; f += 1) {
+    files[f].file_name = state->file_names[first + f];
+    snprintf(files[f].path, sizeof(files[f].path), "%s/%s",
+             state->data_path, files[f].file_name);
+    open_arrow_file(&files[f]);
+  }
+  for (int i = 0; i < state->tupdesc->natts; i += 1) {
+    Form_pg_attribute attribute = TupleDescAttr(state->tupdesc, i);
+    state->file_indexes[i] = 0;
+    state->field_indexes[i] = -1;
+    for (int f = 0; f < num_of_files && state->field_indexes[i] < 0;
+         f += 1) {
+      GArrowSchema *schema =
+          garrow_record_batch_file_reader_get_schema(files[f].reader);
+      int field_index =
+          garrow_schema_get_field_index(schema, NameStr(attribute->attname));
+      if (field_index >= 0) {
+        GArrowField *field = garrow_schema_get_field(schema, field_index);
+        g_object_unref(schema);
+        check_field_type(field, attribute);
+        g_object_unref(field);
+        state->field_indexes[i] = field_index;
+        state->file_indexes[i] = f;
+      } else {
+        g_object_unref(schema);
+      }
+    }
+  }
+
+  state->num_of_batches =
+      garrow_record_batch_file_reader_get_n_record_batches(files[0].reader);
+  for (int f = 1; f < num_of_files; f += 1) {
+    if (garrow_record_batch_file_reader_get_n_record_batches(
+            files[f].reader) != state->num_of_batches) {
+      ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+                      errmsg("column group \"%s\" isn't aligned with \"%s\"",
+                             files[f].file_name, files[0].file_name)));
+    }
+  }
+  state->next_batch = 0;
+  state->num_of_rows = 0;
+  state->next_row = 0;
+}
+
+/*
+ * Resolves the columns of the next record batch of the chunk. Batches are
+ * only decoded if some of their columns aren't cached.
+ */
+static void load_batch(ScanState *state) {
+  guint batch_num = state->next_batch;
+  state->next_batch += 1;
+  int64 num_of_rows = -1;
+  for (int i = 0; i < state->tupdesc->natts; i += 1) {
+    if (state->field_indexes[i] < 0) {
+      continue;
+    }
+    ScanFile *file = &state->files[state->file_indexes[i]];
+    BatchColumn *column = &state->columns[i];
+    bool use_cache =
+        column_cache_enabled() && file_is_compressed(file->file_name);
+    const char *column_name =
+        NameStr(TupleDescAttr(state->tupdesc, i)->attname);
+    GArrowArray *array = NULL;
+    if (use_cache) {
+      populate_column_cache_key(&state->key, state->table_name,
+                                file->file_name, batch_num, column_name,
+                                state->generation);
+      array = column_cache_lookup(state->key.data, &column->cached_data);
+    }
+    bool is_cached = array != NULL;
+    if (!is_cached) {
+      if (file->batch == NULL) {
+        read_record_batch(file, batch_num);
+      }
+      array = garrow_record_batch_get_column_data(file->batch,
+                                                  state->field_indexes[i]);
+    }
+    init_batch_column(column, array, &state->scan_columns[i]);
+    if (use_cache && !is_cached) {
+      column_cache_store(state->key.data, array);
+    }
+    int64 column_rows = garrow_array_get_length(array);
+    if (num_of_rows >= 0 && column_rows != num_of_rows) {
+      ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+                      errmsg("column group \"%s\" isn't aligned with the "
+                             "other columns of its chunk",
+                             file->file_name)));
+    }
+    num_of_rows = column_rows;
+  }
+  if (num_of_rows < 0) {
+    // None of the result columns were exported.
+    read_record_batch(&state->files[0], batch_num);
+    num_of_rows = garrow_record_batch_get_n_rows(state->files[0].batch);
+  }
+  state->num_of_rows = num_of_rows;
+  state->next_row = 0;
+}
+
+/*
+ * Populates values and nulls of state with the next row of the scan.
+ * Returns false once every file was scanned.
+ */
+static bool scan_next_row(ScanState *state, MemoryContext scan_context) {
+  while (state->files == NULL || state->next_row == state->num_of_rows) {
+    MemoryContext old_context = MemoryContextSwitchTo(scan_context);
+    if (state->files != NULL &&
+        state->next_batch < state->num_of_batches) {
+      release_batch(state);
+      load_batch(state);
+    } else {
+      if (state->files != NULL) {
+        close_chunk(state);
+      }
+      if (state->next_file == state->num_of_files) {
+        MemoryContextSwitchTo(old_context);
+        return false;
+      }
+      open_chunk(state);
+    }
+    MemoryContextSwitchTo(old_context);
+  }
+  for (int i = 0; i < state->tupdesc->natts; i += 1) {
+    state->values[i] =
+        batch_column_datum(&state->columns[i], state->next_row,
+                           &state->scan_columns[i], &state->nulls[i]);
+  }
+  state->next_row += 1;
+  return true;
+}
+
+/*
+ * Returns true if file_name is an Arrow file.
+ */
+static bool is_arrow_file(const char *file_name) {
+  size_t name_length = strlen(file_name);
+  size_t extension_length = strlen(ARROW_FILE_EXTENSION);
+  return name_length > extension_length &&
+         strcmp(file_name + name_length - extension_length,
+                ARROW_FILE_EXTENSION) == 0;
+}
+
+void prewarm_column_cache(const char *table_name) {
+  if (!column_cache_enabled()) {
+    return;
+  }
+  // Columns of the previous generation can't be read anymore.
+  column_cache_remove_table(table_name);
+  uint64 generation = get_export_generation(table_name);
+  StringInfoData key;
+  initStringInfo(&key);
+  char data_path[MAXPGPATH];
+  snprintf(data_path, sizeof(data_path), "pg_analytica/%u/%s", MyDatabaseId,
+           table_name);
+  ScanFile *file = palloc0(sizeof(ScanFile));
+  DIR *dir = AllocateDir(data_path);
+  struct dirent *entry;
+  while ((entry = ReadDir(dir, data_path)) != NULL) {
+    if (!is_arrow_file(entry->d_name) ||
+        !file_is_compressed(entry->d_name)) {
+      continue;
+    }
+    file->file_name = entry->d_name;
+    snprintf(file->path, sizeof(file->path), "%s/%s", data_path,
+             entry->d_name);
+    PG_TRY();
+    {
+      open_arrow_file(file);
+      GArrowSchema *schema =
+          garrow_record_batch_file_reader_get_schema(file->reader);
+      guint num_of_fields = garrow_schema_n_fields(schema);
+      g_object_unref(schema);
+      guint num_of_batches =
+          garrow_record_batch_file_reader_get_n_record_batches(file->reader);
+      for (guint batch_num = 0; batch_num < num_of_batches; batch_num += 1) {
+        read_record_batch(file, batch_num);
+        for (guint i = 0; i < num_of_fields; i += 1) {
+          GArrowArray *column =
+              garrow_record_batch_get_column_data(file->batch, i);
+          populate_column_cache_key(
+              &key, table_name, entry->d_name, batch_num,
+              garrow_record_batch_get_column_name(file->batch, i),
+              generation);
+          column_cache_store(key.data, column);
+          g_object_unref(column);
+        }
+        release_record_batch(file);
+      }
+    }
+    PG_FINALLY();
+    { close_arrow_file(file); }
+    PG_END_TRY();
+  }
+  FreeDir(dir);
+  pfree(file);
+  pfree(key.data);
+  elog(LOG, "Prewarmed column cache for %s", table_name);
+}
+
+/*
+ * Starts a scan of the Arrow files of table, or of its bucket when it isn't
+ * -1, returning rows of tupdesc. Must be called in the multi call memory
+ * context, the objects of the scan are released when it is deleted.
+ */
+static ScanState *begin_scan(char *table_name, int bucket, TupleDesc tupdesc) {
+  ScanState *state = palloc0(sizeof(ScanState));
+  state->table_name = table_name;
+  state->tupdesc = tupdesc;
+  state->scan_columns = palloc(tupdesc->natts * sizeof(ScanColumn));
+  for (int i = 0; i < tupdesc->natts; i += 1) {
+    Form_pg_attribute attribute = TupleDescAttr(tupdesc, i);
+    init_scan_column(&state->scan_columns[i], attribute->atttypid,
+                     attribute->atttypmod);
+  }
+  state->columns = palloc0(tupdesc->natts * sizeof(BatchColumn));
+  state->values = palloc(tupdesc->natts * sizeof(Datum));
+  state->nulls = palloc(tupdesc->natts * sizeof(bool));
+  initStringInfo(&state->key);
+  state->release_callback.func = release_scan;
+  state->release_callback.arg = state;
+  MemoryContextRegisterResetCallback(CurrentMemoryContext,
+                                     &state->release_callback);
+
+  // Files published after the generation is read are cached under the
+  // generation they replace, which is never read again. Reading it after
+  // opening the files could cache replaced files under the new generation.
+  state->generation = get_export_generation(table_name);
+  snprintf(state->data_path, sizeof(state->data_path), "pg_analytica/%u/%s",
+           MyDatabaseId, table_name);
+  int max_files = 64;
+  state->file_names = palloc(max_files * sizeof(char *));
+  DIR *dir = AllocateDir(state->data_path);
+  struct dirent *entry;
+  while ((entry = ReadDir(dir, state->data_path)) != NULL) {
+    if (!is_arrow_file(entry->d_name) ||
+        (bucket >= 0 && get_file_bucket(entry->d_name) != bucket)) {
+      continue;
+    }
+    if (state->num_of_files == max_files) {
+      max_files *= 2;
+      state->file_names =
+          repalloc(state->file_names, max_files * sizeof(char *));
+    }
+    state->file_names[state->num_of_files] = pstrdup(entry->d_name);
+    state->num_of_files += 1;
+  }
+  FreeDir(dir);
+  // Column groups of the same chunk end up next to each other.
+  qsort(state->file_names, state->num_of_files, sizeof(char *),
+        compare_chunk_files);
+  return state;
+}
+
+/**
+ * Returns rows of a table exported to Arrow IPC files, one per call. Files
+ * are memory mapped and values are read straight from their buffers, so
+ * uncompressed files are read without copying. Column groups of a chunk are
+ * read together. Only files of bucket are read when it isn't -1. Result
+ * columns are matched to exported columns by name. Requires SELECT on the
+ * relation of the table, which the view calling it is.
+ */
+Datum analytica_scan(PG_FUNCTION_ARGS) {
+  FuncCallContext *funcctx;
+  if (SRF_IS_FIRSTCALL()) {
+    char *table_name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+    check_export_access(table_name);
+    int bucket = PG_NARGS() > 1 ? PG_GETARG_INT32(1) : -1;
+    funcctx = SRF_FIRSTCALL_INIT();
+    MemoryContext old_context =
+        MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    TupleDesc tupdesc;
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+      ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                      errmsg("analytica_scan needs a column definition "
+                             "list")));
+    }
+    funcctx->tuple_desc = BlessTupleDesc(CreateTupleDescCopy(tupdesc));
+    funcctx->user_fctx =
+        begin_scan(pstrdup(table_name), bucket, funcctx->tuple_desc);
+    MemoryContextSwitchTo(old_context);
+    pfree(table_name);
+  }
+  funcctx = SRF_PERCALL_SETUP();
+  ScanState *state = (ScanState *)funcctx->user_fctx;
+  if (!scan_next_row(state, funcctx->multi_call_memory_ctx)) {
+    SRF_RETURN_DONE(funcctx);
+  }
+  HeapTuple tuple =
+      heap_form_tuple(funcctx->tuple_desc, state->values, state->nulls);
+  SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
@@ -0,0 +1,12 @@
+#ifndef _ARROW_SCAN_H
+#define _ARROW_SCAN_H
+
+#include "postgres.h"
+
+/**
+ * Decodes columns of the compressed Arrow files of table into the column
+ * cache, must be called after new files of the table were published.
+ */
+extern void prewarm_column_cache(const char *table_name);
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdio.h>
+
+#include "postgres.h"
+
+#include "bloom_filter.h"
+#include "catalog/pg_type_d.h"
+#include "common/hashfn.h"
+#include "fmgr.h"
+#include "port/pg_bitutils.h"
+#include "storage/fd.h"
+
+#define BLOOM_FILTER_FILE_MAGIC 0x50414246
+// Version 2 hashes bpchar values without trailing spaces, version 3 drops
+// the filters of row groups.
+#define BLOOM_FILTER_FILE_VERSION 3
+#define BLOOM_FILTER_MIN_BYTES 64
+// Caps the size of a single filter at 16MiB.
+#define BLOOM_FILTER_MAX_BYTES (16 * 1024 * 1024)
+
+static bool is_integer_type(Oid type_oid) {
+  return type_oid == INT2OID || type_oid == INT4OID || type_oid == INT8OID;
+}
+
+static bool is_string_type(Oid type_oid) {
+  return type_oid == TEXTOID || type_oid == VARCHAROID ||
+         type_oid == BPCHAROID;
+}
+
+bool bloom_filter_supports_type(Oid type_oid) {
+  return is_integer_type(type_oid) || is_string_type(type_oid);
+}
+
+bool bloom_filter_types_compatible(Oid type_oid, Oid other_type_oid) {
+  // Other strings compared as bpchar lose their trailing spaces, which
+  // their hash includes.
+  return (is_integer_type(type_oid) && is_integer_type(other_type_oid)) ||
+         (is_string_type(type_oid) && is_string_type(other_type_oid) &&
+          (type_oid == BPCHAROID) == (other_type_oid == BPCHAROID));
+}
+
+void bloom_filter_init(BloomFilter *filter, int64 expected_values) {
+  int64 num_bytes =
+      Max(expected_values, 1) * BLOOM_FILTER_BITS_PER_VALUE / BITS_PER_BYTE;
+  num_bytes = Min(Max(num_bytes, BLOOM_FILTER_MIN_BYTES),
+                  BLOOM_FILTER_MAX_BYTES);
+  filter->num_hashes = BLOOM_FILTER_NUM_HASHES;
+  filter->num_bytes = pg_nextpower2_32((uint32)num_bytes);
+  filter->bits = palloc0(filter->num_bytes);
+}
+
+void bloom_filter_free(BloomFilter *filter) {
+  if (filter->bits != NULL) {
+    pfree(filter->bits);
+    filter->bits = NULL;
+  }
+}
+
+/*
+ * Hashes value with the hashing shared by exported values and query
+ * constants. Returns false for types that can't be hashed. Trailing spaces
+ * of bpchar values are insignificant in comparisons and aren't hashed.
+ */
+static bool hash_datum(Oid type_oid, Datum value, uint64 *hash) {
+  if (is_integer_type(type_oid)) {
+    int64 int_value;
+    if (type_oid == INT2OID) {
+      int_value = DatumGetInt16(value);
+    } else if (type_oid == INT4OID) {
+      int_value = DatumGetInt32(value);
+    } else {
+      int_value = DatumGetInt64(value);
+    }
+    *hash = hash_bytes_extended((const unsigned char *)&int_value,
+                                sizeof(int64), 0);
+    return true;
+  }
+  if (is_string_type(type_oid)) {
+    struct varlena *original = (struct varlena *)DatumGetPointer(value);
+    struct varlena *detoasted = pg_detoast_datum_packed(original);
+    const char *data = VARDATA_ANY(detoasted);
+    int length = VARSIZE_ANY_EXHDR(detoasted);
+    if (type_oid == BPCHAROID) {
+      while (length > 0 && data[length - 1] == ' ') {
+        length -= 1;
+      }
+    }
+    *hash = hash_bytes_extended((const unsigned char *)data, length, 0);
+    if (detoasted != original) {
+      pfree(detoasted);
+    }
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Bit positions are derived from a single 64 bit hash using double hashing.
+ */
+static uint32 bloom_filter_bit(const BloomFilter *filter, uint64 hash,
+                               uint32 i) {
+  uint32 h1 = (uint32)hash;
+  uint32 h2 = (uint32)(hash >> 32) | 1;
+  return (h1 + i * h2) & (filter->num_bytes * BITS_PER_BYTE - 1);
+}
+
+void bloom_filter_add_datum(BloomFilter *filter, Oid type_oid, Datum value) {
+  uint64 hash;
+  if (!hash_datum(type_oid, value, &hash)) {
+    return;
+  }
+  for (uint32 i = 0; i < filter->num_hashes; i += 1) {
+    uint32 bit = bloom_filter_bit(filter, hash, i);
+    filter->bits[bit / BITS_PER_BYTE] |= 1 << (bit % BITS_PER_BYTE);
+  }
+}
+
+bool bloom_filter_may_contain_datum(const BloomFilter *filter, Oid type_oid,
+                                    Datum value) {
+  uint64 hash;
+  if (!hash_datum(type_oid, value, &hash)) {
+    return true;
+  }
+  for (uint32 i = 0; i < filter->num_hashes; i += 1) {
+    uint32 bit = bloom_filter_bit(filter, hash, i);
+    if ((filter->bits[bit / BITS_PER_BYTE] & (1 << (bit % BITS_PER_BYTE))) ==
+        0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void write_filter(FILE *file, const BloomFilter *filter) {
+  fwrite(filter->bits, 1, filter->num_bytes, file);
+}
+
+/*
+ * Sidecar files start with a header of magic, version and number of
+ * columns. Each column is stored as its name, number of hashes and filter
+ * size followed by the file filter.
+ */
+void write_bloom_filter_file(const char *path,
+                             const ColumnBloomFilter *columns,
+                             int num_of_columns) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    ereport(ERROR,
+            (errcode_for_file_access(),
+             errmsg("could not create bloom filter file \"%s\": %m", path)));
+  }
+  uint32 header[3] = {BLOOM_FILTER_FILE_MAGIC, BLOOM_FILTER_FILE_VERSION,
+                      (uint32)num_of_columns};
+  fwrite(header, sizeof(uint32), 3, file);
+  for (int i = 0; i < num_of_columns; i += 1) {
+    const ColumnBloomFilter *column = &columns[i];
+    uint32 column_header[2] = {column->file_filter.num_hashes,
+                               column->file_filter.num_bytes};
+    fwrite(column->column_name, 1, NAMEDATALEN, file);
+    fwrite(column_header, sizeof(uint32), 2, file);
+    write_filter(file, &column->file_filter);
+  }
+  if (ferror(file) || fclose(file) != 0) {
+    ereport(ERROR,
+            (errcode_for_file_access(),
+             errmsg("could not write bloom filter file \"%s\": %m", path)));
+  }
+  fsync_fname(path, /*isdir=*/false);
+}
+
+bool read_file_bloom_filter(const char *path, const char *column_name,
+                            BloomFilter *out) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  bool found = false;
+  uint32 header[3];
+  if (fread(header, sizeof(uint32), 3, file) != 3 ||
+      header[0] != BLOOM_FILTER_FILE_MAGIC ||
+      header[1] != BLOOM_FILTER_FILE_VERSION) {
+    elog(LOG, "Ignoring invalid bloom filter file %s", path);
+    fclose(file);
+    return false;
+  }
+  for (uint32 i = 0; i < header[2]; i += 1) {
+    char name[NAMEDATALEN];
+    uint32 column_header[2];
+    if (fread(name, 1, NAMEDATALEN, file) != NAMEDATALEN ||
+        fread(column_header, sizeof(uint32), 2, file) != 2) {
+      break;
+    }
+    name[NAMEDATALEN - 1] = '\0';
+    uint32 num_bytes = column_header[1];
+    if (strcmp(name, column_name) == 0 && num_bytes > 0 &&
+        num_bytes <= BLOOM_FILTER_MAX_BYTES) {
+      out->num_hashes = column_header[0];
+      out->num_bytes = num_bytes;
+      out->bits = palloc(num_bytes);
+      found = fread(out->bits, 1, num_bytes, file) == num_bytes;
+      if (!found) {
+        bloom_filter_free(out);
+      }
+      break;
+    }
+    // Skip the filters of other columns.
+    if (fseek(file, (long)num_bytes, SEEK_CUR) != 0) {
+      break;
+    }
+  }
+  fclose(file);
+  return found;
+}
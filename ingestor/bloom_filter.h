@@ -0,0 +1,73 @@
+#ifndef _BLOOM_FILTER_H
+#define _BLOOM_FILTER_H
+
+#include "postgres.h"
+
+// Sidecar files holding bloom filters are named {columnar file}.bloom.
+#define BLOOM_FILTER_FILE_SUFFIX ".bloom"
+// 10 bits per value with 7 hash functions gives a false positive rate of
+// roughly 1%.
+#define BLOOM_FILTER_BITS_PER_VALUE 10
+#define BLOOM_FILTER_NUM_HASHES 7
+
+typedef struct _BloomFilter {
+  uint32 num_hashes;
+  // Size of the bit array, always a power of two.
+  uint32 num_bytes;
+  uint8 *bits;
+} BloomFilter;
+
+/**
+ * Bloom filter of an exported column covering the whole file. Files are
+ * pruned as a whole while they are listed, so row groups have no filters.
+ */
+typedef struct _ColumnBloomFilter {
+  char column_name[NAMEDATALEN];
+  BloomFilter file_filter;
+} ColumnBloomFilter;
+
+/**
+ * Returns true if values of type can be added to bloom filters. Integers
+ * are hashed as int64 and strings as their bytes, without trailing spaces
+ * for bpchar, so that values of the exported column and query constants
+ * hash the same.
+ */
+extern bool bloom_filter_supports_type(Oid type_oid);
+
+/**
+ * Returns true if values of both types are hashed the same way.
+ */
+extern bool bloom_filter_types_compatible(Oid type_oid, Oid other_type_oid);
+
+/**
+ * Initializes filter sized for the expected number of distinct values.
+ */
+extern void bloom_filter_init(BloomFilter *filter, int64 expected_values);
+
+extern void bloom_filter_free(BloomFilter *filter);
+
+extern void bloom_filter_add_datum(BloomFilter *filter, Oid type_oid,
+                                   Datum value);
+
+/**
+ * Returns false if value is definitely not in the filter.
+ */
+extern bool bloom_filter_may_contain_datum(const BloomFilter *filter,
+                                           Oid type_oid, Datum value);
+
+/**
+ * Durably writes bloom filters of columns to the sidecar file at path.
+ */
+extern void write_bloom_filter_file(const char *path,
+                                    const ColumnBloomFilter *columns,
+                                    int num_of_columns);
+
+/**
+ * Populates out with the file level bloom filter of column stored in the
+ * sidecar file at path. Returns false if the file doesn't exist or has no
+ * filter for column.
+ */
+extern bool read_file_bloom_filter(const char *path, const char *column_name,
+                                   BloomFilter *out);
+
+#endif
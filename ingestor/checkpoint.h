@@ -0,0 +1,272 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "postgres.h"
+
+#include "common/hashfn.h"
+#include "export_entry.h"
+#include "file_utils.h"
+#include "storage/fd.h"
+#include "utils/palloc.h"
+
+#define CHECKPOINT_FILE_NAME ".checkpoint"
+#define MAX_CHECKPOINT_LINE_CHARS 1024
+#define MAX_CHECKPOINT_UNITS 1024
+
+/**
+ * Progress of an in-flight export persisted after every columnar file is
+ * written. A restarted worker resumes the export from the checkpoint instead
+ * of starting over.
+ *
+ * Relations are exported in ranges of heap blocks so progress is recorded as
+ * the next block to export. The number of blocks in the relation when the
+ * export started is recorded as the boundary of the export so a resumed
+ * export covers the same range of blocks as the original one. Relations read
+ * through a covering index record the last exported key instead.
+ *
+ * Fingerprints are recorded as of the start of the export, rows written
+ * after it may lie past the boundary so a resumed export must not claim to
+ * cover them.
+ */
+typedef struct _ExportCheckpoint {
+  // Hash of the exported and bloom filter columns, checkpoints for a
+  // different set of columns are discarded.
+  uint32 columns_hash;
+  // Fingerprint of the table when the export started, empty for
+  // checkpoints written before it was recorded.
+  char fingerprint[NAMEDATALEN];
+  // Relation being exported when the checkpoint was written and its
+  // fingerprint when its export started.
+  char relation_name[MAX_CHECKPOINT_LINE_CHARS];
+  char relation_fingerprint[NAMEDATALEN];
+  Oid relfilenode;
+  int64 boundary_block;
+  int64 next_block;
+  int next_chunk;
+  // Covering index the relation is read through, empty if it's read in
+  // ranges of heap blocks, and the quoted key columns of the last exported
+  // row separated by commas, empty before the first file. The export ends
+  // at the largest key when it started, empty if there were no rows.
+  char index_name[NAMEDATALEN];
+  char next_key[MAX_CHECKPOINT_LINE_CHARS];
+  char end_key[MAX_CHECKPOINT_LINE_CHARS];
+  // Partitions that were completely exported and moved to the data directory
+  // along with the fingerprint they were exported at.
+  int num_completed_units;
+  char completed_units[MAX_CHECKPOINT_UNITS][NAMEDATALEN];
+  char completed_fingerprints[MAX_CHECKPOINT_UNITS][NAMEDATALEN];
+  // Largest value of the fresh column of tables with a fresh view when the
+  // export started, rows past it aren't exported. Empty if the table had no
+  // values.
+  bool has_fresh_watermark;
+  char fresh_watermark[MAX_CHECKPOINT_LINE_CHARS];
+  // Start of the window of tables with one when the export started, empty
+  // for other tables.
+  char window_start[NAMEDATALEN];
+} ExportCheckpoint;
+
+uint32 hash_export_columns(const ExportEntry *entry) {
+  uint32 hash = 0;
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    const char *column_name = entry->columns_to_export[i];
+    hash = hash_combine(hash, hash_bytes((const unsigned char *)column_name,
+                                         strlen(column_name)));
+  }
+  // Files written without bloom filters for a column can't be resumed.
+  for (int i = 0; i < entry->num_of_bloom_filter_columns; i += 1) {
+    const char *column_name = entry->bloom_filter_columns[i];
+    uint32 column_hash =
+        hash_bytes((const unsigned char *)column_name, strlen(column_name));
+    hash = hash_combine(hash, ~column_hash);
+  }
+  return hash;
+}
+
+/*
+ * Populates the path of the checkpoint file for table in out.
+ * Assumes that buffer has PATH_MAX space available.
+ */
+void populate_checkpoint_path_for_table(const char *table, char *out) {
+  populate_data_path_for_table(table, out, /*relative=*/false);
+  strcat(out, "/" CHECKPOINT_FILE_NAME);
+}
+
+/**
+ * Returns checkpoint for the export of table or NULL if the table has no
+ * checkpoint or the checkpoint was written for different columns.
+ * Caller should free the returned pointer.
+ */
+ExportCheckpoint *load_export_checkpoint(const char *table_name,
+                                         uint32 columns_hash) {
+  char path[PATH_MAX];
+  populate_checkpoint_path_for_table(table_name, path);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+  ExportCheckpoint *checkpoint = palloc0(sizeof(ExportCheckpoint));
+  char line[MAX_CHECKPOINT_LINE_CHARS];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    char *value = strchr(line, ' ');
+    if (value == NULL) {
+      continue;
+    }
+    *value = '\0';
+    value += 1;
+    if (strcmp(line, "columns_hash") == 0) {
+      checkpoint->columns_hash = (uint32)strtoul(value, NULL, 10);
+    } else if (strcmp(line, "fingerprint") == 0) {
+      strlcpy(checkpoint->fingerprint, value, NAMEDATALEN);
+    } else if (strcmp(line, "relation") == 0) {
+      strlcpy(checkpoint->relation_name, value, MAX_CHECKPOINT_LINE_CHARS);
+    } else if (strcmp(line, "relation_fingerprint") == 0) {
+      strlcpy(checkpoint->relation_fingerprint, value, NAMEDATALEN);
+    } else if (strcmp(line, "relfilenode") == 0) {
+      checkpoint->relfilenode = (Oid)strtoul(value, NULL, 10);
+    } else if (strcmp(line, "boundary_block") == 0) {
+      checkpoint->boundary_block = strtoll(value, NULL, 10);
+    } else if (strcmp(line, "next_block") == 0) {
+      checkpoint->next_block = strtoll(value, NULL, 10);
+    } else if (strcmp(line, "next_chunk") == 0) {
+      checkpoint->next_chunk = atoi(value);
+    } else if (strcmp(line, "index") == 0) {
+      strlcpy(checkpoint->index_name, value, NAMEDATALEN);
+    } else if (strcmp(line, "next_key") == 0) {
+      strlcpy(checkpoint->next_key, value, MAX_CHECKPOINT_LINE_CHARS);
+    } else if (strcmp(line, "end_key") == 0) {
+      strlcpy(checkpoint->end_key, value, MAX_CHECKPOINT_LINE_CHARS);
+    } else if (strcmp(line, "fresh_watermark") == 0) {
+      checkpoint->has_fresh_watermark = true;
+      strlcpy(checkpoint->fresh_watermark, value, MAX_CHECKPOINT_LINE_CHARS);
+    } else if (strcmp(line, "window_start") == 0) {
+      strlcpy(checkpoint->window_start, value, NAMEDATALEN);
+    } else if (strcmp(line, "completed") == 0 &&
+               checkpoint->num_completed_units < MAX_CHECKPOINT_UNITS) {
+      // Completed entries are stored as "<fingerprint> <partition name>".
+      char *unit_name = strchr(value, ' ');
+      if (unit_name == NULL) {
+        continue;
+      }
+      *unit_name = '\0';
+      int unit = checkpoint->num_completed_units;
+      strlcpy(checkpoint->completed_fingerprints[unit], value, NAMEDATALEN);
+      strlcpy(checkpoint->completed_units[unit], unit_name + 1, NAMEDATALEN);
+      checkpoint->num_completed_units += 1;
+    }
+  }
+  fclose(file);
+
+  if (checkpoint->columns_hash != columns_hash) {
+    elog(LOG, "Discarding checkpoint for %s written for different columns",
+         table_name);
+    pfree(checkpoint);
+    return NULL;
+  }
+  elog(LOG, "Loaded checkpoint for %s at block " INT64_FORMAT " of %s",
+       table_name, checkpoint->next_block, checkpoint->relation_name);
+  return checkpoint;
+}
+
+/**
+ * Durably writes checkpoint for table. The checkpoint is written to a
+ * temporary file first and renamed so that a crash never leaves a partially
+ * written checkpoint behind.
+ */
+void save_export_checkpoint(const char *table_name,
+                            const ExportCheckpoint *checkpoint) {
+  char path[PATH_MAX];
+  char temp_path[PATH_MAX];
+  populate_checkpoint_path_for_table(table_name, path);
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+  FILE *file = fopen(temp_path, "w");
+  if (file == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not create checkpoint file \"%s\": %m",
+                           temp_path)));
+  }
+  fprintf(file, "columns_hash %u\n", checkpoint->columns_hash);
+  if (checkpoint->fingerprint[0] != '\0') {
+    fprintf(file, "fingerprint %s\n", checkpoint->fingerprint);
+  }
+  fprintf(file, "relation %s\n", checkpoint->relation_name);
+  if (checkpoint->relation_fingerprint[0] != '\0') {
+    fprintf(file, "relation_fingerprint %s\n",
+            checkpoint->relation_fingerprint);
+  }
+  fprintf(file, "relfilenode %u\n", checkpoint->relfilenode);
+  fprintf(file, "boundary_block " INT64_FORMAT "\n",
+          checkpoint->boundary_block);
+  fprintf(file, "next_block " INT64_FORMAT "\n", checkpoint->next_block);
+  fprintf(file, "next_chunk %d\n", checkpoint->next_chunk);
+  if (checkpoint->index_name[0] != '\0') {
+    fprintf(file, "index %s\n", checkpoint->index_name);
+    fprintf(file, "next_key %s\n", checkpoint->next_key);
+    fprintf(file, "end_key %s\n", checkpoint->end_key);
+  }
+  if (checkpoint->has_fresh_watermark) {
+    fprintf(file, "fresh_watermark %s\n", checkpoint->fresh_watermark);
+  }
+  if (checkpoint->window_start[0] != '\0') {
+    fprintf(file, "window_start %s\n", checkpoint->window_start);
+  }
+  for (int i = 0; i < checkpoint->num_completed_units; i += 1) {
+    fprintf(file, "completed %s %s\n", checkpoint->completed_fingerprints[i],
+            checkpoint->completed_units[i]);
+  }
+  if (fclose(file) != 0) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not write checkpoint file \"%s\": %m",
+                           temp_path)));
+  }
+  // Flushes the checkpoint and its directory entry to disk.
+  durable_rename(temp_path, path, ERROR);
+}
+
+/**
+ * Returns true if the partition was completely exported before the
+ * checkpoint was written. Populates fingerprint the partition was exported
+ * at in out.
+ */
+bool export_checkpoint_find_completed(const ExportCheckpoint *checkpoint,
+                                      const char *unit_name, char *out) {
+  for (int i = 0; i < checkpoint->num_completed_units; i += 1) {
+    if (strcmp(checkpoint->completed_units[i], unit_name) == 0) {
+      strcpy(out, checkpoint->completed_fingerprints[i]);
+      return true;
+    }
+  }
+  return false;
+}
+
+void export_checkpoint_add_completed(ExportCheckpoint *checkpoint,
+                                     const char *unit_name,
+                                     const char *fingerprint) {
+  if (checkpoint->num_completed_units >= MAX_CHECKPOINT_UNITS) {
+    // Partition will be re-exported if the export is resumed.
+    return;
+  }
+  int unit = checkpoint->num_completed_units;
+  strlcpy(checkpoint->completed_units[unit], unit_name, NAMEDATALEN);
+  strlcpy(checkpoint->completed_fingerprints[unit], fingerprint, NAMEDATALEN);
+  checkpoint->num_completed_units += 1;
+}
+
+/**
+ * Deletes checkpoint of table after the export has completed.
+ */
+void remove_export_checkpoint(const char *table_name) {
+  char path[PATH_MAX];
+  populate_checkpoint_path_for_table(table_name, path);
+  if (unlink(path) == -1 && errno != ENOENT) {
+    elog(LOG, "Failed to delete checkpoint file %s", path);
+  }
+}
+
+#endif
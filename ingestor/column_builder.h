@@ -0,0 +1,865 @@
+#ifndef _COLUMN_BUILDER_H
+#define _COLUMN_BUILDER_H
+
+#include <string.h>
+
+/* Header for arrow parquet */
+#include <arrow-glib/arrow-glib.h>
+
+#include "postgres.h"
+
+#include "catalog/pg_type_d.h"
+#include "column_types.h"
+#include "common/hashfn.h"
+#include "datatype/timestamp.h"
+#include "fmgr.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/jsonb.h"
+#include "utils/lsyscache.h"
+#include "utils/numeric.h"
+#include "utils/timestamp.h"
+#include "utils/uuid.h"
+
+// Columns are dictionary encoded until they have more distinct values than
+// STRING_DICTIONARY_MIN_VALUES and more than one distinct value for every
+// STRING_DICTIONARY_MAX_RATIO rows.
+#define STRING_DICTIONARY_MIN_VALUES 1024
+#define STRING_DICTIONARY_MAX_RATIO 2
+#define STRING_DICTIONARY_INITIAL_SLOTS 1024
+#define DICTIONARY_EMPTY_SLOT -1
+
+/**
+ * Builds an Arrow string column by appending varlena payloads directly into
+ * Arrow offset and data buffers.
+ *
+ * Columns meant to be dictionary encoded are encoded when they are
+ * finished, storing each distinct value once along with an index per row.
+ * Columns with too many distinct values stay plain string arrays. Encoding
+ * calls no backend functions so it runs in column tasks.
+ *
+ * Buffers are allocated using glib and handed over to Arrow when the
+ * column is finished.
+ */
+typedef struct _StringColumnBuilder {
+  int64 length;
+  int64 n_nulls;
+  // Validity bitmap with one bit per row, set if the row isn't null.
+  GByteArray *null_bitmap;
+  // Plain string array buffers.
+  GByteArray *offsets;
+  GByteArray *data;
+  bool use_dictionary;
+  // Dictionary encoding buffers, only used while the column is finished.
+  int32 num_of_dictionary_values;
+  GByteArray *indices;
+  GByteArray *dictionary_offsets;
+  GByteArray *dictionary_data;
+  GByteArray *dictionary_hashes;
+  // Open addressing hash table of indices into the dictionary.
+  int32 *slots;
+  int32 num_of_slots;
+} StringColumnBuilder;
+
+static void append_validity(GByteArray *null_bitmap, int64 row, bool is_valid) {
+  if (row % 8 == 0) {
+    guint8 empty = 0;
+    g_byte_array_append(null_bitmap, &empty, 1);
+  }
+  if (is_valid) {
+    null_bitmap->data[row / 8] |= (guint8)(1 << (row % 8));
+  }
+}
+
+static GArrowBuffer *byte_array_to_buffer(GByteArray *array) {
+  GBytes *bytes = g_byte_array_free_to_bytes(array);
+  GArrowBuffer *buffer = garrow_buffer_new_bytes(bytes);
+  g_bytes_unref(bytes);
+  return buffer;
+}
+
+/**
+ * Returns the validity bitmap of the column as an Arrow buffer or NULL if
+ * the column has no nulls. The bitmap is owned by Arrow afterwards.
+ */
+static GArrowBuffer *finish_null_bitmap(GByteArray *null_bitmap,
+                                        int64 n_nulls) {
+  if (n_nulls == 0) {
+    g_byte_array_unref(null_bitmap);
+    return NULL;
+  }
+  return byte_array_to_buffer(null_bitmap);
+}
+
+void string_column_builder_init(StringColumnBuilder *builder,
+                                bool use_dictionary) {
+  int32 zero_offset = 0;
+  memset(builder, 0, sizeof(StringColumnBuilder));
+  builder->null_bitmap = g_byte_array_new();
+  builder->offsets = g_byte_array_new();
+  g_byte_array_append(builder->offsets, (guint8 *)&zero_offset,
+                      sizeof(int32));
+  builder->data = g_byte_array_new();
+  builder->use_dictionary = use_dictionary;
+}
+
+static const char *dictionary_value(const StringColumnBuilder *builder,
+                                    int32 index, int32 *length) {
+  const int32 *offsets = (const int32 *)builder->dictionary_offsets->data;
+  *length = offsets[index + 1] - offsets[index];
+  return (const char *)builder->dictionary_data->data + offsets[index];
+}
+
+static void dictionary_insert_slot(StringColumnBuilder *builder, uint32 hash,
+                                   int32 index) {
+  uint32 mask = builder->num_of_slots - 1;
+  uint32 slot = hash & mask;
+  while (builder->slots[slot] != DICTIONARY_EMPTY_SLOT) {
+    slot = (slot + 1) & mask;
+  }
+  builder->slots[slot] = index;
+}
+
+/**
+ * Doubles the number of hash table slots once the table is half full.
+ */
+static void dictionary_grow_slots(StringColumnBuilder *builder) {
+  const uint32 *hashes = (const uint32 *)builder->dictionary_hashes->data;
+  g_free(builder->slots);
+  builder->num_of_slots *= 2;
+  builder->slots = g_new(int32, builder->num_of_slots);
+  for (int i = 0; i < builder->num_of_slots; i += 1) {
+    builder->slots[i] = DICTIONARY_EMPTY_SLOT;
+  }
+  for (int32 i = 0; i < builder->num_of_dictionary_values; i += 1) {
+    dictionary_insert_slot(builder, hashes[i], i);
+  }
+}
+
+/**
+ * Returns index of value in the dictionary, adding it if not present.
+ */
+static int32 dictionary_get_or_add(StringColumnBuilder *builder,
+                                   const char *value, int32 length) {
+  uint32 hash = hash_bytes((const unsigned char *)value, length);
+  const uint32 *hashes = (const uint32 *)builder->dictionary_hashes->data;
+  uint32 mask = builder->num_of_slots - 1;
+  uint32 slot = hash & mask;
+  while (builder->slots[slot] != DICTIONARY_EMPTY_SLOT) {
+    int32 index = builder->slots[slot];
+    int32 existing_length;
+    const char *existing = dictionary_value(builder, index, &existing_length);
+    if (hashes[index] == hash && existing_length == length &&
+        memcmp(existing, value, length) == 0) {
+      return index;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  int32 index = builder->num_of_dictionary_values;
+  g_byte_array_append(builder->dictionary_data, (const guint8 *)value, length);
+  int32 end_offset = builder->dictionary_data->len;
+  g_byte_array_append(builder->dictionary_offsets, (guint8 *)&end_offset,
+                      sizeof(int32));
+  g_byte_array_append(builder->dictionary_hashes, (guint8 *)&hash,
+                      sizeof(uint32));
+  builder->slots[slot] = index;
+  builder->num_of_dictionary_values += 1;
+  if (builder->num_of_dictionary_values * 2 > builder->num_of_slots) {
+    dictionary_grow_slots(builder);
+  }
+  return index;
+}
+
+static void free_dictionary(StringColumnBuilder *builder) {
+  g_byte_array_unref(builder->indices);
+  g_byte_array_unref(builder->dictionary_offsets);
+  g_byte_array_unref(builder->dictionary_data);
+  g_byte_array_unref(builder->dictionary_hashes);
+  g_free(builder->slots);
+}
+
+/**
+ * Builds the dictionary of the appended rows. Returns false, freeing the
+ * dictionary, once the column has more distinct values than
+ * STRING_DICTIONARY_MIN_VALUES and more than one distinct value for every
+ * STRING_DICTIONARY_MAX_RATIO rows.
+ */
+static bool build_dictionary(StringColumnBuilder *builder) {
+  int32 zero_offset = 0;
+  builder->indices = g_byte_array_sized_new(builder->length * sizeof(int32));
+  builder->dictionary_offsets = g_byte_array_new();
+  g_byte_array_append(builder->dictionary_offsets, (guint8 *)&zero_offset,
+                      sizeof(int32));
+  builder->dictionary_data = g_byte_array_new();
+  builder->dictionary_hashes = g_byte_array_new();
+  builder->num_of_dictionary_values = 0;
+  builder->num_of_slots = STRING_DICTIONARY_INITIAL_SLOTS;
+  builder->slots = g_new(int32, builder->num_of_slots);
+  for (int i = 0; i < builder->num_of_slots; i += 1) {
+    builder->slots[i] = DICTIONARY_EMPTY_SLOT;
+  }
+
+  const int32 *offsets = (const int32 *)builder->offsets->data;
+  for (int64 row = 0; row < builder->length; row += 1) {
+    bool is_valid = builder->null_bitmap->data[row / 8] & (1 << (row % 8));
+    int32 index = 0;
+    if (is_valid) {
+      index = dictionary_get_or_add(
+          builder, (const char *)builder->data->data + offsets[row],
+          offsets[row + 1] - offsets[row]);
+    }
+    g_byte_array_append(builder->indices, (guint8 *)&index, sizeof(int32));
+    if (builder->num_of_dictionary_values > STRING_DICTIONARY_MIN_VALUES &&
+        builder->num_of_dictionary_values * STRING_DICTIONARY_MAX_RATIO >
+            row + 1) {
+      free_dictionary(builder);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void append_plain_value(StringColumnBuilder *builder, const char *value,
+                               int32 length) {
+  g_byte_array_append(builder->data, (const guint8 *)value, length);
+  int32 end_offset = builder->data->len;
+  g_byte_array_append(builder->offsets, (guint8 *)&end_offset, sizeof(int32));
+}
+
+/**
+ * Appends length bytes of payload to the column as a string, or a null.
+ */
+static void string_column_builder_append_payload(StringColumnBuilder *builder,
+                                                 const char *payload,
+                                                 int32 length, bool isnull) {
+  if (isnull) {
+    builder->n_nulls += 1;
+  }
+  append_validity(builder->null_bitmap, builder->length, !isnull);
+  append_plain_value(builder, payload, length);
+  builder->length += 1;
+}
+
+/**
+ * Appends text datum to the column. The varlena payload is copied straight
+ * into the Arrow buffers, only values stored out of line or compressed are
+ * detoasted first.
+ */
+void string_column_builder_append(StringColumnBuilder *builder, Datum value,
+                                  bool isnull) {
+  if (isnull) {
+    string_column_builder_append_payload(builder, "", 0, /*isnull=*/true);
+    return;
+  }
+  struct varlena *original = (struct varlena *)DatumGetPointer(value);
+  struct varlena *detoasted = pg_detoast_datum_packed(original);
+  string_column_builder_append_payload(builder, VARDATA_ANY(detoasted),
+                                       VARSIZE_ANY_EXHDR(detoasted),
+                                       /*isnull=*/false);
+  if (detoasted != original) {
+    pfree(detoasted);
+  }
+}
+
+/**
+ * Appends jsonb datum to the column as its json text, so that json and
+ * jsonb columns are both exported as strings.
+ */
+static void string_column_builder_append_jsonb(StringColumnBuilder *builder,
+                                               Datum value, bool isnull) {
+  if (isnull) {
+    string_column_builder_append_payload(builder, "", 0, /*isnull=*/true);
+    return;
+  }
+  Jsonb *jsonb = DatumGetJsonbP(value);
+  char *json = JsonbToCString(NULL, &jsonb->root, VARSIZE(jsonb));
+  string_column_builder_append_payload(builder, json, strlen(json),
+                                       /*isnull=*/false);
+  pfree(json);
+  if ((Pointer)jsonb != DatumGetPointer(value)) {
+    pfree(jsonb);
+  }
+}
+
+/**
+ * Returns Arrow array with the values appended to the builder. Returns a
+ * dictionary array if the column is dictionary encoded.
+ * Buffers of the builder are owned by the returned array afterwards.
+ */
+GArrowArray *string_column_builder_finish(StringColumnBuilder *builder,
+                                          GError **error) {
+  bool is_dictionary = builder->use_dictionary && build_dictionary(builder);
+  GArrowBuffer *null_bitmap =
+      finish_null_bitmap(builder->null_bitmap, builder->n_nulls);
+  builder->null_bitmap = NULL;
+
+  if (!is_dictionary) {
+    GArrowBuffer *offsets = byte_array_to_buffer(builder->offsets);
+    GArrowBuffer *data = byte_array_to_buffer(builder->data);
+    GArrowStringArray *string_array = garrow_string_array_new(
+        builder->length, offsets, data, null_bitmap, builder->n_nulls);
+    g_object_unref(offsets);
+    g_object_unref(data);
+    if (null_bitmap != NULL) {
+      g_object_unref(null_bitmap);
+    }
+    return GARROW_ARRAY(string_array);
+  }
+  g_byte_array_unref(builder->offsets);
+  g_byte_array_unref(builder->data);
+
+  GArrowBuffer *indices_buffer = byte_array_to_buffer(builder->indices);
+  GArrowInt32Array *indices = garrow_int32_array_new(
+      builder->length, indices_buffer, null_bitmap, builder->n_nulls);
+  GArrowBuffer *dictionary_offsets =
+      byte_array_to_buffer(builder->dictionary_offsets);
+  GArrowBuffer *dictionary_data =
+      byte_array_to_buffer(builder->dictionary_data);
+  GArrowStringArray *dictionary =
+      garrow_string_array_new(builder->num_of_dictionary_values,
+                              dictionary_offsets, dictionary_data, NULL, 0);
+
+  GArrowDataType *index_type = GARROW_DATA_TYPE(garrow_int32_data_type_new());
+  GArrowDataType *value_type = GARROW_DATA_TYPE(garrow_string_data_type_new());
+  GArrowDictionaryDataType *dictionary_type =
+      garrow_dictionary_data_type_new(index_type, value_type, FALSE);
+  GArrowDictionaryArray *dictionary_array = garrow_dictionary_array_new(
+      GARROW_DATA_TYPE(dictionary_type), GARROW_ARRAY(indices),
+      GARROW_ARRAY(dictionary), error);
+
+  g_byte_array_unref(builder->dictionary_hashes);
+  g_free(builder->slots);
+  g_object_unref(dictionary_type);
+  g_object_unref(value_type);
+  g_object_unref(index_type);
+  g_object_unref(dictionary);
+  g_object_unref(dictionary_data);
+  g_object_unref(dictionary_offsets);
+  g_object_unref(indices);
+  g_object_unref(indices_buffer);
+  if (null_bitmap != NULL) {
+    g_object_unref(null_bitmap);
+  }
+  return GARROW_ARRAY(dictionary_array);
+}
+
+/**
+ * Builds an Arrow column of any supported kind by appending Datums of the
+ * exported Postgres type. Fixed width values are written into the Arrow
+ * value buffer and variable width values into offset and data buffers, see
+ * column_kind_for_type for the mapping of types.
+ *
+ * Fixed width values passed by value are buffered as Datums and decimals
+ * as the payloads of their numerics, both are converted when the column is
+ * finished. column_builder_finish calls no backend functions so columns of
+ * a chunk can be finished in column tasks.
+ */
+typedef struct _ColumnBuilder {
+  ColumnKind kind;
+  Oid type_oid;
+  int32 typmod;
+  int64 length;
+  int64 n_nulls;
+  GByteArray *null_bitmap;
+  // Values of fixed width columns or offsets of variable width columns.
+  GByteArray *values;
+  // Payloads of variable width columns.
+  GByteArray *data;
+  // Datums and null flags of fixed width values yet to be converted, NULL
+  // if values are converted as they are appended.
+  GByteArray *datums;
+  GByteArray *datum_nulls;
+  // Payloads of numerics of decimal columns and their end offsets, null
+  // values have empty payloads.
+  GByteArray *numerics;
+  GByteArray *numeric_offsets;
+  // Arrow type of columns whose type depends on the Postgres type.
+  GArrowDataType *data_type;
+  // Builds text columns, which may be dictionary encoded.
+  StringColumnBuilder strings;
+  // Builds elements of list columns.
+  struct _ColumnBuilder *element_builder;
+  int16 element_length;
+  bool element_by_value;
+  char element_align;
+} ColumnBuilder;
+
+/*
+ * Returns true for kinds of columns whose values are converted without
+ * calling Postgres functions.
+ */
+static bool is_fixed_width_kind(ColumnKind kind) {
+  return kind == COLUMN_INT64 || kind == COLUMN_DOUBLE ||
+         kind == COLUMN_BOOLEAN || kind == COLUMN_TIMESTAMP ||
+         kind == COLUMN_DATE32;
+}
+
+void column_builder_init(ColumnBuilder *builder, Oid type_oid, int32 typmod,
+                         bool use_dictionary) {
+  memset(builder, 0, sizeof(ColumnBuilder));
+  builder->kind = column_kind_for_type(type_oid);
+  builder->type_oid = type_oid;
+  builder->typmod = typmod;
+  switch (builder->kind) {
+  case COLUMN_STRING:
+    string_column_builder_init(&builder->strings, use_dictionary);
+    return;
+  case COLUMN_BINARY:
+  case COLUMN_LIST: {
+    int32 zero_offset = 0;
+    builder->values = g_byte_array_new();
+    g_byte_array_append(builder->values, (guint8 *)&zero_offset,
+                        sizeof(int32));
+    break;
+  }
+  default:
+    builder->values = g_byte_array_new();
+    break;
+  }
+  builder->null_bitmap = g_byte_array_new();
+  if (builder->kind == COLUMN_TIMESTAMP ||
+      builder->kind == COLUMN_DECIMAL128 || builder->kind == COLUMN_LIST) {
+    builder->data_type = arrow_data_type_for_column(type_oid, typmod);
+  }
+  if (is_fixed_width_kind(builder->kind) && get_typbyval(type_oid)) {
+    builder->datums = g_byte_array_new();
+    builder->datum_nulls = g_byte_array_new();
+  }
+  if (builder->kind == COLUMN_DECIMAL128) {
+    builder->numerics = g_byte_array_new();
+    builder->numeric_offsets = g_byte_array_new();
+    builder->datum_nulls = g_byte_array_new();
+  }
+  if (builder->kind == COLUMN_BINARY) {
+    builder->data = g_byte_array_new();
+  } else if (builder->kind == COLUMN_LIST) {
+    Oid element_type = get_element_type(type_oid);
+    get_typlenbyvalalign(element_type, &builder->element_length,
+                         &builder->element_by_value, &builder->element_align);
+    builder->element_builder = g_new(ColumnBuilder, 1);
+    // Arrow list elements share the list's value type so elements are never
+    // dictionary encoded.
+    column_builder_init(builder->element_builder, element_type, -1,
+                        /*use_dictionary=*/false);
+    // List offsets are taken from the length of the element builder, so
+    // elements are converted as they are appended.
+    ColumnBuilder *element_builder = builder->element_builder;
+    if (element_builder->datums != NULL) {
+      g_byte_array_unref(element_builder->datums);
+      g_byte_array_unref(element_builder->datum_nulls);
+      element_builder->datums = NULL;
+      element_builder->datum_nulls = NULL;
+    }
+  }
+}
+
+static void append_value(ColumnBuilder *builder, const void *value,
+                         size_t size) {
+  g_byte_array_append(builder->values, (const guint8 *)value, size);
+}
+
+/**
+ * Converts the length bytes of the payload of a numeric value to its
+ * unscaled 128 bit integer representation at scale, reading its digits
+ * directly. Decimals past the scale are truncated.
+ * Returns false for NaN and infinities which have no decimal representation.
+ */
+static bool numeric_to_int128(const char *payload, int64 length, int32 scale,
+                              int128 *out) {
+  uint16 header;
+  memcpy(&header, payload, sizeof(uint16));
+  uint16 format = header & NUMERIC_FORMAT_MASK;
+  if (format == NUMERIC_FORMAT_SPECIAL) {
+    return false;
+  }
+  bool is_negative;
+  int weight;
+  const char *digits;
+  if (format == NUMERIC_FORMAT_SHORT) {
+    is_negative = (header & NUMERIC_SHORT_NEGATIVE) != 0;
+    weight = header & NUMERIC_SHORT_WEIGHT_MASK;
+    if ((header & NUMERIC_SHORT_WEIGHT_NEGATIVE) != 0) {
+      weight |= ~NUMERIC_SHORT_WEIGHT_MASK;
+    }
+    digits = payload + sizeof(uint16);
+  } else {
+    int16 long_weight;
+    memcpy(&long_weight, payload + sizeof(uint16), sizeof(int16));
+    is_negative = format == NUMERIC_FORMAT_NEGATIVE;
+    weight = long_weight;
+    digits = payload + 2 * sizeof(uint16);
+  }
+  int num_of_digits = (payload + length - digits) / sizeof(int16);
+  int128 unscaled = 0;
+  // Power of ten of the units of the last digit read at the scale.
+  int exponent = 0;
+  for (int i = 0; i < num_of_digits; i += 1) {
+    int16 digit;
+    memcpy(&digit, digits + i * sizeof(int16), sizeof(int16));
+    exponent = NUMERIC_DIGIT_DECIMALS * (weight - i) + scale;
+    if (exponent >= 0) {
+      unscaled = unscaled * NUMERIC_DIGIT_BASE + digit;
+      continue;
+    }
+    // Only the leading decimals of the digit are within the scale.
+    for (int j = exponent; j < 0; j += 1) {
+      digit /= 10;
+    }
+    for (int j = 0; j < NUMERIC_DIGIT_DECIMALS + exponent; j += 1) {
+      unscaled *= 10;
+    }
+    unscaled += digit;
+    exponent = 0;
+    break;
+  }
+  for (; exponent > 0; exponent -= 1) {
+    unscaled *= 10;
+  }
+  *out = is_negative ? -unscaled : unscaled;
+  return true;
+}
+
+static void append_variable_width(ColumnBuilder *builder, const char *payload,
+                                  int64 length) {
+  g_byte_array_append(builder->data, (const guint8 *)payload, length);
+  int32 end_offset = builder->data->len;
+  append_value(builder, &end_offset, sizeof(int32));
+}
+
+void column_builder_append(ColumnBuilder *builder, Datum value, bool isnull);
+
+/**
+ * Appends elements of array to the element builder, multi-dimensional
+ * arrays are flattened.
+ */
+static void append_list_elements(ColumnBuilder *builder, Datum value) {
+  ArrayType *array = DatumGetArrayTypeP(value);
+  Datum *elements;
+  bool *nulls;
+  int num_of_elements;
+  deconstruct_array(array, ARR_ELEMTYPE(array), builder->element_length,
+                    builder->element_by_value, builder->element_align,
+                    &elements, &nulls, &num_of_elements);
+  for (int i = 0; i < num_of_elements; i += 1) {
+    column_builder_append(builder->element_builder, elements[i], nulls[i]);
+  }
+  int32 end_offset = builder->element_builder->length;
+  append_value(builder, &end_offset, sizeof(int32));
+  pfree(elements);
+  pfree(nulls);
+  if ((Pointer)array != DatumGetPointer(value)) {
+    pfree(array);
+  }
+}
+
+/*
+ * Appends a value of a fixed width column. Infinite timestamps and dates
+ * have no Arrow equivalent and are exported as nulls.
+ */
+static void append_fixed_width_value(ColumnBuilder *builder, Datum value,
+                                     bool isnull) {
+  if (!isnull && builder->kind == COLUMN_TIMESTAMP) {
+    isnull = TIMESTAMP_NOT_FINITE(DatumGetTimestamp(value));
+  } else if (!isnull && builder->kind == COLUMN_DATE32) {
+    isnull = DATE_NOT_FINITE(DatumGetDateADT(value));
+  }
+  append_validity(builder->null_bitmap, builder->length, !isnull);
+  builder->length += 1;
+  if (isnull) {
+    builder->n_nulls += 1;
+  }
+
+  switch (builder->kind) {
+  case COLUMN_INT64: {
+    int64 int_value = 0;
+    if (!isnull) {
+      if (builder->type_oid == INT2OID) {
+        int_value = DatumGetInt16(value);
+      } else if (builder->type_oid == INT4OID) {
+        int_value = DatumGetInt32(value);
+      } else {
+        int_value = DatumGetInt64(value);
+      }
+    }
+    append_value(builder, &int_value, sizeof(int64));
+    break;
+  }
+  case COLUMN_DOUBLE: {
+    double double_value = 0.0;
+    if (!isnull) {
+      double_value = builder->type_oid == FLOAT4OID ? DatumGetFloat4(value)
+                                                    : DatumGetFloat8(value);
+    }
+    append_value(builder, &double_value, sizeof(double));
+    break;
+  }
+  case COLUMN_BOOLEAN:
+    // Boolean values are bit packed like the validity bitmap.
+    append_validity(builder->values, builder->length - 1,
+                    !isnull && DatumGetBool(value));
+    break;
+  case COLUMN_TIMESTAMP: {
+    int64 timestamp_value = 0;
+    if (!isnull) {
+      timestamp_value = DatumGetTimestamp(value) + UNIX_EPOCH_OFFSET_USECS;
+    }
+    append_value(builder, &timestamp_value, sizeof(int64));
+    break;
+  }
+  case COLUMN_DATE32: {
+    int32 date_value = 0;
+    if (!isnull) {
+      date_value = DatumGetDateADT(value) + UNIX_EPOCH_OFFSET_DAYS;
+    }
+    append_value(builder, &date_value, sizeof(int32));
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+/*
+ * Converts the buffered Datums of a fixed width column into Arrow values.
+ */
+static void convert_buffered_datums(ColumnBuilder *builder) {
+  const Datum *datums = (const Datum *)builder->datums->data;
+  const bool *nulls = (const bool *)builder->datum_nulls->data;
+  int64 num_of_datums = builder->datum_nulls->len;
+  for (int64 i = 0; i < num_of_datums; i += 1) {
+    append_fixed_width_value(builder, datums[i], nulls[i]);
+  }
+  g_byte_array_unref(builder->datums);
+  g_byte_array_unref(builder->datum_nulls);
+  builder->datums = NULL;
+  builder->datum_nulls = NULL;
+}
+
+/*
+ * Converts the buffered numerics of a decimal column into Arrow values. NaN
+ * and infinite decimals have no Arrow equivalent and are exported as nulls.
+ */
+static void convert_buffered_numerics(ColumnBuilder *builder) {
+  int32 precision;
+  int32 scale;
+  decimal_precision_and_scale(builder->typmod, &precision, &scale);
+  const int32 *offsets = (const int32 *)builder->numeric_offsets->data;
+  const bool *nulls = (const bool *)builder->datum_nulls->data;
+  int64 num_of_values = builder->datum_nulls->len;
+  for (int64 i = 0; i < num_of_values; i += 1) {
+    int32 start = i > 0 ? offsets[i - 1] : 0;
+    int128 decimal = 0;
+    bool isnull =
+        nulls[i] ||
+        !numeric_to_int128((const char *)builder->numerics->data + start,
+                           offsets[i] - start, scale, &decimal);
+    append_validity(builder->null_bitmap, builder->length, !isnull);
+    builder->length += 1;
+    if (isnull) {
+      builder->n_nulls += 1;
+    }
+    // Arrow decimals are little endian 128 bit integers.
+    append_value(builder, &decimal, sizeof(int128));
+  }
+  g_byte_array_unref(builder->numerics);
+  g_byte_array_unref(builder->numeric_offsets);
+  g_byte_array_unref(builder->datum_nulls);
+  builder->numerics = NULL;
+  builder->numeric_offsets = NULL;
+  builder->datum_nulls = NULL;
+}
+
+/*
+ * Buffers the payload of a numeric of a decimal column, detoasting it if
+ * needed.
+ */
+static void append_numeric(ColumnBuilder *builder, Datum value, bool isnull) {
+  if (!isnull) {
+    struct varlena *original = (struct varlena *)DatumGetPointer(value);
+    struct varlena *detoasted = pg_detoast_datum_packed(original);
+    g_byte_array_append(builder->numerics,
+                        (const guint8 *)VARDATA_ANY(detoasted),
+                        VARSIZE_ANY_EXHDR(detoasted));
+    if (detoasted != original) {
+      pfree(detoasted);
+    }
+  }
+  int32 end_offset = builder->numerics->len;
+  g_byte_array_append(builder->numeric_offsets, (guint8 *)&end_offset,
+                      sizeof(int32));
+  g_byte_array_append(builder->datum_nulls, (guint8 *)&isnull, sizeof(bool));
+}
+
+/**
+ * Appends a value of the column's type to the column.
+ */
+void column_builder_append(ColumnBuilder *builder, Datum value, bool isnull) {
+  if (builder->kind == COLUMN_STRING && builder->type_oid == JSONBOID) {
+    string_column_builder_append_jsonb(&builder->strings, value, isnull);
+    builder->length += 1;
+    return;
+  }
+  if (builder->kind == COLUMN_STRING) {
+    string_column_builder_append(&builder->strings, value, isnull);
+    builder->length += 1;
+    return;
+  }
+  if (builder->datums != NULL) {
+    g_byte_array_append(builder->datums, (guint8 *)&value, sizeof(Datum));
+    g_byte_array_append(builder->datum_nulls, (guint8 *)&isnull,
+                        sizeof(bool));
+    return;
+  }
+  if (is_fixed_width_kind(builder->kind)) {
+    append_fixed_width_value(builder, value, isnull);
+    return;
+  }
+  if (builder->kind == COLUMN_DECIMAL128) {
+    append_numeric(builder, value, isnull);
+    return;
+  }
+  append_validity(builder->null_bitmap, builder->length, !isnull);
+  builder->length += 1;
+  if (isnull) {
+    builder->n_nulls += 1;
+  }
+
+  switch (builder->kind) {
+  case COLUMN_UUID: {
+    static const guint8 empty_uuid[UUID_BYTE_WIDTH] = {0};
+    append_value(builder,
+                 isnull ? empty_uuid : DatumGetUUIDP(value)->data,
+                 UUID_BYTE_WIDTH);
+    break;
+  }
+  case COLUMN_BINARY: {
+    if (isnull) {
+      append_variable_width(builder, "", 0);
+      break;
+    }
+    struct varlena *original = (struct varlena *)DatumGetPointer(value);
+    struct varlena *detoasted = pg_detoast_datum_packed(original);
+    append_variable_width(builder, VARDATA_ANY(detoasted),
+                          VARSIZE_ANY_EXHDR(detoasted));
+    if (detoasted != original) {
+      pfree(detoasted);
+    }
+    break;
+  }
+  case COLUMN_LIST: {
+    if (isnull) {
+      int32 end_offset = builder->element_builder->length;
+      append_value(builder, &end_offset, sizeof(int32));
+      break;
+    }
+    append_list_elements(builder, value);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+/**
+ * Returns Arrow array with the values appended to the builder.
+ * Buffers of the builder are owned by the returned array afterwards.
+ */
+GArrowArray *column_builder_finish(ColumnBuilder *builder, GError **error) {
+  if (builder->kind == COLUMN_STRING) {
+    return string_column_builder_finish(&builder->strings, error);
+  }
+  if (builder->datums != NULL) {
+    convert_buffered_datums(builder);
+  }
+  if (builder->numerics != NULL) {
+    convert_buffered_numerics(builder);
+  }
+  GArrowBuffer *null_bitmap =
+      finish_null_bitmap(builder->null_bitmap, builder->n_nulls);
+  GArrowBuffer *values = byte_array_to_buffer(builder->values);
+  GArrowBuffer *data = NULL;
+  if (builder->data != NULL) {
+    data = byte_array_to_buffer(builder->data);
+  }
+  int64 length = builder->length;
+  int64 n_nulls = builder->n_nulls;
+  GArrowArray *array = NULL;
+
+  switch (builder->kind) {
+  case COLUMN_INT64:
+    array = GARROW_ARRAY(
+        garrow_int64_array_new(length, values, null_bitmap, n_nulls));
+    break;
+  case COLUMN_DOUBLE:
+    array = GARROW_ARRAY(
+        garrow_double_array_new(length, values, null_bitmap, n_nulls));
+    break;
+  case COLUMN_BOOLEAN:
+    array = GARROW_ARRAY(
+        garrow_boolean_array_new(length, values, null_bitmap, n_nulls));
+    break;
+  case COLUMN_TIMESTAMP:
+    array = GARROW_ARRAY(garrow_timestamp_array_new(
+        GARROW_TIMESTAMP_DATA_TYPE(builder->data_type), length, values,
+        null_bitmap, n_nulls));
+    break;
+  case COLUMN_DATE32:
+    array = GARROW_ARRAY(
+        garrow_date32_array_new(length, values, null_bitmap, n_nulls));
+    break;
+  case COLUMN_DECIMAL128: {
+    // Decimals are built as 16 byte wide binary values and viewed as
+    // decimals which shares the buffers without copying them.
+    GArrowFixedSizeBinaryDataType *binary_type =
+        garrow_fixed_size_binary_data_type_new(sizeof(int128));
+    GArrowFixedSizeBinaryArray *binary_array =
+        garrow_fixed_size_binary_array_new(binary_type, length, values,
+                                           null_bitmap, n_nulls);
+    array = garrow_array_view(GARROW_ARRAY(binary_array), builder->data_type,
+                              error);
+    g_object_unref(binary_array);
+    g_object_unref(binary_type);
+    break;
+  }
+  case COLUMN_UUID: {
+    GArrowFixedSizeBinaryDataType *uuid_type =
+        garrow_fixed_size_binary_data_type_new(UUID_BYTE_WIDTH);
+    array = GARROW_ARRAY(garrow_fixed_size_binary_array_new(
+        uuid_type, length, values, null_bitmap, n_nulls));
+    g_object_unref(uuid_type);
+    break;
+  }
+  case COLUMN_BINARY:
+    array = GARROW_ARRAY(
+        garrow_binary_array_new(length, values, data, null_bitmap, n_nulls));
+    break;
+  case COLUMN_LIST: {
+    GArrowArray *elements =
+        column_builder_finish(builder->element_builder, error);
+    array = GARROW_ARRAY(garrow_list_array_new(builder->data_type, length,
+                                               values, elements, null_bitmap,
+                                               n_nulls));
+    g_object_unref(elements);
+    g_free(builder->element_builder);
+    break;
+  }
+  default:
+    break;
+  }
+
+  g_object_unref(values);
+  if (data != NULL) {
+    g_object_unref(data);
+  }
+  if (null_bitmap != NULL) {
+    g_object_unref(null_bitmap);
+  }
+  if (builder->data_type != NULL) {
+    g_object_unref(builder->data_type);
+  }
+  return array;
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include <limits.h>
+
+#include "postgres.h"
+
+#include "column_cache.h"
+#include "miscadmin.h"
+#include "slot_cache.h"
+#include "storage/ipc.h"
+#include "utils/guc.h"
+
+#define COLUMN_CACHE_NAME "pg_analytica column cache"
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static SlotCache *column_cache = NULL;
+static bool enable_column_cache = true;
+// Sizes are in kB.
+static int column_cache_size = 0;
+static int column_cache_entry_size = 1024;
+
+static int num_column_cache_slots(void) {
+  return column_cache_size / column_cache_entry_size;
+}
+
+static void column_cache_shmem_request(void) {
+  if (prev_shmem_request_hook != NULL) {
+    prev_shmem_request_hook();
+  }
+  RequestAddinShmemSpace(slot_cache_shmem_size(
+      num_column_cache_slots(), (Size)column_cache_entry_size * 1024));
+  slot_cache_request_lock(COLUMN_CACHE_NAME);
+}
+
+static void column_cache_shmem_startup(void) {
+  if (prev_shmem_startup_hook != NULL) {
+    prev_shmem_startup_hook();
+  }
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  column_cache =
+      slot_cache_init(COLUMN_CACHE_NAME, num_column_cache_slots(),
+                      (Size)column_cache_entry_size * 1024);
+  LWLockRelease(AddinShmemInitLock);
+}
+
+void column_cache_init(void) {
+  DefineCustomBoolVariable(
+      "pg_analytica.enable_column_cache",
+      "Share decoded columns of exported files between backends.", NULL,
+      &enable_column_cache, true, PGC_USERSET, 0, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.column_cache_size",
+      "Shared memory used to cache decoded columns of exported files.", NULL,
+      &column_cache_size, 0, 0, INT_MAX / 1024, PGC_POSTMASTER,
+      GUC_UNIT_KB, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.column_cache_entry_size",
+      "Largest decoded column stored in the column cache.", NULL,
+      &column_cache_entry_size, 1024, 1, INT_MAX / 1024, PGC_POSTMASTER,
+      GUC_UNIT_KB, NULL, NULL, NULL);
+
+  if (!process_shared_preload_libraries_in_progress ||
+      num_column_cache_slots() == 0) {
+    return;
+  }
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = column_cache_shmem_request;
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = column_cache_shmem_startup;
+}
+
+bool column_cache_enabled(void) {
+  return column_cache != NULL && enable_column_cache;
+}
+
+/*
+ * Serializes column as a single column record batch in the Arrow IPC stream
+ * format. Returns NULL on failure.
+ */
+static GArrowBuffer *serialize_column(GArrowArray *column) {
+  GError *error = NULL;
+  GArrowDataType *data_type = garrow_array_get_value_data_type(column);
+  GArrowField *field = garrow_field_new("column", data_type);
+  GList *fields = g_list_append(NULL, field);
+  GArrowSchema *schema = garrow_schema_new(fields);
+  GList *columns = g_list_append(NULL, column);
+  GArrowRecordBatch *batch = garrow_record_batch_new(
+      schema, garrow_array_get_length(column), columns, &error);
+  GArrowResizableBuffer *buffer = NULL;
+  if (batch != NULL) {
+    buffer = garrow_resizable_buffer_new(0, &error);
+  }
+  if (buffer != NULL) {
+    GArrowBufferOutputStream *output = garrow_buffer_output_stream_new(buffer);
+    GArrowRecordBatchStreamWriter *writer =
+        garrow_record_batch_stream_writer_new(GARROW_OUTPUT_STREAM(output),
+                                              schema, &error);
+    if (writer == NULL ||
+        !garrow_record_batch_writer_write_record_batch(
+            GARROW_RECORD_BATCH_WRITER(writer), batch, &error) ||
+        !garrow_record_batch_writer_close(GARROW_RECORD_BATCH_WRITER(writer),
+                                          &error)) {
+      g_object_unref(buffer);
+      buffer = NULL;
+    }
+    if (writer != NULL) {
+      g_object_unref(writer);
+    }
+    g_object_unref(output);
+  }
+  if (error != NULL) {
+    elog(LOG, "Failed to serialize column for column cache: %s",
+         error->message);
+    g_error_free(error);
+  }
+  if (batch != NULL) {
+    g_object_unref(batch);
+  }
+  g_list_free(columns);
+  g_list_free(fields);
+  g_object_unref(schema);
+  g_object_unref(field);
+  g_object_unref(data_type);
+  return buffer != NULL ? GARROW_BUFFER(buffer) : NULL;
+}
+
+GArrowArray *column_cache_lookup(const char *key, char **data) {
+  Size data_length;
+  if (!column_cache_enabled() ||
+      !slot_cache_lookup(column_cache, key, strlen(key), data, &data_length)) {
+    return NULL;
+  }
+  GError *error = NULL;
+  GArrowArray *column = NULL;
+  // The column references data directly.
+  GBytes *bytes = g_bytes_new_static(*data, data_length);
+  GArrowBuffer *buffer = garrow_buffer_new_bytes(bytes);
+  GArrowBufferInputStream *input = garrow_buffer_input_stream_new(buffer);
+  GArrowRecordBatchStreamReader *reader =
+      garrow_record_batch_stream_reader_new(GARROW_INPUT_STREAM(input),
+                                            &error);
+  if (reader != NULL) {
+    GArrowRecordBatch *batch = garrow_record_batch_reader_read_next(
+        GARROW_RECORD_BATCH_READER(reader), &error);
+    if (batch != NULL) {
+      column = garrow_record_batch_get_column_data(batch, 0);
+      g_object_unref(batch);
+    }
+    g_object_unref(reader);
+  }
+  if (error != NULL) {
+    elog(LOG, "Failed to read column %s from column cache: %s", key,
+         error->message);
+    g_error_free(error);
+  }
+  g_object_unref(input);
+  g_object_unref(buffer);
+  g_bytes_unref(bytes);
+  if (column == NULL) {
+    pfree(*data);
+    *data = NULL;
+  }
+  return column;
+}
+
+void column_cache_store(const char *key, GArrowArray *column) {
+  if (!column_cache_enabled()) {
+    return;
+  }
+  GArrowBuffer *buffer = serialize_column(column);
+  if (buffer == NULL) {
+    return;
+  }
+  GBytes *bytes = garrow_buffer_get_data(buffer);
+  gsize length;
+  const char *data = g_bytes_get_data(bytes, &length);
+  if (!slot_cache_store(column_cache, key, strlen(key), data, length)) {
+    elog(DEBUG1, "Column %s is too large for the column cache", key);
+  }
+  g_bytes_unref(bytes);
+  g_object_unref(buffer);
+}
+
+void column_cache_remove_table(const char *table_name) {
+  if (column_cache == NULL) {
+    return;
+  }
+  char prefix[NAMEDATALEN + 12];
+  snprintf(prefix, sizeof(prefix), "%u/%s/", MyDatabaseId, table_name);
+  slot_cache_remove_prefix(column_cache, prefix, strlen(prefix));
+}
@@ -0,0 +1,35 @@
+#ifndef _COLUMN_CACHE_H
+#define _COLUMN_CACHE_H
+
+/* Header for arrow parquet */
+#include <arrow-glib/arrow-glib.h>
+
+#include "postgres.h"
+
+/**
+ * Caches decoded columns of exported files in shared memory so that
+ * backends scanning the same files share decoding work. Columns are keyed
+ * by table, file, record batch, column name and export generation of the
+ * table. Requires the library to be in shared_preload_libraries.
+ */
+extern void column_cache_init(void);
+
+extern bool column_cache_enabled(void);
+
+/**
+ * Returns cached column for key or NULL. The returned array references
+ * memory populated in data which must be freed after the array.
+ */
+extern GArrowArray *column_cache_lookup(const char *key, char **data);
+
+/**
+ * Caches column for key, columns larger than a cache entry aren't cached.
+ */
+extern void column_cache_store(const char *key, GArrowArray *column);
+
+/**
+ * Removes cached columns of files of table.
+ */
+extern void column_cache_remove_table(const char *table_name);
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef _COLUMN_ENCODING_H
+#define _COLUMN_ENCODING_H
+
+#include <string.h>
+
+#include <arrow-glib/arrow-glib.h>
+#include <parquet-glib/parquet-glib.h>
+
+#include "postgres.h"
+
+#include "column_threads.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/builtins.h"
+#include "utils/palloc.h"
+
+// A recorded encoding is kept until another candidate encodes the sampled
+// rows in less than ENCODING_DRIFT_RATIO of its size.
+#define ENCODING_DRIFT_RATIO 0.9
+#define NUM_OF_ENCODING_COMPRESSIONS 3
+
+static const GArrowCompressionType encoding_compressions[] = {
+    GARROW_COMPRESSION_TYPE_UNCOMPRESSED, GARROW_COMPRESSION_TYPE_SNAPPY,
+    GARROW_COMPRESSION_TYPE_ZSTD};
+static const char *encoding_compression_names[] = {"uncompressed", "snappy",
+                                                   "zstd"};
+
+/**
+ * Encoding of a column in parquet files, picked by writing the rows of the
+ * first row group of an export with every candidate encoding and keeping
+ * the smallest. Parquet writer properties exposed by parquet-glib select
+ * dictionary encoding and the compression codec per column, the value
+ * encodings within pages follow from the column type.
+ */
+typedef struct _ColumnEncoding {
+  char column_name[NAMEDATALEN];
+  bool use_dictionary;
+  // Index in encoding_compressions.
+  int compression;
+  // Bytes the sampled rows take with the chosen and the default encoding.
+  int64 encoded_bytes;
+  int64 default_bytes;
+  // Set when the encoding was recorded by an earlier export.
+  bool is_recorded;
+} ColumnEncoding;
+
+typedef struct _ColumnEncodings {
+  int num_of_columns;
+  ColumnEncoding *columns;
+  // Set once the first row group of the export was sampled.
+  bool is_sampled;
+} ColumnEncodings;
+
+/**
+ * Initializes default encodings of the exported columns and replaces them
+ * with those recorded for table by earlier exports.
+ * Expects SPI connection to be established.
+ */
+void column_encodings_init(ColumnEncodings *encodings, const char *table_name,
+                           char **column_names, int num_of_columns) {
+  encodings->num_of_columns = num_of_columns;
+  encodings->columns = palloc0(num_of_columns * sizeof(ColumnEncoding));
+  encodings->is_sampled = false;
+  for (int i = 0; i < num_of_columns; i += 1) {
+    strlcpy(encodings->columns[i].column_name, column_names[i], NAMEDATALEN);
+    encodings->columns[i].use_dictionary = true;
+  }
+
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT column_name, dictionary, compression FROM "
+                   "analytica_column_encodings WHERE table_name = %s;",
+                   quote_literal_cstr(table_name));
+  int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/0);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to read column encodings of %s",
+                           table_name)));
+  }
+  for (int i = 0; i < SPI_processed; i += 1) {
+    HeapTuple tuple = SPI_tuptable->vals[i];
+    TupleDesc tupdesc = SPI_tuptable->tupdesc;
+    char *column_name = SPI_getvalue(tuple, tupdesc, 1);
+    char *dictionary = SPI_getvalue(tuple, tupdesc, 2);
+    char *compression = SPI_getvalue(tuple, tupdesc, 3);
+    for (int j = 0; j < num_of_columns; j += 1) {
+      ColumnEncoding *column = &encodings->columns[j];
+      if (strcmp(column->column_name, column_name) != 0) {
+        continue;
+      }
+      column->use_dictionary = dictionary[0] == 't';
+      for (int k = 0; k < NUM_OF_ENCODING_COMPRESSIONS; k += 1) {
+        if (strcmp(encoding_compression_names[k], compression) == 0) {
+          column->compression = k;
+        }
+      }
+      column->is_recorded = true;
+    }
+  }
+  pfree(buf.data);
+}
+
+/*
+ * Returns bytes column of table takes in a parquet file written with the
+ * given encoding, or -1 if it couldn't be written.
+ * Runs in column tasks.
+ */
+static int64 measure_encoded_column(GArrowTable *table, int column_num,
+                                    bool use_dictionary, int compression,
+                                    GError **error_out) {
+  GError *error = NULL;
+  GArrowSchema *schema = garrow_table_get_schema(table);
+  GArrowField *field = garrow_schema_get_field(schema, column_num);
+  GList *fields = g_list_append(NULL, field);
+  GArrowSchema *column_schema = garrow_schema_new(fields);
+  GArrowChunkedArray *column_data =
+      garrow_table_get_column_data(table, column_num);
+  GArrowTable *column_table = garrow_table_new_chunked_arrays(
+      column_schema, &column_data, 1, &error);
+
+  const gchar *path = garrow_field_get_name(field);
+  GParquetWriterProperties *properties = gparquet_writer_properties_new();
+  if (!use_dictionary) {
+    gparquet_writer_properties_disable_dictionary(properties, path);
+  }
+  gparquet_writer_properties_set_compression(
+      properties, encoding_compressions[compression], path);
+  GArrowResizableBuffer *buffer = garrow_resizable_buffer_new(0, &error);
+  GArrowBufferOutputStream *output = garrow_buffer_output_stream_new(buffer);
+  GParquetArrowFileWriter *writer = NULL;
+  int64 size = -1;
+  if (column_table != NULL) {
+    writer = gparquet_arrow_file_writer_new_arrow(
+        column_schema, GARROW_OUTPUT_STREAM(output), properties, &error);
+  }
+  if (writer != NULL &&
+      gparquet_arrow_file_writer_write_table(writer, column_table,
+                                             garrow_table_get_n_rows(table),
+                                             &error) &&
+      gparquet_arrow_file_writer_close(writer, &error)) {
+    size = garrow_buffer_get_size(GARROW_BUFFER(buffer));
+  }
+  if (error != NULL) {
+    g_propagate_error(error_out, error);
+  }
+
+  if (writer != NULL) {
+    g_object_unref(writer);
+  }
+  g_object_unref(output);
+  g_object_unref(buffer);
+  g_object_unref(properties);
+  if (column_table != NULL) {
+    g_object_unref(column_table);
+  }
+  g_object_unref(column_data);
+  g_object_unref(column_schema);
+  g_list_free(fields);
+  g_object_unref(field);
+  g_object_unref(schema);
+  return size;
+}
+
+/* Sizes of a sampled column with every candidate encoding. */
+typedef struct _MeasureColumnTask {
+  GArrowTable *table;
+  int column_num;
+  // Indexed by dictionary use and compression, -1 if the column couldn't
+  // be written with the encoding.
+  int64 encoded_bytes[2][NUM_OF_ENCODING_COMPRESSIONS];
+  // First error encoding the column.
+  GError *error;
+} MeasureColumnTask;
+
+static void measure_column(void *task) {
+  MeasureColumnTask *column = (MeasureColumnTask *)task;
+  for (int dictionary = 0; dictionary < 2; dictionary += 1) {
+    for (int k = 0; k < NUM_OF_ENCODING_COMPRESSIONS; k += 1) {
+      GError *error = NULL;
+      column->encoded_bytes[dictionary][k] = measure_encoded_column(
+          column->table, column->column_num, dictionary == 1, k, &error);
+      if (error != NULL && column->error == NULL) {
+        column->error = error;
+      } else if (error != NULL) {
+        g_error_free(error);
+      }
+    }
+  }
+}
+
+/**
+ * Picks the encoding of every column by writing the rows of table, the
+ * first row group of the export, with each candidate encoding. Columns are
+ * measured in parallel by column tasks. Recorded encodings are replaced
+ * only when the data drifted enough for another encoding to be clearly
+ * smaller.
+ */
+void select_column_encodings(ColumnEncodings *encodings, GArrowTable *table) {
+  encodings->is_sampled = true;
+  MeasureColumnTask *tasks =
+      palloc0(encodings->num_of_columns * sizeof(MeasureColumnTask));
+  for (int i = 0; i < encodings->num_of_columns; i += 1) {
+    tasks[i].table = table;
+    tasks[i].column_num = i;
+  }
+  run_column_tasks(measure_column, tasks, sizeof(MeasureColumnTask),
+                   encodings->num_of_columns);
+  for (int i = 0; i < encodings->num_of_columns; i += 1) {
+    ColumnEncoding *column = &encodings->columns[i];
+    const MeasureColumnTask *task = &tasks[i];
+    if (task->error != NULL) {
+      elog(LOG, "Failed to encode column %s: %s", column->column_name,
+           task->error->message);
+      g_error_free(task->error);
+    }
+    int64 default_bytes = task->encoded_bytes[1][0];
+    int64 current_bytes =
+        task->encoded_bytes[column->use_dictionary][column->compression];
+    if (default_bytes < 0 || current_bytes < 0) {
+      continue;
+    }
+    bool best_dictionary = column->use_dictionary;
+    int best_compression = column->compression;
+    int64 best_bytes = current_bytes;
+    for (int dictionary = 0; dictionary < 2; dictionary += 1) {
+      for (int k = 0; k < NUM_OF_ENCODING_COMPRESSIONS; k += 1) {
+        int64 bytes = task->encoded_bytes[dictionary][k];
+        if (bytes >= 0 && bytes < best_bytes) {
+          best_dictionary = dictionary == 1;
+          best_compression = k;
+          best_bytes = bytes;
+        }
+      }
+    }
+    if (!column->is_recorded ||
+        best_bytes < current_bytes * ENCODING_DRIFT_RATIO) {
+      column->use_dictionary = best_dictionary;
+      column->compression = best_compression;
+      column->encoded_bytes = best_bytes;
+    } else {
+      column->encoded_bytes = current_bytes;
+    }
+    column->default_bytes = default_bytes;
+    elog(LOG,
+         "Encoding column %s %s dictionary with %s compression, " INT64_FORMAT
+         " bytes sampled instead of " INT64_FORMAT,
+         column->column_name, column->use_dictionary ? "with" : "without",
+         encoding_compression_names[column->compression],
+         column->encoded_bytes, default_bytes);
+  }
+  pfree(tasks);
+}
+
+/**
+ * Sets encodings of the columns in the properties of a parquet writer.
+ */
+void apply_column_encodings(const ColumnEncodings *encodings,
+                            GParquetWriterProperties *properties) {
+  for (int i = 0; i < encodings->num_of_columns; i += 1) {
+    const ColumnEncoding *column = &encodings->columns[i];
+    if (!column->use_dictionary) {
+      gparquet_writer_properties_disable_dictionary(properties,
+                                                    column->column_name);
+    }
+    gparquet_writer_properties_set_compression(
+        properties, encoding_compressions[column->compression],
+        column->column_name);
+  }
+}
+
+/**
+ * Records encodings picked for the measured columns of table along with the
+ * bytes they saved on the sampled rows. Records of columns that failed to
+ * be measured are kept, those of columns no longer exported are removed.
+ * Expects SPI connection to be established.
+ */
+void save_column_encodings(const ColumnEncodings *encodings,
+                           const char *table_name) {
+  if (!encodings->is_sampled) {
+    return;
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "DELETE FROM analytica_column_encodings WHERE "
+                   "table_name = %s",
+                   quote_literal_cstr(table_name));
+  for (int i = 0; i < encodings->num_of_columns; i += 1) {
+    appendStringInfo(&buf, "%s%s", i == 0 ? " AND column_name NOT IN (" : ", ",
+                     quote_literal_cstr(encodings->columns[i].column_name));
+  }
+  appendStringInfoString(&buf, encodings->num_of_columns > 0 ? ");" : ";");
+  for (int i = 0; i < encodings->num_of_columns; i += 1) {
+    const ColumnEncoding *column = &encodings->columns[i];
+    if (column->default_bytes == 0) {
+      // Sampling the column failed.
+      continue;
+    }
+    appendStringInfo(
+        &buf,
+        "INSERT INTO analytica_column_encodings (table_name, column_name, "
+        "dictionary, compression, sampled_bytes, sampled_default_bytes, "
+        "sampled_at) VALUES (%s, %s, %s, '%s', " INT64_FORMAT ", "
+        INT64_FORMAT ", "
+        "CURRENT_TIMESTAMP) ON CONFLICT (table_name, column_name) DO UPDATE "
+        "SET dictionary = EXCLUDED.dictionary, "
+        "compression = EXCLUDED.compression, "
+        "sampled_bytes = EXCLUDED.sampled_bytes, "
+        "sampled_default_bytes = EXCLUDED.sampled_default_bytes, "
+        "sampled_at = EXCLUDED.sampled_at;",
+        quote_literal_cstr(table_name),
+        quote_literal_cstr(column->column_name),
+        column->use_dictionary ? "true" : "false",
+        encoding_compression_names[column->compression],
+        column->encoded_bytes, column->default_bytes);
+  }
+  int status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
+  if (status < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to record column encodings of %s",
+                           table_name)));
+  }
+  pfree(buf.data);
+}
+
+void free_column_encodings(ColumnEncodings *encodings) {
+  if (encodings->columns != NULL) {
+    pfree(encodings->columns);
+  }
+  encodings->columns = NULL;
+  encodings->num_of_columns = 0;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef _COLUMN_GROUPS_H
+#define _COLUMN_GROUPS_H
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "postgres.h"
+
+#include "constants.h"
+#include "export_entry.h"
+#include "file_utils.h"
+#include "storage/fd.h"
+#include "utils/palloc.h"
+
+#define COLUMN_GROUPS_FILE_NAME ".column_groups"
+#define COLUMN_GROUP_ROWS_FILE_NAME ".column_group_rows"
+#define MAX_COLUMN_GROUPS_LINE_CHARS 1024
+#define MAX_COLUMN_GROUPS 1024
+
+/**
+ * Manifest of a table exported in the column group layout. It records the
+ * columns whose files are in the data directory and the fingerprint of the
+ * table contents they were exported at. Columns added to the export are
+ * written for the block ranges of the existing files and line up with them
+ * by row position. The fingerprint only tells cheaply that rows changed,
+ * whether the rows of a block range are still those of its files is checked
+ * against the row versions recorded in COLUMN_GROUP_ROWS_FILE_NAME.
+ */
+typedef struct _ColumnGroupManifest {
+  char fingerprint[NAMEDATALEN];
+  int num_of_columns;
+  char columns[MAX_COLUMN_GROUPS][NAMEDATALEN];
+} ColumnGroupManifest;
+
+/* Block range of the files of a chunk. */
+typedef struct _ColumnGroupChunk {
+  int64 start_block;
+  int64 end_block;
+} ColumnGroupChunk;
+
+void populate_column_groups_path_for_table(const char *table, char *out) {
+  populate_data_path_for_table(table, out, /*relative=*/false);
+  strcat(out, "/" COLUMN_GROUPS_FILE_NAME);
+}
+
+/**
+ * Returns manifest of the column groups of table or NULL if the table
+ * hasn't been exported in the column group layout.
+ * Caller should free the returned pointer.
+ */
+ColumnGroupManifest *load_column_group_manifest(const char *table_name) {
+  char path[PATH_MAX];
+  populate_column_groups_path_for_table(table_name, path);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+  ColumnGroupManifest *manifest = palloc0(sizeof(ColumnGroupManifest));
+  char line[MAX_COLUMN_GROUPS_LINE_CHARS];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    char *value = strchr(line, ' ');
+    if (value == NULL) {
+      continue;
+    }
+    *value = '\0';
+    value += 1;
+    if (strcmp(line, "fingerprint") == 0) {
+      strlcpy(manifest->fingerprint, value, NAMEDATALEN);
+    } else if (strcmp(line, "column") == 0 &&
+               manifest->num_of_columns < MAX_COLUMN_GROUPS) {
+      strlcpy(manifest->columns[manifest->num_of_columns], value,
+              NAMEDATALEN);
+      manifest->num_of_columns += 1;
+    }
+  }
+  fclose(file);
+  return manifest;
+}
+
+/**
+ * Durably writes manifest of the exported columns of table.
+ */
+void save_column_group_manifest(const char *table_name,
+                                const char *fingerprint,
+                                const ExportEntry *entry) {
+  char path[PATH_MAX];
+  char temp_path[PATH_MAX];
+  populate_column_groups_path_for_table(table_name, path);
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+  FILE *file = fopen(temp_path, "w");
+  if (file == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not create column groups file \"%s\": %m",
+                           temp_path)));
+  }
+  fprintf(file, "fingerprint %s\n", fingerprint);
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    fprintf(file, "column %s\n", entry->columns_to_export[i]);
+  }
+  if (fclose(file) != 0) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not write column groups file \"%s\": %m",
+                           temp_path)));
+  }
+  durable_rename(temp_path, path, ERROR);
+}
+
+bool column_group_manifest_has_column(const ColumnGroupManifest *manifest,
+                                      const char *column_name) {
+  for (int i = 0; i < manifest->num_of_columns; i += 1) {
+    if (strcmp(manifest->columns[i], column_name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Records row_versions, the row versions found in blocks
+ * [start_block, end_block) when the files of the chunk were written, next
+ * to the files in the temp directory of table. The record is moved to the
+ * data directory along with the files.
+ */
+void append_column_group_rows(const char *table_name, int64 start_block,
+                              int64 end_block, const char *row_versions) {
+  char path[PATH_MAX];
+  populate_temp_path_for_table(table_name, path, /*relative=*/false);
+  strcat(path, "/" COLUMN_GROUP_ROWS_FILE_NAME);
+  FILE *file = fopen(path, "a");
+  if (file == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not open column group rows file \"%s\": %m",
+                           path)));
+  }
+  fprintf(file, INT64_FORMAT "-" INT64_FORMAT " %s\n", start_block, end_block,
+          row_versions);
+  if (fclose(file) != 0) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not write column group rows file \"%s\": %m",
+                           path)));
+  }
+}
+
+/**
+ * Populates in out the row versions recorded for the files of blocks
+ * [start_block, end_block) in the data directory of table. Returns false if
+ * none were recorded, which is the case for chunks written before an export
+ * was resumed or while the rows changed.
+ * Assumes out has MAX_COLUMN_GROUPS_LINE_CHARS space available.
+ */
+bool find_column_group_rows(const char *table_name, int64 start_block,
+                            int64 end_block, char *out) {
+  char path[PATH_MAX];
+  populate_data_path_for_table(table_name, path, /*relative=*/false);
+  strcat(path, "/" COLUMN_GROUP_ROWS_FILE_NAME);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  bool found = false;
+  char line[MAX_COLUMN_GROUPS_LINE_CHARS];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    int64 start;
+    int64 end;
+    int offset;
+    if (sscanf(line, INT64_FORMAT "-" INT64_FORMAT " %n", &start, &end,
+               &offset) != 2 ||
+        start != start_block || end != end_block) {
+      continue;
+    }
+    // Chunks written again after a resumed export are recorded again.
+    strlcpy(out, line + offset, MAX_COLUMN_GROUPS_LINE_CHARS);
+    found = true;
+  }
+  fclose(file);
+  return found;
+}
+
+/*
+ * Populates prefix of the files of a column in out.
+ * Assumes out has NAMEDATALEN + 1 space available.
+ */
+void populate_column_group_prefix(const char *column_name, char *out) {
+  snprintf(out, NAMEDATALEN + 1, "%s%c", column_name, COLUMN_GROUP_SEPARATOR);
+}
+
+/**
+ * Returns block ranges of the chunks with files in the data directory of
+ * table, found from the names of the files of its first exported column.
+ * Caller should free the returned pointer.
+ */
+ColumnGroupChunk *get_column_group_chunks(const char *table_name,
+                                          const ColumnGroupManifest *manifest,
+                                          int *num_of_chunks) {
+  char data_path[PATH_MAX];
+  char prefix[NAMEDATALEN + 1];
+  populate_data_path_for_table(table_name, data_path, /*relative=*/false);
+  populate_column_group_prefix(manifest->columns[0], prefix);
+  int max_chunks = 64;
+  ColumnGroupChunk *chunks = palloc(max_chunks * sizeof(ColumnGroupChunk));
+  *num_of_chunks = 0;
+  DIR *dir = opendir(data_path);
+  if (dir == NULL) {
+    return chunks;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (manifest->num_of_columns == 0 ||
+        !file_has_prefix(entry->d_name, prefix)) {
+      continue;
+    }
+    ColumnGroupChunk chunk;
+    if (sscanf(entry->d_name + strlen(prefix), INT64_FORMAT "-" INT64_FORMAT,
+               &chunk.start_block, &chunk.end_block) != 2) {
+      continue;
+    }
+    if (*num_of_chunks == max_chunks) {
+      max_chunks *= 2;
+      chunks = repalloc(chunks, max_chunks * sizeof(ColumnGroupChunk));
+    }
+    chunks[*num_of_chunks] = chunk;
+    *num_of_chunks += 1;
+  }
+  closedir(dir);
+  return chunks;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include <pthread.h>
+#include <signal.h>
+
+#include <glib.h>
+
+#include "postgres.h"
+
+#include "column_threads.h"
+#include "utils/guc.h"
+
+// Column tasks run on the calling thread when at most one thread is
+// allowed.
+static int max_column_threads = 4;
+
+static GThreadPool *column_thread_pool = NULL;
+
+/* Column tasks of a single run_column_tasks call. */
+typedef struct _ColumnTaskBatch {
+  ColumnTaskFunction function;
+  GMutex mutex;
+  GCond finished;
+  int num_of_pending;
+} ColumnTaskBatch;
+
+typedef struct _ColumnTask {
+  ColumnTaskBatch *batch;
+  void *task;
+} ColumnTask;
+
+void column_threads_init(void) {
+  DefineCustomIntVariable(
+      "pg_analytica.max_column_threads",
+      "Threads converting and encoding the columns of a chunk in parallel.",
+      NULL, &max_column_threads, 4, 1, 64, PGC_SIGHUP, 0, NULL, NULL, NULL);
+}
+
+static void run_column_task(gpointer data, gpointer user_data) {
+  ColumnTask *column_task = (ColumnTask *)data;
+  ColumnTaskBatch *batch = column_task->batch;
+  batch->function(column_task->task);
+  g_mutex_lock(&batch->mutex);
+  batch->num_of_pending -= 1;
+  if (batch->num_of_pending == 0) {
+    g_cond_signal(&batch->finished);
+  }
+  g_mutex_unlock(&batch->mutex);
+}
+
+/*
+ * Creates the pool or resizes it to the configured number of threads, either
+ * may start threads. Returns false if the pool couldn't be created.
+ */
+static bool prepare_column_thread_pool(GError **error) {
+  if (column_thread_pool == NULL) {
+    column_thread_pool = g_thread_pool_new(run_column_task, NULL,
+                                           max_column_threads,
+                                           /*exclusive=*/FALSE, error);
+  } else if (g_thread_pool_get_max_threads(column_thread_pool) !=
+             max_column_threads) {
+    g_thread_pool_set_max_threads(column_thread_pool, max_column_threads,
+                                  error);
+  }
+  return column_thread_pool != NULL;
+}
+
+void run_column_tasks(ColumnTaskFunction function, void *tasks,
+                      Size task_size, int num_of_tasks) {
+  if (num_of_tasks <= 1 || max_column_threads <= 1) {
+    for (int i = 0; i < num_of_tasks; i += 1) {
+      function((char *)tasks + i * task_size);
+    }
+    return;
+  }
+  ColumnTaskBatch batch;
+  batch.function = function;
+  g_mutex_init(&batch.mutex);
+  g_cond_init(&batch.finished);
+  batch.num_of_pending = num_of_tasks;
+  ColumnTask *column_tasks = palloc(num_of_tasks * sizeof(ColumnTask));
+
+  // Threads are spawned while the pool is prepared and while tasks are
+  // pushed, and inherit the signal mask.
+  GError *error = NULL;
+  sigset_t blocked_signals;
+  sigset_t old_signals;
+  sigfillset(&blocked_signals);
+  pthread_sigmask(SIG_SETMASK, &blocked_signals, &old_signals);
+  bool has_pool = prepare_column_thread_pool(&error);
+  for (int i = 0; has_pool && i < num_of_tasks; i += 1) {
+    column_tasks[i].batch = &batch;
+    column_tasks[i].task = (char *)tasks + i * task_size;
+    g_thread_pool_push(column_thread_pool, &column_tasks[i], NULL);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+  if (error != NULL) {
+    elog(LOG, "Failed to prepare column threads: %s", error->message);
+    g_error_free(error);
+  }
+  if (!has_pool) {
+    for (int i = 0; i < num_of_tasks; i += 1) {
+      function((char *)tasks + i * task_size);
+    }
+    batch.num_of_pending = 0;
+  }
+
+  g_mutex_lock(&batch.mutex);
+  while (batch.num_of_pending > 0) {
+    g_cond_wait(&batch.finished, &batch.mutex);
+  }
+  g_mutex_unlock(&batch.mutex);
+  g_cond_clear(&batch.finished);
+  g_mutex_clear(&batch.mutex);
+  pfree(column_tasks);
+}
@@ -0,0 +1,29 @@
+#ifndef _COLUMN_THREADS_H
+#define _COLUMN_THREADS_H
+
+#include "postgres.h"
+
+/**
+ * Work on a single column of a chunk run by run_column_tasks.
+ * Column tasks run outside the backend's main thread so they may only call
+ * into glib, Arrow and pure functions like hash_bytes, never palloc, elog or
+ * any other Postgres function using backend state.
+ */
+typedef void (*ColumnTaskFunction)(void *task);
+
+/**
+ * Pool of threads shared by the column tasks of export workers, bounded by
+ * pg_analytica.max_column_threads. Threads are created with every signal
+ * blocked so that Postgres signal handlers only run on the main thread.
+ */
+extern void column_threads_init(void);
+
+/**
+ * Runs function on each of num_of_tasks tasks, the i-th task is at
+ * tasks + i * task_size, and returns once all of them finished. Tasks run
+ * on the calling thread when column threads are disabled.
+ */
+extern void run_column_tasks(ColumnTaskFunction function, void *tasks,
+                             Size task_size, int num_of_tasks);
+
+#endif
@@ -0,0 +1,209 @@
+#include "postgres.h"
+
+#include "catalog/pg_type_d.h"
+#include "column_types.h"
+#include "utils/elog.h"
+#include "utils/lsyscache.h"
+
+ColumnKind column_kind_for_type(Oid type_oid) {
+  switch (type_oid) {
+  case INT2OID:
+  case INT4OID:
+  case INT8OID:
+    return COLUMN_INT64;
+  case FLOAT4OID:
+  case FLOAT8OID:
+    return COLUMN_DOUBLE;
+  case BOOLOID:
+    return COLUMN_BOOLEAN;
+  case TIMESTAMPOID:
+  case TIMESTAMPTZOID:
+    return COLUMN_TIMESTAMP;
+  case DATEOID:
+    return COLUMN_DATE32;
+  case NUMERICOID:
+    return COLUMN_DECIMAL128;
+  case UUIDOID:
+    return COLUMN_UUID;
+  case TEXTOID:
+  case VARCHAROID:
+  case BPCHAROID:
+  case JSONOID:
+  case JSONBOID:
+    return COLUMN_STRING;
+  case BYTEAOID:
+    return COLUMN_BINARY;
+  default:
+    break;
+  }
+  Oid element_type = get_element_type(type_oid);
+  if (OidIsValid(element_type)) {
+    ColumnKind element_kind = column_kind_for_type(element_type);
+    // Nested lists and numeric elements, which have no typmod of their own,
+    // aren't supported.
+    if (element_kind != COLUMN_UNSUPPORTED && element_kind != COLUMN_LIST &&
+        element_kind != COLUMN_DECIMAL128) {
+      return COLUMN_LIST;
+    }
+  }
+  return COLUMN_UNSUPPORTED;
+}
+
+void decimal_precision_and_scale(int32 typmod, int32 *precision,
+                                 int32 *scale) {
+  // Numeric typmods store precision in the upper 16 bits and scale in the
+  // lower 11 bits, see make_numeric_typmod.
+  int32 value = typmod - VARHDRSZ;
+  *precision = (value >> 16) & 0xffff;
+  *scale = ((value & 0x7ff) ^ 1024) - 1024;
+}
+
+const char *unsupported_column_type_reason(Oid type_oid, int32 typmod) {
+  ColumnKind kind = column_kind_for_type(type_oid);
+  if (kind == COLUMN_UNSUPPORTED) {
+    return "type has no columnar mapping";
+  }
+  if (kind == COLUMN_DECIMAL128) {
+    if (typmod < (int32)VARHDRSZ) {
+      return "numeric columns need a declared precision and scale";
+    }
+    int32 precision;
+    int32 scale;
+    decimal_precision_and_scale(typmod, &precision, &scale);
+    if (precision > DECIMAL128_MAX_PRECISION) {
+      return "numeric precision is larger than 38";
+    }
+    if (scale < 0) {
+      return "numeric columns with negative scale are not supported";
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Returns Arrow data type for columns of a kind that doesn't need a typmod.
+ */
+static GArrowDataType *arrow_data_type_for_kind(ColumnKind kind) {
+  switch (kind) {
+  case COLUMN_INT64:
+    return GARROW_DATA_TYPE(garrow_int64_data_type_new());
+  case COLUMN_DOUBLE:
+    return GARROW_DATA_TYPE(garrow_double_data_type_new());
+  case COLUMN_BOOLEAN:
+    return GARROW_DATA_TYPE(garrow_boolean_data_type_new());
+  case COLUMN_TIMESTAMP: {
+    // Timestamps are stored with microsecond precision in UTC.
+    GTimeZone *time_zone = g_time_zone_new_utc();
+    GArrowDataType *timestamp_type = GARROW_DATA_TYPE(
+        garrow_timestamp_data_type_new(GARROW_TIME_UNIT_MICRO, time_zone));
+    g_time_zone_unref(time_zone);
+    return timestamp_type;
+  }
+  case COLUMN_DATE32:
+    return GARROW_DATA_TYPE(garrow_date32_data_type_new());
+  case COLUMN_UUID:
+    return GARROW_DATA_TYPE(
+        garrow_fixed_size_binary_data_type_new(UUID_BYTE_WIDTH));
+  case COLUMN_STRING:
+    return GARROW_DATA_TYPE(garrow_string_data_type_new());
+  case COLUMN_BINARY:
+    return GARROW_DATA_TYPE(garrow_binary_data_type_new());
+  default:
+    return NULL;
+  }
+}
+
+GArrowDataType *arrow_data_type_for_column(Oid type_oid, int32 typmod) {
+  if (unsupported_column_type_reason(type_oid, typmod) != NULL) {
+    return NULL;
+  }
+  ColumnKind kind = column_kind_for_type(type_oid);
+  switch (kind) {
+  case COLUMN_DECIMAL128: {
+    GError *error = NULL;
+    int32 precision;
+    int32 scale;
+    decimal_precision_and_scale(typmod, &precision, &scale);
+    GArrowDecimal128DataType *decimal_type =
+        garrow_decimal128_data_type_new(precision, scale, &error);
+    if (error != NULL) {
+      elog(LOG, "%s", error->message);
+      g_error_free(error);
+      return NULL;
+    }
+    return GARROW_DATA_TYPE(decimal_type);
+  }
+  case COLUMN_LIST: {
+    ColumnKind element_kind = column_kind_for_type(get_element_type(type_oid));
+    GArrowDataType *element_type = arrow_data_type_for_kind(element_kind);
+    GArrowField *element_field = garrow_field_new("item", element_type);
+    GArrowListDataType *list_type = garrow_list_data_type_new(element_field);
+    g_object_unref(element_field);
+    g_object_unref(element_type);
+    return GARROW_DATA_TYPE(list_type);
+  }
+  default:
+    return arrow_data_type_for_kind(kind);
+  }
+}
+
+Datum int128_to_numeric(int128 value, int32 scale) {
+  // Decimal128 values have at most 39 decimals, padded to whole digits.
+  int16 digits[(DECIMAL128_MAX_PRECISION + 2 * NUMERIC_DIGIT_DECIMALS) /
+               NUMERIC_DIGIT_DECIMALS];
+  int num_of_digits = 0;
+  // Digits are aligned on the decimal point, so the least significant digit
+  // is padded with the decimals below the scale.
+  int lowest_weight =
+      -((scale + NUMERIC_DIGIT_DECIMALS - 1) / NUMERIC_DIGIT_DECIMALS);
+  int multiplier = 1;
+  for (int i = scale; i < -lowest_weight * NUMERIC_DIGIT_DECIMALS; i += 1) {
+    multiplier *= 10;
+  }
+  uint128 magnitude = value < 0 ? -(uint128)value : (uint128)value;
+  int digit = 0;
+  while (magnitude > 0) {
+    digit += (int)(magnitude % 10) * multiplier;
+    magnitude /= 10;
+    multiplier *= 10;
+    if (multiplier == NUMERIC_DIGIT_BASE) {
+      digits[num_of_digits++] = digit;
+      digit = 0;
+      multiplier = 1;
+    }
+  }
+  if (digit != 0) {
+    digits[num_of_digits++] = digit;
+  }
+  int weight = lowest_weight + num_of_digits - 1;
+  // Trailing zero digits aren't stored.
+  int first = 0;
+  while (first < num_of_digits && digits[first] == 0) {
+    first += 1;
+  }
+  int num_of_stored = num_of_digits - first;
+  bool is_negative = value < 0;
+  if (num_of_stored == 0) {
+    weight = 0;
+    is_negative = false;
+  }
+  // Scales and weights of decimal128 values always fit the short format.
+  Assert(scale <= NUMERIC_SHORT_DSCALE_MAX);
+  Assert(weight >= -NUMERIC_SHORT_WEIGHT_MASK - 1 &&
+         weight <= NUMERIC_SHORT_WEIGHT_MASK);
+  uint16 header = NUMERIC_FORMAT_SHORT |
+                  (is_negative ? NUMERIC_SHORT_NEGATIVE : 0) |
+                  (scale << NUMERIC_SHORT_DSCALE_SHIFT) |
+                  (weight < 0 ? NUMERIC_SHORT_WEIGHT_NEGATIVE : 0) |
+                  (weight & NUMERIC_SHORT_WEIGHT_MASK);
+  size_t size = VARHDRSZ + sizeof(uint16) + num_of_stored * sizeof(int16);
+  struct varlena *result = palloc(size);
+  SET_VARSIZE(result, size);
+  char *payload = VARDATA(result);
+  memcpy(payload, &header, sizeof(uint16));
+  int16 *stored = (int16 *)(payload + sizeof(uint16));
+  for (int i = 0; i < num_of_stored; i += 1) {
+    stored[i] = digits[num_of_digits - 1 - i];
+  }
+  return PointerGetDatum(result);
+}
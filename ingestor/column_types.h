@@ -0,0 +1,78 @@
+#ifndef _COLUMN_TYPES_H
+#define _COLUMN_TYPES_H
+
+/* Header for arrow parquet */
+#include <arrow-glib/arrow-glib.h>
+
+#include "postgres.h"
+
+#include "datatype/timestamp.h"
+
+/* Kind of Arrow column that values of a Postgres type are exported to. */
+typedef enum ColumnKind {
+  COLUMN_UNSUPPORTED = 0,
+  COLUMN_INT64,
+  COLUMN_DOUBLE,
+  COLUMN_BOOLEAN,
+  COLUMN_TIMESTAMP,
+  COLUMN_DATE32,
+  COLUMN_DECIMAL128,
+  COLUMN_UUID,
+  COLUMN_STRING,
+  COLUMN_BINARY,
+  COLUMN_LIST
+} ColumnKind;
+
+// Largest precision that fits in an Arrow decimal128 column.
+#define DECIMAL128_MAX_PRECISION 38
+#define UUID_BYTE_WIDTH 16
+// Offsets between the Postgres epoch (2000-01-01) and the Unix epoch.
+#define UNIX_EPOCH_OFFSET_DAYS (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE)
+#define UNIX_EPOCH_OFFSET_USECS (UNIX_EPOCH_OFFSET_DAYS * USECS_PER_DAY)
+
+// Layout of the header of numeric values, see numeric.c. Digits are
+// base NUMERIC_DIGIT_BASE and follow the header.
+#define NUMERIC_FORMAT_MASK 0xC000
+#define NUMERIC_FORMAT_NEGATIVE 0x4000
+#define NUMERIC_FORMAT_SHORT 0x8000
+#define NUMERIC_FORMAT_SPECIAL 0xC000
+#define NUMERIC_SHORT_NEGATIVE 0x2000
+#define NUMERIC_SHORT_DSCALE_MAX 0x3F
+#define NUMERIC_SHORT_DSCALE_SHIFT 7
+#define NUMERIC_SHORT_WEIGHT_NEGATIVE 0x0040
+#define NUMERIC_SHORT_WEIGHT_MASK 0x003F
+#define NUMERIC_DIGIT_BASE 10000
+#define NUMERIC_DIGIT_DECIMALS 4
+
+/**
+ * Returns the kind of Arrow column values of type are exported to.
+ * Arrays are exported as lists if their element type is supported.
+ */
+extern ColumnKind column_kind_for_type(Oid type_oid);
+
+/**
+ * Returns NULL if columns of type can be exported or the reason the type
+ * isn't supported otherwise.
+ */
+extern const char *unsupported_column_type_reason(Oid type_oid, int32 typmod);
+
+/**
+ * Populates the precision and scale of a numeric column from its typmod.
+ */
+extern void decimal_precision_and_scale(int32 typmod, int32 *precision,
+                                        int32 *scale);
+
+/**
+ * Returns Arrow data type that columns of type are exported to or NULL if
+ * the type isn't supported.
+ * Caller is responsible for freeing the returned data type.
+ */
+extern GArrowDataType *arrow_data_type_for_column(Oid type_oid, int32 typmod);
+
+/**
+ * Returns numeric Datum of an unscaled decimal128 value at scale, building
+ * its digits directly.
+ */
+extern Datum int128_to_numeric(int128 value, int32 scale);
+
+#endif
@@ -1,6 +1,56 @@
 #ifndef _ANALYTICA_CONSTANTS_H
 #define _ANALYTICA_CONSTANTS_H
 
+#include <stdlib.h>
+#include <string.h>
+
 enum ExportStatus { PENDING = 0, ACTIVE = 1, INACTIVE = -1 };
 
-#endif
\ No newline at end of file
+/* Format of the columnar files a table is exported to. */
+enum OutputFormat {
+  OUTPUT_FORMAT_PARQUET = 0,
+  // Arrow IPC files, uncompressed or compressed with lz4.
+  OUTPUT_FORMAT_ARROW = 1,
+  OUTPUT_FORMAT_ARROW_LZ4 = 2
+};
+
+/* Layout of the columnar files of a table. */
+enum ExportLayout {
+  EXPORT_LAYOUT_ROWS = 0,
+  // Every column is written to its own files, named
+  // {column}@{first block}-{end block}.arrow, which are aligned by row
+  // position with the files of other columns for the same blocks.
+  EXPORT_LAYOUT_COLUMN_GROUPS = 1
+};
+
+#define COLUMN_GROUP_SEPARATOR '@'
+
+// Files of bucketed tables are named {chunk}#{bucket}.{extension}, rows of
+// a bucket have analytica_bucket(bucket column, number of buckets) equal to
+// the bucket.
+#define BUCKET_SEPARATOR '#'
+#define MAX_BUCKETS 256
+
+/*
+ * Returns bucket of the rows of file_name or -1 if its table isn't bucketed.
+ */
+static inline int get_file_bucket(const char *file_name) {
+  const char *separator = strrchr(file_name, BUCKET_SEPARATOR);
+  return separator == NULL ? -1 : atoi(separator + 1);
+}
+
+// Sample relations of tables read the data directory {table}.sample.
+#define SAMPLE_DATA_SUFFIX ".sample"
+// Column of sample relations holding the number of rows of the table each
+// sampled row stands for.
+#define SAMPLE_WEIGHT_COLUMN "sampling_weight"
+
+// Queries registered for export are read as a subquery with this alias.
+#define QUERY_SOURCE_ALIAS "analytica_source"
+
+#define PARQUET_FILE_EXTENSION ".parquet"
+#define ARROW_FILE_EXTENSION ".arrow"
+// Compressed Arrow files, still ending with ARROW_FILE_EXTENSION.
+#define COMPRESSED_ARROW_FILE_EXTENSION ".lz4.arrow"
+
+#endif
@@ -0,0 +1,217 @@
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "postgres.h"
+
+#include "catalog/pg_type_d.h"
+#include "distinct_sketch.h"
+#include "export_access.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
+
+#define DISTINCT_SKETCH_FILE_MAGIC 0x50414848
+#define DISTINCT_SKETCH_FILE_VERSION 1
+
+PG_FUNCTION_INFO_V1(analytica_approx_count_distinct);
+
+bool distinct_sketch_supports_type(Oid type_oid) {
+  TypeCacheEntry *type = lookup_type_cache(type_oid, TYPECACHE_HASH_PROC);
+  return OidIsValid(type->hash_proc);
+}
+
+void distinct_sketch_init(ColumnDistinctSketch *column,
+                          const char *column_name, Oid type_oid) {
+  TypeCacheEntry *type =
+      lookup_type_cache(type_oid, TYPECACHE_HASH_PROC_FINFO);
+  if (!OidIsValid(type->hash_proc)) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Distinct counts can't be sketched for column %s of "
+                    "type %s",
+                    column_name, format_type_be(type_oid))));
+  }
+  strlcpy(column->column_name, column_name, NAMEDATALEN);
+  // Type cache entries are never freed.
+  column->hash_proc = &type->hash_proc_finfo;
+  column->collation = get_typcollation(type_oid);
+  initHyperLogLog(&column->sketch, DISTINCT_SKETCH_REGISTER_BITS);
+}
+
+void distinct_sketch_free(ColumnDistinctSketch *column) {
+  if (column->sketch.hashesArr != NULL) {
+    freeHyperLogLog(&column->sketch);
+    column->sketch.hashesArr = NULL;
+  }
+}
+
+void distinct_sketch_add_datum(ColumnDistinctSketch *column, Datum value) {
+  uint32 hash = DatumGetUInt32(
+      FunctionCall1Coll(column->hash_proc, column->collation, value));
+  addHyperLogLog(&column->sketch, hash);
+}
+
+/*
+ * Sidecar files start with a header of magic, version, number of columns
+ * and register bits. Each column is stored as its name followed by its
+ * registers.
+ */
+void write_distinct_sketch_file(const char *path,
+                                const ColumnDistinctSketch *columns,
+                                int num_of_columns) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not create distinct sketch file \"%s\": %m",
+                           path)));
+  }
+  uint32 header[4] = {DISTINCT_SKETCH_FILE_MAGIC, DISTINCT_SKETCH_FILE_VERSION,
+                      (uint32)num_of_columns, DISTINCT_SKETCH_REGISTER_BITS};
+  fwrite(header, sizeof(uint32), 4, file);
+  for (int i = 0; i < num_of_columns; i += 1) {
+    fwrite(columns[i].column_name, 1, NAMEDATALEN, file);
+    fwrite(columns[i].sketch.hashesArr, 1, columns[i].sketch.nRegisters, file);
+  }
+  if (ferror(file) || fclose(file) != 0) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not write distinct sketch file \"%s\": %m",
+                           path)));
+  }
+  fsync_fname(path, /*isdir=*/false);
+}
+
+/*
+ * Merges the sketch of column stored in the sidecar file at path into
+ * merged. Returns false if the file doesn't exist or has no sketch for
+ * column.
+ */
+static bool merge_distinct_sketch_file(const char *path,
+                                       const char *column_name,
+                                       hyperLogLogState *merged) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  bool found = false;
+  uint32 header[4];
+  if (fread(header, sizeof(uint32), 4, file) != 4 ||
+      header[0] != DISTINCT_SKETCH_FILE_MAGIC ||
+      header[1] != DISTINCT_SKETCH_FILE_VERSION ||
+      header[3] != merged->registerWidth) {
+    elog(LOG, "Ignoring invalid distinct sketch file %s", path);
+    fclose(file);
+    return false;
+  }
+  uint8 *registers = palloc(merged->nRegisters);
+  for (uint32 i = 0; i < header[2]; i += 1) {
+    char name[NAMEDATALEN];
+    if (fread(name, 1, NAMEDATALEN, file) != NAMEDATALEN) {
+      break;
+    }
+    name[NAMEDATALEN - 1] = '\0';
+    if (strcmp(name, column_name) != 0) {
+      if (fseek(file, merged->nRegisters, SEEK_CUR) != 0) {
+        break;
+      }
+      continue;
+    }
+    found = fread(registers, 1, merged->nRegisters, file) ==
+            merged->nRegisters;
+    for (Size j = 0; found && j < merged->nRegisters; j += 1) {
+      merged->hashesArr[j] = Max(merged->hashesArr[j], registers[j]);
+    }
+    break;
+  }
+  pfree(registers);
+  fclose(file);
+  return found;
+}
+
+static bool is_distinct_sketch_file(const char *file_name) {
+  size_t suffix_length = strlen(DISTINCT_SKETCH_FILE_SUFFIX);
+  size_t name_length = strlen(file_name);
+  return name_length > suffix_length &&
+         strcmp(file_name + name_length - suffix_length,
+                DISTINCT_SKETCH_FILE_SUFFIX) == 0;
+}
+
+/*
+ * Returns true if file_name belongs to one of the partitions, files of
+ * partitions are prefixed with the partition oid and a dot. Every file is
+ * included when no partitions are given.
+ */
+static bool file_in_partitions(const char *file_name, const Oid *partitions,
+                               int num_of_partitions) {
+  if (num_of_partitions == 0) {
+    return true;
+  }
+  for (int i = 0; i < num_of_partitions; i += 1) {
+    char prefix[NAMEDATALEN];
+    snprintf(prefix, sizeof(prefix), "%u.", partitions[i]);
+    if (strncmp(file_name, prefix, strlen(prefix)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Estimates the number of distinct values of a column of an exported table
+ * by merging the sketches stored with its columnar files, optionally only
+ * those of the given partitions. Returns NULL if no file has a sketch of
+ * the column. Merging is idempotent, so files replaced while they are read
+ * at most slightly raise the estimate. Requires SELECT on the relation of
+ * the table.
+ */
+Datum analytica_approx_count_distinct(PG_FUNCTION_ARGS) {
+  char *table_name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  char *column_name = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  check_export_access(table_name);
+  Datum *partition_names;
+  int num_of_partitions;
+  deconstruct_array(PG_GETARG_ARRAYTYPE_P(2), TEXTOID, -1, false,
+                    TYPALIGN_INT, &partition_names, NULL, &num_of_partitions);
+  // Partitions are named like any relation, optionally schema qualified.
+  Oid *partitions = palloc_array(Oid, Max(num_of_partitions, 1));
+  for (int i = 0; i < num_of_partitions; i += 1) {
+    partitions[i] = DatumGetObjectId(DirectFunctionCall1(
+        regclassin,
+        CStringGetDatum(TextDatumGetCString(partition_names[i]))));
+  }
+
+  char data_path[MAXPGPATH];
+  snprintf(data_path, sizeof(data_path), "pg_analytica/%u/%s", MyDatabaseId,
+           table_name);
+  hyperLogLogState merged;
+  initHyperLogLog(&merged, DISTINCT_SKETCH_REGISTER_BITS);
+  int num_of_sketches = 0;
+  DIR *dir = AllocateDir(data_path);
+  struct dirent *entry;
+  while ((entry = ReadDir(dir, data_path)) != NULL) {
+    if (!is_distinct_sketch_file(entry->d_name) ||
+        !file_in_partitions(entry->d_name, partitions, num_of_partitions)) {
+      continue;
+    }
+    char path[MAXPGPATH];
+    snprintf(path, sizeof(path), "%s/%s", data_path, entry->d_name);
+    if (merge_distinct_sketch_file(path, column_name, &merged)) {
+      num_of_sketches += 1;
+    }
+  }
+  FreeDir(dir);
+  pfree(partitions);
+  elog(DEBUG1, "Merged %d distinct sketches of %s.%s", num_of_sketches,
+       table_name, column_name);
+  if (num_of_sketches == 0) {
+    freeHyperLogLog(&merged);
+    PG_RETURN_NULL();
+  }
+  double estimate = estimateHyperLogLog(&merged);
+  freeHyperLogLog(&merged);
+  PG_RETURN_INT64((int64)rint(estimate));
+}
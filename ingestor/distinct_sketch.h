@@ -0,0 +1,51 @@
+#ifndef _DISTINCT_SKETCH_H
+#define _DISTINCT_SKETCH_H
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "lib/hyperloglog.h"
+
+// Sidecar files holding distinct count sketches are named
+// {columnar file}.hll.
+#define DISTINCT_SKETCH_FILE_SUFFIX ".hll"
+// 2^14 registers estimate distinct counts within roughly 1%.
+#define DISTINCT_SKETCH_REGISTER_BITS 14
+
+/**
+ * HyperLogLog sketch of the distinct values of an exported column in a
+ * columnar file. Sketches of several files are merged by keeping the
+ * largest value of each register, so the distinct count of any set of
+ * files is estimated without reading them.
+ */
+typedef struct _ColumnDistinctSketch {
+  char column_name[NAMEDATALEN];
+  // Default hash function of the column type.
+  FmgrInfo *hash_proc;
+  Oid collation;
+  hyperLogLogState sketch;
+} ColumnDistinctSketch;
+
+/**
+ * Returns true if values of type can be added to distinct count sketches,
+ * which needs a default hash function.
+ */
+extern bool distinct_sketch_supports_type(Oid type_oid);
+
+extern void distinct_sketch_init(ColumnDistinctSketch *column,
+                                 const char *column_name, Oid type_oid);
+
+extern void distinct_sketch_free(ColumnDistinctSketch *column);
+
+extern void distinct_sketch_add_datum(ColumnDistinctSketch *column,
+                                      Datum value);
+
+/**
+ * Durably writes distinct count sketches of columns to the sidecar file at
+ * path.
+ */
+extern void write_distinct_sketch_file(const char *path,
+                                       const ColumnDistinctSketch *columns,
+                                       int num_of_columns);
+
+#endif
@@ -0,0 +1,71 @@
+#include "postgres.h"
+
+#include "catalog/pg_namespace_d.h"
+#include "constants.h"
+#include "export_access.h"
+#include "file_filter.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+/*
+ * Returns true if name can be used in SQL without quoting.
+ */
+static bool is_plain_identifier(const char *name) {
+  return name[0] != '\0' && strcmp(quote_identifier(name), name) == 0;
+}
+
+void validate_export_name(const char *table_name) {
+  // Leaves room for the suffixes of sample and fresh relations.
+  if (!is_plain_identifier(table_name) ||
+      strlen(table_name) + strlen(EXPORTED_RELATION_PREFIX "_sample") >=
+          NAMEDATALEN) {
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_NAME),
+             errmsg("Invalid table name %s", table_name),
+             errhint("Exported names are unqualified lower case identifiers "
+                     "that need no quoting.")));
+  }
+}
+
+void validate_export_column_name(const char *column_name) {
+  if (!is_plain_identifier(column_name)) {
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_NAME),
+             errmsg("Column %s can't be exported", column_name),
+             errdetail("Exported columns must have lower case names that "
+                       "need no quoting."),
+             errhint("Rename the column or export it under an alias.")));
+  }
+}
+
+void check_export_access(const char *data_name) {
+  char table_name[NAMEDATALEN];
+  const char *relation_suffix = "";
+  size_t length = strlen(data_name);
+  size_t suffix_length = strlen(SAMPLE_DATA_SUFFIX);
+  if (length > suffix_length &&
+      strcmp(data_name + length - suffix_length, SAMPLE_DATA_SUFFIX) == 0) {
+    length -= suffix_length;
+    relation_suffix = "_sample";
+  }
+  if (length >= NAMEDATALEN) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_NAME),
+                    errmsg("Invalid table name %s", data_name)));
+  }
+  strlcpy(table_name, data_name, length + 1);
+  validate_export_name(table_name);
+  char relation_name[NAMEDATALEN];
+  snprintf(relation_name, sizeof(relation_name),
+           EXPORTED_RELATION_PREFIX "%s%s", table_name, relation_suffix);
+  Oid relid = get_relname_relid(relation_name, PG_PUBLIC_NAMESPACE);
+  if (!OidIsValid(relid)) {
+    ereport(ERROR, (errcode(ERRCODE_UNDEFINED_TABLE),
+                    errmsg("Table %s isn't exported", data_name)));
+  }
+  AclResult result = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+  if (result != ACLCHECK_OK) {
+    aclcheck_error(result, OBJECT_TABLE, relation_name);
+  }
+}
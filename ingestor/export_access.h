@@ -0,0 +1,27 @@
+#ifndef _EXPORT_ACCESS_H
+#define _EXPORT_ACCESS_H
+
+#include "postgres.h"
+
+/**
+ * Raises an error unless table_name can name an export. Names are used as
+ * directory names under pg_analytica and inside SQL run by the export
+ * worker, so they must be identifiers that need no quoting.
+ */
+extern void validate_export_name(const char *table_name);
+
+/**
+ * Raises an error unless column_name can be exported. Column names are
+ * used inside SQL run by the export worker and in file names, so they must
+ * be identifiers that need no quoting.
+ */
+extern void validate_export_column_name(const char *column_name);
+
+/**
+ * Raises an error unless the current user may read the files in the data
+ * directory data_name, the directory of an exported table or of its sample.
+ * Files are readable by roles with SELECT on the relation created for them.
+ */
+extern void check_export_access(const char *data_name);
+
+#endif
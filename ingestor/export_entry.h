@@ -16,15 +16,81 @@ typedef struct _ExportEntry {
   int num_of_columns;
   int export_status;
   int64 chunk_size;
+  // OutputFormat of the columnar files.
+  int output_format;
+  // ExportLayout of the columnar files.
+  int layout;
+  // Column rows are hashed on into num_of_buckets files per chunk, NULL if
+  // the table isn't bucketed.
+  char *bucket_column;
+  int num_of_buckets;
+  // Fraction of rows written to the sample relation of the table and the
+  // column its sample is stratified on, NULL if it isn't stratified.
+  double sample_rate;
+  char *sample_strata_column;
+  // Fingerprint of table contents at the previous export, NULL if the table
+  // hasn't been exported yet.
+  char *fingerprint;
+  // Columns to build bloom filters for, a subset of columns_to_export.
+  char **bloom_filter_columns;
+  int num_of_bloom_filter_columns;
+  // Columns to sketch distinct counts of, a subset of columns_to_export.
+  char **distinct_count_columns;
+  int num_of_distinct_count_columns;
+  // SELECT statement exported instead of a table, table_name then only
+  // names the export. NULL for tables.
+  char *source_query;
+  // Column of the query whose rows are exported once, in increasing order,
+  // NULL if the whole query is exported every time. Rows up to watermark
+  // were exported before, rows up to next_watermark are exported next.
+  char *incremental_key;
+  char *watermark;
+  char *next_watermark;
+  // Column rows added to a table since its last export are found by, NULL
+  // if the table has no fresh view. The watermark of tables is the largest
+  // value of the column that was exported.
+  char *fresh_column;
+  // SQL predicate rows of a table are exported under, NULL if every row is.
+  char *row_filter;
+  // Date or timestamp column limiting exported rows of a table to those
+  // within window_interval of the export, NULL if there's no window.
+  // window_start is the oldest exported time of the current export.
+  char *window_column;
+  char *window_interval;
+  char *window_start;
+  // Role that registered the export. Statements evaluating SQL supplied with
+  // the registration run as this role.
+  Oid registered_by;
 } ExportEntry;
 
 void initialize_export_entry(const char *table_name, int num_of_columns,
                              ExportEntry *entry) {
   // Initialize memory for column names.
   entry->num_of_columns = num_of_columns;
+  entry->fingerprint = NULL;
+  entry->output_format = 0;
+  entry->layout = 0;
+  entry->bucket_column = NULL;
+  entry->num_of_buckets = 0;
+  entry->sample_rate = 0;
+  entry->sample_strata_column = NULL;
+  entry->bloom_filter_columns = NULL;
+  entry->num_of_bloom_filter_columns = 0;
+  entry->distinct_count_columns = NULL;
+  entry->num_of_distinct_count_columns = 0;
+  entry->source_query = NULL;
+  entry->incremental_key = NULL;
+  entry->watermark = NULL;
+  entry->next_watermark = NULL;
+  entry->fresh_column = NULL;
+  entry->row_filter = NULL;
+  entry->window_column = NULL;
+  entry->window_interval = NULL;
+  entry->window_start = NULL;
+  entry->registered_by = InvalidOid;
   entry->columns_to_export = (char **)palloc(num_of_columns * sizeof(char *));
   // Initialize memory and set table name.
-  entry->table_name = (char *)palloc(strlen(table_name) * sizeof(char));
+  entry->table_name = (char *)palloc((strlen(table_name) + 1) * sizeof(char));
   strcpy(entry->table_name, table_name);
 }
 
@@ -32,16 +98,174 @@ void export_entry_add_column(ExportEntry *entry, char *column_name,
                              int column_num) {
   size_t column_name_size = strlen(column_name);
   entry->columns_to_export[column_num] =
-      (char *)palloc(column_name_size * sizeof(char));
+      (char *)palloc((column_name_size + 1) * sizeof(char));
   strcpy(entry->columns_to_export[column_num], column_name);
 }
 
+void export_entry_set_fingerprint(ExportEntry *entry,
+                                  const char *fingerprint) {
+  entry->fingerprint =
+      (char *)palloc((strlen(fingerprint) + 1) * sizeof(char));
+  strcpy(entry->fingerprint, fingerprint);
+}
+
+void export_entry_set_bucketing(ExportEntry *entry, const char *column_name,
+                                int num_of_buckets) {
+  entry->bucket_column =
+      (char *)palloc((strlen(column_name) + 1) * sizeof(char));
+  strcpy(entry->bucket_column, column_name);
+  entry->num_of_buckets = num_of_buckets;
+}
+
+void export_entry_set_sample(ExportEntry *entry, double sample_rate,
+                             const char *strata_column) {
+  entry->sample_rate = sample_rate;
+  if (strata_column != NULL) {
+    entry->sample_strata_column =
+        (char *)palloc((strlen(strata_column) + 1) * sizeof(char));
+    strcpy(entry->sample_strata_column, strata_column);
+  }
+}
+
+/* Returns true if a sample relation is kept for the table. */
+bool export_entry_has_sample(const ExportEntry *entry) {
+  return entry->sample_rate > 0 || entry->sample_strata_column != NULL;
+}
+
+void export_entry_init_bloom_filter_columns(ExportEntry *entry,
+                                            int num_of_columns) {
+  entry->num_of_bloom_filter_columns = num_of_columns;
+  entry->bloom_filter_columns =
+      (char **)palloc(num_of_columns * sizeof(char *));
+}
+
+void export_entry_add_bloom_filter_column(ExportEntry *entry,
+                                          const char *column_name,
+                                          int column_num) {
+  entry->bloom_filter_columns[column_num] =
+      (char *)palloc((strlen(column_name) + 1) * sizeof(char));
+  strcpy(entry->bloom_filter_columns[column_num], column_name);
+}
+
+void export_entry_init_distinct_count_columns(ExportEntry *entry,
+                                              int num_of_columns) {
+  entry->num_of_distinct_count_columns = num_of_columns;
+  entry->distinct_count_columns =
+      (char **)palloc(num_of_columns * sizeof(char *));
+}
+
+void export_entry_add_distinct_count_column(ExportEntry *entry,
+                                            const char *column_name,
+                                            int column_num) {
+  entry->distinct_count_columns[column_num] =
+      (char *)palloc((strlen(column_name) + 1) * sizeof(char));
+  strcpy(entry->distinct_count_columns[column_num], column_name);
+}
+
+void export_entry_set_source_query(ExportEntry *entry, const char *query,
+                                   const char *incremental_key) {
+  entry->source_query = (char *)palloc((strlen(query) + 1) * sizeof(char));
+  strcpy(entry->source_query, query);
+  if (incremental_key != NULL) {
+    entry->incremental_key =
+        (char *)palloc((strlen(incremental_key) + 1) * sizeof(char));
+    strcpy(entry->incremental_key, incremental_key);
+  }
+}
+
+void export_entry_set_watermark(ExportEntry *entry, const char *watermark) {
+  entry->watermark = (char *)palloc((strlen(watermark) + 1) * sizeof(char));
+  strcpy(entry->watermark, watermark);
+}
+
+void export_entry_set_next_watermark(ExportEntry *entry,
+                                     const char *watermark) {
+  entry->next_watermark =
+      (char *)palloc((strlen(watermark) + 1) * sizeof(char));
+  strcpy(entry->next_watermark, watermark);
+}
+
+void export_entry_set_fresh_column(ExportEntry *entry,
+                                   const char *column_name) {
+  entry->fresh_column =
+      (char *)palloc((strlen(column_name) + 1) * sizeof(char));
+  strcpy(entry->fresh_column, column_name);
+}
+
+void export_entry_set_row_filter(ExportEntry *entry, const char *row_filter) {
+  entry->row_filter = (char *)palloc((strlen(row_filter) + 1) * sizeof(char));
+  strcpy(entry->row_filter, row_filter);
+}
+
+void export_entry_set_window(ExportEntry *entry, const char *column_name,
+                             const char *window_interval) {
+  entry->window_column =
+      (char *)palloc((strlen(column_name) + 1) * sizeof(char));
+  strcpy(entry->window_column, column_name);
+  entry->window_interval =
+      (char *)palloc((strlen(window_interval) + 1) * sizeof(char));
+  strcpy(entry->window_interval, window_interval);
+}
+
+void export_entry_set_window_start(ExportEntry *entry,
+                                   const char *window_start) {
+  entry->window_start =
+      (char *)palloc((strlen(window_start) + 1) * sizeof(char));
+  strcpy(entry->window_start, window_start);
+}
+
 void free_export_entry(ExportEntry *entry) {
   pfree(entry->table_name);
+  if (entry->fingerprint != NULL) {
+    pfree(entry->fingerprint);
+  }
+  if (entry->bucket_column != NULL) {
+    pfree(entry->bucket_column);
+  }
+  if (entry->sample_strata_column != NULL) {
+    pfree(entry->sample_strata_column);
+  }
   for (int i = 0; i < entry->num_of_columns; i += 1) {
     pfree(entry->columns_to_export[i]);
   }
   pfree(entry->columns_to_export);
+  for (int i = 0; i < entry->num_of_bloom_filter_columns; i += 1) {
+    pfree(entry->bloom_filter_columns[i]);
+  }
+  if (entry->bloom_filter_columns != NULL) {
+    pfree(entry->bloom_filter_columns);
+  }
+  for (int i = 0; i < entry->num_of_distinct_count_columns; i += 1) {
+    pfree(entry->distinct_count_columns[i]);
+  }
+  if (entry->distinct_count_columns != NULL) {
+    pfree(entry->distinct_count_columns);
+  }
+  if (entry->source_query != NULL) {
+    pfree(entry->source_query);
+  }
+  if (entry->incremental_key != NULL) {
+    pfree(entry->incremental_key);
+  }
+  if (entry->watermark != NULL) {
+    pfree(entry->watermark);
+  }
+  if (entry->next_watermark != NULL) {
+    pfree(entry->next_watermark);
+  }
+  if (entry->fresh_column != NULL) {
+    pfree(entry->fresh_column);
+  }
+  if (entry->row_filter != NULL) {
+    pfree(entry->row_filter);
+  }
+  if (entry->window_column != NULL) {
+    pfree(entry->window_column);
+    pfree(entry->window_interval);
+  }
+  if (entry->window_start != NULL) {
+    pfree(entry->window_start);
+  }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "postgres.h"
+
+#include "export_generation.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+
+#define EXPORT_GENERATIONS_NAME "pg_analytica export generations"
+#define MAX_TRACKED_TABLES 1024
+// Tables are keyed by database oid and table name.
+#define TABLE_GENERATION_KEY_LENGTH (NAMEDATALEN + 11)
+
+typedef struct _TableGeneration {
+  char key[TABLE_GENERATION_KEY_LENGTH];
+  uint64 generation;
+} TableGeneration;
+
+typedef struct _ExportGenerations {
+  LWLock *lock;
+  uint64 last_generation;
+  // Generation of tables that didn't fit in the generations table. It is
+  // advanced whenever any of them is published.
+  uint64 untracked_generation;
+} ExportGenerations;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ExportGenerations *export_generations = NULL;
+static HTAB *table_generations = NULL;
+
+static void export_generation_shmem_request(void) {
+  if (prev_shmem_request_hook != NULL) {
+    prev_shmem_request_hook();
+  }
+  RequestAddinShmemSpace(
+      add_size(MAXALIGN(sizeof(ExportGenerations)),
+               hash_estimate_size(MAX_TRACKED_TABLES,
+                                  sizeof(TableGeneration))));
+  RequestNamedLWLockTranche(EXPORT_GENERATIONS_NAME, 1);
+}
+
+static void export_generation_shmem_startup(void) {
+  if (prev_shmem_startup_hook != NULL) {
+    prev_shmem_startup_hook();
+  }
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  bool found;
+  export_generations = ShmemInitStruct(
+      EXPORT_GENERATIONS_NAME, sizeof(ExportGenerations), &found);
+  if (!found) {
+    export_generations->lock =
+        &(GetNamedLWLockTranche(EXPORT_GENERATIONS_NAME))->lock;
+    export_generations->last_generation = 0;
+    export_generations->untracked_generation = 0;
+  }
+  HASHCTL info;
+  info.keysize = TABLE_GENERATION_KEY_LENGTH;
+  info.entrysize = sizeof(TableGeneration);
+  table_generations = ShmemInitHash(
+      "pg_analytica table generations", MAX_TRACKED_TABLES,
+      MAX_TRACKED_TABLES, &info, HASH_ELEM | HASH_STRINGS);
+  LWLockRelease(AddinShmemInitLock);
+}
+
+void export_generation_init(void) {
+  if (!process_shared_preload_libraries_in_progress) {
+    return;
+  }
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = export_generation_shmem_request;
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = export_generation_shmem_startup;
+}
+
+bool export_generations_enabled(void) { return export_generations != NULL; }
+
+static void populate_table_generation_key(const char *table_name, char *key) {
+  memset(key, 0, TABLE_GENERATION_KEY_LENGTH);
+  snprintf(key, TABLE_GENERATION_KEY_LENGTH, "%u.%s", MyDatabaseId,
+           table_name);
+}
+
+uint64 get_export_generation(const char *table_name) {
+  if (export_generations == NULL) {
+    return 0;
+  }
+  char key[TABLE_GENERATION_KEY_LENGTH];
+  populate_table_generation_key(table_name, key);
+  LWLockAcquire(export_generations->lock, LW_SHARED);
+  TableGeneration *entry = hash_search(table_generations, key, HASH_FIND, NULL);
+  uint64 generation = entry != NULL ? entry->generation
+                                    : export_generations->untracked_generation;
+  LWLockRelease(export_generations->lock);
+  return generation;
+}
+
+uint64 advance_export_generation(const char *table_name) {
+  if (export_generations == NULL) {
+    return 0;
+  }
+  char key[TABLE_GENERATION_KEY_LENGTH];
+  populate_table_generation_key(table_name, key);
+  LWLockAcquire(export_generations->lock, LW_EXCLUSIVE);
+  uint64 generation = ++export_generations->last_generation;
+  bool found;
+  TableGeneration *entry =
+      hash_search(table_generations, key, HASH_ENTER_NULL, &found);
+  if (entry != NULL) {
+    entry->generation = generation;
+  } else {
+    // Invalidates data cached for every untracked table.
+    export_generations->untracked_generation = generation;
+  }
+  LWLockRelease(export_generations->lock);
+  elog(LOG, "Advanced export generation of %s to " UINT64_FORMAT, table_name,
+       generation);
+  return generation;
+}
@@ -0,0 +1,33 @@
+#ifndef _EXPORT_GENERATION_H
+#define _EXPORT_GENERATION_H
+
+#include "postgres.h"
+
+/**
+ * Every publish of new columnar files for a table starts a new generation
+ * of the table. Data cached for a table is keyed by its generation so the
+ * cache is invalidated by the publish. Generations are kept in shared memory
+ * and are only tracked when the library is in shared_preload_libraries.
+ */
+
+/**
+ * Requests shared memory for generations, must be called from _PG_init.
+ */
+extern void export_generation_init(void);
+
+/**
+ * Returns true if generations are tracked in shared memory.
+ */
+extern bool export_generations_enabled(void);
+
+/**
+ * Returns current generation of the exported table.
+ */
+extern uint64 get_export_generation(const char *table_name);
+
+/**
+ * Starts a new generation of the table after its files were published.
+ */
+extern uint64 advance_export_generation(const char *table_name);
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef _EXPORT_STATE_H
+#define _EXPORT_STATE_H
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "postgres.h"
+
+#include "file_utils.h"
+#include "storage/fd.h"
+#include "utils/palloc.h"
+#include "utils/timestamp.h"
+
+#define EXPORT_STATE_FILE_NAME ".export_state"
+#define MAX_EXPORT_STATE_LINE_CHARS 1024
+#define MAX_EXPORT_STATE_PARTITIONS 1024
+
+/**
+ * Export metadata of a table kept in a sidecar file of its data directory.
+ * Exports running on a hot standby can't write analytica_exports and
+ * analytica_export_partitions, so the state they would record there is
+ * stored next to the columnar files of the standby instead.
+ */
+typedef struct _ExportState {
+  // 0 if the table hasn't been exported yet.
+  TimestampTz last_run_completed;
+  // Fingerprint of table contents at the last export, empty if unknown.
+  char fingerprint[NAMEDATALEN];
+  // Largest incremental key exported from a query, empty if unknown.
+  char watermark[MAX_EXPORT_STATE_LINE_CHARS];
+  int num_of_partitions;
+  char partitions[MAX_EXPORT_STATE_PARTITIONS][NAMEDATALEN];
+  char partition_fingerprints[MAX_EXPORT_STATE_PARTITIONS][NAMEDATALEN];
+} ExportState;
+
+/*
+ * Populates the path of the export state file for table in out.
+ * Assumes that buffer has PATH_MAX space available.
+ */
+void populate_export_state_path_for_table(const char *table, char *out) {
+  populate_data_path_for_table(table, out, /*relative=*/false);
+  strcat(out, "/" EXPORT_STATE_FILE_NAME);
+}
+
+/**
+ * Returns export state of table, which is empty if the table has no state
+ * file. Caller should free the returned pointer.
+ */
+ExportState *load_export_state(const char *table_name) {
+  ExportState *state = palloc0(sizeof(ExportState));
+  char path[PATH_MAX];
+  populate_export_state_path_for_table(table_name, path);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return state;
+  }
+  char line[MAX_EXPORT_STATE_LINE_CHARS];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    char *value = strchr(line, ' ');
+    if (value == NULL) {
+      continue;
+    }
+    *value = '\0';
+    value += 1;
+    if (strcmp(line, "last_run_completed") == 0) {
+      state->last_run_completed = strtoll(value, NULL, 10);
+    } else if (strcmp(line, "fingerprint") == 0) {
+      strlcpy(state->fingerprint, value, NAMEDATALEN);
+    } else if (strcmp(line, "watermark") == 0) {
+      strlcpy(state->watermark, value, MAX_EXPORT_STATE_LINE_CHARS);
+    } else if (strcmp(line, "partition") == 0 &&
+               state->num_of_partitions < MAX_EXPORT_STATE_PARTITIONS) {
+      // Partitions are stored as "<fingerprint> <partition name>".
+      char *partition_name = strchr(value, ' ');
+      if (partition_name == NULL) {
+        continue;
+      }
+      *partition_name = '\0';
+      int partition = state->num_of_partitions;
+      strlcpy(state->partition_fingerprints[partition], value, NAMEDATALEN);
+      strlcpy(state->partitions[partition], partition_name + 1, NAMEDATALEN);
+      state->num_of_partitions += 1;
+    }
+  }
+  fclose(file);
+  return state;
+}
+
+/**
+ * Durably writes export state of table, the same way export checkpoints
+ * are written.
+ */
+void save_export_state(const char *table_name, const ExportState *state) {
+  char path[PATH_MAX];
+  char temp_path[PATH_MAX];
+  populate_export_state_path_for_table(table_name, path);
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+  FILE *file = fopen(temp_path, "w");
+  if (file == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not create export state file \"%s\": %m",
+                           temp_path)));
+  }
+  fprintf(file, "last_run_completed " INT64_FORMAT "\n",
+          state->last_run_completed);
+  fprintf(file, "fingerprint %s\n", state->fingerprint);
+  if (state->watermark[0] != '\0') {
+    fprintf(file, "watermark %s\n", state->watermark);
+  }
+  for (int i = 0; i < state->num_of_partitions; i += 1) {
+    fprintf(file, "partition %s %s\n", state->partition_fingerprints[i],
+            state->partitions[i]);
+  }
+  if (fclose(file) != 0) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not write export state file \"%s\": %m",
+                           temp_path)));
+  }
+  durable_rename(temp_path, path, ERROR);
+}
+
+/**
+ * Returns fingerprint the partition was last exported at or NULL if it
+ * hasn't been exported.
+ */
+const char *export_state_find_partition(const ExportState *state,
+                                        const char *partition_name) {
+  for (int i = 0; i < state->num_of_partitions; i += 1) {
+    if (strcmp(state->partitions[i], partition_name) == 0) {
+      return state->partition_fingerprints[i];
+    }
+  }
+  return NULL;
+}
+
+void export_state_set_partition(ExportState *state,
+                                const char *partition_name,
+                                const char *fingerprint) {
+  int partition = 0;
+  while (partition < state->num_of_partitions &&
+         strcmp(state->partitions[partition], partition_name) != 0) {
+    partition += 1;
+  }
+  if (partition == MAX_EXPORT_STATE_PARTITIONS) {
+    // Partition will be exported again by the next export.
+    return;
+  }
+  if (partition == state->num_of_partitions) {
+    strlcpy(state->partitions[partition], partition_name, NAMEDATALEN);
+    state->num_of_partitions += 1;
+  }
+  strlcpy(state->partition_fingerprints[partition], fingerprint, NAMEDATALEN);
+}
+
+void export_state_remove_partition(ExportState *state,
+                                   const char *partition_name) {
+  for (int i = 0; i < state->num_of_partitions; i += 1) {
+    if (strcmp(state->partitions[i], partition_name) != 0) {
+      continue;
+    }
+    int last = state->num_of_partitions - 1;
+    strlcpy(state->partitions[i], state->partitions[last], NAMEDATALEN);
+    strlcpy(state->partition_fingerprints[i],
+            state->partition_fingerprints[last], NAMEDATALEN);
+    state->num_of_partitions -= 1;
+    return;
+  }
+}
+
+#endif
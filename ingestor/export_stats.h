@@ -0,0 +1,290 @@
+#ifndef _EXPORT_STATS_H
+#define _EXPORT_STATS_H
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "postgres.h"
+
+#include "access/heaptoast.h"
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "access/tupdesc.h"
+#include "catalog/indexing.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "commands/vacuum.h"
+#include "common/pg_prng.h"
+#include "file_utils.h"
+#include "storage/lmgr.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+/**
+ * Uniform sample of the rows written during an export, used to compute
+ * planner statistics for the exported relation the same way ANALYZE does
+ * without scanning the columnar files again.
+ *
+ * Rows are sampled with reservoir sampling into a memory context of the
+ * sample so that the sample outlives the export transaction.
+ */
+typedef struct _ExportSample {
+  MemoryContext context;
+  TupleDesc tupdesc;
+  HeapTuple *rows;
+  int num_of_rows;
+  int target_rows;
+  // Rows seen by the sample.
+  int64 num_of_seen_rows;
+  // Estimated rows exported by earlier runs which weren't sampled, like
+  // those of unchanged partitions.
+  double num_of_unsampled_rows;
+} ExportSample;
+
+/*
+ * Initializes sample of rows with the exported columns described by
+ * tupdesc. ANALYZE samples 300 rows per unit of the statistics target.
+ */
+void export_sample_init(ExportSample *sample, TupleDesc tupdesc) {
+  memset(sample, 0, sizeof(ExportSample));
+  sample->context = AllocSetContextCreate(
+      TopMemoryContext, "pg_analytica export sample", ALLOCSET_DEFAULT_SIZES);
+  MemoryContext old_context = MemoryContextSwitchTo(sample->context);
+  sample->tupdesc = CreateTupleDescCopy(tupdesc);
+  sample->target_rows = 300 * default_statistics_target;
+  sample->rows = palloc(sample->target_rows * sizeof(HeapTuple));
+  MemoryContextSwitchTo(old_context);
+}
+
+/*
+ * Adds row to the sample. Out of line values are fetched so sampled rows
+ * stay valid after the export transaction.
+ */
+void export_sample_add(ExportSample *sample, Datum *values, bool *isnull) {
+  int64 position = sample->num_of_seen_rows;
+  sample->num_of_seen_rows += 1;
+  if (position >= sample->target_rows) {
+    position = pg_prng_uint64_range(&pg_global_prng_state, 0, position);
+    if (position >= sample->target_rows) {
+      return;
+    }
+    heap_freetuple(sample->rows[position]);
+  } else {
+    sample->num_of_rows += 1;
+  }
+  MemoryContext old_context = MemoryContextSwitchTo(sample->context);
+  HeapTuple row = heap_form_tuple(sample->tupdesc, values, isnull);
+  sample->rows[position] = toast_flatten_tuple(row, sample->tupdesc);
+  heap_freetuple(row);
+  MemoryContextSwitchTo(old_context);
+}
+
+void free_export_sample(ExportSample *sample) {
+  if (sample->context != NULL) {
+    MemoryContextDelete(sample->context);
+  }
+  memset(sample, 0, sizeof(ExportSample));
+}
+
+static Datum sample_fetch_func(VacAttrStatsP stats, int rownum,
+                               bool *isnull) {
+  return heap_getattr(stats->rows[rownum], stats->tupattnum, stats->tupDesc,
+                      isnull);
+}
+
+/*
+ * Returns statistics of a sampled column computed by the typanalyze
+ * function of its type or NULL if the type can't be analyzed.
+ */
+static VacAttrStats *compute_column_statistics(ExportSample *sample,
+                                               int attnum,
+                                               double total_rows) {
+  Form_pg_attribute attribute = TupleDescAttr(sample->tupdesc, attnum - 1);
+  VacAttrStats *stats = palloc0(sizeof(VacAttrStats));
+  stats->attr = attribute;
+  stats->attrtypid = attribute->atttypid;
+  stats->attrtypmod = attribute->atttypmod;
+  stats->attrcollid = attribute->attcollation;
+  HeapTuple type_tuple =
+      SearchSysCacheCopy1(TYPEOID, ObjectIdGetDatum(stats->attrtypid));
+  if (!HeapTupleIsValid(type_tuple)) {
+    elog(ERROR, "cache lookup failed for type %u", stats->attrtypid);
+  }
+  stats->attrtype = (Form_pg_type)GETSTRUCT(type_tuple);
+  stats->anl_context = CurrentMemoryContext;
+  stats->tupattnum = attnum;
+  for (int i = 0; i < STATISTIC_NUM_SLOTS; i += 1) {
+    stats->statypid[i] = stats->attrtypid;
+    stats->statyplen[i] = stats->attrtype->typlen;
+    stats->statypbyval[i] = stats->attrtype->typbyval;
+    stats->statypalign[i] = stats->attrtype->typalign;
+  }
+  bool is_analyzable;
+  if (OidIsValid(stats->attrtype->typanalyze)) {
+    is_analyzable = DatumGetBool(OidFunctionCall1(
+        stats->attrtype->typanalyze, PointerGetDatum(stats)));
+  } else {
+    is_analyzable = std_typanalyze(stats);
+  }
+  if (!is_analyzable || stats->compute_stats == NULL) {
+    return NULL;
+  }
+  stats->rows = sample->rows;
+  stats->tupDesc = sample->tupdesc;
+  stats->compute_stats(stats, sample_fetch_func, sample->num_of_rows,
+                       total_rows);
+  return stats->stats_valid ? stats : NULL;
+}
+
+/*
+ * Stores statistics of column attnum of relation in pg_statistic replacing
+ * existing statistics, like ANALYZE does.
+ */
+static void store_column_statistics(Oid relid, AttrNumber attnum,
+                                    const VacAttrStats *stats) {
+  Datum values[Natts_pg_statistic];
+  bool nulls[Natts_pg_statistic];
+  bool replaces[Natts_pg_statistic];
+  memset(nulls, false, sizeof(nulls));
+  memset(replaces, true, sizeof(replaces));
+
+  values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(relid);
+  values[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(attnum);
+  values[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(false);
+  values[Anum_pg_statistic_stanullfrac - 1] =
+      Float4GetDatum(stats->stanullfrac);
+  values[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(stats->stawidth);
+  values[Anum_pg_statistic_stadistinct - 1] =
+      Float4GetDatum(stats->stadistinct);
+  for (int i = 0; i < STATISTIC_NUM_SLOTS; i += 1) {
+    values[Anum_pg_statistic_stakind1 - 1 + i] =
+        Int16GetDatum(stats->stakind[i]);
+    values[Anum_pg_statistic_staop1 - 1 + i] =
+        ObjectIdGetDatum(stats->staop[i]);
+    values[Anum_pg_statistic_stacoll1 - 1 + i] =
+        ObjectIdGetDatum(stats->stacoll[i]);
+
+    int numbers_index = Anum_pg_statistic_stanumbers1 - 1 + i;
+    if (stats->numnumbers[i] > 0) {
+      Datum *numbers = palloc(stats->numnumbers[i] * sizeof(Datum));
+      for (int j = 0; j < stats->numnumbers[i]; j += 1) {
+        numbers[j] = Float4GetDatum(stats->stanumbers[i][j]);
+      }
+      values[numbers_index] = PointerGetDatum(
+          construct_array_builtin(numbers, stats->numnumbers[i], FLOAT4OID));
+    } else {
+      nulls[numbers_index] = true;
+      values[numbers_index] = (Datum)0;
+    }
+
+    int values_index = Anum_pg_statistic_stavalues1 - 1 + i;
+    if (stats->numvalues[i] > 0) {
+      values[values_index] = PointerGetDatum(construct_array(
+          stats->stavalues[i], stats->numvalues[i], stats->statypid[i],
+          stats->statyplen[i], stats->statypbyval[i], stats->statypalign[i]));
+    } else {
+      nulls[values_index] = true;
+      values[values_index] = (Datum)0;
+    }
+  }
+
+  Relation statistics = table_open(StatisticRelationId, RowExclusiveLock);
+  HeapTuple old_tuple =
+      SearchSysCache3(STATRELATTINH, ObjectIdGetDatum(relid),
+                      Int16GetDatum(attnum), BoolGetDatum(false));
+  HeapTuple tuple;
+  if (HeapTupleIsValid(old_tuple)) {
+    tuple = heap_modify_tuple(old_tuple, RelationGetDescr(statistics), values,
+                              nulls, replaces);
+    ReleaseSysCache(old_tuple);
+    CatalogTupleUpdate(statistics, &tuple->t_self, tuple);
+  } else {
+    tuple = heap_form_tuple(RelationGetDescr(statistics), values, nulls);
+    CatalogTupleInsert(statistics, tuple);
+  }
+  heap_freetuple(tuple);
+  table_close(statistics, RowExclusiveLock);
+}
+
+/*
+ * Returns number of blocks of the columnar files of table.
+ */
+static BlockNumber get_exported_pages(const char *table_name) {
+  char data_path[PATH_MAX];
+  populate_data_path_for_table(table_name, data_path, /*relative=*/false);
+  DIR *dir = opendir(data_path);
+  if (dir == NULL) {
+    return 0;
+  }
+  int64 total_size = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char path[PATH_MAX];
+    struct stat file_stat;
+    snprintf(path, sizeof(path), "%s/%s", data_path, entry->d_name);
+    if (stat(path, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+      total_size += file_stat.st_size;
+    }
+  }
+  closedir(dir);
+  return (BlockNumber)Min(total_size / BLCKSZ, MaxBlockNumber);
+}
+
+/**
+ * Installs row count and column statistics computed from the sample for
+ * the foreign table of an exported table so the planner doesn't need to
+ * guess them. Views over Arrow files can't have statistics and are skipped,
+ * as are columns the foreign table reads as a different type. Column
+ * statistics are only replaced when every exported row was sampled, since
+ * rows of skipped partitions may differ from the sampled ones.
+ * Expects a transaction to be in progress.
+ */
+void install_export_statistics(const char *table_name,
+                               const char *relation_name,
+                               ExportSample *sample) {
+  Oid relid = get_relname_relid(relation_name, PG_PUBLIC_NAMESPACE);
+  if (!OidIsValid(relid) || get_rel_relkind(relid) != RELKIND_FOREIGN_TABLE) {
+    return;
+  }
+  double total_rows = sample->num_of_seen_rows + sample->num_of_unsampled_rows;
+  Relation relation = table_open(relid, ShareUpdateExclusiveLock);
+  vac_update_relstats(relation, get_exported_pages(table_name), total_rows,
+                      /*num_all_visible_pages=*/0, /*hasindex=*/false,
+                      InvalidTransactionId, InvalidMultiXactId, NULL, NULL,
+                      /*in_outer_xact=*/false);
+
+  if (sample->num_of_unsampled_rows > 0) {
+    table_close(relation, NoLock);
+    elog(LOG, "Installed row count %.0f of %s, %.0f rows weren't sampled",
+         total_rows, relation_name, sample->num_of_unsampled_rows);
+    return;
+  }
+  int num_of_columns = 0;
+  for (int i = 0; i < sample->tupdesc->natts && sample->num_of_rows > 0;
+       i += 1) {
+    Form_pg_attribute attribute = TupleDescAttr(sample->tupdesc, i);
+    AttrNumber attnum = get_attnum(relid, NameStr(attribute->attname));
+    // The foreign table may map a column to a wider type than the exported
+    // column, whose statistics would be misread.
+    if (attnum == InvalidAttrNumber ||
+        get_atttype(relid, attnum) != attribute->atttypid) {
+      continue;
+    }
+    VacAttrStats *stats =
+        compute_column_statistics(sample, i + 1, total_rows);
+    if (stats != NULL) {
+      store_column_statistics(relid, attnum, stats);
+      num_of_columns += 1;
+    }
+  }
+  table_close(relation, NoLock);
+  elog(LOG, "Installed statistics for %d columns and %.0f rows of %s",
+       num_of_columns, total_rows, relation_name);
+}
+
+#endif
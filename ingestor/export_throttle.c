@@ -0,0 +1,200 @@
+#include <limits.h>
+
+#include "postgres.h"
+
+#include "access/xlog.h"
+#include "executor/instrument.h"
+#include "export_throttle.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/interrupt.h"
+#include "replication/walsender.h"
+#include "replication/walsender_private.h"
+#include "storage/latch.h"
+#include "storage/spin.h"
+#include "utils/backend_status.h"
+#include "utils/guc.h"
+#include "utils/timestamp.h"
+#include "utils/wait_event.h"
+
+// Server pressure is checked at most once per interval.
+#define PRESSURE_CHECK_INTERVAL_MS 1000
+#define BACKOFF_SLEEP_MS 1000
+// Exports still make progress while the server stays under pressure.
+#define MAX_BACKOFF_SLEEPS 10
+
+// Throttling is disabled when the delay is 0.
+static int export_cost_delay = 0;
+static int export_cost_limit = 200;
+static int export_cost_page_hit = 1;
+static int export_cost_page_miss = 2;
+static int export_cost_kb_written = 1;
+// Back off is disabled when the threshold is 0. Lag is in kB.
+static int backoff_replication_lag = 0;
+static int backoff_query_duration = 0;
+
+static double cost_balance = 0;
+static BufferUsage last_buffer_usage;
+static TimestampTz last_pressure_check = 0;
+
+void export_throttle_init(void) {
+  DefineCustomIntVariable(
+      "pg_analytica.export_cost_delay",
+      "Export cost delay in milliseconds, 0 disables throttling.", NULL,
+      &export_cost_delay, 0, 0, 100, PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL,
+      NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.export_cost_limit",
+      "Export cost amount available before sleeping.", NULL,
+      &export_cost_limit, 200, 1, 10000, PGC_SIGHUP, 0, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.export_cost_page_hit",
+      "Export cost for a page found in the buffer cache.", NULL,
+      &export_cost_page_hit, 1, 0, 10000, PGC_SIGHUP, 0, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.export_cost_page_miss",
+      "Export cost for a page not found in the buffer cache.", NULL,
+      &export_cost_page_miss, 2, 0, 10000, PGC_SIGHUP, 0, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.export_cost_kb_written",
+      "Export cost for a kB written to columnar files.", NULL,
+      &export_cost_kb_written, 1, 0, 10000, PGC_SIGHUP, 0, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.backoff_replication_lag",
+      "Replay lag of a standby above which exports pause, 0 disables.", NULL,
+      &backoff_replication_lag, 0, 0, INT_MAX, PGC_SIGHUP, GUC_UNIT_KB, NULL,
+      NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.backoff_query_duration",
+      "Duration of a running query above which exports pause, 0 disables.",
+      NULL, &backoff_query_duration, 0, 0, INT_MAX, PGC_SIGHUP, GUC_UNIT_MS,
+      NULL, NULL, NULL);
+}
+
+void export_throttle_start(void) {
+  cost_balance = 0;
+  last_buffer_usage = pgBufferUsage;
+  last_pressure_check = 0;
+}
+
+void export_throttle_add_written(int64 bytes) {
+  if (export_cost_delay == 0) {
+    return;
+  }
+  cost_balance += (double)bytes / 1024 * export_cost_kb_written;
+}
+
+static void charge_page_reads(void) {
+  int64 hits = pgBufferUsage.shared_blks_hit + pgBufferUsage.local_blks_hit -
+               last_buffer_usage.shared_blks_hit -
+               last_buffer_usage.local_blks_hit;
+  int64 misses = pgBufferUsage.shared_blks_read +
+                 pgBufferUsage.local_blks_read -
+                 last_buffer_usage.shared_blks_read -
+                 last_buffer_usage.local_blks_read;
+  cost_balance +=
+      hits * export_cost_page_hit + misses * export_cost_page_miss;
+  last_buffer_usage = pgBufferUsage;
+}
+
+static void throttle_sleep(long msec) {
+  (void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                  msec, PG_WAIT_EXTENSION);
+  ResetLatch(MyLatch);
+  CHECK_FOR_INTERRUPTS();
+}
+
+/*
+ * Returns the largest replay lag in bytes of the connected standbys.
+ */
+static uint64 get_replication_lag(void) {
+  if (WalSndCtl == NULL || RecoveryInProgress()) {
+    return 0;
+  }
+  XLogRecPtr flush = GetFlushRecPtr(NULL);
+  uint64 lag = 0;
+  for (int i = 0; i < max_wal_senders; i += 1) {
+    WalSnd *walsnd = &WalSndCtl->walsnds[i];
+    SpinLockAcquire(&walsnd->mutex);
+    pid_t pid = walsnd->pid;
+    XLogRecPtr apply = walsnd->apply;
+    SpinLockRelease(&walsnd->mutex);
+    if (pid == 0 || XLogRecPtrIsInvalid(apply) || apply >= flush) {
+      continue;
+    }
+    lag = Max(lag, flush - apply);
+  }
+  return lag;
+}
+
+/*
+ * Returns whether a client backend runs a query for longer than
+ * backoff_query_duration.
+ */
+static bool has_slow_queries(TimestampTz now) {
+  bool found = false;
+  pgstat_clear_backend_activity_snapshot();
+  int num_of_backends = pgstat_fetch_stat_numbackends();
+  for (int i = 1; i <= num_of_backends && !found; i += 1) {
+    PgBackendStatus *status =
+        &pgstat_get_local_beentry_by_index(i)->backendStatus;
+    found = status->st_backendType == B_BACKEND &&
+            status->st_state == STATE_RUNNING &&
+            TimestampDifferenceExceeds(status->st_activity_start_timestamp,
+                                       now, backoff_query_duration);
+  }
+  pgstat_clear_backend_activity_snapshot();
+  return found;
+}
+
+static bool is_under_pressure(TimestampTz now) {
+  if (backoff_replication_lag > 0 &&
+      get_replication_lag() > (uint64)backoff_replication_lag * 1024) {
+    elog(DEBUG1, "Replication lag is above %d kB", backoff_replication_lag);
+    return true;
+  }
+  if (backoff_query_duration > 0 && has_slow_queries(now)) {
+    elog(DEBUG1, "Queries are running longer than %d ms",
+         backoff_query_duration);
+    return true;
+  }
+  return false;
+}
+
+static void back_off_under_pressure(void) {
+  if (backoff_replication_lag == 0 && backoff_query_duration == 0) {
+    return;
+  }
+  TimestampTz now = GetCurrentTimestamp();
+  if (!TimestampDifferenceExceeds(last_pressure_check, now,
+                                  PRESSURE_CHECK_INTERVAL_MS)) {
+    return;
+  }
+  int num_of_sleeps = 0;
+  while (num_of_sleeps < MAX_BACKOFF_SLEEPS && is_under_pressure(now)) {
+    throttle_sleep(BACKOFF_SLEEP_MS);
+    num_of_sleeps += 1;
+    now = GetCurrentTimestamp();
+  }
+  if (num_of_sleeps > 0) {
+    elog(LOG, "Export backed off for %d ms", num_of_sleeps * BACKOFF_SLEEP_MS);
+  }
+  last_pressure_check = now;
+}
+
+void export_throttle_point(void) {
+  if (ConfigReloadPending) {
+    ConfigReloadPending = false;
+    ProcessConfigFile(PGC_SIGHUP);
+  }
+  if (export_cost_delay > 0) {
+    charge_page_reads();
+    if (cost_balance >= export_cost_limit) {
+      // Like vacuum, sleep longer when the limit was overshot.
+      double msec = export_cost_delay * cost_balance / export_cost_limit;
+      throttle_sleep((long)Min(msec, export_cost_delay * 4.0));
+      cost_balance = 0;
+    }
+  }
+  back_off_under_pressure();
+}
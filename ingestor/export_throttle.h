@@ -0,0 +1,33 @@
+#ifndef _EXPORT_THROTTLE_H
+#define _EXPORT_THROTTLE_H
+
+#include "postgres.h"
+
+/**
+ * Cost based throttling of export workers, modeled after the cost based
+ * vacuum delay. Pages read by the export queries and bytes written to
+ * columnar files are charged against pg_analytica.export_cost_limit and the
+ * worker sleeps for pg_analytica.export_cost_delay once the limit is
+ * reached. Workers also back off while standbys lag or foreground queries
+ * run longer than configured.
+ */
+extern void export_throttle_init(void);
+
+/**
+ * Resets the cost balance of the worker before it starts exporting.
+ */
+extern void export_throttle_start(void);
+
+/**
+ * Charges bytes written to a columnar file.
+ */
+extern void export_throttle_add_written(int64 bytes);
+
+/**
+ * Charges pages read since the previous call and sleeps if the cost limit
+ * is reached or the server is under pressure. Called for every exported
+ * row.
+ */
+extern void export_throttle_point(void);
+
+#endif
@@ -0,0 +1,233 @@
+#include "postgres.h"
+
+#include "bloom_filter.h"
+#include "catalog/pg_class.h"
+#include "file_filter.h"
+#include "fmgr.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/planner.h"
+#include "parser/parsetree.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+
+PG_FUNCTION_INFO_V1(analytica_file_may_match);
+
+/* Equality filter of a query on a column of an exported table. */
+typedef struct _EqualityFilter {
+  char *table_name;
+  char *column_name;
+  Oid value_type;
+  Datum value;
+} EqualityFilter;
+
+static planner_hook_type prev_planner_hook = NULL;
+static bool enable_bloom_filter_pruning = true;
+// Equality filters of the query being planned. The files function of the
+// foreign tables is called while the query is planned.
+static List *current_filters = NIL;
+
+static bool collect_relation_ids_walker(Node *node, List **relation_ids) {
+  if (node == NULL) {
+    return false;
+  }
+  if (IsA(node, RangeTblEntry)) {
+    RangeTblEntry *rte = (RangeTblEntry *)node;
+    if (rte->rtekind == RTE_RELATION) {
+      *relation_ids = lappend_oid(*relation_ids, rte->relid);
+    }
+    return false;
+  }
+  if (IsA(node, Query)) {
+    return query_tree_walker((Query *)node, collect_relation_ids_walker,
+                             (void *)relation_ids, QTW_EXAMINE_RTES_BEFORE);
+  }
+  return expression_tree_walker(node, collect_relation_ids_walker,
+                                (void *)relation_ids);
+}
+
+static int count_oid_occurrences(List *oids, Oid oid) {
+  int count = 0;
+  ListCell *cell;
+  foreach (cell, oids) {
+    if (lfirst_oid(cell) == oid) {
+      count += 1;
+    }
+  }
+  return count;
+}
+
+/*
+ * Returns filter for qual if it compares a column of an exported table with
+ * a constant for equality.
+ */
+static EqualityFilter *equality_filter_for_qual(Query *parse, Node *qual,
+                                                List *relation_ids) {
+  if (!IsA(qual, OpExpr)) {
+    return NULL;
+  }
+  OpExpr *op = (OpExpr *)qual;
+  if (list_length(op->args) != 2) {
+    return NULL;
+  }
+  char *operator_name = get_opname(op->opno);
+  if (operator_name == NULL || strcmp(operator_name, "=") != 0) {
+    return NULL;
+  }
+  Node *left = strip_implicit_coercions(linitial(op->args));
+  Node *right = strip_implicit_coercions(lsecond(op->args));
+  if (IsA(right, Var)) {
+    Node *temp = left;
+    left = right;
+    right = temp;
+  }
+  if (!IsA(left, Var) || !IsA(right, Const)) {
+    return NULL;
+  }
+  Var *var = (Var *)left;
+  Const *constant = (Const *)right;
+  if (var->varlevelsup != 0 || var->varattno <= 0 || constant->constisnull) {
+    return NULL;
+  }
+  if (!bloom_filter_types_compatible(var->vartype, constant->consttype)) {
+    return NULL;
+  }
+  // Strings equal under a nondeterministic collation can differ in bytes.
+  if (OidIsValid(op->inputcollid) &&
+      !get_collation_isdeterministic(op->inputcollid)) {
+    return NULL;
+  }
+  RangeTblEntry *rte = rt_fetch(var->varno, parse->rtable);
+  if (rte->rtekind != RTE_RELATION ||
+      get_rel_relkind(rte->relid) != RELKIND_FOREIGN_TABLE) {
+    return NULL;
+  }
+  // Filters are looked up by table name so they're only safe to use when
+  // the table is scanned once in the query.
+  if (count_oid_occurrences(relation_ids, rte->relid) != 1) {
+    return NULL;
+  }
+  char *relation_name = get_rel_name(rte->relid);
+  size_t prefix_length = strlen(EXPORTED_RELATION_PREFIX);
+  if (strncmp(relation_name, EXPORTED_RELATION_PREFIX, prefix_length) != 0) {
+    return NULL;
+  }
+
+  EqualityFilter *filter = palloc(sizeof(EqualityFilter));
+  filter->table_name = relation_name + prefix_length;
+  filter->column_name = get_attname(rte->relid, var->varattno, false);
+  filter->value_type = constant->consttype;
+  filter->value = constant->constvalue;
+  return filter;
+}
+
+/*
+ * Returns equality filters in the WHERE clause of the query. Rows of a
+ * table that don't match a top level equality filter can't be part of the
+ * result regardless of joins.
+ */
+static List *collect_equality_filters(Query *parse) {
+  if (parse->commandType != CMD_SELECT || parse->jointree == NULL ||
+      parse->jointree->quals == NULL) {
+    return NIL;
+  }
+  List *relation_ids = NIL;
+  collect_relation_ids_walker((Node *)parse, &relation_ids);
+
+  List *filters = NIL;
+  ListCell *cell;
+  foreach (cell, make_ands_implicit((Expr *)parse->jointree->quals)) {
+    EqualityFilter *filter =
+        equality_filter_for_qual(parse, (Node *)lfirst(cell), relation_ids);
+    if (filter != NULL) {
+      elog(DEBUG1, "Found equality filter on %s.%s", filter->table_name,
+           filter->column_name);
+      filters = lappend(filters, filter);
+    }
+  }
+  list_free(relation_ids);
+  return filters;
+}
+
+static PlannedStmt *analytica_planner(Query *parse, const char *query_string,
+                                      int cursor_options,
+                                      ParamListInfo bound_params) {
+  PlannedStmt *result;
+  // Planning nests when the files function runs queries of its own.
+  List *outer_filters = current_filters;
+  current_filters =
+      enable_bloom_filter_pruning ? collect_equality_filters(parse) : NIL;
+  PG_TRY();
+  {
+    if (prev_planner_hook != NULL) {
+      result = prev_planner_hook(parse, query_string, cursor_options,
+                                 bound_params);
+    } else {
+      result = standard_planner(parse, query_string, cursor_options,
+                                bound_params);
+    }
+  }
+  PG_FINALLY();
+  { current_filters = outer_filters; }
+  PG_END_TRY();
+  return result;
+}
+
+void file_filter_init(void) {
+  DefineCustomBoolVariable(
+      "pg_analytica.enable_bloom_filter_pruning",
+      "Skip columnar files whose bloom filters rule out equality filters.",
+      NULL, &enable_bloom_filter_pruning, true, PGC_USERSET, 0, NULL, NULL,
+      NULL);
+
+  prev_planner_hook = planner_hook;
+  planner_hook = analytica_planner;
+}
+
+bool file_may_match(const char *dir, const char *file_name) {
+  if (current_filters == NIL) {
+    return true;
+  }
+  // Data directories are named after the exported table.
+  const char *table_name = last_dir_separator(dir);
+  table_name = table_name == NULL ? dir : table_name + 1;
+
+  char path[MAXPGPATH];
+  snprintf(path, sizeof(path), "%s/%s" BLOOM_FILTER_FILE_SUFFIX, dir,
+           file_name);
+  bool may_match = true;
+  ListCell *cell;
+  foreach (cell, current_filters) {
+    EqualityFilter *filter = (EqualityFilter *)lfirst(cell);
+    if (strcmp(filter->table_name, table_name) != 0) {
+      continue;
+    }
+    BloomFilter bloom_filter;
+    if (!read_file_bloom_filter(path, filter->column_name, &bloom_filter)) {
+      continue;
+    }
+    may_match = bloom_filter_may_contain_datum(&bloom_filter,
+                                               filter->value_type,
+                                               filter->value);
+    bloom_filter_free(&bloom_filter);
+    if (!may_match) {
+      elog(DEBUG1, "Skipping file %s ruled out by bloom filter on %s",
+           file_name, filter->column_name);
+      break;
+    }
+  }
+  return may_match;
+}
+
+/**
+ * SQL callable variant of file_may_match.
+ */
+Datum analytica_file_may_match(PG_FUNCTION_ARGS) {
+  char *dir = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  char *file_name = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  bool may_match = file_may_match(dir, file_name);
+  pfree(dir);
+  pfree(file_name);
+  PG_RETURN_BOOL(may_match);
+}
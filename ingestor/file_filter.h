@@ -0,0 +1,22 @@
+#ifndef _FILE_FILTER_H
+#define _FILE_FILTER_H
+
+#include "postgres.h"
+
+// Prefix of foreign tables created for exported tables.
+#define EXPORTED_RELATION_PREFIX "analytica_"
+
+/**
+ * Installs the planner hook collecting equality filters on exported tables
+ * which are used to skip columnar files while listing the files of a table.
+ */
+extern void file_filter_init(void);
+
+/**
+ * Returns false if the bloom filters stored alongside the columnar file show
+ * that none of its rows match the equality filters of the query being
+ * planned. Files without bloom filters always match.
+ */
+extern bool file_may_match(const char *dir, const char *file_name);
+
+#endif
@@ -0,0 +1,211 @@
+#include <dirent.h>
+#include <limits.h>
+
+#include "postgres.h"
+
+#include "catalog/pg_type_d.h"
+#include "constants.h"
+#include "export_generation.h"
+#include "file_filter.h"
+#include "file_list.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "slot_cache.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/jsonb.h"
+#include "utils/numeric.h"
+
+#define FILE_LIST_CACHE_NAME "pg_analytica file list cache"
+
+PG_FUNCTION_INFO_V1(list_parquet_files);
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static SlotCache *file_list_cache = NULL;
+// Sizes are in kB.
+static int file_list_cache_size = 1024;
+static int file_list_cache_entry_size = 256;
+
+static int num_file_list_cache_slots(void) {
+  return file_list_cache_size / file_list_cache_entry_size;
+}
+
+static void file_list_shmem_request(void) {
+  if (prev_shmem_request_hook != NULL) {
+    prev_shmem_request_hook();
+  }
+  RequestAddinShmemSpace(slot_cache_shmem_size(
+      num_file_list_cache_slots(), (Size)file_list_cache_entry_size * 1024));
+  slot_cache_request_lock(FILE_LIST_CACHE_NAME);
+}
+
+static void file_list_shmem_startup(void) {
+  if (prev_shmem_startup_hook != NULL) {
+    prev_shmem_startup_hook();
+  }
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  file_list_cache =
+      slot_cache_init(FILE_LIST_CACHE_NAME, num_file_list_cache_slots(),
+                      (Size)file_list_cache_entry_size * 1024);
+  LWLockRelease(AddinShmemInitLock);
+}
+
+void file_list_init(void) {
+  DefineCustomIntVariable(
+      "pg_analytica.file_list_cache_size",
+      "Shared memory used to cache the files of exported tables.", NULL,
+      &file_list_cache_size, 1024, 0, INT_MAX / 1024, PGC_POSTMASTER,
+      GUC_UNIT_KB, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.file_list_cache_entry_size",
+      "Largest list of files of an exported table stored in the cache.", NULL,
+      &file_list_cache_entry_size, 256, 1, INT_MAX / 1024, PGC_POSTMASTER,
+      GUC_UNIT_KB, NULL, NULL, NULL);
+
+  if (!process_shared_preload_libraries_in_progress ||
+      num_file_list_cache_slots() == 0) {
+    return;
+  }
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = file_list_shmem_request;
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = file_list_shmem_startup;
+}
+
+static void populate_file_list_key(StringInfo key, const char *table_name,
+                                   uint64 generation) {
+  appendStringInfo(key, "%u/%s@" UINT64_FORMAT, MyDatabaseId, table_name,
+                   generation);
+}
+
+/*
+ * Appends names of the parquet files in dir to files, each followed by a
+ * NUL byte.
+ */
+static void read_file_list(const char *dir, StringInfo files) {
+  DIR *data_dir = AllocateDir(dir);
+  struct dirent *entry;
+  size_t extension_length = strlen(PARQUET_FILE_EXTENSION);
+  while ((entry = ReadDir(data_dir, dir)) != NULL) {
+    size_t name_length = strlen(entry->d_name);
+    if (name_length <= extension_length ||
+        strcmp(entry->d_name + name_length - extension_length,
+               PARQUET_FILE_EXTENSION) != 0) {
+      continue;
+    }
+    appendBinaryStringInfo(files, entry->d_name, name_length + 1);
+  }
+  FreeDir(data_dir);
+}
+
+void refresh_file_list(const char *table_name, const char *dir) {
+  if (file_list_cache == NULL) {
+    return;
+  }
+  StringInfoData key;
+  initStringInfo(&key);
+  appendStringInfo(&key, "%u/%s@", MyDatabaseId, table_name);
+  // Lists of previous generations can't be looked up anymore.
+  slot_cache_remove_prefix(file_list_cache, key.data, key.len);
+  resetStringInfo(&key);
+  populate_file_list_key(&key, table_name, get_export_generation(table_name));
+
+  StringInfoData files;
+  initStringInfo(&files);
+  read_file_list(dir, &files);
+  // Tables exported to Arrow files have no parquet files to list.
+  if (files.len > 0 &&
+      !slot_cache_store(file_list_cache, key.data, key.len, files.data,
+                        files.len)) {
+    elog(LOG, "Files of %s don't fit in the file list cache", table_name);
+  }
+  pfree(files.data);
+  pfree(key.data);
+}
+
+/*
+ * Populates files with the parquet files of table in dir from the cache,
+ * the directory is read and cached on a miss.
+ */
+static void get_file_list(const char *table_name, const char *dir,
+                          StringInfo files) {
+  if (file_list_cache == NULL) {
+    read_file_list(dir, files);
+    return;
+  }
+  StringInfoData key;
+  initStringInfo(&key);
+  // The generation is read before the directory so that a list read while
+  // files are published is cached under the previous generation.
+  populate_file_list_key(&key, table_name, get_export_generation(table_name));
+  char *cached;
+  Size cached_length;
+  if (slot_cache_lookup(file_list_cache, key.data, key.len, &cached,
+                        &cached_length)) {
+    appendBinaryStringInfo(files, cached, cached_length);
+    pfree(cached);
+  } else {
+    read_file_list(dir, files);
+    slot_cache_store(file_list_cache, key.data, key.len, files->data,
+                     files->len);
+  }
+  pfree(key.data);
+}
+
+/**
+ * Files function of the foreign tables of exported tables. Returns paths of
+ * the parquet files in the "dir" directory of args that may match the
+ * equality filters of the query being planned, or NULL if there are none.
+ */
+Datum list_parquet_files(PG_FUNCTION_ARGS) {
+  Jsonb *args = PG_GETARG_JSONB_P(0);
+  JsonbValue *dir_value =
+      getKeyJsonValueFromContainer(&args->root, "dir", strlen("dir"), NULL);
+  if (dir_value == NULL || dir_value->type != jbvString) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("Files function arguments must include dir")));
+  }
+  char *dir =
+      pnstrdup(dir_value->val.string.val, dir_value->val.string.len);
+  // Data directories are named after the exported table.
+  const char *table_name = last_dir_separator(dir);
+  table_name = table_name == NULL ? dir : table_name + 1;
+  // Foreign tables over a single bucket of a bucketed table pass it along.
+  JsonbValue *bucket_value = getKeyJsonValueFromContainer(
+      &args->root, "bucket", strlen("bucket"), NULL);
+  int bucket = -1;
+  if (bucket_value != NULL && bucket_value->type == jbvNumeric) {
+    bucket = DatumGetInt32(DirectFunctionCall1(
+        numeric_int4, NumericGetDatum(bucket_value->val.numeric)));
+  }
+
+  StringInfoData files;
+  initStringInfo(&files);
+  get_file_list(table_name, dir, &files);
+
+  ArrayBuildState *paths = NULL;
+  for (int offset = 0; offset < files.len;) {
+    const char *file_name = files.data + offset;
+    offset += strlen(file_name) + 1;
+    if ((bucket >= 0 && get_file_bucket(file_name) != bucket) ||
+        !file_may_match(dir, file_name)) {
+      continue;
+    }
+    char path[MAXPGPATH];
+    snprintf(path, sizeof(path), "%s/%s", dir, file_name);
+    paths = accumArrayResult(paths, CStringGetTextDatum(path),
+                             /*disnull=*/false, TEXTOID, CurrentMemoryContext);
+  }
+  pfree(files.data);
+  pfree(dir);
+  if (paths == NULL) {
+    PG_RETURN_NULL();
+  }
+  PG_RETURN_DATUM(makeArrayResult(paths, CurrentMemoryContext));
+}
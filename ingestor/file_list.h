@@ -0,0 +1,22 @@
+#ifndef _FILE_LIST_H
+#define _FILE_LIST_H
+
+#include "postgres.h"
+
+/**
+ * Keeps the parquet files of each exported table in shared memory so that
+ * list_parquet_files, which parquet_fdw calls while planning every query on
+ * an exported table, doesn't need to read the data directory. Lists are
+ * keyed by the export generation of the table and are refreshed by the
+ * exporter when it publishes files. Requires the library to be in
+ * shared_preload_libraries, the data directory is read otherwise.
+ */
+extern void file_list_init(void);
+
+/**
+ * Caches the parquet files of table found in dir, must be called after new
+ * files of the table were published.
+ */
+extern void refresh_file_list(const char *table_name, const char *dir);
+
+#endif
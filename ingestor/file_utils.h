@@ -11,8 +11,10 @@
 
 #include "postgres.h"
 
+#include "miscadmin.h"
+
 /*
- * Populates the root path for the extension data.
+ * Populates the root path for the extension data of the current database.
  * Assumes that buffer has PATH_MAX space available.
  */
 void populate_root_path(char *out, bool relative) {
@@ -24,6 +26,8 @@ void populate_root_path(char *out, bool relative) {
     strcat(out, ".");
   }
   strcat(out, "/pg_analytica/");
+  // Databases may export tables of the same name.
+  sprintf(out + strlen(out), "%u/", MyDatabaseId);
 }
 
 /*
@@ -64,6 +68,46 @@ static void delete_files_in_directory(const char *path) {
   closedir(dir);
 }
 
+/*
+ * Returns true if file name belongs to the file set identified by prefix.
+ * A NULL prefix matches every file.
+ */
+static bool file_has_prefix(const char *file_name, const char *prefix) {
+  if (prefix == NULL) {
+    return true;
+  }
+  return strncmp(file_name, prefix, strlen(prefix)) == 0;
+}
+
+/*
+ * Deletes files in directory whose name starts with prefix.
+ */
+static void delete_files_with_prefix(const char *path, const char *prefix) {
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    perror("opendir");
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char filepath[PATH_MAX];
+    snprintf(filepath, sizeof(filepath), "%s/%s", path, entry->d_name);
+
+    // Skip special entries (".", "..")
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    if (!file_has_prefix(entry->d_name, prefix)) {
+      continue;
+    }
+    if (unlink(filepath) == -1) {
+      elog(LOG, "Failed to delete file %s", filepath);
+      perror("unlink");
+    }
+  }
+  closedir(dir);
+}
+
 int cleanup_table_data(const char *table_name) {
   char temp_path[PATH_MAX];
   char data_path[PATH_MAX];
@@ -16,4 +16,89 @@ SELECT
   floor(random() * 100) + 18 AS age,  -- Generate random ages between 18-117
   random() < 0.5 as is_random,
   random() as rating
-FROM generate_series(1, 10000000);
\ No newline at end of file
+FROM generate_series(1, 10000000);
+-- Small tables exercising every exported type and export option, see
+-- test.sql.
+DROP TABLE IF EXISTS test_orders;
+DROP TABLE IF EXISTS test_customers;
+DROP TABLE IF EXISTS test_events;
+
+CREATE TABLE test_customers (
+  customer_id INTEGER PRIMARY KEY,
+  region TEXT NOT NULL
+);
+
+INSERT INTO test_customers (customer_id, region)
+SELECT
+  id,
+  (ARRAY['north', 'south', 'east', 'west'])[id % 4 + 1]
+FROM generate_series(1, 1000) AS id;
+
+CREATE TABLE test_orders (
+  id SERIAL PRIMARY KEY,
+  customer_id INTEGER NOT NULL,
+  quantity SMALLINT,
+  amount NUMERIC(12, 2),
+  weight FLOAT8,
+  is_gift BOOLEAN,
+  order_uuid UUID,
+  note TEXT,
+  tags TEXT[],
+  details JSONB,
+  payload BYTEA,
+  ordered_on DATE,
+  created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+INSERT INTO test_orders (customer_id, quantity, amount, weight, is_gift,
+                         order_uuid, note, tags, details, payload, ordered_on,
+                         created_at)
+SELECT
+  floor(random() * 1000) + 1,
+  floor(random() * 20),
+  -- Negative, zero and large amounts exercise every numeric layout.
+  CASE WHEN i % 1000 = 0 THEN 0
+       ELSE round((random() * 2000000 - 1000000)::numeric, 2) END,
+  random() * 100,
+  CASE WHEN i % 7 = 0 THEN NULL ELSE random() < 0.5 END,
+  gen_random_uuid(),
+  CASE WHEN i % 5 = 0 THEN NULL ELSE 'note ' || (i % 50) END,
+  ARRAY['tag' || (i % 3), NULL, 'tag' || (i % 11)],
+  jsonb_build_object('line', i, 'rush', i % 2 = 0),
+  decode(md5(i::text), 'hex'),
+  current_date - (i % 365),
+  now()::timestamp - (i % 10000) * interval '1 minute'
+FROM generate_series(1, 20000) AS i;
+
+CREATE INDEX ON test_orders (created_at);
+
+CREATE TABLE test_events (
+  id BIGINT NOT NULL,
+  user_id INTEGER NOT NULL,
+  kind TEXT NOT NULL,
+  value FLOAT8,
+  created_at TIMESTAMP NOT NULL
+) PARTITION BY HASH (user_id);
+
+CREATE TABLE test_events_0 PARTITION OF test_events
+  FOR VALUES WITH (MODULUS 4, REMAINDER 0);
+CREATE TABLE test_events_1 PARTITION OF test_events
+  FOR VALUES WITH (MODULUS 4, REMAINDER 1);
+CREATE TABLE test_events_2 PARTITION OF test_events
+  FOR VALUES WITH (MODULUS 4, REMAINDER 2);
+CREATE TABLE test_events_3 PARTITION OF test_events
+  FOR VALUES WITH (MODULUS 4, REMAINDER 3);
+
+INSERT INTO test_events (id, user_id, kind, value, created_at)
+SELECT
+  i,
+  floor(random() * 5000),
+  -- A rare kind checks that stratified samples keep small groups.
+  CASE WHEN i % 1000 = 0 THEN 'refund'
+       ELSE (ARRAY['view', 'click', 'purchase'])[i % 3 + 1] END,
+  random() * 10,
+  -- Spread over 90 days so that a 30 day window drops rows.
+  now()::timestamp - random() * interval '90 days'
+FROM generate_series(1, 50000) AS i;
+
+CREATE INDEX ON test_events (created_at);
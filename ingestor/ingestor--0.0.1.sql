@@ -8,15 +8,148 @@ CREATE TABLE analytica_exports (
     columns_to_export text[],
     export_frequency_hours int,
     export_status int,
-    chunk_size int
+    chunk_size int,
+    -- Fingerprint of table contents at the last export. Exports are skipped
+    -- while the fingerprint is unchanged.
+    fingerprint text,
+    -- Columns with bloom filters stored alongside each columnar file, used to
+    -- skip files while querying with equality filters.
+    bloom_filter_columns text[],
+    -- Format of the columnar files, 0 for parquet, 1 for Arrow IPC and 2 for
+    -- lz4 compressed Arrow IPC.
+    output_format int DEFAULT 0,
+    -- Layout of the columnar files, 0 for files holding every column and 1
+    -- for a file per column and chunk of rows.
+    layout int DEFAULT 0,
+    -- Rows are written to num_of_buckets files per chunk by the hash of
+    -- bucket_column, see analytica_bucket.
+    bucket_column text,
+    num_of_buckets int DEFAULT 0,
+    -- Fraction of rows kept in the sample relation analytica_{table}_sample
+    -- and the column it is stratified on, refreshed with every export.
+    sample_rate float8 DEFAULT 0,
+    sample_strata_column text,
+    -- Columns with HyperLogLog sketches of their distinct values stored
+    -- alongside each columnar file, see analytica_approx_count_distinct.
+    distinct_count_columns text[],
+    -- SELECT statement exported instead of a table, table_name then only
+    -- names the export. See register_query_export.
+    source_query text,
+    -- Column of the query whose rows are only exported once, and the
+    -- largest value of it or of fresh_column exported so far.
+    incremental_key text,
+    incremental_watermark text,
+    -- Column of an append-only table whose rows past the watermark of the
+    -- last export are read from the table by analytica_{table}_fresh.
+    fresh_column text,
+    -- Predicate rows are exported under, and the column and interval of the
+    -- rolling window exported rows are limited to. Rows and partitions that
+    -- age out of the window are dropped from the files.
+    row_filter text,
+    window_column text,
+    window_interval interval,
+    -- Role that registered the export. Queries, filters and tables of the
+    -- export are read as this role rather than the export worker's role.
+    registered_by oid
 );
 
+-- Table to store export state for leaf partitions of partitioned tables.
+-- Partitions are named by their oid, which also prefixes their files.
+-- Partitions whose fingerprint is unchanged are skipped in subsequent exports.
+CREATE TABLE analytica_export_partitions (
+    table_name text,
+    partition_name text,
+    fingerprint text,
+    last_run_completed TIMESTAMP WITH TIME ZONE,
+    PRIMARY KEY (table_name, partition_name)
+);
+
+-- Encodings picked for the columns of parquet files by sampling the first row
+-- group of each export, with the size of the sampled rows using the picked and
+-- the default encoding.
+CREATE TABLE analytica_column_encodings (
+    table_name text,
+    column_name text,
+    dictionary boolean,
+    compression text,
+    sampled_bytes bigint,
+    sampled_default_bytes bigint,
+    sampled_at TIMESTAMP WITH TIME ZONE,
+    PRIMARY KEY (table_name, column_name)
+);
+
+-- Bytes saved by the picked encodings on the sampled rows of each table.
+CREATE VIEW analytica_encoding_savings AS
+SELECT table_name,
+       sum(sampled_default_bytes) AS sampled_default_bytes,
+       sum(sampled_bytes) AS sampled_bytes,
+       sum(sampled_default_bytes - sampled_bytes) AS bytes_saved
+FROM analytica_column_encodings
+GROUP BY table_name;
+
+-- Bucket of a row of a bucketed table. Values are hashed by their text form
+-- so keys of different integer types land in the same bucket.
+CREATE OR REPLACE FUNCTION analytica_bucket(value anyelement, num_of_buckets int)
+RETURNS int
+AS $$ SELECT (hashtext(value::text) & 2147483647) % num_of_buckets $$
+LANGUAGE SQL IMMUTABLE STRICT PARALLEL SAFE;
+
 -- Register a postgres table for export
 CREATE OR REPLACE FUNCTION register_table_export(
     table_name text, 
     columns_to_export text[], 
     export_frequency_hours int, 
-    chunk_size int DEFAULT 100000)
+    chunk_size int DEFAULT 100000,
+    bloom_filter_columns text[] DEFAULT '{}',
+    -- One of parquet, arrow or arrow_lz4
+    output_format text DEFAULT 'parquet',
+    -- One of rows or column_groups
+    layout text DEFAULT 'rows',
+    -- Exported column to bucket rows on, tables joined on it should use the
+    -- same number of buckets.
+    bucket_column text DEFAULT '',
+    num_of_buckets int DEFAULT 0,
+    -- Fraction of rows written to analytica_{table_name}_sample, optionally
+    -- keeping rows of every value of sample_strata_column.
+    sample_rate float8 DEFAULT 0,
+    sample_strata_column text DEFAULT '',
+    distinct_count_columns text[] DEFAULT '{}',
+    -- Increasing exported column, such as a serial id or insertion time,
+    -- that analytica_{table_name}_fresh finds rows added since the last
+    -- export by. It should be indexed.
+    fresh_column text DEFAULT '',
+    -- Boolean SQL expression over columns of the table, only rows it holds
+    -- for are exported.
+    row_filter text DEFAULT '',
+    -- Date or timestamp column limiting exported rows to those within
+    -- window_interval of each export. It should be indexed.
+    window_column text DEFAULT '',
+    window_interval interval DEFAULT '0')
+RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+-- Register the result of a SELECT statement, such as a join of several
+-- tables or a view, for export as analytica_{table_name}. Columns of the
+-- result must have distinct names. When incremental_key is set only rows
+-- with a larger key than any exported before are exported, and added to
+-- the files of earlier exports.
+CREATE OR REPLACE FUNCTION register_query_export(
+    table_name text,
+    query text,
+    export_frequency_hours int,
+    chunk_size int DEFAULT 100000,
+    -- One of parquet, arrow or arrow_lz4
+    output_format text DEFAULT 'parquet',
+    incremental_key text DEFAULT '')
+RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+-- Change the columns exported for a registered table.
+CREATE OR REPLACE FUNCTION set_export_columns(
+    table_name text,
+    columns_to_export text[])
 RETURNS bigint
 AS 'MODULE_PATHNAME'
 LANGUAGE C STRICT VOLATILE;
@@ -34,14 +167,39 @@ RETURNS pg_catalog.int4 STRICT
 AS 'MODULE_PATHNAME'
 LANGUAGE C;
 
--- function to list all parquet iles in data directory for table
+-- Returns false if bloom filters of a columnar file rule out the equality
+-- filters of the query being planned.
+CREATE OR REPLACE FUNCTION analytica_file_may_match(dir text, filename text)
+RETURNS bool
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+-- Returns rows of a table exported to Arrow IPC files. Exported tables are
+-- queried through the analytica_{table_name} view created by the exporter,
+-- the function requires SELECT on that view.
+-- Bucketed tables can be scanned a bucket at a time, -1 scans all buckets.
+CREATE OR REPLACE FUNCTION analytica_scan(table_name text, bucket int DEFAULT -1)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+-- Estimates the number of distinct values of a column of an exported table
+-- from the sketches stored with its columnar files, without reading them.
+-- Partitioned tables can be restricted to some partitions, such as those of
+-- a time range. Returns NULL if the column isn't sketched. Requires SELECT on
+-- analytica_{table_name}.
+CREATE OR REPLACE FUNCTION analytica_approx_count_distinct(
+    table_name text,
+    column_name text,
+    partitions text[] DEFAULT '{}')
+RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+-- Files function of the foreign tables of exported tables. Lists parquet
+-- files of the table that may match the equality filters of the query being
+-- planned, file lists are cached in shared memory.
 CREATE OR REPLACE FUNCTION list_parquet_files(args jsonb)
-returns text[] as
-$$
-begin
-    return array_agg(args->>'dir' || '/' || filename)
-           from pg_ls_dir(args->>'dir') as files(filename)
-           where filename ~~ '%.parquet';
-end
-$$
-language plpgsql;
\ No newline at end of file
+RETURNS text[]
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
\ No newline at end of file
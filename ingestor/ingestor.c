@@ -13,40 +13,98 @@
 
 /* These are always necessary for a bgworker */
 #include "miscadmin.h"
+#include "optimizer/optimizer.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/interrupt.h"
 #include "storage/ipc.h"
 #include "storage/latch.h"
+#include "storage/bufmgr.h"
+#include "storage/fd.h"
+#include "storage/lmgr.h"
 #include "storage/lwlock.h"
 #include "storage/proc.h"
 #include "storage/shmem.h"
 
 /* these headers are used by this particular worker's code */
 #include "access/xact.h"
+#include "access/xlog.h"
+#include "arrow_scan.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_namespace_d.h"
+#include "bloom_filter.h"
+#include "checkpoint.h"
+#include "column_builder.h"
+#include "column_encoding.h"
+#include "column_groups.h"
+#include "column_threads.h"
+#include "column_types.h"
 #include "commands/dbcommands.h"
 #include "constants.h"
+#include "distinct_sketch.h"
 #include "executor/spi.h"
 #include "export_entry.h"
+#include "export_generation.h"
+#include "export_state.h"
+#include "export_stats.h"
+#include "export_throttle.h"
+#include "file_filter.h"
+#include "file_list.h"
 #include "file_utils.h"
+#include "launcher.h"
 #include "fmgr.h"
 #include "lib/stringinfo.h"
 #include "pgstat.h"
+#include "result_cache.h"
 #include "tcop/utility.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/plancache.h"
 #include "utils/snapmgr.h"
 #include "utils/wait_event.h"
 
 PG_MODULE_MAGIC;
 
-PG_FUNCTION_INFO_V1(ingestor_launch);
-
-PGDLLEXPORT void ingestor_main(void) pg_attribute_noreturn();
+PGDLLEXPORT void ingestor_main(Datum main_arg) pg_attribute_noreturn();
 
 #define MAX_COLUMN_NAME_CHARS 100
 #define MAX_SUPPORTED_COLUMNS 100
 #define MAX_EXPORT_ENTRIES 10
 #define PARQUET_ROW_GROUP_CHUNK_SIZE 10000
+#define MAX_RELATION_NAME_CHARS (2 * NAMEDATALEN + 5)
+#define MAX_FINGERPRINT_CHARS 64
+// Length of data directory names of sample relations.
+#define MAX_SAMPLE_NAME_CHARS (NAMEDATALEN + sizeof(SAMPLE_DATA_SUFFIX))
+// Views combining exported rows with rows added since are named
+// analytica_{table_name}_fresh.
+#define FRESH_RELATION_SUFFIX "_fresh"
+// Rows of each value of the strata column kept by a stratified sample at
+// least, so that rare groups remain in the sample.
+#define MIN_STRATUM_SAMPLE_ROWS 100
+// Values of the strata column tracked while sampling, rows of further
+// values are only sampled at the sample rate. Each tracked value holds up
+// to MIN_STRATUM_SAMPLE_ROWS rows in memory.
+#define MAX_SAMPLE_STRATA 1000
+// Used to size export chunks for relations that haven't been analyzed.
+#define DEFAULT_TUPLES_PER_BLOCK 100
+// Relations are exported through a covering index only when at least this
+// fraction of their heap pages is all-visible, other pages are still read
+// from the heap.
+#define MIN_ALL_VISIBLE_FRACTION 0.9
+// Covering indexes with more key columns aren't used, so that the last
+// exported key fits in the checkpoint.
+#define MAX_COVERING_INDEX_KEYS 8
+
+/*
+ * SQL expression computing a cheap fingerprint of a relation's contents
+ * from pg_class c and pg_stat_all_tables s. The relfilenode changes on
+ * TRUNCATE and table rewrites, the relation size changes as rows are added
+ * and the cumulative tuple modification counters change with every write.
+ */
+#define RELATION_FINGERPRINT_SQL                                               \
+  "c.relfilenode || ':' || pg_relation_size(c.oid) || ':' || "                 \
+  "coalesce(s.n_tup_ins + s.n_tup_upd + s.n_tup_del, 0)"
 
 /** Arrow functionality */
 #define ASSIGN_IF_NOT_NULL(check_ptr, dest_ptr)                                \
@@ -63,11 +121,46 @@ PGDLLEXPORT void ingestor_main(void) pg_attribute_noreturn();
     }                                                                          \
   }
 
-static char source_database[] = "postgres";
-static char *source_database_role = NULL;
-// Wait 5min after a successfull export run before starting again.
-// This param can be tuned using GUC variable.
-static int ingestor_naptime_sec = 300;
+// Set when the worker exports on a hot standby, export state is then kept
+// in sidecar files instead of the extension's tables.
+static bool is_standby_export = false;
+
+/* Role and security context of the worker while running as another role. */
+typedef struct _SavedRole {
+  Oid user_id;
+  int sec_context;
+} SavedRole;
+
+/*
+ * Runs the following statements as role, the role registering an export, so
+ * that SQL supplied at registration can't use the privileges of the worker.
+ * Entries registered before roles were recorded keep the worker's role.
+ */
+static void switch_to_role(Oid role, SavedRole *saved) {
+  GetUserIdAndSecContext(&saved->user_id, &saved->sec_context);
+  if (!OidIsValid(role)) {
+    return;
+  }
+  SetUserIdAndSecContext(role, saved->sec_context |
+                                   SECURITY_LOCAL_USERID_CHANGE |
+                                   SECURITY_RESTRICTED_OPERATION);
+}
+
+/* Returns to the role saved by switch_to_role. */
+static void restore_role(const SavedRole *saved) {
+  SetUserIdAndSecContext(saved->user_id, saved->sec_context);
+}
+
+void _PG_init(void) {
+  file_filter_init();
+  export_generation_init();
+  result_cache_init();
+  column_cache_init();
+  file_list_init();
+  launcher_init();
+  export_throttle_init();
+  column_threads_init();
+}
 
 static void list_current_directories() {
   DIR *dir;
@@ -89,135 +182,30 @@ static void list_current_directories() {
   closedir(dir);
 }
 
-GArrowArray *create_int64_array(const int64 *data, int num_values,
-                                GError *error) {
-  GError *inner_error = NULL;
-  GArrowInt64ArrayBuilder *int_array_builder;
-  int_array_builder = garrow_int64_array_builder_new();
-
-  for (int i = 0; i < num_values; i++) {
-    int64 value = data[i];
-    elog(LOG, "Adding value %d to arrow array", value);
-    garrow_int64_array_builder_append_value(int_array_builder, value,
-                                            &inner_error);
-    LOG_ARROW_ERROR(inner_error);
-    ASSIGN_IF_NOT_NULL(inner_error, error);
-  }
-  GArrowArray *int_array = garrow_array_builder_finish(
-      GARROW_ARRAY_BUILDER(int_array_builder), &inner_error);
-  LOG_ARROW_ERROR(inner_error);
-  ASSIGN_IF_NOT_NULL(inner_error, error);
-  g_object_unref(int_array_builder);
-
-  return int_array;
-}
-
-GArrowArray *create_timestamp_array(const int64 *data, int num_values,
-                                    GError *error) {
-  GError *inner_error = NULL;
-  GArrowTimestampArrayBuilder *timestamp_array_builder;
-  GTimeZone *time_zone = g_time_zone_new_utc();
-  GArrowTimestampDataType *timestamp_data_type =
-      garrow_timestamp_data_type_new(GARROW_TIME_UNIT_SECOND, time_zone);
-  timestamp_array_builder =
-      garrow_timestamp_array_builder_new(timestamp_data_type);
-
-  for (int i = 0; i < num_values; i++) {
-    int64 value = data[i];
-    elog(LOG, "Adding value %ld to arrow array", value);
-    garrow_timestamp_array_builder_append(timestamp_array_builder, value,
-                                          &inner_error);
-    LOG_ARROW_ERROR(inner_error);
-    ASSIGN_IF_NOT_NULL(inner_error, error);
-  }
-  GArrowArray *int_array = garrow_array_builder_finish(
-      GARROW_ARRAY_BUILDER(timestamp_array_builder), &inner_error);
-  LOG_ARROW_ERROR(inner_error);
-  ASSIGN_IF_NOT_NULL(inner_error, error);
-
-  g_object_unref(timestamp_array_builder);
-  g_object_unref(timestamp_data_type);
-
-  return int_array;
-}
-
-GArrowArray *create_double_array(const double *data, int num_values,
-                                 GError *error) {
-  GError *inner_error = NULL;
-  GArrowDoubleArrayBuilder *double_array_builder;
-  double_array_builder = garrow_double_array_builder_new();
-
-  for (int i = 0; i < num_values; i++) {
-    double value = data[i];
-    elog(LOG, "Adding value %f to arrow array", value);
-    garrow_double_array_builder_append_value(double_array_builder, value,
-                                             &inner_error);
-    LOG_ARROW_ERROR(inner_error);
-    ASSIGN_IF_NOT_NULL(inner_error, error);
-  }
-  GArrowArray *double_array = garrow_array_builder_finish(
-      GARROW_ARRAY_BUILDER(double_array_builder), &inner_error);
-  LOG_ARROW_ERROR(inner_error);
-  ASSIGN_IF_NOT_NULL(inner_error, error);
-  g_object_unref(double_array_builder);
-
-  return double_array;
-}
-
-GArrowArray *create_bool_array(const int16 *data, int num_values,
-                               GError *error) {
-  GError *inner_error = NULL;
-  GArrowBooleanArrayBuilder *bool_array_builder;
-  bool_array_builder = garrow_boolean_array_builder_new();
-
-  for (int i = 0; i < num_values; i++) {
-    bool value = data[i] == 1 ? true : false;
-    elog(LOG, "Adding value %d to arrow array", value);
-    garrow_boolean_array_builder_append_value(bool_array_builder, value,
-                                              &inner_error);
-    LOG_ARROW_ERROR(inner_error);
-    ASSIGN_IF_NOT_NULL(inner_error, error);
-  }
-  GArrowArray *bool_array = garrow_array_builder_finish(
-      GARROW_ARRAY_BUILDER(bool_array_builder), &inner_error);
-  LOG_ARROW_ERROR(inner_error);
-  ASSIGN_IF_NOT_NULL(inner_error, error);
-  g_object_unref(bool_array_builder);
-
-  return bool_array;
-}
-
-GArrowArray *create_string_array(const char **data, int num_values,
-                                 GError *error) {
-  GError *inner_error = NULL;
-  GArrowStringArrayBuilder *string_array_builder;
-  string_array_builder = garrow_string_array_builder_new();
-
-  for (int i = 0; i < num_values; i++) {
-    char *value = data[i];
-    if (value == 0) {
-      value = "";
-    }
-    elog(LOG, "Adding value %s to arrow array", value);
-    garrow_string_array_builder_append_value(string_array_builder, value,
-                                             &inner_error);
-    ASSIGN_IF_NOT_NULL(inner_error, error);
-  }
-
-  GArrowArray *string_array = garrow_array_builder_finish(
-      GARROW_ARRAY_BUILDER(string_array_builder), &inner_error);
-  LOG_ARROW_ERROR(inner_error);
-  ASSIGN_IF_NOT_NULL(inner_error, error);
-  g_object_unref(string_array_builder);
-  return string_array;
-}
-
 /* Stores information about column names and column types. */
 typedef struct _ColumnInfo {
   char column_name[MAX_COLUMN_NAME_CHARS];
   Oid column_type;
+  int32 column_typmod;
 } ColumnInfo;
 
+/**
+ * Returns column info for column_name. Columns to export are validated at
+ * registration so the column is expected to exist.
+ */
+static const ColumnInfo *find_column_info(const ColumnInfo *column_info,
+                                          int overall_num_columns,
+                                          const char *column_name) {
+  for (int i = 0; i < overall_num_columns; i += 1) {
+    if (strcmp(column_info[i].column_name, column_name) == 0) {
+      return &column_info[i];
+    }
+  }
+  ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+                  errmsg("Column %s not found for export", column_name)));
+  return NULL;
+}
+
 /**
  * Returns list of columns and type of each column.
  * num_of_columns is populated with columns in the table.
@@ -227,14 +215,16 @@ static ColumnInfo *get_column_types(const char *table_name,
                                     int *num_of_columns) {
   StringInfoData buf;
   initStringInfo(&buf);
-  // TODO - ensure column schema is deterministic even after new columns are
-  // added
+  // Columns are only looked up by name, the exported schema follows the
+  // order of columns_to_export so added columns never reorder it.
   appendStringInfo(&buf,
-                   "SELECT attname, atttypid FROM pg_attribute WHERE attrelid "
-                   "= '%s'::regclass AND attnum > 0;",
-                   table_name);
+                   "SELECT attname, atttypid, atttypmod FROM pg_attribute "
+                   "WHERE attrelid = %s::regclass AND attnum > 0 "
+                   "AND NOT attisdropped ORDER BY attnum;",
+                   quote_literal_cstr(table_name));
   int status = SPI_execute(buf.data, true, 0);
-  elog(LOG, "Executed SPI_execute query %s with status %d", buf.data, status);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
   if (status != SPI_OK_SELECT) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
                     errmsg("Failed to deduce column types")));
@@ -255,8 +245,12 @@ static ColumnInfo *get_column_types(const char *table_name,
     Oid column_type_value = DatumGetObjectId(column_type_data);
     elog(LOG, "Acquired column type as %d", column_type_value);
 
+    Datum column_typmod_data =
+        SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 3, &isnull);
+
     strcpy(column_info.column_name, column_name_value);
     column_info.column_type = column_type_value;
+    column_info.column_typmod = DatumGetInt32(column_typmod_data);
 
     columns[i] = column_info;
   }
@@ -265,8 +259,58 @@ static ColumnInfo *get_column_types(const char *table_name,
   return columns;
 }
 
+/**
+ * Returns columns of the result of query, planned as role, and the type of
+ * each column, read from the tuple descriptor of the query.
+ * num_of_columns is populated with columns in the result.
+ * Caller should free the returned pointer.
+ */
+static ColumnInfo *get_query_column_types(const char *query, Oid role,
+                                          int *num_of_columns) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT * FROM (%s) AS " QUERY_SOURCE_ALIAS " LIMIT 0;",
+                   query);
+  SavedRole saved_role;
+  switch_to_role(role, &saved_role);
+  int status = SPI_execute(buf.data, true, 0);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to deduce column types")));
+  }
+  TupleDesc tupdesc = SPI_tuptable->tupdesc;
+  ColumnInfo *columns = palloc_array(ColumnInfo, tupdesc->natts);
+  for (int i = 0; i < tupdesc->natts; i += 1) {
+    Form_pg_attribute attribute = TupleDescAttr(tupdesc, i);
+    strlcpy(columns[i].column_name, NameStr(attribute->attname),
+            MAX_COLUMN_NAME_CHARS);
+    columns[i].column_type = attribute->atttypid;
+    columns[i].column_typmod = attribute->atttypmod;
+  }
+  *num_of_columns = tupdesc->natts;
+  pfree(buf.data);
+  return columns;
+}
+
+/**
+ * Returns columns of the table or query exported by entry.
+ * Caller should free the returned pointer.
+ */
+static ColumnInfo *get_export_column_types(const ExportEntry *entry,
+                                           int *num_of_columns) {
+  if (entry->source_query != NULL) {
+    return get_query_column_types(entry->source_query, entry->registered_by,
+                                  num_of_columns);
+  }
+  return get_column_types(entry->table_name, num_of_columns);
+}
+
 /*
- * Creates Arrow schema for the table for basic types.
+ * Creates Arrow schema for the exported columns of the table.
  * Caller is reponsible for freeing schema memory.
  */
 static GArrowSchema *create_table_schema(const ColumnInfo *column_info,
@@ -281,316 +325,704 @@ static GArrowSchema *create_table_schema(const ColumnInfo *column_info,
   temp = garrow_schema_new(fields);
   for (int i = 0; i < entry->num_of_columns; i += 1) {
     const char *column_name = entry->columns_to_export[i];
-    // TODO - move column type deduction to util
-    Oid column_type;
-    bool column_type_found = false;
-    for (int j = 0; j < overall_num_columns; j += 1) {
-      if (strcmp(column_info[j].column_name, column_name) == 0) {
-        column_type = column_info[j].column_type;
-        column_type_found = true;
-        break;
-      }
-    }
-    Assert(column_type_found);
+    const ColumnInfo *column =
+        find_column_info(column_info, overall_num_columns, column_name);
     elog(LOG, "Adding column %s to schema with type %d", column_name,
-         column_type);
-    switch (column_type) {
-    case INT2OID:
-    case INT4OID:
-    case INT8OID: {
-      GArrowDataType *int_type = garrow_int64_data_type_new();
-      GArrowField *int_field = garrow_field_new(column_name, int_type);
-
-      temp = garrow_schema_add_field(temp, i, int_field, &error);
+         column->column_type);
+    GArrowDataType *data_type =
+        arrow_data_type_for_column(column->column_type, column->column_typmod);
+    if (data_type == NULL) {
+      // Types are validated at registration, the column type must have been
+      // altered since.
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("Column %s of type %s is not supported for export",
+                      column_name,
+                      format_type_with_typemod(column->column_type,
+                                               column->column_typmod))));
+    }
+    GArrowField *field = garrow_field_new(column_name, data_type);
+    GArrowSchema *schema_with_field =
+        garrow_schema_add_field(temp, i, field, &error);
+    LOG_ARROW_ERROR(error);
+
+    g_object_unref(temp);
+    temp = schema_with_field;
+    g_object_unref(field);
+    g_object_unref(data_type);
+  }
+  const char *schema_str = garrow_schema_to_string(temp);
+  elog(LOG, "Created schema with string %s", schema_str);
+  return temp;
+}
 
-      g_object_unref(int_field);
-      g_object_unref(int_type);
-      break;
+/**
+ * Returns Arrow table of the arrays built for the exported columns.
+ * String columns may be dictionary encoded so the schema of the table is
+ * derived from the types of the arrays that were built.
+ * Caller is reponsible for freeing table memory.
+ */
+static GArrowTable *create_arrow_table(GArrowSchema *schema,
+                                       GArrowArray **arrow_arrays,
+                                       int num_export_columns) {
+  GError *error = NULL;
+  GArrowSchema *chunk_schema = g_object_ref(schema);
+  for (int i = 0; i < num_export_columns; i += 1) {
+    GArrowField *field = garrow_schema_get_field(chunk_schema, i);
+    GArrowDataType *array_type =
+        garrow_array_get_value_data_type(arrow_arrays[i]);
+    GArrowDataType *field_type = garrow_field_get_data_type(field);
+    if (!garrow_data_type_equal(array_type, field_type)) {
+      GArrowField *chunk_field =
+          garrow_field_new(garrow_field_get_name(field), array_type);
+      GArrowSchema *replaced_schema =
+          garrow_schema_replace_field(chunk_schema, i, chunk_field, &error);
+      LOG_ARROW_ERROR(error);
+      g_object_unref(chunk_field);
+      g_object_unref(chunk_schema);
+      chunk_schema = replaced_schema;
     }
-    case FLOAT4OID:
-    case FLOAT8OID: {
-      GArrowDataType *precision_type = garrow_double_data_type_new();
-      GArrowField *precision_field =
-          garrow_field_new(column_name, precision_type);
+    g_object_unref(array_type);
+    g_object_unref(field);
+  }
+  GArrowTable *table = garrow_table_new_arrays(chunk_schema, arrow_arrays,
+                                               num_export_columns, &error);
+  LOG_ARROW_ERROR(error);
+  g_object_unref(chunk_schema);
+  return table;
+}
 
-      temp = garrow_schema_add_field(temp, i, precision_field, &error);
+/*
+ * Returns extension of the columnar files of table.
+ */
+static const char *get_file_extension(const ExportEntry *entry) {
+  if (entry->output_format == OUTPUT_FORMAT_PARQUET) {
+    return PARQUET_FILE_EXTENSION;
+  } else if (entry->output_format == OUTPUT_FORMAT_ARROW_LZ4) {
+    return COMPRESSED_ARROW_FILE_EXTENSION;
+  }
+  return ARROW_FILE_EXTENSION;
+}
 
-      g_object_unref(precision_field);
-      g_object_unref(precision_type);
-      break;
-    }
-    case TEXTOID:
-    case VARCHAROID: {
-      GArrowDataType *string_type = garrow_string_data_type_new();
-      GArrowField *string_field = garrow_field_new(column_name, string_type);
+/*
+ * Populates the path of a columnar file in the temp directory for table.
+ * Files are named {file_prefix}{chunk_num}.{extension} so that files
+ * belonging to different partitions can be told apart.
+ * Assumes that buffer has PATH_MAX space available.
+ */
+static void populate_temp_file_path(const ExportEntry *entry,
+                                    const char *file_prefix, int chunk_num,
+                                    char *out) {
+  char file_name[PATH_MAX];
+  populate_temp_path_for_table(entry->table_name, out, /*relative=*/true);
+  sprintf(file_name, "/%s%d%s", file_prefix == NULL ? "" : file_prefix,
+          chunk_num, get_file_extension(entry));
+  strcat(out, file_name);
+}
 
-      temp = garrow_schema_add_field(temp, i, string_field, &error);
+/*
+ * Populates name of the data directory of the sample relation of table.
+ * Assumes that buffer has MAX_SAMPLE_NAME_CHARS space available.
+ */
+static void populate_sample_name(const char *table_name, char *out) {
+  snprintf(out, MAX_SAMPLE_NAME_CHARS, "%s" SAMPLE_DATA_SUFFIX, table_name);
+}
 
-      g_object_unref(string_field);
-      g_object_unref(string_type);
-      break;
-    }
-    case BOOLOID: {
-      GArrowDataType *bool_type = garrow_boolean_data_type_new();
-      GArrowField *bool_field = garrow_field_new(column_name, bool_type);
+/*
+ * Populates the path of the file of bucket for the columnar file at path,
+ * named {chunk}#{bucket}.{extension}.
+ * Assumes that buffer has PATH_MAX space available.
+ */
+static void populate_bucket_file_path(const ExportEntry *entry,
+                                      const char *path, int bucket,
+                                      char *out) {
+  int extension_start = strlen(path) - strlen(get_file_extension(entry));
+  snprintf(out, PATH_MAX, "%.*s%c%d%s", extension_start, path,
+           BUCKET_SEPARATOR, bucket, path + extension_start);
+}
 
-      temp = garrow_schema_add_field(temp, i, bool_field, &error);
+/*
+ * Populates the path of a chunk of the column group layout in the temp
+ * directory for table. The files of its columns are named after it, see
+ * populate_column_group_file_path.
+ * Assumes that buffer has PATH_MAX space available.
+ */
+static void populate_column_group_chunk_path(const ExportEntry *entry,
+                                             int64 start_block,
+                                             int64 end_block, char *out) {
+  char chunk_name[NAMEDATALEN];
+  populate_temp_path_for_table(entry->table_name, out, /*relative=*/true);
+  snprintf(chunk_name, sizeof(chunk_name), "/" INT64_FORMAT "-" INT64_FORMAT,
+           start_block, end_block);
+  strcat(out, chunk_name);
+}
 
-      g_object_unref(bool_field);
-      g_object_unref(bool_type);
-      break;
-    }
-    case TIMESTAMPOID: {
-      GTimeZone *time_zone = g_time_zone_new_utc();
-      GArrowDataType *timestamp_type =
-          garrow_timestamp_data_type_new(GARROW_TIME_UNIT_SECOND, time_zone);
-      GArrowField *timestamp_field =
-          garrow_field_new(column_name, timestamp_type);
+/*
+ * Populates the path of the file of column_name for the chunk at
+ * chunk_path, named {column}@{first block}-{end block}.{extension}.
+ * Assumes that buffer has PATH_MAX space available.
+ */
+static void populate_column_group_file_path(const ExportEntry *entry,
+                                            const char *chunk_path,
+                                            const char *column_name,
+                                            char *out) {
+  const char *chunk_name = strrchr(chunk_path, '/') + 1;
+  snprintf(out, PATH_MAX, "%.*s%s%c%s%s", (int)(chunk_name - chunk_path),
+           chunk_path, column_name, COLUMN_GROUP_SEPARATOR, chunk_name,
+           get_file_extension(entry));
+}
 
-      temp = garrow_schema_add_field(temp, i, timestamp_field, &error);
+/*
+ * Writes arrow table as an Arrow IPC file which can be memory mapped and
+ * read without decoding. Record batches hold PARQUET_ROW_GROUP_CHUNK_SIZE
+ * rows like parquet row groups.
+ */
+static void write_arrow_ipc_file(const char *path, GArrowTable *table,
+                                 bool compress) {
+  GError *error = NULL;
+  GArrowFileOutputStream *output =
+      garrow_file_output_stream_new(path, /*append=*/FALSE, &error);
+  LOG_ARROW_ERROR(error);
+  if (output == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not create file \"%s\"", path)));
+  }
+  GArrowFeatherWriteProperties *properties =
+      garrow_feather_write_properties_new();
+  g_object_set(properties, "compression",
+               compress ? GARROW_COMPRESSION_TYPE_LZ4_FRAME
+                        : GARROW_COMPRESSION_TYPE_UNCOMPRESSED,
+               "chunk-size", (gint64)PARQUET_ROW_GROUP_CHUNK_SIZE, NULL);
+  gboolean is_write_successfull = garrow_table_write_as_feather(
+      table, GARROW_OUTPUT_STREAM(output), properties, &error);
+  LOG_ARROW_ERROR(error);
+  gboolean file_closed = garrow_file_close(GARROW_FILE(output), &error);
+  LOG_ARROW_ERROR(error);
+  if (!is_write_successfull || !file_closed) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not write file \"%s\"", path)));
+  }
+  g_object_unref(properties);
+  g_object_unref(output);
+}
 
-      g_object_unref(timestamp_field);
-      g_object_unref(timestamp_type);
-      break;
+/*
+ * Writes every column of arrow table to its own Arrow IPC file for the
+ * chunk at chunk_path. Returns the number of bytes written.
+ */
+static int64 write_column_group_files(const ExportEntry *entry,
+                                      const char *chunk_path,
+                                      GArrowTable *table) {
+  GError *error = NULL;
+  int64 num_of_bytes = 0;
+  GArrowSchema *schema = garrow_table_get_schema(table);
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    GArrowField *field = garrow_schema_get_field(schema, i);
+    GList *fields = g_list_append(NULL, field);
+    GArrowSchema *column_schema = garrow_schema_new(fields);
+    GArrowChunkedArray *column_data = garrow_table_get_column_data(table, i);
+    GArrowTable *column_table = garrow_table_new_chunked_arrays(
+        column_schema, &column_data, 1, &error);
+    LOG_ARROW_ERROR(error);
+    char path[PATH_MAX];
+    populate_column_group_file_path(entry, chunk_path,
+                                    entry->columns_to_export[i], path);
+    if (column_table == NULL) {
+      ereport(ERROR, (errcode_for_file_access(),
+                      errmsg("could not write file \"%s\"", path)));
     }
-    default:
-      elog(LOG, "Column type %s not yet supported in columnar schema",
-           column_type);
-      break;
+    write_arrow_ipc_file(
+        path, column_table,
+        /*compress=*/entry->output_format == OUTPUT_FORMAT_ARROW_LZ4);
+    struct stat file_stat;
+    if (stat(path, &file_stat) == 0) {
+      num_of_bytes += file_stat.st_size;
     }
+    g_object_unref(column_table);
+    g_object_unref(column_data);
+    g_object_unref(column_schema);
+    g_list_free(fields);
+    g_object_unref(field);
   }
-  const char *schema_str = garrow_schema_to_string(temp);
-  elog(LOG, "Created schema with string %s", schema_str);
-  return temp;
+  g_object_unref(schema);
+  return num_of_bytes;
 }
 
-static int64 *create_int64_data_array(Datum *data, int num_values) {
-  int64 *int_data = (int64 *)palloc(num_values * sizeof(int64));
-  for (int i = 0; i < num_values; i += 1) {
-    if (data[i] == ULONG_MAX) {
-      int_data[i] = 0;
-    } else {
-      int_data[i] = DatumGetInt64(data[i]);
-    }
+/**
+ * Receives rows of a chunk query from the executor and appends the exported
+ * attributes straight into Arrow column builders, so rows of the chunk are
+ * never materialized in an SPI tuple table.
+ *
+ * Parquet files are written a row group at a time, keeping at most
+ * PARQUET_ROW_GROUP_CHUNK_SIZE rows in memory. Arrow IPC files can only
+ * hold a single dictionary per column so their columns are built for the
+ * whole chunk and written once it's finished.
+ */
+typedef struct _ChunkWriter {
+  DestReceiver pub;
+  const ExportEntry *entry;
+  GArrowSchema *schema;
+  const ColumnInfo **columns;
+  ColumnBuilder *builders;
+  // String columns of a parquet file keep the encoding picked by the first
+  // row group so that all row groups share the file schema.
+  bool *use_dictionary;
+  int64 num_of_rows;
+  int64 num_of_buffered_rows;
+  // Size of the file when it was last written, charged to the throttle.
+  int64 num_of_written_bytes;
+  char path[PATH_MAX];
+  // Opened when the first row group is flushed.
+  GParquetArrowFileWriter *parquet_writer;
+  // Index of each bloom filter column among the exported columns.
+  int *bloom_filter_attributes;
+  ColumnBloomFilter *bloom_filters;
+  int num_of_bloom_filters;
+  // Index of each distinct count column among the exported columns.
+  int *distinct_sketch_attributes;
+  ColumnDistinctSketch *distinct_sketches;
+  int num_of_distinct_sketches;
+  // Sample of rows for planner statistics of the exported table.
+  ExportSample *sample;
+  // Encodings of the columns of parquet files, picked from the first row
+  // group of the export.
+  ColumnEncodings *encodings;
+  // Picks rows for the sample relation of the table, NULL if it has none.
+  struct _SampleWriter *sampler;
+  // Context outliving the chunk query, state of the writer lives in it.
+  MemoryContext context;
+} ChunkWriter;
+
+static void chunk_writer_init_builders(ChunkWriter *writer) {
+  for (int i = 0; i < writer->entry->num_of_columns; i += 1) {
+    column_builder_init(&writer->builders[i], writer->columns[i]->column_type,
+                        writer->columns[i]->column_typmod,
+                        writer->use_dictionary[i]);
   }
-  return int_data;
+  writer->num_of_buffered_rows = 0;
 }
 
-static double *create_double_data_array(Datum *data, int num_values) {
-  double *double_data = (double *)palloc(num_values * sizeof(double));
-  for (int i = 0; i < num_values; i += 1) {
-    if (data[i] == ULONG_MAX) {
-      double_data[i] = 0.0f;
-    } else {
-      double_data[i] = DatumGetFloat8(data[i]);
-    }
+/*
+ * Opens the parquet file with the schema of the first row group. Column
+ * encodings are picked from the first row group of the export.
+ */
+static void chunk_writer_open_parquet_file(ChunkWriter *writer,
+                                           GArrowTable *table) {
+  GError *error = NULL;
+  GArrowSchema *schema = garrow_table_get_schema(table);
+  GParquetWriterProperties *writer_properties =
+      gparquet_writer_properties_new();
+  if (!writer->encodings->is_sampled) {
+    select_column_encodings(writer->encodings, table);
+  }
+  apply_column_encodings(writer->encodings, writer_properties);
+  writer->parquet_writer = gparquet_arrow_file_writer_new_path(
+      schema, writer->path, writer_properties, &error);
+  LOG_ARROW_ERROR(error);
+  if (writer->parquet_writer == NULL) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not create file \"%s\"", writer->path)));
   }
-  return double_data;
+  for (int i = 0; i < writer->entry->num_of_columns; i += 1) {
+    GArrowField *field = garrow_schema_get_field(schema, i);
+    writer->use_dictionary[i] =
+        GARROW_IS_DICTIONARY_DATA_TYPE(garrow_field_get_data_type(field));
+    g_object_unref(field);
+  }
+  g_object_unref(writer_properties);
+  g_object_unref(schema);
 }
 
-static int16 *create_bool_data_array(Datum *data, int num_values) {
-  int16 *bool_data = (int16 *)palloc(num_values * sizeof(int16));
-  for (int i = 0; i < num_values; i += 1) {
-    if (data[i] == ULONG_MAX) {
-      bool_data[i] = 0;
-    } else {
-      bool_data[i] = DatumGetBool(data[i]) ? 1 : 0;
-    }
+/* Finishes the Arrow array of a column in a column task. */
+typedef struct _FinishColumnTask {
+  ColumnBuilder *builder;
+  // Set when the file schema expects a dictionary array.
+  bool needs_dictionary;
+  GArrowArray *array;
+  GError *error;
+} FinishColumnTask;
+
+static void finish_column(void *task) {
+  FinishColumnTask *column = (FinishColumnTask *)task;
+  column->array = column_builder_finish(column->builder, &column->error);
+  if (column->needs_dictionary && column->error == NULL &&
+      !GARROW_IS_DICTIONARY_ARRAY(column->array)) {
+    // The row group had too many distinct values to be dictionary encoded
+    // by the builder, the file schema expects a dictionary.
+    GArrowDictionaryArray *encoded =
+        garrow_array_dictionary_encode(column->array, &column->error);
+    g_object_unref(column->array);
+    column->array = GARROW_ARRAY(encoded);
   }
-  return bool_data;
 }
 
-static int64 *create_timestamp_data_array(Datum *data, int num_values) {
-  int64 *timestamp_data = (int64 *)palloc(num_values * sizeof(int64));
-  for (int i = 0; i < num_values; i += 1) {
-    if (data[i] == ULONG_MAX) {
-      timestamp_data[i] = 0;
+/*
+ * Writes rows buffered in the column builders. Builders are initialized
+ * again for the next row group when reset_builders is set. Columns are
+ * finished in parallel by column tasks.
+ */
+static void chunk_writer_flush(ChunkWriter *writer, bool reset_builders) {
+  const ExportEntry *entry = writer->entry;
+  GError *error = NULL;
+  MemoryContext old_context = MemoryContextSwitchTo(writer->context);
+  GArrowArray **arrow_arrays =
+      palloc(entry->num_of_columns * sizeof(GArrowArray *));
+  FinishColumnTask *tasks =
+      palloc0(entry->num_of_columns * sizeof(FinishColumnTask));
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    tasks[i].builder = &writer->builders[i];
+    tasks[i].needs_dictionary =
+        writer->parquet_writer != NULL && writer->use_dictionary[i];
+  }
+  run_column_tasks(finish_column, tasks, sizeof(FinishColumnTask),
+                   entry->num_of_columns);
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    arrow_arrays[i] = tasks[i].array;
+    LOG_ARROW_ERROR(tasks[i].error);
+  }
+  pfree(tasks);
+
+  if (writer->num_of_buffered_rows > 0) {
+    GArrowTable *table = create_arrow_table(writer->schema, arrow_arrays,
+                                            entry->num_of_columns);
+    elog(LOG, "Writing " INT64_FORMAT " rows to %s",
+         writer->num_of_buffered_rows, writer->path);
+    if (entry->layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+      export_throttle_add_written(
+          write_column_group_files(entry, writer->path, table));
+    } else if (entry->output_format != OUTPUT_FORMAT_PARQUET) {
+      write_arrow_ipc_file(
+          writer->path, table,
+          /*compress=*/entry->output_format == OUTPUT_FORMAT_ARROW_LZ4);
     } else {
-      Timestamp pg_timestanp = DatumGetTimestamp(data[i]);
-      timestamp_data[i] = timestamptz_to_time_t(pg_timestanp);
+      if (writer->parquet_writer == NULL) {
+        chunk_writer_open_parquet_file(writer, table);
+      }
+      gboolean is_write_successfull = gparquet_arrow_file_writer_write_table(
+          writer->parquet_writer, table, PARQUET_ROW_GROUP_CHUNK_SIZE, &error);
+      LOG_ARROW_ERROR(error);
+      if (!is_write_successfull) {
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not write file \"%s\"", writer->path)));
+      }
+    }
+    g_object_unref(table);
+
+    struct stat file_stat;
+    if (stat(writer->path, &file_stat) == 0) {
+      export_throttle_add_written(file_stat.st_size -
+                                  writer->num_of_written_bytes);
+      writer->num_of_written_bytes = file_stat.st_size;
     }
   }
-  return timestamp_data;
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    g_object_unref(arrow_arrays[i]);
+  }
+  pfree(arrow_arrays);
+  if (reset_builders) {
+    chunk_writer_init_builders(writer);
+  }
+  MemoryContextSwitchTo(old_context);
 }
 
-static char **create_string_data_array(Datum *data, int num_values) {
-  char **string_data = (char **)palloc(num_values * sizeof(char *));
-  for (int i = 0; i < num_values; i += 1) {
-    if (data[i] == ULONG_MAX) {
-      char *cstring = "";
-      string_data[i] = (char *)palloc(sizeof(char));
-      strcpy(string_data[i], cstring);
-    } else {
-      char *cstring = TextDatumGetCString(data[i]);
-      string_data[i] = (char *)palloc(sizeof(char) * strlen(cstring) + 1);
-      strcpy(string_data[i], cstring);
+static void sample_writer_add(struct _SampleWriter *sampler,
+                              TupleTableSlot *slot);
+
+static bool chunk_writer_receive(TupleTableSlot *slot, DestReceiver *self) {
+  ChunkWriter *writer = (ChunkWriter *)self;
+  const ExportEntry *entry = writer->entry;
+  slot_getallattrs(slot);
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    column_builder_append(&writer->builders[i], slot->tts_values[i],
+                          slot->tts_isnull[i]);
+  }
+  for (int i = 0; i < writer->num_of_bloom_filters; i += 1) {
+    int attribute = writer->bloom_filter_attributes[i];
+    if (!slot->tts_isnull[attribute]) {
+      bloom_filter_add_datum(&writer->bloom_filters[i].file_filter,
+                             writer->columns[attribute]->column_type,
+                             slot->tts_values[attribute]);
+    }
+  }
+  for (int i = 0; i < writer->num_of_distinct_sketches; i += 1) {
+    int attribute = writer->distinct_sketch_attributes[i];
+    if (!slot->tts_isnull[attribute]) {
+      distinct_sketch_add_datum(&writer->distinct_sketches[i],
+                                slot->tts_values[attribute]);
     }
   }
-  return string_data;
+  if (writer->sample != NULL) {
+    export_sample_add(writer->sample, slot->tts_values, slot->tts_isnull);
+  }
+  if (writer->sampler != NULL) {
+    sample_writer_add(writer->sampler, slot);
+  }
+  writer->num_of_rows += 1;
+  writer->num_of_buffered_rows += 1;
+  if (entry->output_format == OUTPUT_FORMAT_PARQUET &&
+      writer->num_of_buffered_rows == PARQUET_ROW_GROUP_CHUNK_SIZE) {
+    chunk_writer_flush(writer, /*reset_builders=*/true);
+  }
+  export_throttle_point();
+  return true;
 }
 
+static void chunk_writer_startup(DestReceiver *self, int operation,
+                                 TupleDesc typeinfo) {}
+
+static void chunk_writer_shutdown(DestReceiver *self) {}
+
+static void chunk_writer_destroy(DestReceiver *self) {}
+
 /**
- * Returns Arrow table pointer with data populated from SPI query.
- * Expects SPI query to read desired table rows has been executed.
- * Caller is reponsible for freeing table memory.
+ * Prepares writer to write rows of a chunk to the columnar file at path in
+ * the temp directory for table. Chunks of the column group layout are
+ * written to a file per column named after path. Bloom filters are sized
+ * for a chunk of the configured size.
  */
-static GArrowTable *create_arrow_table(GArrowSchema *schema,
-                                       const ColumnInfo *column_info,
-                                       const ExportEntry *entry,
-                                       int overall_num_columns) {
-  Assert(SPI_processed > 0);
-  elog(LOG, "Creating arrow table");
-  int num_export_columns = entry->num_of_columns;
-  GArrowArray **arrow_arrays =
-      (GArrowArray **)palloc(num_export_columns * sizeof(GArrowArray));
-  Datum **table_data = (Datum **)palloc(num_export_columns * sizeof(Datum *));
-  // Iterate over all rows for each column and create Datum Arays for each
-  // column Datums are just pointers to the actual data so the additional memory
-  // of creating temp datums array is very low.
-  for (int i = 0; i < num_export_columns; i += 1) {
-    // Copy datums to temp variable to access all datums for a column
-    table_data[i] = (Datum *)palloc(SPI_processed * sizeof(Datum));
-    for (int j = 0; j < SPI_processed; j += 1) {
-      bool isnull;
-      Datum datum = SPI_getbinval(SPI_tuptable->vals[j], SPI_tuptable->tupdesc,
-                                  i + 1, &isnull);
-      if (!isnull) {
-        table_data[i][j] = datum;
-      } else {
-        table_data[i][j] = ULONG_MAX;
-      }
-    }
+static void chunk_writer_init(ChunkWriter *writer, const ExportEntry *entry,
+                              GArrowSchema *schema,
+                              const ColumnInfo *column_info, int total_columns,
+                              const char *path, ExportSample *sample,
+                              ColumnEncodings *encodings) {
+  memset(writer, 0, sizeof(ChunkWriter));
+  writer->pub.receiveSlot = chunk_writer_receive;
+  writer->pub.rStartup = chunk_writer_startup;
+  writer->pub.rShutdown = chunk_writer_shutdown;
+  writer->pub.rDestroy = chunk_writer_destroy;
+  // Any destination other than DestNone makes SPI report SPI_OK_SELECT.
+  writer->pub.mydest = DestTuplestore;
+  writer->entry = entry;
+  writer->schema = schema;
+  writer->sample = sample;
+  writer->encodings = encodings;
+  writer->context = CurrentMemoryContext;
+  strlcpy(writer->path, path, PATH_MAX);
+
+  int num_of_columns = entry->num_of_columns;
+  writer->columns = palloc(num_of_columns * sizeof(ColumnInfo *));
+  writer->builders = palloc(num_of_columns * sizeof(ColumnBuilder));
+  writer->use_dictionary = palloc(num_of_columns * sizeof(bool));
+  for (int i = 0; i < num_of_columns; i += 1) {
+    writer->columns[i] = find_column_info(column_info, total_columns,
+                                          entry->columns_to_export[i]);
+    // Plain encoded columns don't need to be built as dictionaries.
+    writer->use_dictionary[i] = !encodings->is_sampled ||
+                                encodings->columns[i].use_dictionary;
   }
-  GError *error = NULL;
-  // Populate arrow arrays for each column
-  for (int i = 0; i < num_export_columns; i += 1) {
-    // TODO - move column type deduction to util
-    const char *column_name = entry->columns_to_export[i];
-    Oid column_type;
-    bool column_type_found = false;
-    for (int j = 0; j < overall_num_columns; j += 1) {
-      if (strcmp(column_info[j].column_name, column_name) == 0) {
-        column_type = column_info[j].column_type;
-        column_type_found = true;
+  chunk_writer_init_builders(writer);
+
+  writer->num_of_distinct_sketches = entry->num_of_distinct_count_columns;
+  if (writer->num_of_distinct_sketches > 0) {
+    writer->distinct_sketch_attributes =
+        palloc(writer->num_of_distinct_sketches * sizeof(int));
+    writer->distinct_sketches = palloc0(writer->num_of_distinct_sketches *
+                                        sizeof(ColumnDistinctSketch));
+  }
+  for (int i = 0; i < writer->num_of_distinct_sketches; i += 1) {
+    const char *column_name = entry->distinct_count_columns[i];
+    writer->distinct_sketch_attributes[i] = -1;
+    for (int j = 0; j < num_of_columns; j += 1) {
+      if (strcmp(entry->columns_to_export[j], column_name) == 0) {
+        writer->distinct_sketch_attributes[i] = j;
         break;
       }
     }
-    Assert(column_type_found);
-    elog(LOG, "Adding values to arrow array for column %s", column_name);
-    switch (column_type) {
-    case INT2OID:
-    case INT4OID:
-    case INT8OID: {
-      const int64 *int_data =
-          create_int64_data_array(table_data[i], SPI_processed);
-      arrow_arrays[i] = create_int64_array(int_data, SPI_processed, error);
-      pfree(int_data);
-      elog(LOG, "Created int data array");
-      LOG_ARROW_ERROR(error);
-      break;
-    }
-    case FLOAT4OID:
-    case FLOAT8OID: {
-      const double *double_data =
-          create_double_data_array(table_data[i], SPI_processed);
-      arrow_arrays[i] = create_double_array(double_data, SPI_processed, error);
-      pfree(double_data);
-      elog(LOG, "Created int data array");
-      LOG_ARROW_ERROR(error);
-      break;
-    }
-    case TEXTOID:
-    case VARCHAROID: {
-      const char **string_data =
-          create_string_data_array(table_data[i], SPI_processed);
-      arrow_arrays[i] = create_string_array(string_data, SPI_processed, error);
-      for (int k = 0; k < SPI_processed; k += 1) {
-        pfree(string_data[k]);
-      }
-      pfree(string_data);
-      elog(LOG, "Created string data array");
-      LOG_ARROW_ERROR(error);
-      break;
-    }
-    case BOOLOID: {
-      const int16 *bool_data =
-          create_bool_data_array(table_data[i], SPI_processed);
-      arrow_arrays[i] = create_bool_array(bool_data, SPI_processed, error);
-      pfree(bool_data);
-      elog(LOG, "Created bool data array");
-      LOG_ARROW_ERROR(error);
-      break;
-    }
-    case TIMESTAMPOID: {
-      const int64 *timestamp_data =
-          create_timestamp_data_array(table_data[i], SPI_processed);
-      arrow_arrays[i] =
-          create_timestamp_array(timestamp_data, SPI_processed, error);
-      pfree(timestamp_data);
-      elog(LOG, "Created timestamp data array");
-      LOG_ARROW_ERROR(error);
-      break;
-    }
-    default:
-      elog(LOG, "Column type %s not yet supported in columnar schema",
-           column_type);
-      break;
+    if (writer->distinct_sketch_attributes[i] < 0) {
+      ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+                      errmsg("Distinct count column %s is not exported",
+                             column_name)));
     }
+    distinct_sketch_init(
+        &writer->distinct_sketches[i], column_name,
+        writer->columns[writer->distinct_sketch_attributes[i]]->column_type);
   }
-  GArrowTable *table =
-      garrow_table_new_arrays(schema, arrow_arrays, num_export_columns, &error);
-  LOG_ARROW_ERROR(error);
 
-  for (int i = 0; i < num_export_columns; i += 1) {
-    g_object_unref(arrow_arrays[i]);
-    pfree(table_data[i]);
+  // Bloom filters are consulted while listing parquet files.
+  if (entry->num_of_bloom_filter_columns == 0 ||
+      entry->output_format != OUTPUT_FORMAT_PARQUET) {
+    return;
+  }
+  writer->num_of_bloom_filters = entry->num_of_bloom_filter_columns;
+  writer->bloom_filter_attributes =
+      palloc(writer->num_of_bloom_filters * sizeof(int));
+  writer->bloom_filters =
+      palloc0(writer->num_of_bloom_filters * sizeof(ColumnBloomFilter));
+  for (int i = 0; i < writer->num_of_bloom_filters; i += 1) {
+    ColumnBloomFilter *column = &writer->bloom_filters[i];
+    strlcpy(column->column_name, entry->bloom_filter_columns[i], NAMEDATALEN);
+    writer->bloom_filter_attributes[i] = -1;
+    for (int j = 0; j < num_of_columns; j += 1) {
+      if (strcmp(entry->columns_to_export[j], column->column_name) == 0) {
+        writer->bloom_filter_attributes[i] = j;
+        break;
+      }
+    }
+    if (writer->bloom_filter_attributes[i] < 0) {
+      ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+                      errmsg("Bloom filter column %s is not exported",
+                             column->column_name)));
+    }
+    // Rows of a chunk are spread over the files of its buckets.
+    bloom_filter_init(&column->file_filter,
+                      entry->chunk_size / Max(entry->num_of_buckets, 1));
   }
-  pfree(arrow_arrays);
-  pfree(table_data);
-
-  const char *table_definition = garrow_table_to_string(table, &error);
-  elog(LOG, "Created arrow table with definition %s", table_definition);
-  return table;
 }
 
-static void write_arrow_table(const char *table_name, int chunk_num,
-                              GArrowSchema *schema, GArrowTable *table) {
-  char path[PATH_MAX];
-  char file_name[PATH_MAX];
-  populate_temp_path_for_table(table_name, path, /*relative=*/true);
-  sprintf(file_name, "/%d.parquet", chunk_num);
-  strcat(path, file_name);
-  elog(LOG, "Attempting to write file %s", path);
-
+/**
+ * Writes the remaining rows of the chunk and the bloom filter sidecar of
+ * the columnar file. Returns the number of rows written, no file is
+ * created for an empty chunk.
+ */
+static int64 chunk_writer_finish(ChunkWriter *writer) {
   GError *error = NULL;
-  GParquetWriterProperties *writer_properties =
-      gparquet_writer_properties_new();
-  GParquetArrowFileWriter *writer = gparquet_arrow_file_writer_new_path(
-      schema, path, writer_properties, &error);
-  LOG_ARROW_ERROR(error);
-
-  gboolean is_write_successfull = gparquet_arrow_file_writer_write_table(
-      writer, table, PARQUET_ROW_GROUP_CHUNK_SIZE, &error);
-  LOG_ARROW_ERROR(error);
+  chunk_writer_flush(writer, /*reset_builders=*/false);
+  if (writer->parquet_writer != NULL) {
+    gboolean file_closed =
+        gparquet_arrow_file_writer_close(writer->parquet_writer, &error);
+    LOG_ARROW_ERROR(error);
+    Assert(file_closed);
+    g_object_unref(writer->parquet_writer);
+  }
+  if (writer->num_of_rows > 0 &&
+      writer->entry->layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+    for (int i = 0; i < writer->entry->num_of_columns; i += 1) {
+      char path[PATH_MAX];
+      populate_column_group_file_path(writer->entry, writer->path,
+                                      writer->entry->columns_to_export[i],
+                                      path);
+      fsync_fname(path, /*isdir=*/false);
+    }
+    elog(LOG, "Sucessfully wrote column groups to disk.");
+  } else if (writer->num_of_rows > 0) {
+    // Files must be on disk before they are recorded in the export
+    // checkpoint.
+    fsync_fname(writer->path, /*isdir=*/false);
+    elog(LOG, "Sucessfully wrote columnar file to disk.");
+  }
+  if (writer->num_of_rows > 0 && writer->num_of_bloom_filters > 0) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", writer->path,
+             BLOOM_FILTER_FILE_SUFFIX);
+    write_bloom_filter_file(path, writer->bloom_filters,
+                            writer->num_of_bloom_filters);
+    elog(LOG, "Wrote bloom filters for %d columns to %s",
+         writer->num_of_bloom_filters, path);
+  }
+  for (int i = 0; i < writer->num_of_bloom_filters; i += 1) {
+    bloom_filter_free(&writer->bloom_filters[i].file_filter);
+  }
+  if (writer->num_of_bloom_filters > 0) {
+    pfree(writer->bloom_filters);
+    pfree(writer->bloom_filter_attributes);
+  }
+  if (writer->num_of_rows > 0 && writer->num_of_distinct_sketches > 0) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", writer->path,
+             DISTINCT_SKETCH_FILE_SUFFIX);
+    write_distinct_sketch_file(path, writer->distinct_sketches,
+                               writer->num_of_distinct_sketches);
+    elog(LOG, "Wrote distinct sketches for %d columns to %s",
+         writer->num_of_distinct_sketches, path);
+  }
+  for (int i = 0; i < writer->num_of_distinct_sketches; i += 1) {
+    distinct_sketch_free(&writer->distinct_sketches[i]);
+  }
+  if (writer->num_of_distinct_sketches > 0) {
+    pfree(writer->distinct_sketches);
+    pfree(writer->distinct_sketch_attributes);
+  }
+  pfree(writer->use_dictionary);
+  pfree(writer->builders);
+  pfree(writer->columns);
+  return writer->num_of_rows;
+}
 
-  gboolean file_closed = gparquet_arrow_file_writer_close(writer, &error);
-  LOG_ARROW_ERROR(error);
+/**
+ * Routes rows of a chunk query to the chunk writer of their bucket, which
+ * the query returns after the exported columns.
+ */
+typedef struct _BucketWriter {
+  DestReceiver pub;
+  ChunkWriter *writers;
+  int bucket_attribute;
+} BucketWriter;
+
+static bool bucket_writer_receive(TupleTableSlot *slot, DestReceiver *self) {
+  BucketWriter *router = (BucketWriter *)self;
+  bool isnull;
+  Datum bucket_datum =
+      slot_getattr(slot, router->bucket_attribute + 1, &isnull);
+  // Rows without a bucket key can't be joined on it.
+  int bucket = isnull ? 0 : DatumGetInt32(bucket_datum);
+  ChunkWriter *writer = &router->writers[bucket];
+  return writer->pub.receiveSlot(slot, (DestReceiver *)writer);
+}
 
-  Assert(file_closed);
+static void bucket_writer_init(BucketWriter *router, ChunkWriter *writers,
+                               int bucket_attribute) {
+  memset(router, 0, sizeof(BucketWriter));
+  router->pub.receiveSlot = bucket_writer_receive;
+  router->pub.rStartup = chunk_writer_startup;
+  router->pub.rShutdown = chunk_writer_shutdown;
+  router->pub.rDestroy = chunk_writer_destroy;
+  router->pub.mydest = DestTuplestore;
+  router->writers = writers;
+  router->bucket_attribute = bucket_attribute;
+}
 
-  g_object_unref(table);
-  g_object_unref(writer);
-  g_object_unref(writer_properties);
+/*
+ * Prepares writers of the chunk file at path, one for each bucket of
+ * bucketed tables. Returns the receiver rows of the chunk are sent to.
+ */
+static DestReceiver *chunk_writers_init(
+    ChunkWriter *writers, BucketWriter *router, const ExportEntry *entry,
+    GArrowSchema *arrow_schema, const ColumnInfo *column_info,
+    int total_columns, const char *path, ExportSample *sample,
+    ColumnEncodings *encodings, struct _SampleWriter *sampler) {
+  int num_of_writers = Max(entry->num_of_buckets, 1);
+  for (int i = 0; i < num_of_writers; i += 1) {
+    char writer_path[PATH_MAX];
+    if (entry->num_of_buckets > 0) {
+      populate_bucket_file_path(entry, path, i, writer_path);
+    } else {
+      strlcpy(writer_path, path, PATH_MAX);
+    }
+    chunk_writer_init(&writers[i], entry, arrow_schema, column_info,
+                      total_columns, writer_path, sample, encodings);
+    writers[i].sampler = sampler;
+  }
+  bucket_writer_init(router, writers, entry->num_of_columns);
+  return entry->num_of_buckets > 0 ? (DestReceiver *)router
+                                   : (DestReceiver *)&writers[0];
+}
 
-  elog(LOG, "Sucessfully wrote columnar file to disk.");
+/*
+ * Finishes the writers of a chunk, returns the number of rows written.
+ */
+static int64 chunk_writers_finish(ChunkWriter *writers,
+                                  const ExportEntry *entry) {
+  int64 num_of_rows = 0;
+  for (int i = 0; i < Max(entry->num_of_buckets, 1); i += 1) {
+    num_of_rows += chunk_writer_finish(&writers[i]);
+  }
+  return num_of_rows;
 }
 
 void delete_export_entry(const char *table_name) {
   StringInfoData buf;
   initStringInfo(&buf);
   appendStringInfo(&buf,
-                   "DELETE FROM analytica_exports WHERE table_name = '%s';",
-                   table_name);
+                   "DELETE FROM analytica_export_partitions WHERE table_name "
+                   "= %s;",
+                   quote_literal_cstr(table_name));
+  appendStringInfo(&buf,
+                   "DELETE FROM analytica_column_encodings WHERE table_name "
+                   "= %s;",
+                   quote_literal_cstr(table_name));
+  appendStringInfo(&buf,
+                   "DELETE FROM analytica_exports WHERE table_name = %s;",
+                   quote_literal_cstr(table_name));
 
   SetCurrentStatementStartTimestamp();
   StartTransactionCommand();
@@ -600,9 +1032,9 @@ void delete_export_entry(const char *table_name) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
                     errmsg("Failed to connect to database")));
   }
-  elog(LOG, "Executing SPI_execute query %s", buf.data);
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
   int status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
-  elog(LOG, "Executed SPI_execute command with status %d", status);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
   if (status != SPI_OK_DELETE) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
                     errmsg("Failed to delete export entry.")));
@@ -623,11 +1055,31 @@ static void get_tables_to_process_in_order(ExportEntry *entries,
 		export_frequency_hours,  \
 		export_status, \
 		chunk_size, \
-		now() \
+		now(), \
+		fingerprint, \
+		bloom_filter_columns, \
+		output_format, \
+		layout, \
+		bucket_column, \
+		num_of_buckets, \
+		sample_rate, \
+		sample_strata_column, \
+		distinct_count_columns, \
+		source_query, \
+		incremental_key, \
+		incremental_watermark, \
+		fresh_column, \
+		row_filter, \
+		window_column, \
+		window_interval, \
+		registered_by \
 	FROM analytica_exports      \
-	ORDER BY last_run_completed \
-	LIMIT %d;",
-                   MAX_EXPORT_ENTRIES);
+	ORDER BY last_run_completed NULLS FIRST");
+  // Standbys don't record exports in analytica_exports so its order doesn't
+  // reflect their progress.
+  if (!is_standby_export) {
+    appendStringInfo(&buf, " LIMIT %d", MAX_EXPORT_ENTRIES);
+  }
 
   SetCurrentStatementStartTimestamp();
   StartTransactionCommand();
@@ -638,9 +1090,9 @@ static void get_tables_to_process_in_order(ExportEntry *entries,
                     errmsg("Failed to connect to database")));
   }
   elog(LOG, "Created connection for query");
-  elog(LOG, "Executing SPI_execute query %s", buf.data);
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
   int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/0);
-  elog(LOG, "Executed SPI_execute command with status %d", status);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
   if (status < 0) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
                     errmsg("Failed to fetch tables to export.")));
@@ -650,11 +1102,19 @@ static void get_tables_to_process_in_order(ExportEntry *entries,
   int valid_entries = 0;
 
   // Calaculate number of vvalid entries to export.
-  for (int i = 0; i < SPI_processed; i += 1) {
+  for (int i = 0; i < SPI_processed && valid_entries < MAX_EXPORT_ENTRIES;
+       i += 1) {
     bool isnull;
     bool is_valid_entry = false;
     Datum last_completed_datum =
         SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 3, &isnull);
+    ExportState *state = NULL;
+    if (is_standby_export) {
+      state = load_export_state(
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1));
+      isnull = state->last_run_completed == 0;
+      last_completed_datum = TimestampTzGetDatum(state->last_run_completed);
+    }
     elog(LOG, "Read last completed datum");
     if (isnull) {
       // Table is newly scheduled for export so last run completed is null
@@ -700,8 +1160,6 @@ static void get_tables_to_process_in_order(ExportEntry *entries,
     }
 
     if (is_valid_entry) {
-      valid_entries += 1;
-
       Datum name_datum = SPI_getbinval(SPI_tuptable->vals[i],
                                        SPI_tuptable->tupdesc, 1, &isnull);
       char *table_name = TextDatumGetCString(name_datum);
@@ -721,12 +1179,118 @@ static void get_tables_to_process_in_order(ExportEntry *entries,
       initialize_export_entry(table_name, num_of_columns, &entry);
       entry.export_status = export_status;
       entry.chunk_size = chunk_size;
+      Datum output_format_datum = SPI_getbinval(
+          SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 10, &isnull);
+      entry.output_format =
+          isnull ? OUTPUT_FORMAT_PARQUET : DatumGetInt32(output_format_datum);
+      Datum layout_datum = SPI_getbinval(SPI_tuptable->vals[i],
+                                         SPI_tuptable->tupdesc, 11, &isnull);
+      entry.layout = isnull ? EXPORT_LAYOUT_ROWS : DatumGetInt32(layout_datum);
+      Datum num_of_buckets_datum = SPI_getbinval(
+          SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 13, &isnull);
+      if (!isnull && DatumGetInt32(num_of_buckets_datum) > 0) {
+        export_entry_set_bucketing(
+            &entry,
+            SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 12),
+            DatumGetInt32(num_of_buckets_datum));
+      }
+      Datum sample_rate_datum = SPI_getbinval(
+          SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 14, &isnull);
+      export_entry_set_sample(
+          &entry, isnull ? 0 : DatumGetFloat8(sample_rate_datum),
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 15));
 
       for (int j = 0; j < num_of_columns; j += 1) {
         char *column_name = TextDatumGetCString(column_datums[j]);
         export_entry_add_column(&entry, column_name, j);
       }
-      entries[i] = entry;
+
+      char *fingerprint =
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 8);
+      if (state != NULL) {
+        fingerprint = state->fingerprint[0] != '\0' ? state->fingerprint
+                                                     : NULL;
+      }
+      if (fingerprint != NULL) {
+        export_entry_set_fingerprint(&entry, fingerprint);
+      }
+
+      Datum bloom_filter_columns_datum = SPI_getbinval(
+          SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 9, &isnull);
+      if (!isnull) {
+        Datum *bloom_filter_column_datums;
+        int num_of_bloom_filter_columns;
+        deconstruct_array(DatumGetArrayTypeP(bloom_filter_columns_datum),
+                          TEXTOID, -1, false, TYPALIGN_INT,
+                          &bloom_filter_column_datums, NULL,
+                          &num_of_bloom_filter_columns);
+        export_entry_init_bloom_filter_columns(&entry,
+                                               num_of_bloom_filter_columns);
+        for (int j = 0; j < num_of_bloom_filter_columns; j += 1) {
+          export_entry_add_bloom_filter_column(
+              &entry, TextDatumGetCString(bloom_filter_column_datums[j]), j);
+        }
+      }
+
+      Datum distinct_count_columns_datum = SPI_getbinval(
+          SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 16, &isnull);
+      if (!isnull) {
+        Datum *distinct_count_column_datums;
+        int num_of_distinct_count_columns;
+        deconstruct_array(DatumGetArrayTypeP(distinct_count_columns_datum),
+                          TEXTOID, -1, false, TYPALIGN_INT,
+                          &distinct_count_column_datums, NULL,
+                          &num_of_distinct_count_columns);
+        export_entry_init_distinct_count_columns(
+            &entry, num_of_distinct_count_columns);
+        for (int j = 0; j < num_of_distinct_count_columns; j += 1) {
+          export_entry_add_distinct_count_column(
+              &entry, TextDatumGetCString(distinct_count_column_datums[j]),
+              j);
+        }
+      }
+      char *source_query =
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 17);
+      if (source_query != NULL) {
+        export_entry_set_source_query(
+            &entry, source_query,
+            SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 18));
+      }
+      char *watermark =
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 19);
+      if (state != NULL) {
+        watermark = state->watermark[0] != '\0' ? state->watermark : NULL;
+      }
+      if (watermark != NULL) {
+        export_entry_set_watermark(&entry, watermark);
+      }
+      char *fresh_column =
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 20);
+      if (fresh_column != NULL) {
+        export_entry_set_fresh_column(&entry, fresh_column);
+      }
+      char *row_filter =
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 21);
+      if (row_filter != NULL) {
+        export_entry_set_row_filter(&entry, row_filter);
+      }
+      char *window_column =
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 22);
+      if (window_column != NULL) {
+        export_entry_set_window(
+            &entry, window_column,
+            SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 23));
+      }
+      Datum registered_by_datum = SPI_getbinval(
+          SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 24, &isnull);
+      if (!isnull) {
+        entry.registered_by = DatumGetObjectId(registered_by_datum);
+      }
+      entries[valid_entries] = entry;
+      valid_entries += 1;
+    }
+    if (state != NULL) {
+      pfree(state);
     }
   }
   *num_of_tables = valid_entries;
@@ -735,7 +1299,13 @@ static void get_tables_to_process_in_order(ExportEntry *entries,
   CommitTransactionCommand();
 }
 
-static void setup_data_directories(const char *table_name) {
+/**
+ * Creates data directories for table. Files left in the temp directory by an
+ * earlier export are deleted unless keep_temp_files is set, which is the
+ * case when an interrupted export is resumed.
+ */
+static void setup_data_directories(const char *table_name,
+                                   bool keep_temp_files) {
 
   char root_path[PATH_MAX];
   char base_path[PATH_MAX];
@@ -749,7 +1319,11 @@ static void setup_data_directories(const char *table_name) {
   elog(LOG, "Setting up base directory %s", base_path);
   elog(LOG, "Setting up temp directory %s", temp_path);
 
-  // Create root data directory if not exists.
+  // Create root data directory and the directory of the database if not
+  // exists.
+  if (mkdir("pg_analytica", 0755) == -1) {
+    elog(DEBUG1, "Failed to create directory pg_analytica");
+  }
   if (mkdir(root_path, 0755) == -1) {
     perror("mkdir");
     elog(LOG, "Failed to create root directoy %s", root_path);
@@ -767,6 +1341,11 @@ static void setup_data_directories(const char *table_name) {
     elog(LOG, "Failed to create data directoy %s", temp_path);
   }
 
+  if (keep_temp_files) {
+    elog(LOG, "Keeping temp files to resume export for %s", table_name);
+    return;
+  }
+
   // Delete content in temp directory.
   DIR *dir = opendir(temp_path);
   struct dirent *entry;
@@ -788,10 +1367,12 @@ static void setup_data_directories(const char *table_name) {
 
 /**
  * Moves columnar files from temp directory to data directory for table.
- * Existing files in data directory are deleted.
+ * Only files starting with file_prefix are moved and existing files in the
+ * data directory with the same prefix are deleted. A NULL prefix replaces
+ * all files for the table.
  * Cuurently this moves files one by one so it isn't atomic.
  */
-void move_temp_files(const char *table_name) {
+void move_temp_files(const char *table_name, const char *file_prefix) {
   DIR *dir;
   struct dirent *entry;
 
@@ -813,72 +1394,2453 @@ void move_temp_files(const char *table_name) {
     if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
       continue;
     }
-    if (unlink(filepath) == -1) {
+    // Temp directory and the export checkpoint live within the data
+    // directory.
+    if (strcmp(entry->d_name, "temp") == 0 || entry->d_name[0] == '.') {
+      continue;
+    }
+    if (!file_has_prefix(entry->d_name, file_prefix)) {
+      continue;
+    }
+    if (unlink(filepath) == -1) {
       elog(LOG, "Failed to delete data file %s", filepath);
     }
   }
-  closedir(dir);
-
-  dir = opendir(temp_path);
-  if (dir == NULL) {
-    perror("opendir");
-    return;
+  closedir(dir);
+
+  dir = opendir(temp_path);
+  if (dir == NULL) {
+    perror("opendir");
+    return;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    if (!file_has_prefix(entry->d_name, file_prefix)) {
+      continue;
+    }
+    elog(LOG, "Found entry with path %s", entry->d_name);
+    char src_path[PATH_MAX];
+    char dest_path[PATH_MAX];
+
+    // temp columnar file
+    strcpy(src_path, temp_path);
+    strcat(src_path, "/");
+    strcat(src_path, entry->d_name);
+
+    // Final path
+    strcpy(dest_path, data_path);
+    strcat(dest_path, "/");
+    strcat(dest_path, entry->d_name);
+
+    elog(LOG, "Temp path %s", src_path);
+    elog(LOG, "Data path %s", dest_path);
+
+    if (rename(src_path, dest_path) == 0) {
+      elog(LOG, "File '%s' renamed to '%s' successfully.\n", src_path,
+           dest_path);
+    } else {
+      perror("rename"); // Print error message if rename fails
+    }
+  }
+  closedir(dir);
+  // Data cached for the previous files is stale now.
+  advance_export_generation(table_name);
+  refresh_file_list(table_name, data_path);
+}
+
+char *get_columns_string(char **columns, int num_of_columns) {
+  int total_size = 0;
+  for (int i = 0; i < num_of_columns; i++) {
+    char *column_name = columns[i];
+    total_size += strlen(column_name) + 1;
+    elog(LOG, "Size of column %s is %d", column_name, strlen(column_name));
+  }
+  char *combined_string = (char *)palloc(total_size * sizeof(char));
+  combined_string[0] = '\0';
+  for (int i = 0; i < num_of_columns; i++) {
+    strcat(combined_string, columns[i]);
+    if (i < num_of_columns - 1) {
+      strcat(combined_string, ",");
+    }
+  }
+  return combined_string;
+}
+
+/*
+ * A physical relation whose rows are written to their own set of columnar
+ * files. Plain tables are exported as a single unit while partitioned tables
+ * are exported as one unit per leaf partition.
+ */
+typedef struct _ExportUnit {
+  // Name used to query the relation.
+  char relation_name[MAX_RELATION_NAME_CHARS];
+  // Oid of the partition as text, used as prefix for its columnar files.
+  // Unlike relation names, oids are unique across schemas.
+  char partition_name[NAMEDATALEN];
+  char fingerprint[MAX_FINGERPRINT_CHARS];
+  bool needs_export;
+  // Set for partitions without rows in the window of the table, their files
+  // are deleted.
+  bool is_expired;
+} ExportUnit;
+
+/*
+ * Returns the column rows added since the last export of table are found
+ * by, NULL if the table has no fresh column.
+ */
+static const char *get_fresh_column(const ExportEntry *entry) {
+  return entry->source_query != NULL ? entry->incremental_key
+                                     : entry->fresh_column;
+}
+
+/*
+ * Returns true if table has a fresh view. Watermarks of exports on standbys
+ * aren't recorded in analytica_exports so they have none.
+ */
+static bool has_fresh_view(const ExportEntry *entry) {
+  return get_fresh_column(entry) != NULL && !standby_exports_enabled();
+}
+
+/*
+ * Appends the conditions rows of table are exported under, each preceded by
+ * AND, to buf. Rows are exported if they match the row filter and are in
+ * the window that starts at window_start. Tables with a fresh view only
+ * export rows up to the watermark the view reads rows of the table past.
+ */
+static void append_export_filter(StringInfo buf, const ExportEntry *entry) {
+  if (entry->row_filter != NULL) {
+    appendStringInfo(buf, " AND (%s)", entry->row_filter);
+  }
+  if (entry->window_start != NULL) {
+    appendStringInfo(buf, " AND %s >= %s::timestamptz",
+                     quote_identifier(entry->window_column),
+                     quote_literal_cstr(entry->window_start));
+  }
+  if (entry->source_query == NULL && has_fresh_view(entry)) {
+    const char *fresh_column = quote_identifier(entry->fresh_column);
+    if (entry->next_watermark != NULL) {
+      appendStringInfo(buf, " AND (%s <= %s OR %s IS NULL)", fresh_column,
+                       quote_literal_cstr(entry->next_watermark),
+                       fresh_column);
+    } else {
+      appendStringInfo(buf, " AND %s IS NULL", fresh_column);
+    }
+  }
+}
+
+/*
+ * Keeps queries from reading the fresh view of table until the export
+ * transaction commits. Files are published before the view is replaced with
+ * the watermark they were exported up to, queries would otherwise read rows
+ * past the old watermark twice. Called before the first file is published.
+ */
+static void lock_fresh_view(const ExportEntry *entry) {
+  if (!has_fresh_view(entry)) {
+    return;
+  }
+  char fresh_name[NAMEDATALEN];
+  snprintf(fresh_name, sizeof(fresh_name),
+           EXPORTED_RELATION_PREFIX "%s" FRESH_RELATION_SUFFIX,
+           entry->table_name);
+  Oid relid = get_relname_relid(fresh_name, PG_PUBLIC_NAMESPACE);
+  if (OidIsValid(relid)) {
+    LockRelationOid(relid, AccessExclusiveLock);
+  }
+}
+
+/**
+ * Sets whether relation has rows matching the row filter of table within its
+ * window, and rows that matched it but aged out of the window. Cheap when an
+ * index starts with the window column.
+ * Expects SPI connection to be established.
+ */
+static void get_window_extent(const char *relation_name,
+                              const ExportEntry *entry, bool *has_recent,
+                              bool *has_expired) {
+  StringInfoData filter;
+  initStringInfo(&filter);
+  if (entry->row_filter != NULL) {
+    appendStringInfo(&filter, " AND (%s)", entry->row_filter);
+  }
+  const char *window_column = quote_identifier(entry->window_column);
+  const char *window_start = quote_literal_cstr(entry->window_start);
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT EXISTS (SELECT 1 FROM %s WHERE %s >= "
+                   "%s::timestamptz%s), EXISTS (SELECT 1 FROM %s WHERE "
+                   "%s < %s::timestamptz%s);",
+                   relation_name, window_column, window_start, filter.data,
+                   relation_name, window_column, window_start, filter.data);
+  SavedRole saved_role;
+  switch_to_role(entry->registered_by, &saved_role);
+  int status = SPI_execute(buf.data, true, 0);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to find rows of %s within window",
+                           relation_name)));
+  }
+  bool isnull;
+  *has_recent = DatumGetBool(
+      SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
+  *has_expired = DatumGetBool(
+      SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2, &isnull));
+  pfree(filter.data);
+  pfree(buf.data);
+}
+
+static bool find_window_index(const char *relation_name,
+                              const char *window_column,
+                              struct _ExportIndex *out);
+
+/**
+ * Returns true if table is a declaratively partitioned table.
+ * Expects SPI connection to be established.
+ */
+static bool is_partitioned_table(const char *table_name) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT relkind FROM pg_class WHERE oid = %s::regclass;",
+                   quote_literal_cstr(table_name));
+  int status = SPI_execute(buf.data, true, 0);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to deduce relation kind for %s",
+                           table_name)));
+  }
+  bool isnull;
+  Datum relkind_datum =
+      SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+  pfree(buf.data);
+  return DatumGetChar(relkind_datum) == RELKIND_PARTITIONED_TABLE;
+}
+
+/**
+ * Returns leaf partitions of a partitioned table along with a fingerprint
+ * of their contents, see RELATION_FINGERPRINT_SQL. Partitions are keyed by
+ * their oid, leaves of different schemas may share a name.
+ * Partitions are marked for export if their fingerprint does not match the
+ * one recorded during the previous export. Rows age out of the window of a
+ * table without changing the fingerprint, so partitions with rows on both
+ * sides of the window are always exported and partitions without rows in it
+ * are marked as expired. Partitions without an index on the window column
+ * are always exported.
+ * Expects SPI connection to be established.
+ * Caller should free the returned pointer.
+ */
+static ExportUnit *get_partitions_to_export(const ExportEntry *entry,
+                                            int *num_of_units) {
+  const char *table_name = entry->table_name;
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(
+      &buf,
+      "SELECT t.relid::regclass::text, t.relid::oid::text, "
+      RELATION_FINGERPRINT_SQL ", p.fingerprint "
+      "FROM pg_partition_tree(%s::regclass) t "
+      "JOIN pg_class c ON c.oid = t.relid "
+      "LEFT JOIN pg_stat_all_tables s ON s.relid = t.relid "
+      "LEFT JOIN analytica_export_partitions p "
+      "ON p.table_name = %s AND p.partition_name = t.relid::oid::text "
+      "WHERE t.isleaf;",
+      quote_literal_cstr(table_name), quote_literal_cstr(table_name));
+  int status = SPI_execute(buf.data, true, 0);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to list partitions for %s", table_name)));
+  }
+  ExportUnit *units = palloc0_array(ExportUnit, Max(SPI_processed, 1));
+  ExportState *state =
+      is_standby_export ? load_export_state(table_name) : NULL;
+  for (int i = 0; i < SPI_processed; i += 1) {
+    HeapTuple tuple = SPI_tuptable->vals[i];
+    TupleDesc tupdesc = SPI_tuptable->tupdesc;
+    char *relation_name = SPI_getvalue(tuple, tupdesc, 1);
+    char *partition_name = SPI_getvalue(tuple, tupdesc, 2);
+    char *fingerprint = SPI_getvalue(tuple, tupdesc, 3);
+    const char *previous_fingerprint =
+        state != NULL ? export_state_find_partition(state, partition_name)
+                      : SPI_getvalue(tuple, tupdesc, 4);
+
+    strlcpy(units[i].relation_name, relation_name, MAX_RELATION_NAME_CHARS);
+    strlcpy(units[i].partition_name, partition_name, NAMEDATALEN);
+    strlcpy(units[i].fingerprint, fingerprint, MAX_FINGERPRINT_CHARS);
+    // Write counters in the fingerprint aren't replicated so standbys
+    // can't tell whether a partition changed.
+    units[i].needs_export = is_standby_export ||
+                            previous_fingerprint == NULL ||
+                            strcmp(previous_fingerprint, fingerprint) != 0;
+    elog(LOG, "Partition %s has fingerprint %s, previous fingerprint %s",
+         relation_name, fingerprint,
+         previous_fingerprint == NULL ? "none" : previous_fingerprint);
+  }
+  *num_of_units = SPI_processed;
+  if (state != NULL) {
+    pfree(state);
+  }
+  for (int i = 0; entry->window_start != NULL && i < *num_of_units;
+       i += 1) {
+    // Without an index on the window column finding aged out rows reads
+    // the partition in full, so it's exported instead.
+    if (!find_window_index(units[i].relation_name, entry->window_column,
+                           /*out=*/NULL)) {
+      units[i].needs_export = true;
+      continue;
+    }
+    bool has_recent;
+    bool has_expired;
+    get_window_extent(units[i].relation_name, entry, &has_recent,
+                      &has_expired);
+    units[i].is_expired = !has_recent;
+    units[i].needs_export =
+        has_recent && (units[i].needs_export || has_expired);
+    elog(LOG, "Partition %s has rows within window %d, aged out rows %d",
+         units[i].relation_name, has_recent, has_expired);
+  }
+  pfree(buf.data);
+  return units;
+}
+
+/**
+ * Deletes columnar files and export state of partitions that were detached
+ * or dropped since the previous export, or whose rows aged out of the window
+ * of the table.
+ * Expects SPI connection to be established.
+ */
+static void remove_stale_partitions(const char *table_name,
+                                    const ExportUnit *units, int num_of_units) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  int num_of_stored;
+  char **stored_partitions;
+  ExportState *state = NULL;
+  if (is_standby_export) {
+    state = load_export_state(table_name);
+    num_of_stored = state->num_of_partitions;
+    stored_partitions = palloc_array(char *, Max(num_of_stored, 1));
+    for (int i = 0; i < num_of_stored; i += 1) {
+      stored_partitions[i] = pstrdup(state->partitions[i]);
+    }
+  } else {
+    appendStringInfo(&buf,
+                     "SELECT partition_name FROM analytica_export_partitions "
+                     "WHERE table_name = %s;",
+                     quote_literal_cstr(table_name));
+    int status = SPI_execute(buf.data, true, 0);
+    elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+         status);
+    if (status != SPI_OK_SELECT) {
+      ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                      errmsg("Failed to fetch exported partitions for %s",
+                             table_name)));
+    }
+    num_of_stored = SPI_processed;
+    stored_partitions = palloc_array(char *, Max(num_of_stored, 1));
+    for (int i = 0; i < num_of_stored; i += 1) {
+      stored_partitions[i] =
+          SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1);
+    }
+  }
+
+  char data_path[PATH_MAX];
+  char sample_name[MAX_SAMPLE_NAME_CHARS];
+  char sample_path[PATH_MAX];
+  populate_data_path_for_table(table_name, data_path, /*relative=*/false);
+  populate_sample_name(table_name, sample_name);
+  populate_data_path_for_table(sample_name, sample_path, /*relative=*/false);
+  for (int i = 0; i < num_of_stored; i += 1) {
+    bool is_present = false;
+    for (int j = 0; j < num_of_units; j += 1) {
+      if (strcmp(stored_partitions[i], units[j].partition_name) == 0 &&
+          !units[j].is_expired) {
+        is_present = true;
+        break;
+      }
+    }
+    if (is_present) {
+      continue;
+    }
+    elog(LOG, "Removing columnar files for stale partition %s",
+         stored_partitions[i]);
+    char file_prefix[NAMEDATALEN + 1];
+    snprintf(file_prefix, sizeof(file_prefix), "%s.", stored_partitions[i]);
+    delete_files_with_prefix(data_path, file_prefix);
+    delete_files_with_prefix(sample_path, file_prefix);
+
+    if (state != NULL) {
+      export_state_remove_partition(state, stored_partitions[i]);
+      continue;
+    }
+    resetStringInfo(&buf);
+    appendStringInfo(&buf,
+                     "DELETE FROM analytica_export_partitions WHERE "
+                     "table_name = %s AND partition_name = %s;",
+                     quote_literal_cstr(table_name),
+                     quote_literal_cstr(stored_partitions[i]));
+    int status = SPI_execute(buf.data, false, 0);
+    elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+         status);
+  }
+  if (state != NULL) {
+    save_export_state(table_name, state);
+    pfree(state);
+  }
+  pfree(stored_partitions);
+  pfree(buf.data);
+}
+
+/**
+ * Records fingerprint of a partition after its files have been exported.
+ * Expects SPI connection to be established.
+ */
+static void save_partition_fingerprint(const char *table_name,
+                                       const ExportUnit *unit) {
+  if (is_standby_export) {
+    ExportState *state = load_export_state(table_name);
+    export_state_set_partition(state, unit->partition_name, unit->fingerprint);
+    save_export_state(table_name, state);
+    pfree(state);
+    return;
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(
+      &buf,
+      "INSERT INTO analytica_export_partitions (table_name, partition_name, "
+      "fingerprint, last_run_completed) VALUES (%s, %s, %s, "
+      "CURRENT_TIMESTAMP) ON CONFLICT (table_name, partition_name) DO UPDATE "
+      "SET fingerprint = EXCLUDED.fingerprint, "
+      "last_run_completed = EXCLUDED.last_run_completed;",
+      quote_literal_cstr(table_name),
+      quote_literal_cstr(unit->partition_name),
+      quote_literal_cstr(unit->fingerprint));
+  int status = SPI_execute(buf.data, false, 0);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_INSERT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to save fingerprint for partition %s",
+                           unit->partition_name)));
+  }
+  pfree(buf.data);
+}
+
+/**
+ * Populates the relfilenode, number of blocks and estimated number of tuples
+ * per block of relation.
+ * Expects SPI connection to be established.
+ */
+static void get_relation_layout(const char *relation_name, Oid *relfilenode,
+                                int64 *num_of_blocks,
+                                double *tuples_per_block) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT relfilenode, pg_relation_size(oid), "
+                   "CASE WHEN reltuples > 0 AND relpages > 0 "
+                   "THEN reltuples / relpages ELSE 0 END "
+                   "FROM pg_class WHERE oid = %s::regclass;",
+                   quote_literal_cstr(relation_name));
+  int status = SPI_execute(buf.data, true, 0);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to read layout of %s", relation_name)));
+  }
+  bool isnull;
+  HeapTuple tuple = SPI_tuptable->vals[0];
+  TupleDesc tupdesc = SPI_tuptable->tupdesc;
+  *relfilenode =
+      DatumGetObjectId(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+  *num_of_blocks =
+      DatumGetInt64(SPI_getbinval(tuple, tupdesc, 2, &isnull)) / BLCKSZ;
+  *tuples_per_block = DatumGetFloat8(SPI_getbinval(tuple, tupdesc, 3, &isnull));
+  pfree(buf.data);
+}
+
+/**
+ * Returns estimated number of rows in relation.
+ * Expects SPI connection to be established.
+ */
+static double estimate_relation_rows(const char *relation_name) {
+  Oid relfilenode;
+  int64 num_of_blocks;
+  double tuples_per_block;
+  get_relation_layout(relation_name, &relfilenode, &num_of_blocks,
+                      &tuples_per_block);
+  if (tuples_per_block <= 0) {
+    tuples_per_block = DEFAULT_TUPLES_PER_BLOCK;
+  }
+  return num_of_blocks * tuples_per_block;
+}
+
+/**
+ * Writes rows picked for the sample relation of a table to columnar files
+ * in its own data directory, named like the files of the table. Rows are
+ * picked with probability sample_rate. Stratified samples keep a reservoir
+ * of MIN_STRATUM_SAMPLE_ROWS rows of every value of the strata column until
+ * the value has enough rows to be sampled at the rate. Each sampled row is
+ * written with the number of rows it stands for in SAMPLE_WEIGHT_COLUMN.
+ */
+typedef struct _SampleWriter {
+  ExportEntry entry;
+  // Exported columns followed by the weight column.
+  GArrowSchema *schema;
+  ColumnInfo *column_info;
+  int total_columns;
+  ColumnEncodings encodings;
+  // Prefix of the files of the export unit being sampled.
+  char *file_prefix;
+  ChunkWriter writer;
+  int num_of_files;
+  // Rows are passed to the writer in this slot.
+  TupleDesc tupdesc;
+  TupleTableSlot *slot;
+  // Index of the strata column among the exported columns.
+  int strata_attribute;
+  FmgrInfo strata_output;
+  // Strata by the text of their strata column value, NULL if the sample
+  // isn't stratified.
+  HTAB *strata;
+  // Holds the values of strata and their reservoirs.
+  MemoryContext context;
+} SampleWriter;
+
+typedef struct _Stratum {
+  // Key of the stratum, copied into the context of the writer.
+  char *value;
+  int64 num_of_rows;
+  // Uniform sample of the rows of the stratum, NULL once they're sampled at
+  // the sample rate.
+  HeapTuple *rows;
+  int num_of_sampled_rows;
+} Stratum;
+
+static uint32 stratum_hash(const void *key, Size keysize) {
+  const char *value = *(const char *const *)key;
+  return hash_bytes((const unsigned char *)value, strlen(value));
+}
+
+static int stratum_match(const void *key1, const void *key2, Size keysize) {
+  return strcmp(*(const char *const *)key1, *(const char *const *)key2);
+}
+
+static void sample_writer_open_file(SampleWriter *sampler) {
+  char path[PATH_MAX];
+  populate_temp_file_path(&sampler->entry, sampler->file_prefix,
+                          sampler->num_of_files, path);
+  chunk_writer_init(&sampler->writer, &sampler->entry, sampler->schema,
+                    sampler->column_info, sampler->total_columns, path,
+                    /*sample=*/NULL, &sampler->encodings);
+  sampler->num_of_files += 1;
+}
+
+/**
+ * Prepares sampler to sample rows of the export unit whose files are
+ * prefixed with file_prefix.
+ * Expects SPI connection to be established.
+ */
+static void sample_writer_begin(SampleWriter *sampler,
+                                const ExportEntry *entry,
+                                const ColumnInfo *column_info,
+                                int total_columns, const char *file_prefix) {
+  memset(sampler, 0, sizeof(SampleWriter));
+  sampler->context = AllocSetContextCreate(
+      CurrentMemoryContext, "pg_analytica sample", ALLOCSET_DEFAULT_SIZES);
+  char sample_name[MAX_SAMPLE_NAME_CHARS];
+  populate_sample_name(entry->table_name, sample_name);
+  int num_of_columns = entry->num_of_columns + 1;
+  initialize_export_entry(sample_name, num_of_columns, &sampler->entry);
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    export_entry_add_column(&sampler->entry, entry->columns_to_export[i], i);
+  }
+  export_entry_add_column(&sampler->entry, SAMPLE_WEIGHT_COLUMN,
+                          entry->num_of_columns);
+  sampler->entry.output_format = entry->output_format;
+  sampler->entry.chunk_size = entry->chunk_size;
+  sampler->entry.sample_rate = entry->sample_rate;
+  sampler->total_columns = total_columns + 1;
+  sampler->column_info =
+      palloc(sampler->total_columns * sizeof(ColumnInfo));
+  memcpy(sampler->column_info, column_info,
+         total_columns * sizeof(ColumnInfo));
+  ColumnInfo *weight = &sampler->column_info[total_columns];
+  strlcpy(weight->column_name, SAMPLE_WEIGHT_COLUMN, MAX_COLUMN_NAME_CHARS);
+  weight->column_type = FLOAT8OID;
+  weight->column_typmod = -1;
+  sampler->schema = create_table_schema(
+      sampler->column_info, &sampler->entry, sampler->total_columns);
+  sampler->tupdesc = CreateTemplateTupleDesc(num_of_columns);
+  for (int i = 0; i < num_of_columns; i += 1) {
+    const ColumnInfo *column =
+        find_column_info(sampler->column_info, sampler->total_columns,
+                         sampler->entry.columns_to_export[i]);
+    TupleDescInitEntry(sampler->tupdesc, i + 1, column->column_name,
+                       column->column_type, column->column_typmod, 0);
+  }
+  sampler->slot =
+      MakeSingleTupleTableSlot(sampler->tupdesc, &TTSOpsVirtual);
+  sampler->file_prefix = file_prefix == NULL ? NULL : pstrdup(file_prefix);
+  column_encodings_init(&sampler->encodings, sample_name,
+                        sampler->entry.columns_to_export, num_of_columns);
+
+  // Discard sample files of an earlier attempt.
+  char temp_path[PATH_MAX];
+  populate_temp_path_for_table(sample_name, temp_path, /*relative=*/false);
+  delete_files_with_prefix(temp_path, file_prefix);
+
+  if (entry->sample_strata_column != NULL) {
+    for (int i = 0; i < entry->num_of_columns; i += 1) {
+      if (strcmp(entry->columns_to_export[i],
+                 entry->sample_strata_column) == 0) {
+        sampler->strata_attribute = i;
+      }
+    }
+    const ColumnInfo *column = find_column_info(
+        column_info, total_columns, entry->sample_strata_column);
+    Oid output_function;
+    bool is_varlena;
+    getTypeOutputInfo(column->column_type, &output_function, &is_varlena);
+    fmgr_info(output_function, &sampler->strata_output);
+    HASHCTL info;
+    info.keysize = sizeof(char *);
+    info.entrysize = sizeof(Stratum);
+    info.hash = stratum_hash;
+    info.match = stratum_match;
+    info.hcxt = sampler->context;
+    sampler->strata = hash_create("pg_analytica sample strata", 1024, &info,
+                                  HASH_ELEM | HASH_FUNCTION | HASH_COMPARE |
+                                      HASH_CONTEXT);
+  }
+  sample_writer_open_file(sampler);
+}
+
+/*
+ * Writes the exported columns in values and isnull to the sample with the
+ * number of rows the row stands for.
+ */
+static void sample_writer_write(SampleWriter *sampler, Datum *values,
+                                bool *isnull, double weight) {
+  TupleTableSlot *slot = sampler->slot;
+  int weight_attribute = sampler->entry.num_of_columns - 1;
+  ExecClearTuple(slot);
+  memcpy(slot->tts_values, values, weight_attribute * sizeof(Datum));
+  memcpy(slot->tts_isnull, isnull, weight_attribute * sizeof(bool));
+  slot->tts_values[weight_attribute] = Float8GetDatum(weight);
+  slot->tts_isnull[weight_attribute] = false;
+  ExecStoreVirtualTuple(slot);
+  chunk_writer_receive(slot, (DestReceiver *)&sampler->writer);
+  // Sample files hold at most a chunk of rows like the files of the table.
+  if (sampler->writer.num_of_rows >= sampler->entry.chunk_size) {
+    chunk_writer_finish(&sampler->writer);
+    sample_writer_open_file(sampler);
+  }
+}
+
+/*
+ * Writes the reservoir of stratum, each row standing for an equal share of
+ * the rows of the stratum seen so far, and frees it.
+ */
+static void sample_writer_write_stratum(SampleWriter *sampler,
+                                        Stratum *stratum) {
+  int num_of_columns = sampler->entry.num_of_columns;
+  Datum *values = palloc(num_of_columns * sizeof(Datum));
+  bool *isnull = palloc(num_of_columns * sizeof(bool));
+  double weight =
+      (double)stratum->num_of_rows / stratum->num_of_sampled_rows;
+  for (int i = 0; i < stratum->num_of_sampled_rows; i += 1) {
+    heap_deform_tuple(stratum->rows[i], sampler->tupdesc, values, isnull);
+    sample_writer_write(sampler, values, isnull, weight);
+    heap_freetuple(stratum->rows[i]);
+  }
+  pfree(stratum->rows);
+  stratum->rows = NULL;
+  pfree(values);
+  pfree(isnull);
+}
+
+/*
+ * Adds row in slot to the reservoir of stratum. Out of line values are
+ * fetched so that rows stay valid across chunk queries.
+ */
+static void sample_writer_add_to_stratum(SampleWriter *sampler,
+                                         Stratum *stratum,
+                                         TupleTableSlot *slot) {
+  int64 position = stratum->num_of_rows;
+  stratum->num_of_rows += 1;
+  if (position >= MIN_STRATUM_SAMPLE_ROWS) {
+    position = pg_prng_uint64_range(&pg_global_prng_state, 0, position);
+    if (position >= MIN_STRATUM_SAMPLE_ROWS) {
+      return;
+    }
+    heap_freetuple(stratum->rows[position]);
+  } else {
+    stratum->num_of_sampled_rows += 1;
+  }
+  MemoryContext old_context = MemoryContextSwitchTo(sampler->context);
+  int weight_attribute = sampler->entry.num_of_columns - 1;
+  Datum *values = palloc((weight_attribute + 1) * sizeof(Datum));
+  bool *isnull = palloc((weight_attribute + 1) * sizeof(bool));
+  memcpy(values, slot->tts_values, weight_attribute * sizeof(Datum));
+  memcpy(isnull, slot->tts_isnull, weight_attribute * sizeof(bool));
+  isnull[weight_attribute] = true;
+  HeapTuple row = heap_form_tuple(sampler->tupdesc, values, isnull);
+  stratum->rows[position] = toast_flatten_tuple(row, sampler->tupdesc);
+  heap_freetuple(row);
+  pfree(values);
+  pfree(isnull);
+  MemoryContextSwitchTo(old_context);
+}
+
+/*
+ * Returns the stratum of the row in slot, NULL if its rows are sampled at
+ * the sample rate.
+ */
+static Stratum *sample_writer_find_stratum(SampleWriter *sampler,
+                                           TupleTableSlot *slot) {
+  int attribute = sampler->strata_attribute;
+  if (sampler->strata == NULL || slot->tts_isnull[attribute]) {
+    return NULL;
+  }
+  char *value = OutputFunctionCall(&sampler->strata_output,
+                                   slot->tts_values[attribute]);
+  HASHACTION action =
+      hash_get_num_entries(sampler->strata) < MAX_SAMPLE_STRATA ? HASH_ENTER
+                                                                : HASH_FIND;
+  bool found;
+  Stratum *stratum = hash_search(sampler->strata, &value, action, &found);
+  if (stratum != NULL && !found) {
+    stratum->value = MemoryContextStrdup(sampler->context, value);
+    stratum->num_of_rows = 0;
+    stratum->num_of_sampled_rows = 0;
+    stratum->rows = MemoryContextAlloc(
+        sampler->context, MIN_STRATUM_SAMPLE_ROWS * sizeof(HeapTuple));
+  }
+  pfree(value);
+  return stratum == NULL || stratum->rows == NULL ? NULL : stratum;
+}
+
+static void sample_writer_add(SampleWriter *sampler, TupleTableSlot *slot) {
+  double rate = sampler->entry.sample_rate;
+  Stratum *stratum = sample_writer_find_stratum(sampler, slot);
+  if (stratum != NULL) {
+    sample_writer_add_to_stratum(sampler, stratum, slot);
+    // Values with enough rows for MIN_STRATUM_SAMPLE_ROWS at the rate have
+    // each of their rows in the reservoir with the rate as probability, so
+    // further rows are sampled at the rate.
+    if (rate > 0 && stratum->num_of_rows * rate >= MIN_STRATUM_SAMPLE_ROWS) {
+      sample_writer_write_stratum(sampler, stratum);
+    }
+    return;
+  }
+  if (pg_prng_double(&pg_global_prng_state) < rate) {
+    sample_writer_write(sampler, slot->tts_values, slot->tts_isnull,
+                        1.0 / rate);
+  }
+}
+
+/**
+ * Writes the reservoirs of strata with few rows and the remaining sampled
+ * rows, then replaces the sample files of the export unit.
+ */
+static void sample_writer_end(SampleWriter *sampler) {
+  if (sampler->strata != NULL) {
+    HASH_SEQ_STATUS status;
+    hash_seq_init(&status, sampler->strata);
+    Stratum *stratum;
+    while ((stratum = hash_seq_search(&status)) != NULL) {
+      if (stratum->rows != NULL) {
+        sample_writer_write_stratum(sampler, stratum);
+      }
+    }
+  }
+  chunk_writer_finish(&sampler->writer);
+  move_temp_files(sampler->entry.table_name, sampler->file_prefix);
+  elog(LOG, "Refreshed sample %s with %d files", sampler->entry.table_name,
+       sampler->num_of_files);
+  if (sampler->strata != NULL) {
+    hash_destroy(sampler->strata);
+  }
+  if (sampler->file_prefix != NULL) {
+    pfree(sampler->file_prefix);
+  }
+  ExecDropSingleTupleTableSlot(sampler->slot);
+  FreeTupleDesc(sampler->tupdesc);
+  g_object_unref(sampler->schema);
+  pfree(sampler->column_info);
+  free_column_encodings(&sampler->encodings);
+  free_export_entry(&sampler->entry);
+  MemoryContextDelete(sampler->context);
+}
+
+/**
+ * Exports rows of relation selected by row_clause, the WHERE and ORDER BY
+ * clauses of the query reading the relation, into the columnar file at path,
+ * or into a file per bucket named after path for bucketed tables. Rows are
+ * also passed to sampler unless it is NULL.
+ * Returns the number of rows written.
+ * Expects SPI connection to be established.
+ */
+static int64 export_chunk(const char *relation_name, const ExportEntry *entry,
+                          GArrowSchema *arrow_schema,
+                          const ColumnInfo *column_info, int total_columns,
+                          const char *column_str, const char *row_clause,
+                          const char *path, ExportSample *sample,
+                          ColumnEncodings *encodings, SampleWriter *sampler) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  // column_str and the schema both list columns in the order of
+  // columns_to_export, so result columns match schema fields by position.
+  appendStringInfo(&buf, "SELECT %s", column_str);
+  if (entry->num_of_buckets > 0) {
+    appendStringInfo(&buf, ", analytica_bucket(%s, %d)", entry->bucket_column,
+                     entry->num_of_buckets);
+  }
+  appendStringInfo(&buf, " FROM %s %s;", relation_name, row_clause);
+
+  // Rows are streamed into the columnar files as the executor produces
+  // them.
+  ChunkWriter *writers = palloc(Max(entry->num_of_buckets, 1) *
+                                sizeof(ChunkWriter));
+  BucketWriter router;
+  SPIExecuteOptions options;
+  memset(&options, 0, sizeof(SPIExecuteOptions));
+  options.read_only = true;
+  options.dest =
+      chunk_writers_init(writers, &router, entry, arrow_schema, column_info,
+                         total_columns, path, sample, encodings, sampler);
+  elog(DEBUG1, "Executing SPI_execute_extended query %s", buf.data);
+  SetCurrentStatementStartTimestamp();
+  SavedRole saved_role;
+  switch_to_role(entry->registered_by, &saved_role);
+  int select = SPI_execute_extended(buf.data, &options);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute_extended command with status %d", select);
+
+  if (select != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("SELECT Query execution failed")));
+  }
+  int64 num_of_rows = chunk_writers_finish(writers, entry);
+  elog(LOG, "Processed " INT64_FORMAT " rows", num_of_rows);
+  pfree(writers);
+  pfree(buf.data);
+  return num_of_rows;
+}
+
+/**
+ * Exports rows of relation in blocks [start_block, end_block) that pass the
+ * export filter of table as in export_chunk. Rows of column groups are
+ * written in ctid order so that files of columns exported later line up.
+ * Expects SPI connection to be established.
+ */
+static int64 export_block_range(const char *relation_name,
+                                const ExportEntry *entry,
+                                GArrowSchema *arrow_schema,
+                                const ColumnInfo *column_info,
+                                int total_columns, const char *column_str,
+                                int64 start_block, int64 end_block,
+                                const char *path, ExportSample *sample,
+                                ColumnEncodings *encodings,
+                                SampleWriter *sampler) {
+  StringInfoData row_clause;
+  initStringInfo(&row_clause);
+  appendStringInfo(&row_clause,
+                   "WHERE ctid >= '(" INT64_FORMAT ",0)'::tid AND ctid < '("
+                   INT64_FORMAT ",0)'::tid",
+                   start_block, end_block);
+  append_export_filter(&row_clause, entry);
+  if (entry->layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+    appendStringInfoString(&row_clause, " ORDER BY ctid");
+  }
+  int64 num_of_rows = export_chunk(
+      relation_name, entry, arrow_schema, column_info, total_columns,
+      column_str, row_clause.data, path, sample, encodings, sampler);
+  pfree(row_clause.data);
+  return num_of_rows;
+}
+
+/**
+ * Returns a digest of the ctid and xmin of the rows of relation in blocks
+ * [start_block, end_block). Updates, including HOT updates, and deletes
+ * change the digest even when the write counters of the fingerprint haven't
+ * been flushed yet.
+ * Expects SPI connection to be established.
+ */
+static char *get_block_range_rows(const char *relation_name,
+                                  const ExportEntry *entry, int64 start_block,
+                                  int64 end_block) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT coalesce(md5(string_agg(ctid::text || ':' || "
+                   "xmin::text, ',' ORDER BY ctid)), '') FROM %s "
+                   "WHERE ctid >= '(" INT64_FORMAT ",0)'::tid AND ctid < '("
+                   INT64_FORMAT ",0)'::tid;",
+                   relation_name, start_block, end_block);
+  SavedRole saved_role;
+  switch_to_role(entry->registered_by, &saved_role);
+  int status = SPI_execute(buf.data, true, 0);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to read row versions of %s",
+                           relation_name)));
+  }
+  pfree(buf.data);
+  return SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+}
+
+/**
+ * Btree index a relation is exported through in chunks of consecutive keys.
+ * Covering indexes hold every exported column so that the relation can be
+ * exported with index-only scans.
+ */
+typedef struct _ExportIndex {
+  char index_name[NAMEDATALEN];
+  // Key columns in index order separated by commas, and the same columns
+  // each followed by DESC.
+  char *key_columns;
+  char *descending_key_columns;
+  // SQL expression quoting the key columns of a row into a single string
+  // that can be compared against the key columns.
+  char *quoted_key;
+} ExportIndex;
+
+/**
+ * Finds the smallest btree index of relation whose key and included columns
+ * hold every exported column. Key columns must be NOT NULL, fixed-width,
+ * ascending and use their default operator class so that chunks can be
+ * bounded by row comparisons of keys. Returns false if there is no such
+ * index, it isn't smaller than the heap or too few heap pages are
+ * all-visible for index-only scans to skip the heap.
+ * Expects SPI connection to be established.
+ */
+static bool find_covering_index(const char *relation_name,
+                                const char *column_str, ExportIndex *out) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(
+      &buf,
+      "SELECT ic.relname, "
+      "string_agg(a.attname::text, ', ' ORDER BY k.n) "
+      "FILTER (WHERE k.n <= i.indnkeyatts), "
+      "string_agg(a.attname::text || ' DESC', ', ' ORDER BY k.n) "
+      "FILTER (WHERE k.n <= i.indnkeyatts), "
+      "'concat_ws('', '', ' || string_agg('quote_literal(' || "
+      "a.attname::text || ')', ', ' ORDER BY k.n) "
+      "FILTER (WHERE k.n <= i.indnkeyatts) || ')', "
+      "r.relallvisible::float8 / r.relpages "
+      "FROM pg_index i "
+      "JOIN pg_class r ON r.oid = i.indrelid "
+      "JOIN pg_class ic ON ic.oid = i.indexrelid "
+      "JOIN pg_am am ON am.oid = ic.relam "
+      "CROSS JOIN LATERAL unnest(i.indkey::int2[], i.indclass::oid[]) "
+      "WITH ORDINALITY AS k(attnum, opclass, n) "
+      "JOIN pg_attribute a ON a.attrelid = i.indrelid "
+      "AND a.attnum = k.attnum "
+      "JOIN pg_type t ON t.oid = a.atttypid "
+      "LEFT JOIN pg_opclass opc ON opc.oid = k.opclass "
+      "WHERE i.indrelid = %s::regclass AND am.amname = 'btree' "
+      "AND i.indisvalid AND i.indisready AND i.indexprs IS NULL "
+      "AND i.indpred IS NULL AND i.indnkeyatts <= %d "
+      "AND 0 = ALL(i.indoption::int2[]) "
+      "AND r.relpages > 0 AND ic.relpages < r.relpages "
+      "GROUP BY ic.relname, ic.relpages, i.indnkeyatts, r.relallvisible, "
+      "r.relpages "
+      "HAVING array_agg(a.attname::text) @> '{%s}'::text[] "
+      "AND bool_and(k.n > i.indnkeyatts OR "
+      "(a.attnotnull AND t.typlen > 0 AND opc.opcdefault)) "
+      "ORDER BY ic.relpages LIMIT 1;",
+      quote_literal_cstr(relation_name), MAX_COVERING_INDEX_KEYS, column_str);
+  int status = SPI_execute(buf.data, true, 0);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to find covering index of %s",
+                           relation_name)));
+  }
+  pfree(buf.data);
+  if (SPI_processed == 0) {
+    elog(LOG, "%s has no covering index", relation_name);
+    return false;
+  }
+  bool isnull;
+  HeapTuple tuple = SPI_tuptable->vals[0];
+  TupleDesc tupdesc = SPI_tuptable->tupdesc;
+  double all_visible_fraction =
+      DatumGetFloat8(SPI_getbinval(tuple, tupdesc, 5, &isnull));
+  char *index_name = SPI_getvalue(tuple, tupdesc, 1);
+  if (all_visible_fraction < MIN_ALL_VISIBLE_FRACTION) {
+    elog(LOG, "Not exporting %s through %s, only %.2f of pages are visible",
+         relation_name, index_name, all_visible_fraction);
+    return false;
+  }
+  elog(LOG, "Exporting %s through covering index %s", relation_name,
+       index_name);
+  strlcpy(out->index_name, index_name, NAMEDATALEN);
+  out->key_columns = SPI_getvalue(tuple, tupdesc, 2);
+  out->descending_key_columns = SPI_getvalue(tuple, tupdesc, 3);
+  out->quoted_key = SPI_getvalue(tuple, tupdesc, 4);
+  return true;
+}
+
+/**
+ * Finds a btree index of relation starting with window_column with its
+ * default operator class, so that rows within the window of the table are
+ * read without visiting older rows into out, unless it is NULL. Returns
+ * false if there is no such index.
+ * Expects SPI connection to be established.
+ */
+static bool find_window_index(const char *relation_name,
+                              const char *window_column, ExportIndex *out) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(
+      &buf,
+      "SELECT ic.relname FROM pg_index i "
+      "JOIN pg_class ic ON ic.oid = i.indexrelid "
+      "JOIN pg_am am ON am.oid = ic.relam "
+      "JOIN pg_attribute a ON a.attrelid = i.indrelid "
+      "AND a.attnum = i.indkey[0] "
+      "JOIN pg_opclass opc ON opc.oid = i.indclass[0] "
+      "WHERE i.indrelid = %s::regclass AND am.amname = 'btree' "
+      "AND i.indisvalid AND i.indisready AND i.indexprs IS NULL "
+      "AND i.indpred IS NULL AND opc.opcdefault AND a.attname = %s "
+      "ORDER BY ic.relpages LIMIT 1;",
+      quote_literal_cstr(relation_name), quote_literal_cstr(window_column));
+  int status = SPI_execute(buf.data, true, 0);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to find window index of %s",
+                           relation_name)));
+  }
+  pfree(buf.data);
+  if (SPI_processed == 0) {
+    elog(LOG, "%s has no index on window column %s", relation_name,
+         window_column);
+    return false;
+  }
+  if (out == NULL) {
+    return true;
+  }
+  char *index_name =
+      SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+  elog(LOG, "Exporting %s through window index %s", relation_name,
+       index_name);
+  const char *column = quote_identifier(window_column);
+  strlcpy(out->index_name, index_name, NAMEDATALEN);
+  out->key_columns = pstrdup(column);
+  out->descending_key_columns = psprintf("%s DESC", column);
+  out->quoted_key = psprintf("quote_literal(%s)", column);
+  return true;
+}
+
+/**
+ * Populates in out the quoted key of the last exported row of relation in
+ * index order. Returns false if the relation has no exported rows.
+ * Assumes out has MAX_CHECKPOINT_LINE_CHARS space available.
+ * Expects SPI connection to be established.
+ */
+static bool get_last_key(const char *relation_name, const ExportEntry *entry,
+                         const ExportIndex *index, char *out) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf, "SELECT %s FROM %s WHERE true", index->quoted_key,
+                   relation_name);
+  append_export_filter(&buf, entry);
+  appendStringInfo(&buf, " ORDER BY %s LIMIT 1;",
+                   index->descending_key_columns);
+  SavedRole saved_role;
+  switch_to_role(entry->registered_by, &saved_role);
+  int status = SPI_execute(buf.data, true, 0);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to find last key of %s", relation_name)));
+  }
+  pfree(buf.data);
+  if (SPI_processed == 0) {
+    return false;
+  }
+  char *key = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+  if (strlen(key) >= MAX_CHECKPOINT_LINE_CHARS - NAMEDATALEN) {
+    ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                    errmsg("Key %s of %s is too long to checkpoint", key,
+                           relation_name)));
+  }
+  strcpy(out, key);
+  pfree(key);
+  return true;
+}
+
+/**
+ * Writes rows of an index scan into chunk files of roughly chunk_size rows,
+ * starting the next file once the current one is full and the key changes
+ * so that rows sharing a key end up in the same file. The query returns the
+ * quoted key of each row after the exported columns and bucket.
+ */
+typedef struct _IndexChunkWriter {
+  DestReceiver pub;
+  const ExportEntry *entry;
+  GArrowSchema *schema;
+  const ColumnInfo *column_info;
+  int total_columns;
+  const char *file_prefix;
+  ExportSample *sample;
+  ColumnEncodings *encodings;
+  SampleWriter *sampler;
+  ExportCheckpoint *checkpoint;
+  int key_attribute;
+  ChunkWriter *writers;
+  BucketWriter router;
+  DestReceiver *dest;
+  int64 num_of_chunk_rows;
+  int64 num_of_rows;
+  // Quoted key of the last row of the current file.
+  StringInfoData last_key;
+  // Context outliving the query, files are opened in it.
+  MemoryContext context;
+} IndexChunkWriter;
+
+static void index_chunk_writer_open_file(IndexChunkWriter *router) {
+  char path[PATH_MAX];
+  populate_temp_file_path(router->entry, router->file_prefix,
+                          router->checkpoint->next_chunk, path);
+  router->dest = chunk_writers_init(
+      router->writers, &router->router, router->entry, router->schema,
+      router->column_info, router->total_columns, path, router->sample,
+      router->encodings, router->sampler);
+  router->num_of_chunk_rows = 0;
+}
+
+/*
+ * Finishes the current file and saves the key it ends at to the checkpoint.
+ */
+static void index_chunk_writer_finish_file(IndexChunkWriter *router) {
+  ExportCheckpoint *checkpoint = router->checkpoint;
+  int64 num_of_rows = chunk_writers_finish(router->writers, router->entry);
+  if (num_of_rows == 0) {
+    return;
+  }
+  router->num_of_rows += num_of_rows;
+  if (router->last_key.len >= MAX_CHECKPOINT_LINE_CHARS - NAMEDATALEN) {
+    ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                    errmsg("Key %s of %s is too long to checkpoint",
+                           router->last_key.data, router->entry->table_name)));
+  }
+  checkpoint->next_chunk += 1;
+  strlcpy(checkpoint->next_key, router->last_key.data,
+          MAX_CHECKPOINT_LINE_CHARS);
+  save_export_checkpoint(router->entry->table_name, checkpoint);
+}
+
+static bool index_chunk_writer_receive(TupleTableSlot *slot,
+                                       DestReceiver *self) {
+  IndexChunkWriter *router = (IndexChunkWriter *)self;
+  bool isnull;
+  text *key =
+      DatumGetTextPP(slot_getattr(slot, router->key_attribute + 1, &isnull));
+  const char *key_data = VARDATA_ANY(key);
+  int key_length = VARSIZE_ANY_EXHDR(key);
+  bool is_same_key = router->last_key.len == key_length &&
+                     memcmp(router->last_key.data, key_data, key_length) == 0;
+  MemoryContext old_context = MemoryContextSwitchTo(router->context);
+  if (router->num_of_chunk_rows >= router->entry->chunk_size &&
+      !is_same_key) {
+    index_chunk_writer_finish_file(router);
+    index_chunk_writer_open_file(router);
+  }
+  if (!is_same_key) {
+    resetStringInfo(&router->last_key);
+    appendBinaryStringInfo(&router->last_key, key_data, key_length);
+  }
+  MemoryContextSwitchTo(old_context);
+  router->num_of_chunk_rows += 1;
+  return router->dest->receiveSlot(slot, router->dest);
+}
+
+/**
+ * Exports rows of relation through a scan of index, in chunks of roughly
+ * chunk_size consecutive keys. Scans of a covering index are index-only and
+ * only visit heap pages that aren't all-visible. Progress is saved to the
+ * checkpoint as the last exported key after every file. The export ends at
+ * the largest key when it started, rows with larger keys are picked up by
+ * the next export. Returns the number of rows written.
+ * Expects SPI connection to be established.
+ */
+static int64 export_index_chunks(const ExportUnit *unit,
+                                 const char *file_prefix,
+                                 const ExportEntry *entry,
+                                 GArrowSchema *arrow_schema,
+                                 const ColumnInfo *column_info,
+                                 int total_columns, const char *column_str,
+                                 const ExportIndex *index,
+                                 ExportCheckpoint *checkpoint,
+                                 ExportSample *sample,
+                                 ColumnEncodings *encodings,
+                                 SampleWriter *sampler) {
+  if (checkpoint->end_key[0] == '\0') {
+    elog(LOG, "%s has no rows to export", unit->relation_name);
+    return 0;
+  }
+  // Keeps the planner on the index, the settings are restored once the
+  // relation is exported.
+  int nest_level = NewGUCNestLevel();
+  set_config_option("enable_seqscan", "off", PGC_USERSET, PGC_S_SESSION,
+                    GUC_ACTION_SAVE, true, 0, false);
+  set_config_option("enable_bitmapscan", "off", PGC_USERSET, PGC_S_SESSION,
+                    GUC_ACTION_SAVE, true, 0, false);
+
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf, "SELECT %s", column_str);
+  if (entry->num_of_buckets > 0) {
+    appendStringInfo(&buf, ", analytica_bucket(%s, %d)", entry->bucket_column,
+                     entry->num_of_buckets);
+  }
+  appendStringInfo(&buf, ", %s FROM %s WHERE (%s) <= (%s)", index->quoted_key,
+                   unit->relation_name, index->key_columns,
+                   checkpoint->end_key);
+  if (checkpoint->next_key[0] != '\0') {
+    appendStringInfo(&buf, " AND (%s) > (%s)", index->key_columns,
+                     checkpoint->next_key);
+  }
+  append_export_filter(&buf, entry);
+  appendStringInfo(&buf, " ORDER BY %s;", index->key_columns);
+
+  IndexChunkWriter router;
+  memset(&router, 0, sizeof(IndexChunkWriter));
+  router.pub.receiveSlot = index_chunk_writer_receive;
+  router.pub.rStartup = chunk_writer_startup;
+  router.pub.rShutdown = chunk_writer_shutdown;
+  router.pub.rDestroy = chunk_writer_destroy;
+  router.pub.mydest = DestTuplestore;
+  router.entry = entry;
+  router.schema = arrow_schema;
+  router.column_info = column_info;
+  router.total_columns = total_columns;
+  router.file_prefix = file_prefix;
+  router.sample = sample;
+  router.encodings = encodings;
+  router.sampler = sampler;
+  router.checkpoint = checkpoint;
+  router.key_attribute =
+      entry->num_of_columns + (entry->num_of_buckets > 0 ? 1 : 0);
+  router.writers =
+      palloc(Max(entry->num_of_buckets, 1) * sizeof(ChunkWriter));
+  router.context = CurrentMemoryContext;
+  initStringInfo(&router.last_key);
+  index_chunk_writer_open_file(&router);
+
+  SPIExecuteOptions options;
+  memset(&options, 0, sizeof(SPIExecuteOptions));
+  options.read_only = true;
+  options.dest = (DestReceiver *)&router;
+  elog(DEBUG1, "Executing SPI_execute_extended query %s", buf.data);
+  SetCurrentStatementStartTimestamp();
+  SavedRole saved_role;
+  switch_to_role(entry->registered_by, &saved_role);
+  int status = SPI_execute_extended(buf.data, &options);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute_extended command with status %d", status);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("SELECT Query execution failed")));
+  }
+  index_chunk_writer_finish_file(&router);
+  pfree(router.writers);
+  pfree(router.last_key.data);
+  pfree(buf.data);
+  AtEOXact_GUC(true, nest_level);
+  return router.num_of_rows;
+}
+
+/**
+ * Exports rows of relation into columnar files in the temp directory
+ * of table. Files are prefixed with file_prefix.
+ *
+ * The relation is read in ranges of heap blocks sized to hold roughly
+ * chunk_size rows. Progress is saved to the checkpoint after every file so
+ * that an interrupted export resumes from the last written file. The export
+ * covers the blocks present when it first started, rows added to the relation
+ * afterwards are picked up by the next export. Relations of tables with a
+ * window and an index on the window column are read through that index
+ * instead, and so are relations with a covering index that are mostly
+ * all-visible.
+ * Exported rows are added to sample.
+ * Expects SPI connection to be established.
+ */
+static void export_relation_chunks(ExportUnit *unit,
+                                   const char *file_prefix,
+                                   const ExportEntry *entry,
+                                   GArrowSchema *arrow_schema,
+                                   const ColumnInfo *column_info,
+                                   int total_columns, const char *column_str,
+                                   ExportCheckpoint *checkpoint,
+                                   ExportSample *sample,
+                                   ColumnEncodings *encodings) {
+  Oid relfilenode;
+  int64 num_of_blocks;
+  double tuples_per_block;
+  get_relation_layout(unit->relation_name, &relfilenode, &num_of_blocks,
+                      &tuples_per_block);
+  // Files of the column groups layout are named after their heap blocks.
+  // An index on the window column skips rows that aged out of the window,
+  // which usually outweighs index-only scans of a covering index.
+  ExportIndex index;
+  bool use_index =
+      entry->layout == EXPORT_LAYOUT_ROWS &&
+      ((entry->window_start != NULL &&
+        find_window_index(unit->relation_name, entry->window_column,
+                          &index)) ||
+       find_covering_index(unit->relation_name, column_str, &index));
+  const char *index_name = use_index ? index.index_name : "";
+
+  // Checkpoints of index exports without an end key can't be resumed.
+  // Relations written since the interrupted export started are read again
+  // in full, so that every file holds rows of the same snapshot.
+  if (strcmp(checkpoint->relation_name, unit->relation_name) == 0 &&
+      checkpoint->relfilenode == relfilenode &&
+      strcmp(checkpoint->relation_fingerprint, unit->fingerprint) == 0 &&
+      strcmp(checkpoint->index_name, index_name) == 0 &&
+      (!use_index || checkpoint->end_key[0] != '\0')) {
+    elog(LOG, "Resuming export of %s at block " INT64_FORMAT " of " INT64_FORMAT
+         ", key %s",
+         unit->relation_name, checkpoint->next_block,
+         checkpoint->boundary_block, checkpoint->next_key);
+  } else {
+    // Discard files of an earlier attempt that can't be resumed.
+    char temp_path[PATH_MAX];
+    populate_temp_path_for_table(entry->table_name, temp_path,
+                                 /*relative=*/false);
+    delete_files_with_prefix(temp_path, file_prefix);
+
+    strlcpy(checkpoint->relation_name, unit->relation_name,
+            MAX_CHECKPOINT_LINE_CHARS);
+    strlcpy(checkpoint->relation_fingerprint, unit->fingerprint, NAMEDATALEN);
+    checkpoint->relfilenode = relfilenode;
+    checkpoint->boundary_block = num_of_blocks;
+    checkpoint->next_block = 0;
+    checkpoint->next_chunk = 0;
+    strlcpy(checkpoint->index_name, index_name, NAMEDATALEN);
+    checkpoint->next_key[0] = '\0';
+    checkpoint->end_key[0] = '\0';
+    if (use_index) {
+      get_last_key(unit->relation_name, entry, &index, checkpoint->end_key);
+    }
+  }
+
+  if (tuples_per_block <= 0) {
+    tuples_per_block = DEFAULT_TUPLES_PER_BLOCK;
+  }
+  // Rows written before the export was interrupted weren't sampled.
+  if (use_index) {
+    sample->num_of_unsampled_rows +=
+        (double)checkpoint->next_chunk * entry->chunk_size;
+  } else {
+    sample->num_of_unsampled_rows += checkpoint->next_block * tuples_per_block;
+  }
+  int64 blocks_per_chunk =
+      Max(1, (int64)(entry->chunk_size / tuples_per_block));
+  int64 processed_count = 0;
+  // Sample files are only replaced by exports reading the whole relation.
+  SampleWriter sampler;
+  bool is_sampled = export_entry_has_sample(entry) &&
+                    checkpoint->next_block == 0 &&
+                    checkpoint->next_key[0] == '\0';
+  if (is_sampled) {
+    sample_writer_begin(&sampler, entry, column_info, total_columns,
+                        file_prefix);
+  }
+
+  if (use_index) {
+    processed_count = export_index_chunks(
+        unit, file_prefix, entry, arrow_schema, column_info, total_columns,
+        column_str, &index, checkpoint, sample, encodings,
+        is_sampled ? &sampler : NULL);
+  } else {
+    for (int64 block = checkpoint->next_block;
+         block < checkpoint->boundary_block; block += blocks_per_chunk) {
+      int64 end_block =
+          Min(block + blocks_per_chunk, checkpoint->boundary_block);
+      char path[PATH_MAX];
+      char *row_versions = NULL;
+      if (entry->layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+        // Files are named after their blocks so that columns added later can
+        // be exported for the same rows.
+        populate_column_group_chunk_path(entry, block, end_block, path);
+        row_versions =
+            get_block_range_rows(unit->relation_name, entry, block, end_block);
+      } else {
+        populate_temp_file_path(entry, file_prefix, checkpoint->next_chunk,
+                                path);
+      }
+      int64 num_of_rows = export_block_range(
+          unit->relation_name, entry, arrow_schema, column_info, total_columns,
+          column_str, block, end_block, path, sample, encodings,
+          is_sampled ? &sampler : NULL);
+      // Rows of the chunk are only known when they didn't change while it
+      // was exported.
+      if (row_versions != NULL && num_of_rows > 0 &&
+          strcmp(row_versions,
+                 get_block_range_rows(unit->relation_name, entry, block,
+                                      end_block)) == 0) {
+        append_column_group_rows(entry->table_name, block, end_block,
+                                 row_versions);
+      }
+      if (num_of_rows > 0) {
+        processed_count += num_of_rows;
+        checkpoint->next_chunk += 1;
+        checkpoint->next_block = end_block;
+        save_export_checkpoint(entry->table_name, checkpoint);
+      }
+    }
+  }
+  if (is_sampled) {
+    sample_writer_end(&sampler);
+  }
+  elog(LOG, "Finished processing " INT64_FORMAT " rows of %s", processed_count,
+       unit->relation_name);
+}
+
+/**
+ * Exports each leaf partition of a partitioned table, units as returned by
+ * get_partitions_to_export, into its own set of columnar files. Partitions
+ * that haven't changed since the previous export are skipped and files of
+ * detached, dropped or expired partitions are deleted.
+ * Expects SPI connection to be established.
+ */
+static void export_partitioned_table_data(const ExportEntry *entry,
+                                          ExportUnit *units, int num_of_units,
+                                          GArrowSchema *arrow_schema,
+                                          const ColumnInfo *column_info,
+                                          int total_columns,
+                                          const char *column_str,
+                                          ExportCheckpoint *checkpoint,
+                                          ExportSample *sample,
+                                          ColumnEncodings *encodings) {
+  elog(LOG, "Found %d leaf partitions for %s", num_of_units,
+       entry->table_name);
+
+  for (int i = 0; i < num_of_units; i += 1) {
+    if (units[i].is_expired) {
+      elog(LOG, "Skipping partition %s outside the window",
+           units[i].relation_name);
+      continue;
+    }
+    char completed_fingerprint[NAMEDATALEN];
+    if (export_checkpoint_find_completed(checkpoint, units[i].partition_name,
+                                         completed_fingerprint)) {
+      // Partition was exported before the worker was interrupted.
+      elog(LOG, "Partition %s was exported before export was interrupted",
+           units[i].relation_name);
+      strlcpy(units[i].fingerprint, completed_fingerprint,
+              MAX_FINGERPRINT_CHARS);
+      save_partition_fingerprint(entry->table_name, &units[i]);
+      sample->num_of_unsampled_rows +=
+          estimate_relation_rows(units[i].relation_name);
+      continue;
+    }
+    if (!units[i].needs_export) {
+      elog(LOG, "Skipping unchanged partition %s", units[i].relation_name);
+      sample->num_of_unsampled_rows +=
+          estimate_relation_rows(units[i].relation_name);
+      continue;
+    }
+    char file_prefix[NAMEDATALEN + 1];
+    snprintf(file_prefix, sizeof(file_prefix), "%s.", units[i].partition_name);
+
+    elog(LOG, "Exporting partition %s", units[i].relation_name);
+    export_relation_chunks(&units[i], file_prefix, entry, arrow_schema,
+                           column_info, total_columns, column_str, checkpoint,
+                           sample, encodings);
+    // Replace files of the partition from the previous export.
+    lock_fresh_view(entry);
+    move_temp_files(entry->table_name, file_prefix);
+    save_partition_fingerprint(entry->table_name, &units[i]);
+
+    export_checkpoint_add_completed(checkpoint, units[i].partition_name,
+                                    units[i].fingerprint);
+    checkpoint->relation_name[0] = '\0';
+    save_export_checkpoint(entry->table_name, checkpoint);
+  }
+  remove_stale_partitions(entry->table_name, units, num_of_units);
+}
+
+/*
+ * Returns true if the export adds files to those of earlier exports, which
+ * incremental query exports do once they have a watermark.
+ */
+static bool is_appending_export(const ExportEntry *entry) {
+  return entry->incremental_key != NULL && entry->watermark != NULL;
+}
+
+/**
+ * Writes rows of an exported query into columnar files of chunk_size rows,
+ * starting a new file once the current one is full. Queries can't be read
+ * in ranges of heap blocks so their rows come from a single execution.
+ */
+typedef struct _QueryChunkWriter {
+  DestReceiver pub;
+  const ExportEntry *entry;
+  GArrowSchema *schema;
+  const ColumnInfo *column_info;
+  int total_columns;
+  const char *file_prefix;
+  ExportSample *sample;
+  ColumnEncodings *encodings;
+  ChunkWriter writer;
+  int num_of_files;
+  int64 num_of_rows;
+  // Context outliving the query, files are opened in it.
+  MemoryContext context;
+} QueryChunkWriter;
+
+static void query_chunk_writer_open_file(QueryChunkWriter *router) {
+  char path[PATH_MAX];
+  populate_temp_file_path(router->entry, router->file_prefix,
+                          router->num_of_files, path);
+  chunk_writer_init(&router->writer, router->entry, router->schema,
+                    router->column_info, router->total_columns, path,
+                    router->sample, router->encodings);
+  router->num_of_files += 1;
+}
+
+static bool query_chunk_writer_receive(TupleTableSlot *slot,
+                                       DestReceiver *self) {
+  QueryChunkWriter *router = (QueryChunkWriter *)self;
+  bool result = chunk_writer_receive(slot, (DestReceiver *)&router->writer);
+  if (router->writer.num_of_rows >= router->entry->chunk_size) {
+    MemoryContext old_context = MemoryContextSwitchTo(router->context);
+    router->num_of_rows += chunk_writer_finish(&router->writer);
+    query_chunk_writer_open_file(router);
+    MemoryContextSwitchTo(old_context);
+  }
+  return result;
+}
+
+/**
+ * Exports rows of the query of entry into columnar files in the temp
+ * directory of table, prefixed with file_prefix. Incremental queries only
+ * export rows with keys past the watermark of the previous export, up to
+ * the next watermark. Exported rows are added to sample.
+ * Expects SPI connection to be established.
+ */
+static void export_query_chunks(const ExportEntry *entry,
+                                const char *file_prefix,
+                                GArrowSchema *arrow_schema,
+                                const ColumnInfo *column_info,
+                                int total_columns, const char *column_str,
+                                ExportSample *sample,
+                                ColumnEncodings *encodings) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf, "SELECT %s FROM (%s) AS " QUERY_SOURCE_ALIAS,
+                   column_str, entry->source_query);
+  if (entry->incremental_key != NULL) {
+    // Rows without a key are never exported.
+    appendStringInfo(&buf, " WHERE %s IS NOT NULL", entry->incremental_key);
+    if (entry->watermark != NULL) {
+      appendStringInfo(&buf, " AND %s > %s", entry->incremental_key,
+                       quote_literal_cstr(entry->watermark));
+    }
+    if (entry->next_watermark != NULL) {
+      appendStringInfo(&buf, " AND %s <= %s", entry->incremental_key,
+                       quote_literal_cstr(entry->next_watermark));
+    }
+  }
+  appendStringInfoChar(&buf, ';');
+
+  QueryChunkWriter router;
+  memset(&router, 0, sizeof(QueryChunkWriter));
+  router.pub.receiveSlot = query_chunk_writer_receive;
+  router.pub.rStartup = chunk_writer_startup;
+  router.pub.rShutdown = chunk_writer_shutdown;
+  router.pub.rDestroy = chunk_writer_destroy;
+  router.pub.mydest = DestTuplestore;
+  router.entry = entry;
+  router.schema = arrow_schema;
+  router.column_info = column_info;
+  router.total_columns = total_columns;
+  router.file_prefix = file_prefix;
+  router.sample = sample;
+  router.encodings = encodings;
+  router.context = CurrentMemoryContext;
+  query_chunk_writer_open_file(&router);
+
+  SPIExecuteOptions options;
+  memset(&options, 0, sizeof(SPIExecuteOptions));
+  options.read_only = true;
+  options.dest = (DestReceiver *)&router;
+  elog(DEBUG1, "Executing SPI_execute_extended query %s", buf.data);
+  SetCurrentStatementStartTimestamp();
+  SavedRole saved_role;
+  switch_to_role(entry->registered_by, &saved_role);
+  int status = SPI_execute_extended(buf.data, &options);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute_extended command with status %d", status);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("SELECT Query execution failed")));
+  }
+  router.num_of_rows += chunk_writer_finish(&router.writer);
+  elog(LOG, "Finished processing " INT64_FORMAT
+       " rows of query %s into %d files",
+       router.num_of_rows, entry->table_name, router.num_of_files);
+  pfree(buf.data);
+}
+
+/*
+ * Returns the largest value of column among rows of source, a relation or
+ * subquery read as role, past watermark unless it is NULL. Returns NULL if
+ * there are no such rows.
+ * Expects SPI connection to be established.
+ */
+static char *read_watermark(const char *source, const char *column,
+                            const char *watermark, Oid role) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf, "SELECT max(%s)::text FROM %s", column, source);
+  if (watermark != NULL) {
+    appendStringInfo(&buf, " WHERE %s > %s", column,
+                     quote_literal_cstr(watermark));
+  }
+  appendStringInfoChar(&buf, ';');
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
+  SavedRole saved_role;
+  switch_to_role(role, &saved_role);
+  int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/0);
+  restore_role(&saved_role);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to read watermark of %s", source)));
+  }
+  pfree(buf.data);
+  return SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+}
+
+/**
+ * Sets the next watermark of an incremental query export to the largest
+ * key of its rows, allocated in context. It is left NULL if no row has a
+ * key past the watermark. Read in the snapshot the rows are exported from,
+ * rows committed later with smaller keys are never exported.
+ * Expects SPI connection to be established.
+ */
+static void set_next_watermark(ExportEntry *entry, MemoryContext context) {
+  char *source = psprintf("(%s) AS " QUERY_SOURCE_ALIAS, entry->source_query);
+  char *watermark =
+      read_watermark(source, entry->incremental_key, entry->watermark,
+                     entry->registered_by);
+  if (watermark != NULL) {
+    MemoryContext old_context = MemoryContextSwitchTo(context);
+    export_entry_set_next_watermark(entry, watermark);
+    MemoryContextSwitchTo(old_context);
+  }
+  pfree(source);
+}
+
+/**
+ * Sets the start of the window of table for the current export, allocated
+ * in context. Every chunk of an export is cut at the same time, resumed
+ * exports keep the window start of checkpoint unless it is NULL.
+ * Expects SPI connection to be established.
+ */
+static void set_window_start(ExportEntry *entry,
+                             const ExportCheckpoint *checkpoint,
+                             MemoryContext context) {
+  if (checkpoint != NULL && checkpoint->window_start[0] != '\0') {
+    MemoryContext old_context = MemoryContextSwitchTo(context);
+    export_entry_set_window_start(entry, checkpoint->window_start);
+    MemoryContextSwitchTo(old_context);
+    elog(LOG, "Resuming export of rows of %s since %s", entry->table_name,
+         checkpoint->window_start);
+    return;
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf, "SELECT (now() - %s::interval)::text;",
+                   quote_literal_cstr(entry->window_interval));
+  int status = SPI_execute(buf.data, true, 0);
+  elog(DEBUG1, "Executed SPI_execute query %s with status %d", buf.data,
+       status);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to compute window of %s",
+                           entry->table_name)));
+  }
+  char *window_start =
+      SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+  MemoryContext old_context = MemoryContextSwitchTo(context);
+  export_entry_set_window_start(entry, window_start);
+  MemoryContextSwitchTo(old_context);
+  elog(LOG, "Exporting rows of %s since %s", entry->table_name, window_start);
+  pfree(buf.data);
+}
+
+/**
+ * Sets the next watermark of a table with a fresh view to the largest value
+ * of its fresh column, allocated in context. Rows up to it are exported and
+ * the view reads the rest from the table. A resumed export keeps the
+ * watermark recorded in checkpoint when it started. The watermark is left
+ * NULL if the table has no values, then only rows without one are exported.
+ * Expects SPI connection to be established.
+ */
+static void set_fresh_watermark(ExportEntry *entry,
+                                ExportCheckpoint *checkpoint,
+                                MemoryContext context) {
+  if (entry->source_query != NULL || !has_fresh_view(entry)) {
+    return;
+  }
+  if (!checkpoint->has_fresh_watermark) {
+    char *watermark =
+        read_watermark(entry->table_name, entry->fresh_column,
+                       /*watermark=*/NULL, entry->registered_by);
+    checkpoint->has_fresh_watermark = true;
+    strlcpy(checkpoint->fresh_watermark, watermark == NULL ? "" : watermark,
+            MAX_CHECKPOINT_LINE_CHARS);
+  }
+  if (checkpoint->fresh_watermark[0] != '\0') {
+    MemoryContext old_context = MemoryContextSwitchTo(context);
+    export_entry_set_next_watermark(entry, checkpoint->fresh_watermark);
+    MemoryContextSwitchTo(old_context);
+  }
+  elog(LOG, "Exporting rows of %s up to watermark %s", entry->table_name,
+       checkpoint->fresh_watermark);
+}
+
+/*
+ * Returns the oids of the relations query, planned as role, depends on,
+ * including those read through views, as an array literal. Sets
+ * is_immutable to whether the query, including its views, calls no stable
+ * or volatile functions, which may read other relations or the time.
+ * Expects SPI connection to be established.
+ */
+static char *get_query_relations(const char *query, Oid role,
+                                 bool *is_immutable) {
+  SavedRole saved_role;
+  switch_to_role(role, &saved_role);
+  SPIPlanPtr plan = SPI_prepare(query, 0, NULL);
+  restore_role(&saved_role);
+  if (plan == NULL) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to prepare exported query: %s",
+                           SPI_result_code_string(SPI_result))));
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfoChar(&buf, '{');
+  *is_immutable = true;
+  ListCell *source_cell;
+  foreach (source_cell, SPI_plan_get_plan_sources(plan)) {
+    CachedPlanSource *source = (CachedPlanSource *)lfirst(source_cell);
+    if (contain_mutable_functions((Node *)source->query_list)) {
+      *is_immutable = false;
+    }
+    ListCell *relation_cell;
+    foreach (relation_cell, source->relationOids) {
+      appendStringInfo(&buf, "%s%u", buf.len > 1 ? "," : "",
+                       lfirst_oid(relation_cell));
+    }
+  }
+  appendStringInfoChar(&buf, '}');
+  SPI_freeplan(plan);
+  return buf.data;
+}
+
+/**
+ * Populates fingerprint of the table contents in out.
+ * For partitioned tables the fingerprint covers all leaf partitions and for
+ * exported queries all tables the query reads. Results of queries calling
+ * functions that aren't immutable can change without their tables changing,
+ * they get an empty fingerprint and are exported every time.
+ * Assumes out has MAX_FINGERPRINT_CHARS space available.
+ * Expects SPI connection to be established.
+ */
+static void compute_table_fingerprint(const ExportEntry *entry, char *out) {
+  const char *table_name = entry->table_name;
+  StringInfoData leaves;
+  initStringInfo(&leaves);
+  if (entry->source_query != NULL) {
+    bool is_immutable;
+    char *relations = get_query_relations(
+        entry->source_query, entry->registered_by, &is_immutable);
+    if (!is_immutable) {
+      elog(LOG, "Query of %s isn't immutable", table_name);
+      out[0] = '\0';
+      pfree(relations);
+      pfree(leaves.data);
+      return;
+    }
+    // pg_partition_tree returns no rows for views, the tables they read
+    // are dependencies of the query as well.
+    appendStringInfo(&leaves,
+                     "unnest('%s'::oid[]) AS r(relid) CROSS JOIN LATERAL "
+                     "pg_partition_tree(r.relid::regclass)",
+                     relations);
+  } else {
+    appendStringInfo(&leaves, "pg_partition_tree(%s::regclass)",
+                     quote_literal_cstr(table_name));
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  // pg_partition_tree returns the table itself as the only leaf for
+  // tables that aren't partitioned.
+  appendStringInfo(&buf,
+                   "SELECT md5(string_agg(" RELATION_FINGERPRINT_SQL
+                   ", ',' ORDER BY c.oid)) "
+                   "FROM %s t "
+                   "JOIN pg_class c ON c.oid = t.relid "
+                   "LEFT JOIN pg_stat_all_tables s ON s.relid = t.relid "
+                   "WHERE t.isleaf;",
+                   leaves.data);
+  // Write counters are otherwise read once per transaction.
+  pgstat_clear_snapshot();
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
+  int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/0);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to compute fingerprint for %s",
+                           table_name)));
+  }
+  char *fingerprint =
+      SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+  strlcpy(out, fingerprint == NULL ? "" : fingerprint, MAX_FINGERPRINT_CHARS);
+  pfree(leaves.data);
+  pfree(buf.data);
+}
+
+static void get_table_fingerprint(const ExportEntry *entry, char *out) {
+  SetCurrentStatementStartTimestamp();
+  StartTransactionCommand();
+  PushActiveSnapshot(GetTransactionSnapshot());
+  int connection = SPI_connect();
+  if (connection < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to connect to database")));
+  }
+  compute_table_fingerprint(entry, out);
+  SPI_finish();
+  PopActiveSnapshot();
+  CommitTransactionCommand();
+}
+
+/*
+ * Initializes sample of the exported columns of the table.
+ */
+static void init_export_sample(ExportSample *sample, const ExportEntry *entry,
+                               const ColumnInfo *column_info,
+                               int total_columns) {
+  TupleDesc tupdesc = CreateTemplateTupleDesc(entry->num_of_columns);
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    const ColumnInfo *column = find_column_info(
+        column_info, total_columns, entry->columns_to_export[i]);
+    TupleDescInitEntry(tupdesc, i + 1, column->column_name,
+                       column->column_type, column->column_typmod, 0);
+    TupleDescInitEntryCollation(tupdesc, i + 1,
+                                get_typcollation(column->column_type));
+  }
+  export_sample_init(sample, tupdesc);
+  FreeTupleDesc(tupdesc);
+}
+
+static int compare_column_group_chunks(const void *a, const void *b) {
+  int64 start_a = ((const ColumnGroupChunk *)a)->start_block;
+  int64 start_b = ((const ColumnGroupChunk *)b)->start_block;
+  return start_a < start_b ? -1 : start_a > start_b;
+}
+
+/*
+ * Returns true if the table has no rows outside the block ranges of chunks,
+ * which are sorted by their first block. Ranges without files must have
+ * stayed empty for the existing files to hold every row.
+ * Expects SPI connection to be established.
+ */
+static bool column_group_chunks_cover_rows(const ExportEntry *entry,
+                                           const ColumnGroupChunk *chunks,
+                                           int num_of_chunks) {
+  Oid relfilenode;
+  int64 num_of_blocks;
+  double tuples_per_block;
+  get_relation_layout(entry->table_name, &relfilenode, &num_of_blocks,
+                      &tuples_per_block);
+  int64 block = 0;
+  for (int i = 0; i <= num_of_chunks; i += 1) {
+    int64 end_block = i < num_of_chunks ? chunks[i].start_block
+                                        : Max(num_of_blocks, block);
+    if (end_block > block &&
+        get_block_range_rows(entry->table_name, entry, block,
+                             end_block)[0] != '\0') {
+      return false;
+    }
+    if (i < num_of_chunks) {
+      block = Max(block, chunks[i].end_block);
+    }
+  }
+  return true;
+}
+
+/*
+ * Returns true if the rows of chunk are those recorded when its files were
+ * written and populates their versions in row_versions.
+ * Assumes row_versions has MAX_COLUMN_GROUPS_LINE_CHARS space available.
+ * Expects SPI connection to be established.
+ */
+static bool column_group_chunk_is_unchanged(const ExportEntry *entry,
+                                            const ColumnGroupChunk *chunk,
+                                            char *row_versions) {
+  return find_column_group_rows(entry->table_name, chunk->start_block,
+                                chunk->end_block, row_versions) &&
+         strcmp(row_versions,
+                get_block_range_rows(entry->table_name, entry,
+                                     chunk->start_block,
+                                     chunk->end_block)) == 0;
+}
+
+/**
+ * Exports columns added to a table exported in the column group layout for
+ * the block ranges of its existing files and deletes files of columns no
+ * longer exported. Returns false without publishing any file when the table
+ * has to be exported in full instead, because rows were written to its
+ * blocks since the existing files were written. Rows of the added columns
+ * are sampled into sample, which is left uninitialized when false is
+ * returned.
+ * Expects SPI connection to be established.
+ */
+static bool export_added_column_groups(const ExportEntry *entry,
+                                       const char *fingerprint,
+                                       const ColumnInfo *column_info,
+                                       int total_columns, ExportSample *sample,
+                                       ColumnEncodings *encodings) {
+  ColumnGroupManifest *manifest = load_column_group_manifest(entry->table_name);
+  if (manifest == NULL || manifest->num_of_columns == 0) {
+    if (manifest != NULL) {
+      pfree(manifest);
+    }
+    return false;
+  }
+  // Rows are matched by position, which only holds for blocks whose rows
+  // are unchanged. Writes anywhere in the table change the fingerprint, so
+  // the row versions of each block range are compared instead: ranges
+  // without files must still be empty, the others are checked as their
+  // columns are exported.
+  int num_of_chunks;
+  ColumnGroupChunk *chunks =
+      get_column_group_chunks(entry->table_name, manifest, &num_of_chunks);
+  qsort(chunks, num_of_chunks, sizeof(ColumnGroupChunk),
+        compare_column_group_chunks);
+  if (!column_group_chunks_cover_rows(entry, chunks, num_of_chunks)) {
+    elog(LOG, "Rows of %s were written outside its column groups",
+         entry->table_name);
+    pfree(chunks);
+    pfree(manifest);
+    return false;
+  }
+
+  int num_of_added = 0;
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    if (!column_group_manifest_has_column(manifest,
+                                          entry->columns_to_export[i])) {
+      num_of_added += 1;
+    }
+  }
+  ExportEntry added;
+  initialize_export_entry(entry->table_name, num_of_added, &added);
+  added.output_format = entry->output_format;
+  added.layout = entry->layout;
+  added.chunk_size = entry->chunk_size;
+  // Existing files hold the rows up to the watermark of their export.
+  if (entry->source_query == NULL && entry->fresh_column != NULL) {
+    export_entry_set_fresh_column(&added, entry->fresh_column);
+    if (entry->watermark != NULL) {
+      export_entry_set_next_watermark(&added, entry->watermark);
+    }
+  }
+  num_of_added = 0;
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    if (!column_group_manifest_has_column(manifest,
+                                          entry->columns_to_export[i])) {
+      export_entry_add_column(&added, entry->columns_to_export[i],
+                              num_of_added);
+      num_of_added += 1;
+    }
+  }
+  elog(LOG, "Exporting %d added columns of %s", num_of_added,
+       entry->table_name);
+  bool is_aligned = true;
+
+  init_export_sample(sample, &added, column_info, total_columns);
+  if (num_of_added > 0) {
+    GArrowSchema *arrow_schema =
+        create_table_schema(column_info, &added, total_columns);
+    char *column_str =
+        get_columns_string(added.columns_to_export, num_of_added);
+    for (int i = 0; i < num_of_chunks && is_aligned; i += 1) {
+      char path[PATH_MAX];
+      char row_versions[MAX_COLUMN_GROUPS_LINE_CHARS];
+      populate_column_group_chunk_path(&added, chunks[i].start_block,
+                                       chunks[i].end_block, path);
+      // Rows match those of the existing files if their versions are the
+      // same before and after the added columns are exported.
+      is_aligned =
+          column_group_chunk_is_unchanged(entry, &chunks[i], row_versions);
+      if (!is_aligned) {
+        break;
+      }
+      export_block_range(entry->table_name, &added, arrow_schema, column_info,
+                         total_columns, column_str, chunks[i].start_block,
+                         chunks[i].end_block, path, sample, encodings,
+                         /*sampler=*/NULL);
+      is_aligned = strcmp(row_versions,
+                          get_block_range_rows(entry->table_name, entry,
+                                               chunks[i].start_block,
+                                               chunks[i].end_block)) == 0;
+    }
+    pfree(column_str);
+    g_object_unref(arrow_schema);
+  } else {
+    // Files of the kept columns must still hold the rows of their blocks.
+    for (int i = 0; i < num_of_chunks && is_aligned; i += 1) {
+      char row_versions[MAX_COLUMN_GROUPS_LINE_CHARS];
+      is_aligned =
+          column_group_chunk_is_unchanged(entry, &chunks[i], row_versions);
+    }
+    sample->num_of_unsampled_rows += estimate_relation_rows(entry->table_name);
+  }
+  pfree(chunks);
+
+  if (!is_aligned) {
+    elog(LOG, "Rows of %s changed since its column groups were exported",
+         entry->table_name);
+    char temp_path[PATH_MAX];
+    populate_temp_path_for_table(entry->table_name, temp_path,
+                                 /*relative=*/false);
+    delete_files_with_prefix(temp_path, /*prefix=*/NULL);
+    free_export_sample(sample);
+    free_export_entry(&added);
+    pfree(manifest);
+    return false;
   }
 
-  while ((entry = readdir(dir)) != NULL) {
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+  lock_fresh_view(entry);
+  for (int i = 0; i < num_of_added; i += 1) {
+    char file_prefix[NAMEDATALEN + 1];
+    populate_column_group_prefix(added.columns_to_export[i], file_prefix);
+    move_temp_files(entry->table_name, file_prefix);
+  }
+  // Files of removed columns are deleted once the manifest no longer lists
+  // them, so that a column added back is exported again.
+  save_column_group_manifest(entry->table_name, fingerprint, entry);
+  char data_path[PATH_MAX];
+  populate_data_path_for_table(entry->table_name, data_path,
+                               /*relative=*/false);
+  bool removed_columns = false;
+  for (int i = 0; i < manifest->num_of_columns; i += 1) {
+    bool is_exported = false;
+    for (int j = 0; j < entry->num_of_columns && !is_exported; j += 1) {
+      is_exported =
+          strcmp(manifest->columns[i], entry->columns_to_export[j]) == 0;
+    }
+    if (is_exported) {
       continue;
     }
-    elog(LOG, "Found entry with path %s", entry->d_name);
-    char src_path[PATH_MAX];
-    char dest_path[PATH_MAX];
+    elog(LOG, "Removing column group %s of %s", manifest->columns[i],
+         entry->table_name);
+    char file_prefix[NAMEDATALEN + 1];
+    populate_column_group_prefix(manifest->columns[i], file_prefix);
+    delete_files_with_prefix(data_path, file_prefix);
+    removed_columns = true;
+  }
+  if (removed_columns) {
+    advance_export_generation(entry->table_name);
+    refresh_file_list(entry->table_name, data_path);
+  }
+  free_export_entry(&added);
+  pfree(manifest);
+  return true;
+}
 
-    // temp columnar file
-    strcpy(src_path, temp_path);
-    strcat(src_path, "/");
-    strcat(src_path, entry->d_name);
+/*
+ * Appends statement dropping relation_name which queries are served from.
+ * It is a foreign table for parquet files and a view for Arrow files and
+ * the format of the table may have changed.
+ * Expects SPI connection to be established.
+ */
+static void append_drop_exported_relation(StringInfo buf,
+                                          const char *relation_name) {
+  StringInfoData query;
+  initStringInfo(&query);
+  appendStringInfo(&query,
+                   "SELECT relkind FROM pg_class WHERE oid = "
+                   "to_regclass('public.%s');",
+                   relation_name);
+  int status = SPI_execute(query.data, /*read_only=*/true, /*count=*/1);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to look up exported relation.")));
+  }
+  if (SPI_processed > 0) {
+    char *relkind =
+        SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+    appendStringInfo(buf, "DROP %s public.%s;\n",
+                     relkind[0] == RELKIND_VIEW ? "VIEW" : "FOREIGN TABLE",
+                     relation_name);
+  }
+  pfree(query.data);
+}
 
-    // Final path
-    strcpy(dest_path, data_path);
-    strcat(dest_path, "/");
-    strcat(dest_path, entry->d_name);
+/*
+ * Returns column definitions of the exported columns of table with the
+ * types of the source columns, or of the columns of the query result for
+ * exported queries.
+ * Expects SPI connection to be established.
+ */
+static char *get_column_definitions(const ExportEntry *entry) {
+  if (entry->source_query != NULL) {
+    int total_columns;
+    ColumnInfo *column_info =
+        get_query_column_types(entry->source_query, entry->registered_by,
+                               &total_columns);
+    StringInfoData definitions;
+    initStringInfo(&definitions);
+    for (int i = 0; i < entry->num_of_columns; i += 1) {
+      const ColumnInfo *column = find_column_info(
+          column_info, total_columns, entry->columns_to_export[i]);
+      appendStringInfo(&definitions, "%s%s %s", i > 0 ? ", " : "",
+                       quote_identifier(column->column_name),
+                       format_type_with_typemod(column->column_type,
+                                                column->column_typmod));
+    }
+    pfree(column_info);
+    return definitions.data;
+  }
+  char *column_str =
+      get_columns_string(entry->columns_to_export, entry->num_of_columns);
+  StringInfoData query;
+  initStringInfo(&query);
+  appendStringInfo(&query,
+                   "SELECT string_agg(quote_ident(attname) || ' ' || "
+                   "format_type(atttypid, atttypmod), ', ' ORDER BY "
+                   "array_position('{%s}'::text[], attname::text)) "
+                   "FROM pg_attribute WHERE attrelid = %s::regclass "
+                   "AND attname = ANY('{%s}'::text[]) AND NOT attisdropped;",
+                   column_str, quote_literal_cstr(entry->table_name),
+                   column_str);
+  int status = SPI_execute(query.data, /*read_only=*/true, /*count=*/1);
+  if (status != SPI_OK_SELECT || SPI_processed != 1) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to read column types of %s",
+                           entry->table_name)));
+  }
+  char *column_definitions =
+      SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+  pfree(query.data);
+  pfree(column_str);
+  return column_definitions;
+}
 
-    elog(LOG, "Temp path %s", src_path);
-    elog(LOG, "Data path %s", dest_path);
+/*
+ * Appends statement creating view relation_name returning the rows of
+ * Arrow files in the data directory data_name with the column definitions
+ * column_definitions.
+ */
+static void append_create_arrow_view(StringInfo buf,
+                                     const char *relation_name,
+                                     const char *data_name,
+                                     const char *column_definitions) {
+  appendStringInfo(buf,
+                   "CREATE VIEW public.%s AS SELECT * FROM "
+                   "analytica_scan(%s) AS t(%s);",
+                   relation_name, quote_literal_cstr(data_name),
+                   column_definitions);
+}
 
-    if (rename(src_path, dest_path) == 0) {
-      elog(LOG, "File '%s' renamed to '%s' successfully.\n", src_path,
-           dest_path);
-    } else {
-      perror("rename"); // Print error message if rename fails
-    }
+/*
+ * Appends statement creating the parquet_fdw foreign table of table with
+ * the column definitions column_definitions. Unlike import_parquet it
+ * doesn't read the schema from the files, which only exist on standbys when
+ * they export.
+ */
+static void append_create_parquet_table(StringInfo buf,
+                                        const char *relation_name,
+                                        const char *data_name,
+                                        const char *column_definitions) {
+  appendStringInfo(buf,
+                   "CREATE FOREIGN TABLE public.%s (%s) "
+                   "SERVER parquet_srv OPTIONS ("
+                   "files_func 'list_parquet_files', "
+                   "files_func_arg '{\"dir\": \"./pg_analytica/%u/%s\"}', "
+                   "use_mmap 'true', use_threads 'true');",
+                   relation_name, column_definitions, MyDatabaseId,
+                   data_name);
+}
+
+/*
+ * Appends statements replacing relation_name with a relation reading the
+ * files of the data directory data_name. Sample relations also have the
+ * weight column and may have no files, import_parquet reads the schema from
+ * the files so it isn't used for them.
+ * Returns the SPI status of the last statement.
+ * Expects SPI connection to be established.
+ */
+static int append_create_exported_relation(StringInfo buf,
+                                           const ExportEntry *entry,
+                                           const char *relation_name,
+                                           const char *data_name,
+                                           bool is_sample) {
+  char *column_definitions = get_column_definitions(entry);
+  if (is_sample) {
+    column_definitions = psprintf("%s, %s float8", column_definitions,
+                                  SAMPLE_WEIGHT_COLUMN);
   }
-  closedir(dir);
+  append_drop_exported_relation(buf, relation_name);
+  if (entry->output_format == OUTPUT_FORMAT_PARQUET &&
+      (is_sample || standby_exports_enabled())) {
+    append_create_parquet_table(buf, relation_name, data_name,
+                                column_definitions);
+    return SPI_OK_UTILITY;
+  } else if (entry->output_format == OUTPUT_FORMAT_PARQUET) {
+    appendStringInfo(buf, "select import_parquet(     \
+			%s,         \
+			'public',               \
+			'parquet_srv',          \
+			'list_parquet_files',   \
+			'{\"dir\": \"./pg_analytica/%u/%s\"}',  \
+			'{\"use_mmap\": \"true\", \"use_threads\": \"true\"}' \
+		);",
+                     quote_literal_cstr(relation_name), MyDatabaseId,
+                     data_name);
+    return SPI_OK_SELECT;
+  }
+  append_create_arrow_view(buf, relation_name, data_name,
+                           column_definitions);
+  return SPI_OK_UTILITY;
 }
 
-char *get_columns_string(char **columns, int num_of_columns) {
-  int total_size = 0;
-  for (int i = 0; i < num_of_columns; i++) {
-    char *column_name = columns[i];
-    total_size += strlen(column_name) + 1;
-    elog(LOG, "Size of column %s is %d", column_name, strlen(column_name));
+/*
+ * Returns the watermark the files of table were exported up to, NULL if no
+ * row with a value of the fresh column was exported.
+ */
+static const char *get_fresh_watermark(const ExportEntry *entry) {
+  // Incremental queries without new rows keep the previous watermark.
+  if (entry->source_query != NULL && entry->next_watermark == NULL) {
+    return entry->watermark;
   }
-  char *combined_string = (char *)palloc(total_size * sizeof(char));
-  combined_string[0] = '\0';
-  for (int i = 0; i < num_of_columns; i++) {
-    strcat(combined_string, columns[i]);
-    if (i < num_of_columns - 1) {
-      strcat(combined_string, ",");
-    }
+  return entry->next_watermark;
+}
+
+/*
+ * Appends statement creating view relation_name returning the rows of the
+ * exported relation exported_name followed by the rows of the source of
+ * table past the watermark of its last export that pass its row filter and
+ * window. Exported columns are cast to the source types so both sides of
+ * the union agree. The watermark is a constant of the view, replaced along
+ * with the files, so that rows are found by an index scan on the fresh
+ * column. The view reads the source with the privileges of the role
+ * querying it.
+ * Expects SPI connection to be established.
+ */
+static void append_create_fresh_view(StringInfo buf, const ExportEntry *entry,
+                                     const char *relation_name,
+                                     const char *exported_name) {
+  const char *fresh_column = get_fresh_column(entry);
+  int total_columns;
+  ColumnInfo *column_info = get_export_column_types(entry, &total_columns);
+  StringInfoData exported_columns;
+  StringInfoData source_columns;
+  initStringInfo(&exported_columns);
+  initStringInfo(&source_columns);
+  for (int i = 0; i < entry->num_of_columns; i += 1) {
+    const ColumnInfo *column = find_column_info(column_info, total_columns,
+                                                entry->columns_to_export[i]);
+    const char *column_name = quote_identifier(column->column_name);
+    appendStringInfo(&exported_columns, "%s%s::%s AS %s", i > 0 ? ", " : "",
+                     column_name,
+                     format_type_with_typemod(column->column_type,
+                                              column->column_typmod),
+                     column_name);
+    appendStringInfo(&source_columns, "%s%s", i > 0 ? ", " : "",
+                     column_name);
   }
-  return combined_string;
+  const ColumnInfo *fresh =
+      find_column_info(column_info, total_columns, fresh_column);
+  char *source = entry->source_query != NULL
+                     ? psprintf("(%s) AS " QUERY_SOURCE_ALIAS,
+                                entry->source_query)
+                     : pstrdup(entry->table_name);
+  appendStringInfo(buf,
+                   "CREATE VIEW public.%s WITH (security_invoker = true) AS "
+                   "SELECT %s FROM public.%s UNION ALL SELECT %s FROM %s ",
+                   relation_name, exported_columns.data, exported_name,
+                   source_columns.data, source);
+  // Rows without a value were exported, if any, and with no watermark
+  // every other row is fresh.
+  const char *watermark = get_fresh_watermark(entry);
+  if (watermark != NULL) {
+    appendStringInfo(buf, "WHERE %s > %s::%s", quote_identifier(fresh_column),
+                     quote_literal_cstr(watermark),
+                     format_type_with_typemod(fresh->column_type,
+                                              fresh->column_typmod));
+  } else {
+    appendStringInfo(buf, "WHERE %s IS NOT NULL",
+                     quote_identifier(fresh_column));
+  }
+  // Fresh rows are limited the same way as exported rows.
+  if (entry->row_filter != NULL) {
+    appendStringInfo(buf, " AND (%s)", entry->row_filter);
+  }
+  if (entry->window_column != NULL) {
+    appendStringInfo(buf, " AND %s >= now() - %s::interval",
+                     quote_identifier(entry->window_column),
+                     quote_literal_cstr(entry->window_interval));
+  }
+  appendStringInfoChar(buf, ';');
+  pfree(source);
+  pfree(exported_columns.data);
+  pfree(source_columns.data);
+  pfree(column_info);
+}
+
+/**
+ * Makes exported files queryable as analytica_{table_name}. Parquet files
+ * are served by a parquet_fdw foreign table and Arrow files by a view over
+ * analytica_scan. The sample relation of the table is made queryable as
+ * analytica_{table_name}_sample the same way, and tables with a fresh
+ * column get the analytica_{table_name}_fresh view. Relations are replicated to
+ * standbys and read the files of the server they are queried on.
+ * Expects SPI connection to be established.
+ */
+static void replace_exported_relations(const ExportEntry *entry) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  char exported_name[NAMEDATALEN];
+  snprintf(exported_name, sizeof(exported_name),
+           EXPORTED_RELATION_PREFIX "%s", entry->table_name);
+  char fresh_name[NAMEDATALEN];
+  snprintf(fresh_name, sizeof(fresh_name),
+           EXPORTED_RELATION_PREFIX "%s" FRESH_RELATION_SUFFIX,
+           entry->table_name);
+  // The fresh view depends on the relation being replaced.
+  append_drop_exported_relation(&buf, fresh_name);
+  int expected_status = append_create_exported_relation(
+      &buf, entry, exported_name, entry->table_name, /*is_sample=*/false);
+  if (export_entry_has_sample(entry)) {
+    char relation_name[NAMEDATALEN];
+    char sample_name[MAX_SAMPLE_NAME_CHARS];
+    populate_sample_name(entry->table_name, sample_name);
+    snprintf(relation_name, sizeof(relation_name),
+             EXPORTED_RELATION_PREFIX "%s_sample", entry->table_name);
+    expected_status = append_create_exported_relation(
+        &buf, entry, relation_name, sample_name, /*is_sample=*/true);
+  }
+  if (has_fresh_view(entry)) {
+    append_create_fresh_view(&buf, entry, fresh_name, exported_name);
+    expected_status = SPI_OK_UTILITY;
+  }
+
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
+  int status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
+  if (status != expected_status) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to register new table entry.")));
+  }
+  pfree(buf.data);
+}
+
+/**
+ * Creates the relations of table in a transaction of its own, see
+ * replace_exported_relations.
+ */
+void register_table_with_parquet_server(const ExportEntry *entry) {
+  SetCurrentStatementStartTimestamp();
+  StartTransactionCommand();
+  PushActiveSnapshot(GetTransactionSnapshot());
+  int connection = SPI_connect();
+  if (connection < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to connect to database")));
+  }
+  elog(LOG, "Created connection for query");
+  replace_exported_relations(entry);
+  SPI_finish();
+  PopActiveSnapshot();
+  CommitTransactionCommand();
 }
 
-void export_table_data(ExportEntry entry) {
-  int offset = 0;
-  int64 processed_count;
-  int select;
+/*
+ * Drops the relations table is queried through, if they exist.
+ */
+static void drop_exported_relations(const char *table_name) {
+  SetCurrentStatementStartTimestamp();
+  StartTransactionCommand();
+  PushActiveSnapshot(GetTransactionSnapshot());
+  int connection = SPI_connect();
+  if (connection < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to connect to database")));
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  char relation_name[NAMEDATALEN];
+  // The fresh view depends on the exported relation.
+  snprintf(relation_name, sizeof(relation_name),
+           EXPORTED_RELATION_PREFIX "%s" FRESH_RELATION_SUFFIX, table_name);
+  append_drop_exported_relation(&buf, relation_name);
+  snprintf(relation_name, sizeof(relation_name),
+           EXPORTED_RELATION_PREFIX "%s", table_name);
+  append_drop_exported_relation(&buf, relation_name);
+  snprintf(relation_name, sizeof(relation_name),
+           EXPORTED_RELATION_PREFIX "%s_sample", table_name);
+  append_drop_exported_relation(&buf, relation_name);
+  if (buf.len > 0) {
+    elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
+    int status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
+    elog(DEBUG1, "Executed SPI_execute command with status %d", status);
+    if (status != SPI_OK_UTILITY) {
+      ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                      errmsg("Failed to drop relations of %s", table_name)));
+    }
+  }
+  pfree(buf.data);
+  SPI_finish();
+  PopActiveSnapshot();
+  CommitTransactionCommand();
+}
 
+/**
+ * Exports columnar files for table and moves them to the data directory.
+ * Resumes from checkpoint when it isn't NULL. Exported rows are sampled
+ * into sample which the caller should free. fingerprint is the fingerprint
+ * of the table contents the export started at. The next watermark of
+ * tables with a fresh view is set to the largest exported value of their
+ * fresh column. Relations reading the files are replaced in the same
+ * transaction.
+ */
+void export_table_data(ExportEntry *entry, const char *fingerprint,
+                       ExportCheckpoint *checkpoint, ExportSample *sample) {
+  MemoryContext caller_context = CurrentMemoryContext;
   SetCurrentStatementStartTimestamp();
   StartTransactionCommand();
   PushActiveSnapshot(GetTransactionSnapshot());
@@ -888,53 +3850,113 @@ void export_table_data(ExportEntry entry) {
                     errmsg("Failed to connect to database")));
   }
   elog(LOG, "Created connection for query");
+  if (entry->window_column != NULL) {
+    set_window_start(entry, checkpoint, caller_context);
+  }
 
   int total_columns;
   elog(LOG, "Trying to extract column types");
-  ColumnInfo *column_info = get_column_types(entry.table_name, &total_columns);
+  ColumnInfo *column_info = get_export_column_types(entry, &total_columns);
   elog(LOG, "Extracted %d column types", total_columns);
 
   GArrowSchema *arrow_schema =
-      create_table_schema(column_info, &entry, total_columns);
+      create_table_schema(column_info, entry, total_columns);
 
-  int chunk = 0;
   char *column_str =
-      get_columns_string(entry.columns_to_export, entry.num_of_columns);
-
-  do {
-    StringInfoData buf;
-    initStringInfo(&buf);
-    // TODO - order of columns in result should match schema columns
-    appendStringInfo(&buf, "SELECT %s FROM %s LIMIT %d OFFSET %d;", column_str,
-                     entry.table_name, entry.chunk_size, offset);
-
-    // Execute the chunked query using SPI_exec
-    elog(LOG, "Executing SPI_execute query %s", buf.data);
-    SetCurrentStatementStartTimestamp();
-    select = SPI_execute(buf.data, true, 0);
-    elog(LOG, "Executed SPI_execute command with status %d", select);
-
-    if (select != SPI_OK_SELECT) {
-      ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
-                      errmsg("SELECT Query execution failed")));
-    }
-    processed_count = SPI_processed;
-    elog(LOG, "Processed %d rows", processed_count);
-    elog(LOG, "Number of rows is %lu", SPI_tuptable->numvals);
-    if (processed_count > 0) {
-      GArrowTable *arrow_table =
-          create_arrow_table(arrow_schema, column_info, &entry, total_columns);
-      // write to disk
-      write_arrow_table(entry.table_name, chunk, arrow_schema, arrow_table);
-      chunk += 1;
-    }
-    // Increment offset by number of processed rows
-    offset += processed_count;
-  } while (processed_count > 0);
-  elog(LOG, "Finished processing %lld rows", processed_count);
+      get_columns_string(entry->columns_to_export, entry->num_of_columns);
+  ColumnEncodings encodings;
+  column_encodings_init(&encodings, entry->table_name,
+                        entry->columns_to_export, entry->num_of_columns);
+
+  // Columns added to a table in the column group layout are exported on
+  // their own, the files of the other columns are kept.
+  bool exported_added_columns =
+      entry->layout == EXPORT_LAYOUT_COLUMN_GROUPS && checkpoint == NULL &&
+      export_added_column_groups(entry, fingerprint, column_info,
+                                 total_columns, sample, &encodings);
+  if (!exported_added_columns) {
+    init_export_sample(sample, entry, column_info, total_columns);
+  }
+
+  // Whether new files were published.
+  bool published = true;
+  if (checkpoint == NULL) {
+    checkpoint = palloc0(sizeof(ExportCheckpoint));
+    checkpoint->columns_hash = hash_export_columns(entry);
+    strlcpy(checkpoint->fingerprint, fingerprint, NAMEDATALEN);
+    if (entry->window_start != NULL) {
+      strlcpy(checkpoint->window_start, entry->window_start, NAMEDATALEN);
+    }
+  }
+
+  if (exported_added_columns) {
+    elog(LOG, "Kept column groups of unchanged rows of %s", entry->table_name);
+    if (entry->source_query == NULL && entry->watermark != NULL) {
+      MemoryContext old_context = MemoryContextSwitchTo(caller_context);
+      export_entry_set_next_watermark(entry, entry->watermark);
+      MemoryContextSwitchTo(old_context);
+    }
+  } else if (entry->source_query != NULL) {
+    // Appended files are named after the time of the export.
+    char file_prefix[MAX_FINGERPRINT_CHARS];
+    snprintf(file_prefix, sizeof(file_prefix), INT64_FORMAT ".",
+             GetCurrentTimestamp());
+    const char *query_prefix =
+        is_appending_export(entry) ? file_prefix : NULL;
+    if (entry->incremental_key != NULL) {
+      set_next_watermark(entry, caller_context);
+    }
+    if (query_prefix != NULL && entry->next_watermark == NULL) {
+      // The files of earlier exports hold every row.
+      elog(LOG, "No new rows of %s to export", entry->table_name);
+      published = false;
+    } else {
+      export_query_chunks(entry, query_prefix, arrow_schema, column_info,
+                          total_columns, column_str, sample, &encodings);
+      lock_fresh_view(entry);
+      move_temp_files(entry->table_name, query_prefix);
+    }
+  } else if (is_partitioned_table(entry->table_name)) {
+    int num_of_units;
+    ExportUnit *units = get_partitions_to_export(entry, &num_of_units);
+    // Rows past the watermark change the fingerprints of their partitions
+    // only if the fingerprints are read first.
+    set_fresh_watermark(entry, checkpoint, caller_context);
+    export_partitioned_table_data(entry, units, num_of_units, arrow_schema,
+                                  column_info, total_columns, column_str,
+                                  checkpoint, sample, &encodings);
+    pfree(units);
+  } else {
+    set_fresh_watermark(entry, checkpoint, caller_context);
+    ExportUnit unit;
+    memset(&unit, 0, sizeof(ExportUnit));
+    strlcpy(unit.relation_name, entry->table_name, MAX_RELATION_NAME_CHARS);
+    unit.needs_export = true;
+    export_relation_chunks(&unit, /*file_prefix=*/NULL, entry, arrow_schema,
+                           column_info, total_columns, column_str, checkpoint,
+                           sample, &encodings);
+    // Move files from temp directly to data directory.
+    lock_fresh_view(entry);
+    move_temp_files(entry->table_name, /*file_prefix=*/NULL);
+    if (entry->layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+      save_column_group_manifest(entry->table_name, fingerprint, entry);
+    }
+  }
+  // Relations are replaced in the transaction that published the files, so
+  // that the fresh view switches to the new watermark along with them.
+  // Standbys can't run DDL, the relations created by the primary read the
+  // new files.
+  if (!is_standby_export && published) {
+    replace_exported_relations(entry);
+  }
+  // All files have been published so there is nothing left to resume.
+  remove_export_checkpoint(entry->table_name);
+  if (!is_standby_export) {
+    save_column_encodings(&encodings, entry->table_name);
+  }
+  free_column_encodings(&encodings);
+  pfree(checkpoint);
   pfree(column_str);
-  // Move files from temp directly to data directory.
-  move_temp_files(entry.table_name);
 
   g_object_unref(arrow_schema);
   pfree(column_info);
@@ -945,15 +3967,37 @@ void export_table_data(ExportEntry entry) {
 }
 
 /**
- * Update table export status after successfull export.
+ * Update table export status and content fingerprint after successfull
+ * export, along with the incremental key exported up to unless watermark is
+ * NULL. Exports on a standby record them in the export state file of the
+ * table.
  */
-void update_table_export_metadata(const char *table_name) {
+void update_table_export_metadata(const char *table_name,
+                                  const char *fingerprint,
+                                  const char *watermark) {
+  if (is_standby_export) {
+    ExportState *state = load_export_state(table_name);
+    state->last_run_completed = GetCurrentTimestamp();
+    strlcpy(state->fingerprint, fingerprint, NAMEDATALEN);
+    if (watermark != NULL) {
+      strlcpy(state->watermark, watermark, MAX_EXPORT_STATE_LINE_CHARS);
+    }
+    save_export_state(table_name, state);
+    pfree(state);
+    return;
+  }
   StringInfoData buf;
   initStringInfo(&buf);
-  appendStringInfo(&buf, "UPDATE analytica_exports        \
-		 SET last_run_completed = CURRENT_TIMESTAMP, export_status = %d \
-		 WHERE table_name = '%s';",
-                   ACTIVE, table_name);
+  appendStringInfo(&buf,
+                   "UPDATE analytica_exports SET last_run_completed = "
+                   "CURRENT_TIMESTAMP, export_status = %d, fingerprint = %s",
+                   ACTIVE, quote_literal_cstr(fingerprint));
+  if (watermark != NULL) {
+    appendStringInfo(&buf, ", incremental_watermark = %s",
+                     quote_literal_cstr(watermark));
+  }
+  appendStringInfo(&buf, " WHERE table_name = %s;",
+                   quote_literal_cstr(table_name));
 
   SetCurrentStatementStartTimestamp();
   StartTransactionCommand();
@@ -964,9 +4008,9 @@ void update_table_export_metadata(const char *table_name) {
                     errmsg("Failed to connect to database")));
   }
   elog(LOG, "Created connection for query");
-  elog(LOG, "Executing SPI_execute query %s", buf.data);
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
   int status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
-  elog(LOG, "Executed SPI_execute command with status %d", status);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
 
   SPI_finish();
   PopActiveSnapshot();
@@ -981,26 +4025,93 @@ void cleanup_inactive_export(const char *table_name) {
     elog(LOG, "Failed to cleanup data for table %s", table_name);
     return;
   }
+  advance_export_generation(table_name);
+  char sample_name[MAX_SAMPLE_NAME_CHARS];
+  char sample_path[PATH_MAX];
+  struct stat sample_stat;
+  populate_sample_name(table_name, sample_name);
+  populate_data_path_for_table(sample_name, sample_path, /*relative=*/false);
+  if (stat(sample_path, &sample_stat) == 0 &&
+      cleanup_table_data(sample_name) == 0) {
+    advance_export_generation(sample_name);
+  }
+  if (is_standby_export) {
+    // The entry is left for the primary and other standbys.
+    return;
+  }
+  drop_exported_relations(table_name);
   // delete metadata entry
   delete_export_entry(table_name);
   elog(LOG, "Cleaned up data for table %s", table_name);
 }
 
-void register_table_with_parquet_server(const ExportEntry *entry) {
-  StringInfoData buf;
-  initStringInfo(&buf);
-  appendStringInfo(&buf, "DROP FOREIGN TABLE IF EXISTS analytica_%s;\n",
-                   entry->table_name);
-  appendStringInfo(&buf, "select import_parquet(     \
-			'analytica_%s',         \
-			'public',               \
-			'parquet_srv',          \
-			'list_parquet_files',   \
-			'{\"dir\": \"./pg_analytica/%s\"}',  \
-			'{\"use_mmap\": \"true\", \"use_threads\": \"true\"}' \
-		);",
-                   entry->table_name, entry->table_name);
+/**
+ * Installs planner statistics computed from the rows sampled during export
+ * for the relation registered for table.
+ */
+void update_export_statistics(const ExportEntry *entry,
+                              ExportSample *sample) {
+  char relation_name[NAMEDATALEN];
+  snprintf(relation_name, sizeof(relation_name), EXPORTED_RELATION_PREFIX "%s",
+           entry->table_name);
+  SetCurrentStatementStartTimestamp();
+  StartTransactionCommand();
+  PushActiveSnapshot(GetTransactionSnapshot());
+  install_export_statistics(entry->table_name, relation_name, sample);
+  PopActiveSnapshot();
+  CommitTransactionCommand();
+}
+
+/*
+ * Returns whether the extension is installed in the database the worker is
+ * connected to. The launcher starts workers for every database.
+ */
+static bool is_extension_installed() {
+  SetCurrentStatementStartTimestamp();
+  StartTransactionCommand();
+  SPI_connect();
+  PushActiveSnapshot(GetTransactionSnapshot());
+  int ret = SPI_execute(
+      "SELECT 1 FROM pg_extension WHERE extname = 'ingestor'", true, 1);
+  if (ret != SPI_OK_SELECT) {
+    elog(FATAL, "Failed to look up extension: error code %d", ret);
+  }
+  bool is_installed = SPI_processed > 0;
+  SPI_finish();
+  PopActiveSnapshot();
+  CommitTransactionCommand();
+  return is_installed;
+}
+
+/*
+ * Creates the relations of newly registered tables on a primary whose
+ * tables are exported by standbys. Tables aren't read. Unregistered tables
+ * have their relations and entries removed, standbys remove the files of
+ * tables without an entry.
+ */
+static void register_pending_tables(ExportEntry *entries, int num_of_tables) {
+  for (int i = 0; i < num_of_tables; i += 1) {
+    if (entries[i].export_status == PENDING) {
+      elog(LOG, "Registering %s for export on standbys",
+           entries[i].table_name);
+      register_table_with_parquet_server(&entries[i]);
+      update_table_export_metadata(entries[i].table_name, "",
+                                   /*watermark=*/NULL);
+    } else if (entries[i].export_status == INACTIVE) {
+      elog(LOG, "Removing unregistered table %s", entries[i].table_name);
+      drop_exported_relations(entries[i].table_name);
+      delete_export_entry(entries[i].table_name);
+    }
+    free_export_entry(&entries[i]);
+  }
+}
 
+/*
+ * Removes data directories of tables without an entry on a standby. The
+ * primary deletes entries of unregistered tables, possibly before the
+ * standby saw them inactive.
+ */
+static void remove_orphaned_data_directories(void) {
   SetCurrentStatementStartTimestamp();
   StartTransactionCommand();
   PushActiveSnapshot(GetTransactionSnapshot());
@@ -1009,130 +4120,195 @@ void register_table_with_parquet_server(const ExportEntry *entry) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
                     errmsg("Failed to connect to database")));
   }
-  elog(LOG, "Created connection for query");
-  elog(LOG, "Executing SPI_execute query %s", buf.data);
-  int status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
-  elog(LOG, "Executed SPI_execute command with status %d", status);
+  int status = SPI_execute("SELECT table_name FROM analytica_exports;",
+                           /*read_only=*/true, /*count=*/0);
   if (status != SPI_OK_SELECT) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
-                    errmsg("Failed to register new table entry.")));
+                    errmsg("Failed to read export entries")));
   }
+  MemoryContext old_context = MemoryContextSwitchTo(TopMemoryContext);
+  int num_of_tables = SPI_processed;
+  char **table_names = palloc(Max(num_of_tables, 1) * sizeof(char *));
+  for (int i = 0; i < num_of_tables; i += 1) {
+    table_names[i] =
+        SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1);
+  }
+  MemoryContextSwitchTo(old_context);
   SPI_finish();
   PopActiveSnapshot();
   CommitTransactionCommand();
+
+  char root_path[PATH_MAX];
+  populate_root_path(root_path, /*relative=*/false);
+  DIR *dir = opendir(root_path);
+  if (dir == NULL) {
+    pfree(table_names);
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    // Samples are kept while their table has an entry.
+    char table_name[MAX_SAMPLE_NAME_CHARS];
+    strlcpy(table_name, entry->d_name, sizeof(table_name));
+    size_t length = strlen(table_name);
+    size_t suffix_length = strlen(SAMPLE_DATA_SUFFIX);
+    if (length > suffix_length &&
+        strcmp(table_name + length - suffix_length, SAMPLE_DATA_SUFFIX) == 0) {
+      table_name[length - suffix_length] = '\0';
+    }
+    bool has_entry = false;
+    for (int i = 0; i < num_of_tables && !has_entry; i += 1) {
+      has_entry = strcmp(table_names[i], table_name) == 0;
+    }
+    char temp_path[PATH_MAX];
+    struct stat temp_stat;
+    populate_temp_path_for_table(entry->d_name, temp_path,
+                                 /*relative=*/false);
+    if (!has_entry && stat(temp_path, &temp_stat) == 0) {
+      elog(LOG, "Removing files of unregistered table %s", entry->d_name);
+      if (cleanup_table_data(entry->d_name) == 0) {
+        advance_export_generation(entry->d_name);
+      }
+    }
+  }
+  closedir(dir);
+  for (int i = 0; i < num_of_tables; i += 1) {
+    pfree(table_names[i]);
+  }
+  pfree(table_names);
 }
 
 /**
+ * Runs one export pass over the tables of the database the launcher started
+ * the worker for.
  * Use SPI to read rows from table.
  * https://www.postgresql.org/docs/current/spi.html
  */
-void ingestor_main() {
-  elog(LOG, "Started export in background worker");
-  bits32 flags = 0;
+void ingestor_main(Datum main_arg) {
+  // Throttling settings are reloaded while exporting.
+  pqsignal(SIGHUP, SignalHandlerForConfigReload);
   BackgroundWorkerUnblockSignals();
-  elog(LOG, "Establishing connection to database %s with role %s",
-       source_database, source_database_role);
-  BackgroundWorkerInitializeConnection(source_database, source_database_role,
-                                       flags);
-
-  for (;;) {
-    /*
-     * Background workers mustn't call usleep() or any direct equivalent:
-     * instead, they may wait on their process latch, which sleeps as
-     * necessary, but is awakened if postmaster dies.  That way the
-     * background process goes away immediately in an emergency.
-     */
-    (void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
-                    ingestor_naptime_sec * 1000L, PG_WAIT_EXTENSION);
-    ResetLatch(MyLatch);
+  export_worker_connect();
+  if (!is_extension_installed()) {
+    proc_exit(0);
+  }
+  is_standby_export = RecoveryInProgress();
+  if (is_standby_export && !standby_exports_enabled()) {
+    proc_exit(0);
+  }
+  elog(LOG, "Started export in background worker");
+  export_throttle_start();
+
+  int num_of_tables;
+  ExportEntry entries[MAX_EXPORT_ENTRIES];
+  elog(LOG, "Fetching tables to export");
+  get_tables_to_process_in_order(&entries, &num_of_tables);
+  if (!is_standby_export && standby_exports_enabled()) {
+    register_pending_tables(entries, num_of_tables);
+    proc_exit(0);
+  }
+  if (is_standby_export) {
+    remove_orphaned_data_directories();
+  }
 
-    int num_of_tables;
-    ExportEntry entries[MAX_EXPORT_ENTRIES];
-    elog(LOG, "Fetching tables to export");
-    get_tables_to_process_in_order(&entries, &num_of_tables);
+  elog(LOG, "Beginning export for %d tables", num_of_tables);
 
-    elog(LOG, "Beginning export for %d tables", num_of_tables);
+  for (int i = 0; i < num_of_tables; i += 1) {
+    char *table_name = entries[i].table_name;
 
-    for (int i = 0; i < num_of_tables; i += 1) {
-      char *table_name = entries[i].table_name;
+    if (entries[i].export_status == INACTIVE) {
+      elog(LOG, "Cleaning up inactive entry %s", entries[i].table_name);
+      cleanup_inactive_export(table_name);
+      free_export_entry(&entries[i]);
+      continue;
+    }
 
-      if (entries[i].export_status == INACTIVE) {
-        elog(LOG, "Cleaning up inactive entry %s", entries[i].table_name);
-        cleanup_inactive_export(table_name);
-        free_export_entry(&entries[i]);
-        continue;
-      }
+    char fingerprint[MAX_FINGERPRINT_CHARS];
+    get_table_fingerprint(&entries[i], fingerprint);
+    char data_path[PATH_MAX];
+    struct stat data_stat;
+    populate_data_path_for_table(table_name, data_path, /*relative=*/false);
+    // Tables exported before files were kept per database have no data
+    // directory yet and are exported again. Standbys don't have the write
+    // counters of the fingerprint and export tables whenever they're due.
+    // Rows age out of the window of a table without changing its
+    // fingerprint.
+    if (!is_standby_export && entries[i].fingerprint != NULL &&
+        fingerprint[0] != '\0' && entries[i].window_column == NULL &&
+        strcmp(entries[i].fingerprint, fingerprint) == 0 &&
+        stat(data_path, &data_stat) == 0) {
+      // Nothing changed since the previous export so the columnar files
+      // and foreign table are still current.
+      elog(LOG, "Skipping export of unchanged table %s", table_name);
+      update_table_export_metadata(table_name, fingerprint,
+                                   /*watermark=*/NULL);
+      free_export_entry(&entries[i]);
+      continue;
+    }
+
+    // Queries are exported in a single pass that can't be resumed.
+    ExportCheckpoint *checkpoint =
+        entries[i].source_query != NULL
+            ? NULL
+            : load_export_checkpoint(table_name,
+                                     hash_export_columns(&entries[i]));
+    // Files written before the interruption only match the rows read now
+    // if nothing was written since, otherwise a row updated in between
+    // could be exported twice. Standbys can't tell, so they start over.
+    if (checkpoint != NULL &&
+        (is_standby_export || fingerprint[0] == '\0' ||
+         strcmp(checkpoint->fingerprint, fingerprint) != 0)) {
+      elog(LOG, "Restarting export of %s changed since it was interrupted",
+           table_name);
+      remove_export_checkpoint(table_name);
+      pfree(checkpoint);
+      checkpoint = NULL;
+    }
 
-      elog(LOG, "Initializing data directory for %s with %d columns",
-           table_name, entries[i].num_of_columns);
-      setup_data_directories(table_name);
+    elog(LOG, "Initializing data directory for %s with %d columns",
+         table_name, entries[i].num_of_columns);
+    setup_data_directories(table_name,
+                           /*keep_temp_files=*/checkpoint != NULL);
+    if (export_entry_has_sample(&entries[i])) {
+      char sample_name[MAX_SAMPLE_NAME_CHARS];
+      populate_sample_name(table_name, sample_name);
+      setup_data_directories(sample_name,
+                             /*keep_temp_files=*/checkpoint != NULL);
+    }
 
-      elog(LOG, "Starting export for %s", table_name);
-      export_table_data(entries[i]);
+    elog(LOG, "Starting export for %s", table_name);
+    ExportSample sample;
+    export_table_data(&entries[i], fingerprint, checkpoint, &sample);
+
+    elog(LOG, "Updating export status for %s", table_name);
+    update_table_export_metadata(entries[i].table_name, fingerprint,
+                                 entries[i].next_watermark);
+
+    // Standbys can't write statistics, the relation created by the primary
+    // reads the new files.
+    if (!is_standby_export) {
+      // Rows sampled by appending exports only describe the new files.
+      if (!is_appending_export(&entries[i])) {
+        elog(LOG, "Installing statistics for %s", table_name);
+        update_export_statistics(&entries[i], &sample);
+      }
+    }
+    free_export_sample(&sample);
 
-      elog(LOG, "Updating export status for %s", table_name);
-      update_table_export_metadata(entries[i].table_name);
+    if (entries[i].output_format == OUTPUT_FORMAT_ARROW_LZ4) {
+      // Decode the new files once instead of in the first queries.
+      prewarm_column_cache(table_name);
+    }
 
-      elog(LOG, "Registering table with parqut fdw table %s", table_name);
-      register_table_with_parquet_server(&entries[i]);
+    elog(LOG, "Freeing export entry");
+    free_export_entry(&entries[i]);
 
-      elog(LOG, "Freeing export entry");
-      free_export_entry(&entries[i]);
+    elog(LOG, "Export completed for %s", table_name);
 
-      elog(LOG, "Export completed for %s", table_name);
-
-      CHECK_FOR_INTERRUPTS();
-    }
-  }
-  exit(0);
-}
-
-Datum ingestor_launch(PG_FUNCTION_ARGS) {
-  pid_t pid;
-  BackgroundWorker worker;
-  BackgroundWorkerHandle *handle;
-  BgwHandleStatus status;
-
-  DefineCustomIntVariable(
-      "pg_analytica.naptime", "Duration between each check (in seconds).", NULL,
-      &ingestor_naptime_sec, 10, 1, INT_MAX, PGC_SIGHUP, 0, NULL, NULL, NULL);
-  DefineCustomStringVariable("pg_analytica.database", "Database to connect to.",
-                             NULL, &source_database, "postgres", PGC_SIGHUP, 0,
-                             NULL, NULL, NULL);
-  DefineCustomStringVariable("pg_analytica.role", "Role to connect with.", NULL,
-                             &source_database_role, NULL, PGC_SIGHUP, 0, NULL,
-                             NULL, NULL);
-
-  memset(&worker, 0, sizeof(worker));
-  worker.bgw_flags =
-      BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
-  worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
-  worker.bgw_restart_time = BGW_DEFAULT_RESTART_INTERVAL;
-  sprintf(worker.bgw_library_name, "ingestor");
-  sprintf(worker.bgw_function_name, "ingestor_main");
-  snprintf(worker.bgw_name, BGW_MAXLEN, "ingestor dynamic worker");
-  snprintf(worker.bgw_type, BGW_MAXLEN, "ingestor dynamic");
-  /* set bgw_notify_pid so that we can use WaitForBackgroundWorkerStartup */
-  worker.bgw_notify_pid = MyProcPid;
-
-  if (!RegisterDynamicBackgroundWorker(&worker, &handle))
-    PG_RETURN_NULL();
-
-  status = WaitForBackgroundWorkerStartup(handle, &pid);
-  if (status == BGWH_STOPPED)
-    ereport(ERROR,
-            (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
-             errmsg("could not start background process"),
-             errhint("More details may be available in the server log.")));
-  if (status == BGWH_POSTMASTER_DIED)
-    ereport(ERROR,
-            (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
-             errmsg("cannot start background processes without postmaster"),
-             errhint("Kill all remaining database processes and restart the "
-                     "database.")));
-
-  Assert(status == BGWH_STARTED);
-
-  elog(LOG, "Background worker started");
-  PG_RETURN_INT32(pid);
+    CHECK_FOR_INTERRUPTS();
+  }
+  proc_exit(0);
 }
@@ -0,0 +1,411 @@
+#include <limits.h>
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "access/xact.h"
+#include "catalog/pg_database.h"
+#include "fmgr.h"
+#include "launcher.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/wait_event.h"
+
+PG_FUNCTION_INFO_V1(ingestor_launch);
+
+PGDLLEXPORT void ingestor_launcher_main(Datum main_arg)
+    pg_attribute_noreturn();
+
+// Wait 5min between export runs of a database.
+// This param can be tuned using GUC variable.
+static int ingestor_naptime_sec = 300;
+static int max_export_workers = 2;
+static char *export_worker_role = NULL;
+static bool enable_standby_exports = false;
+
+#define LAUNCHER_STATE_NAME "pg_analytica launcher"
+
+/* State of the launcher in shared memory, a single launcher may run. */
+typedef struct _LauncherState {
+  // Pid of the running launcher, 0 if there is none.
+  pid_t pid;
+} LauncherState;
+
+static LauncherState *launcher_state = NULL;
+
+/* Database the launcher starts export workers for. */
+typedef struct _ExportDatabase {
+  Oid oid;
+  char name[NAMEDATALEN];
+  TimestampTz last_started;
+  // Handle of the running export worker, NULL if there is none.
+  BackgroundWorkerHandle *handle;
+} ExportDatabase;
+
+void launcher_init(void) {
+  DefineCustomIntVariable(
+      "pg_analytica.naptime",
+      "Duration between export runs of a database (in seconds).", NULL,
+      &ingestor_naptime_sec, 10, 1, INT_MAX / 1000, PGC_SIGHUP, GUC_UNIT_S,
+      NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.max_workers",
+      "Maximum number of export workers running across all databases.", NULL,
+      &max_export_workers, 2, 1, MAX_BACKENDS, PGC_SIGHUP, 0, NULL, NULL,
+      NULL);
+  DefineCustomStringVariable("pg_analytica.role", "Role to connect with.", NULL,
+                             &export_worker_role, NULL, PGC_SIGHUP, 0, NULL,
+                             NULL, NULL);
+  DefineCustomBoolVariable(
+      "pg_analytica.standby_exports",
+      "Export tables on hot standbys instead of the primary.", NULL,
+      &enable_standby_exports, false, PGC_SIGHUP, 0, NULL, NULL, NULL);
+}
+
+bool standby_exports_enabled(void) { return enable_standby_exports; }
+
+/*
+ * Workers run on hot standbys once they reach a consistent state when
+ * standby exports are enabled.
+ */
+static BgWorkerStartTime get_worker_start_time(void) {
+  return enable_standby_exports ? BgWorkerStart_ConsistentState
+                                : BgWorkerStart_RecoveryFinished;
+}
+
+/*
+ * Attaches to the launcher state, creating it on first use. The state is
+ * small enough to be allocated without the library being preloaded.
+ */
+static LauncherState *get_launcher_state(void) {
+  if (launcher_state == NULL) {
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+    bool found;
+    launcher_state =
+        ShmemInitStruct(LAUNCHER_STATE_NAME, sizeof(LauncherState), &found);
+    if (!found) {
+      launcher_state->pid = 0;
+    }
+    LWLockRelease(AddinShmemInitLock);
+  }
+  return launcher_state;
+}
+
+/*
+ * Returns the pid of the running launcher, 0 if there is none.
+ */
+static pid_t get_launcher_pid(void) {
+  LauncherState *state = get_launcher_state();
+  LWLockAcquire(AddinShmemInitLock, LW_SHARED);
+  pid_t pid = state->pid;
+  LWLockRelease(AddinShmemInitLock);
+  return pid;
+}
+
+static void clear_launcher_pid(int code, Datum arg) {
+  LauncherState *state = get_launcher_state();
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  if (state->pid == MyProcPid) {
+    state->pid = 0;
+  }
+  LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Records the current process as the launcher. Returns false if another
+ * launcher is running.
+ */
+static bool claim_launcher(void) {
+  LauncherState *state = get_launcher_state();
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  bool is_claimed = state->pid == 0;
+  if (is_claimed) {
+    state->pid = MyProcPid;
+  }
+  LWLockRelease(AddinShmemInitLock);
+  if (is_claimed) {
+    on_shmem_exit(clear_launcher_pid, (Datum)0);
+  }
+  return is_claimed;
+}
+
+/*
+ * Workers connect by oid so that databases renamed after the worker was
+ * started are still found. The role is resolved by the launcher and passed
+ * in bgw_extra.
+ */
+void export_worker_connect(void) {
+  Oid database_oid = DatumGetObjectId(MyBgworkerEntry->bgw_main_arg);
+  Oid role_oid;
+  memcpy(&role_oid, MyBgworkerEntry->bgw_extra, sizeof(Oid));
+  elog(LOG, "Establishing connection to database %u with role %u",
+       database_oid, role_oid);
+  BackgroundWorkerInitializeConnectionByOid(database_oid, role_oid, 0);
+}
+
+/*
+ * Returns the oid of the role export workers connect with, InvalidOid for
+ * the bootstrap superuser. Roles are a shared catalog so the launcher can
+ * read them without a database connection.
+ */
+static Oid get_export_worker_role(void) {
+  if (export_worker_role == NULL || export_worker_role[0] == '\0') {
+    return InvalidOid;
+  }
+  SetCurrentStatementStartTimestamp();
+  StartTransactionCommand();
+  Oid role_oid = get_role_oid(export_worker_role, /*missing_ok=*/true);
+  CommitTransactionCommand();
+  if (!OidIsValid(role_oid)) {
+    ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+                    errmsg("Role %s of export workers does not exist",
+                           export_worker_role)));
+  }
+  return role_oid;
+}
+
+/*
+ * Returns databases accepting connections. Workers started for databases
+ * found previously are carried over from databases.
+ */
+static ExportDatabase *get_export_databases(ExportDatabase *databases,
+                                            int num_of_databases,
+                                            int *num_of_found) {
+  int capacity = Max(num_of_databases, 8);
+  ExportDatabase *found = MemoryContextAllocZero(
+      TopMemoryContext, capacity * sizeof(ExportDatabase));
+  *num_of_found = 0;
+
+  SetCurrentStatementStartTimestamp();
+  StartTransactionCommand();
+  (void)GetTransactionSnapshot();
+  Relation relation = table_open(DatabaseRelationId, AccessShareLock);
+  TableScanDesc scan = table_beginscan_catalog(relation, 0, NULL);
+  HeapTuple tuple;
+  while (HeapTupleIsValid(tuple = heap_getnext(scan, ForwardScanDirection))) {
+    Form_pg_database database = (Form_pg_database)GETSTRUCT(tuple);
+    if (!database->datallowconn || database->datistemplate) {
+      continue;
+    }
+    if (*num_of_found == capacity) {
+      capacity *= 2;
+      found = repalloc(found, capacity * sizeof(ExportDatabase));
+    }
+    ExportDatabase *entry = &found[*num_of_found];
+    memset(entry, 0, sizeof(ExportDatabase));
+    entry->oid = database->oid;
+    strlcpy(entry->name, NameStr(database->datname), NAMEDATALEN);
+    for (int i = 0; i < num_of_databases; i += 1) {
+      if (databases[i].oid == entry->oid) {
+        entry->last_started = databases[i].last_started;
+        entry->handle = databases[i].handle;
+        break;
+      }
+    }
+    *num_of_found += 1;
+  }
+  table_endscan(scan);
+  table_close(relation, AccessShareLock);
+  CommitTransactionCommand();
+  if (databases != NULL) {
+    pfree(databases);
+  }
+  return found;
+}
+
+static bool start_export_worker(ExportDatabase *database, Oid role_oid) {
+  BackgroundWorker worker;
+  memset(&worker, 0, sizeof(worker));
+  worker.bgw_flags =
+      BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+  worker.bgw_start_time = get_worker_start_time();
+  worker.bgw_restart_time = BGW_NEVER_RESTART;
+  sprintf(worker.bgw_library_name, "ingestor");
+  sprintf(worker.bgw_function_name, "ingestor_main");
+  snprintf(worker.bgw_name, BGW_MAXLEN, "ingestor worker for %s",
+           database->name);
+  snprintf(worker.bgw_type, BGW_MAXLEN, "ingestor worker");
+  worker.bgw_main_arg = ObjectIdGetDatum(database->oid);
+  memcpy(worker.bgw_extra, &role_oid, sizeof(Oid));
+  // The launcher's latch is set when the worker exits.
+  worker.bgw_notify_pid = MyProcPid;
+
+  MemoryContext old_context = MemoryContextSwitchTo(TopMemoryContext);
+  bool is_registered =
+      RegisterDynamicBackgroundWorker(&worker, &database->handle);
+  MemoryContextSwitchTo(old_context);
+  if (!is_registered) {
+    database->handle = NULL;
+    elog(LOG, "No background worker slots left to export database %s",
+         database->name);
+    return false;
+  }
+  elog(LOG, "Started export worker for database %s", database->name);
+  return true;
+}
+
+/*
+ * Starts export workers for databases due for an export run, starting from
+ * next_database, while fewer than max_export_workers are running. Returns
+ * the database to start from next time.
+ */
+static int start_export_workers(ExportDatabase *databases,
+                                int num_of_databases, int next_database) {
+  int num_of_running = 0;
+  for (int i = 0; i < num_of_databases; i += 1) {
+    pid_t pid;
+    if (databases[i].handle == NULL) {
+      continue;
+    }
+    if (GetBackgroundWorkerPid(databases[i].handle, &pid) == BGWH_STOPPED) {
+      pfree(databases[i].handle);
+      databases[i].handle = NULL;
+      continue;
+    }
+    num_of_running += 1;
+  }
+
+  TimestampTz now = GetCurrentTimestamp();
+  Oid role_oid = InvalidOid;
+  bool has_role = false;
+  int start = next_database;
+  for (int n = 0; n < num_of_databases; n += 1) {
+    if (num_of_running >= max_export_workers) {
+      break;
+    }
+    int i = (start + n) % num_of_databases;
+    if (databases[i].handle != NULL ||
+        !TimestampDifferenceExceeds(databases[i].last_started, now,
+                                    ingestor_naptime_sec * 1000)) {
+      continue;
+    }
+    if (!has_role) {
+      role_oid = get_export_worker_role();
+      has_role = true;
+    }
+    if (!start_export_worker(&databases[i], role_oid)) {
+      break;
+    }
+    databases[i].last_started = now;
+    num_of_running += 1;
+    next_database = i + 1;
+  }
+  return num_of_databases > 0 ? next_database % num_of_databases : 0;
+}
+
+/*
+ * Returns milliseconds until the next database is due for an export run.
+ */
+static long get_launcher_timeout(const ExportDatabase *databases,
+                                 int num_of_databases) {
+  long timeout = ingestor_naptime_sec * 1000L;
+  TimestampTz now = GetCurrentTimestamp();
+  for (int i = 0; i < num_of_databases; i += 1) {
+    if (databases[i].handle != NULL) {
+      continue;
+    }
+    TimestampTz next_start = TimestampTzPlusMilliseconds(
+        databases[i].last_started, ingestor_naptime_sec * 1000L);
+    timeout = Min(timeout, TimestampDifferenceMilliseconds(now, next_start));
+  }
+  // Databases may be due while all workers are busy.
+  return Max(timeout, 1000L);
+}
+
+void ingestor_launcher_main(Datum main_arg) {
+  pqsignal(SIGHUP, SignalHandlerForConfigReload);
+  BackgroundWorkerUnblockSignals();
+  // Exiting with 0 keeps the worker from being restarted.
+  if (!claim_launcher()) {
+    elog(LOG, "Export launcher is already running as %d", get_launcher_pid());
+    proc_exit(0);
+  }
+  // The launcher only reads shared catalogs so it doesn't connect to a
+  // database.
+  BackgroundWorkerInitializeConnection(NULL, NULL, 0);
+  elog(LOG, "Started export launcher");
+
+  ExportDatabase *databases = NULL;
+  int num_of_databases = 0;
+  int next_database = 0;
+  for (;;) {
+    CHECK_FOR_INTERRUPTS();
+    if (ConfigReloadPending) {
+      ConfigReloadPending = false;
+      ProcessConfigFile(PGC_SIGHUP);
+    }
+    databases =
+        get_export_databases(databases, num_of_databases, &num_of_databases);
+    next_database =
+        start_export_workers(databases, num_of_databases, next_database);
+
+    (void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                    get_launcher_timeout(databases, num_of_databases),
+                    PG_WAIT_EXTENSION);
+    ResetLatch(MyLatch);
+  }
+}
+
+/**
+ * Starts the launcher which runs export workers for every database with the
+ * extension installed. Returns the pid of the launcher, which is left
+ * running if it was already started.
+ */
+Datum ingestor_launch(PG_FUNCTION_ARGS) {
+  pid_t pid;
+  BackgroundWorker worker;
+  BackgroundWorkerHandle *handle;
+  BgwHandleStatus status;
+
+  pid = get_launcher_pid();
+  if (pid != 0) {
+    ereport(NOTICE, (errmsg("export launcher is already running")));
+    PG_RETURN_INT32(pid);
+  }
+
+  memset(&worker, 0, sizeof(worker));
+  worker.bgw_flags =
+      BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+  worker.bgw_start_time = get_worker_start_time();
+  worker.bgw_restart_time = BGW_DEFAULT_RESTART_INTERVAL;
+  sprintf(worker.bgw_library_name, "ingestor");
+  sprintf(worker.bgw_function_name, "ingestor_launcher_main");
+  snprintf(worker.bgw_name, BGW_MAXLEN, "ingestor launcher");
+  snprintf(worker.bgw_type, BGW_MAXLEN, "ingestor launcher");
+  /* set bgw_notify_pid so that we can use WaitForBackgroundWorkerStartup */
+  worker.bgw_notify_pid = MyProcPid;
+
+  if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+    PG_RETURN_NULL();
+
+  status = WaitForBackgroundWorkerStartup(handle, &pid);
+  if (status == BGWH_STOPPED)
+    ereport(ERROR,
+            (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+             errmsg("could not start background process"),
+             errhint("More details may be available in the server log.")));
+  if (status == BGWH_POSTMASTER_DIED)
+    ereport(ERROR,
+            (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+             errmsg("cannot start background processes without postmaster"),
+             errhint("Kill all remaining database processes and restart the "
+                     "database.")));
+
+  Assert(status == BGWH_STARTED);
+
+  elog(LOG, "Background worker started");
+  PG_RETURN_INT32(pid);
+}
@@ -0,0 +1,26 @@
+#ifndef _LAUNCHER_H
+#define _LAUNCHER_H
+
+#include "postgres.h"
+
+/**
+ * The launcher is a background worker which finds the databases of the
+ * cluster and periodically starts an export worker for each of them. At most
+ * pg_analytica.max_workers export workers run at once and databases are
+ * served round robin so every database gets its turn.
+ */
+extern void launcher_init(void);
+
+/**
+ * Connects an export worker started by the launcher to its database.
+ */
+extern void export_worker_connect(void);
+
+/**
+ * Returns whether exports run on hot standbys. Standbys then export tables
+ * keeping their state in sidecar files while the primary only creates the
+ * relations exported tables are queried through.
+ */
+extern bool standby_exports_enabled(void);
+
+#endif
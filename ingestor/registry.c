@@ -1,17 +1,47 @@
+#include <ctype.h>
+
 #include "postgres.h"
 #include "access/xact.h"
+#include "catalog/pg_authid_d.h"
+#include "catalog/pg_class.h"
 #include "catalog/pg_type_d.h"
+#include "bloom_filter.h"
+#include "column_types.h"
 #include "constants.h"
+#include "distinct_sketch.h"
 #include "executor/spi.h"
+#include "export_access.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "parser/parser.h"
 #include "postgres.h"
+#include "utils/acl.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/regproc.h"
 #include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/typcache.h"
 
 PG_FUNCTION_INFO_V1(register_table_export);
+PG_FUNCTION_INFO_V1(register_query_export);
 PG_FUNCTION_INFO_V1(unregister_table_export);
+PG_FUNCTION_INFO_V1(set_export_columns);
+
+/*
+ * Condition matching exports the current role may change, those registered
+ * by a role it is a member of. Exports registered before roles were
+ * recorded can only be changed by superusers.
+ */
+#define CURRENT_ROLE_EXPORT_SQL                                                \
+  "pg_has_role(coalesce(registered_by, %u), 'MEMBER')"
 
-static int execute_query(StringInfoData buf) {
+/*
+ * Executes buf and returns its SPI status. num_of_rows, unless NULL, is
+ * populated with the number of rows processed.
+ */
+static int execute_query(StringInfoData buf, uint64 *num_of_rows) {
   int connection = SPI_connect();
   if (connection < 0) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
@@ -19,9 +49,12 @@ static int execute_query(StringInfoData buf) {
   }
   elog(LOG, "Created connection for query");
   // Execute the chunked query using SPI_exec
-  elog(LOG, "Executing SPI_execute query %s", buf.data);
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
   int status = SPI_execute(buf.data, false, 0);
-  elog(LOG, "Executed SPI_execute command with status %d", status);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
+  if (num_of_rows != NULL) {
+    *num_of_rows = SPI_processed;
+  }
 
   SPI_finish();
   return status;
@@ -35,7 +68,8 @@ static char *get_columns_string(Datum *columns, int num_of_columns) {
     total_size += strlen(column_name) + 1;
     elog(LOG, "Size of column %s is %d", column_name, strlen(column_name));
   }
-  char *combined_string = (char *)palloc(total_size * sizeof(char));
+  // Leave space for the terminator when there are no columns.
+  char *combined_string = (char *)palloc((total_size + 1) * sizeof(char));
   elog(LOG, "Allocated memory");
   combined_string[0] = '\0';
   for (int i = 0; i < num_of_columns; i++) {
@@ -48,18 +82,452 @@ static char *get_columns_string(Datum *columns, int num_of_columns) {
   return combined_string;
 }
 
+/**
+ * Raises an error if the table doesn't exist, the current user can't read
+ * it or any of the columns can't be exported so that unsupported tables are
+ * rejected at registration instead of failing in the background worker.
+ * The worker reads the table as the role that registered it.
+ */
+static void validate_export_columns(const char *table_name, Datum *columns,
+                                    int num_of_columns) {
+  Oid relid = DatumGetObjectId(
+      DirectFunctionCall1(regclassin, CStringGetDatum(table_name)));
+  AclResult result = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+  if (result != ACLCHECK_OK) {
+    aclcheck_error(result, OBJECT_TABLE, table_name);
+  }
+  for (int i = 0; i < num_of_columns; i++) {
+    char *column_name = TextDatumGetCString(columns[i]);
+    validate_export_column_name(column_name);
+    AttrNumber attnum = get_attnum(relid, column_name);
+    if (attnum == InvalidAttrNumber) {
+      ereport(ERROR,
+              (errcode(ERRCODE_UNDEFINED_COLUMN),
+               errmsg("Column %s does not exist in table %s", column_name,
+                      table_name)));
+    }
+    Oid type_oid;
+    int32 typmod;
+    Oid collation;
+    get_atttypetypmodcoll(relid, attnum, &type_oid, &typmod, &collation);
+    const char *reason = unsupported_column_type_reason(type_oid, typmod);
+    if (reason != NULL) {
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("Column %s of type %s can't be exported", column_name,
+                      format_type_with_typemod(type_oid, typmod)),
+               errdetail("%s.", reason),
+               errhint("Remove the column from the columns to export.")));
+    }
+    pfree(column_name);
+  }
+}
+
+/**
+ * Raises an error unless every bloom filter column is exported and of a type
+ * bloom filters can be built for.
+ */
+static void validate_bloom_filter_columns(const char *table_name,
+                                          Datum *columns, int num_of_columns,
+                                          Datum *bloom_filter_columns,
+                                          int num_of_bloom_filter_columns) {
+  Oid relid = DatumGetObjectId(
+      DirectFunctionCall1(regclassin, CStringGetDatum(table_name)));
+  for (int i = 0; i < num_of_bloom_filter_columns; i++) {
+    char *column_name = TextDatumGetCString(bloom_filter_columns[i]);
+    bool is_exported = false;
+    for (int j = 0; j < num_of_columns && !is_exported; j++) {
+      char *exported_column_name = TextDatumGetCString(columns[j]);
+      is_exported = strcmp(column_name, exported_column_name) == 0;
+      pfree(exported_column_name);
+    }
+    if (!is_exported) {
+      ereport(ERROR,
+              (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+               errmsg("Bloom filter column %s is not exported", column_name),
+               errhint("Add the column to the columns to export.")));
+    }
+    Oid type_oid = get_atttype(relid, get_attnum(relid, column_name));
+    if (!bloom_filter_supports_type(type_oid)) {
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("Bloom filters can't be built for column %s of type %s",
+                      column_name, format_type_be(type_oid)),
+               errdetail("Bloom filters support integer and text columns.")));
+    }
+    pfree(column_name);
+  }
+}
+
+/**
+ * Returns OutputFormat named by output_format.
+ */
+static int parse_output_format(const char *output_format) {
+  if (strcmp(output_format, "parquet") == 0) {
+    return OUTPUT_FORMAT_PARQUET;
+  }
+  if (strcmp(output_format, "arrow") == 0) {
+    return OUTPUT_FORMAT_ARROW;
+  }
+  if (strcmp(output_format, "arrow_lz4") == 0) {
+    return OUTPUT_FORMAT_ARROW_LZ4;
+  }
+  ereport(ERROR,
+          (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+           errmsg("Invalid output format %s", output_format),
+           errhint("Supported formats are parquet, arrow and arrow_lz4.")));
+  return OUTPUT_FORMAT_PARQUET;
+}
+
+/**
+ * Returns ExportLayout named by layout.
+ */
+static int parse_export_layout(const char *layout) {
+  if (strcmp(layout, "rows") == 0) {
+    return EXPORT_LAYOUT_ROWS;
+  }
+  if (strcmp(layout, "column_groups") == 0) {
+    return EXPORT_LAYOUT_COLUMN_GROUPS;
+  }
+  ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                  errmsg("Invalid layout %s", layout),
+                  errhint("Supported layouts are rows and column_groups.")));
+  return EXPORT_LAYOUT_ROWS;
+}
+
+/**
+ * Raises an error unless table can be exported in the column group layout.
+ * Column groups are stitched back together by analytica_scan, which reads
+ * Arrow files, and are named by the heap blocks of a single relation.
+ */
+static void validate_column_group_layout(const char *table_name,
+                                         int output_format) {
+  if (output_format == OUTPUT_FORMAT_PARQUET) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Column groups can't be exported as parquet files"),
+             errhint("Use the arrow or arrow_lz4 output format.")));
+  }
+  Oid relid = DatumGetObjectId(
+      DirectFunctionCall1(regclassin, CStringGetDatum(table_name)));
+  if (get_rel_relkind(relid) == RELKIND_PARTITIONED_TABLE) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Partitioned table %s can't be exported as column "
+                    "groups",
+                    table_name)));
+  }
+}
+
+/**
+ * Raises an error unless column_name, used as the given kind of column, is
+ * one of the exported columns.
+ */
+static void validate_column_is_exported(const char *kind,
+                                        const char *column_name,
+                                        Datum *columns, int num_of_columns) {
+  bool is_exported = false;
+  for (int i = 0; i < num_of_columns && !is_exported; i++) {
+    char *exported_column_name = TextDatumGetCString(columns[i]);
+    is_exported = strcmp(exported_column_name, column_name) == 0;
+    pfree(exported_column_name);
+  }
+  if (!is_exported) {
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("%s column \"%s\" is not exported", kind, column_name),
+             errhint("Add the column to the columns to export.")));
+  }
+}
+
+/**
+ * Raises an error unless rows of table can be bucketed on bucket_column.
+ * The bucket column has to be exported for scans of a bucket to join on it.
+ */
+static void validate_bucketing(const char *bucket_column, int num_of_buckets,
+                               Datum *columns, int num_of_columns,
+                               int layout) {
+  if (num_of_buckets < 0 || num_of_buckets > MAX_BUCKETS) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("Number of buckets must be between 0 and %d",
+                           MAX_BUCKETS)));
+  }
+  if (num_of_buckets == 0) {
+    return;
+  }
+  if (layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Column groups can't be bucketed")));
+  }
+  validate_column_is_exported("Bucket", bucket_column, columns,
+                              num_of_columns);
+}
+
+/**
+ * Raises an error unless the sample relation of a table can be kept at
+ * sample_rate, stratified on strata_column unless it is empty. Sample
+ * relations add SAMPLE_WEIGHT_COLUMN to the exported columns.
+ */
+static void validate_sample(double sample_rate, const char *strata_column,
+                            Datum *columns, int num_of_columns) {
+  if (sample_rate < 0 || sample_rate > 1) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("Sample rate must be between 0 and 1")));
+  }
+  if (strata_column[0] != '\0') {
+    validate_column_is_exported("Strata", strata_column, columns,
+                                num_of_columns);
+  }
+  if (sample_rate == 0 && strata_column[0] == '\0') {
+    return;
+  }
+  for (int i = 0; i < num_of_columns; i++) {
+    char *column_name = TextDatumGetCString(columns[i]);
+    if (strcmp(column_name, SAMPLE_WEIGHT_COLUMN) == 0) {
+      ereport(ERROR,
+              (errcode(ERRCODE_DUPLICATE_COLUMN),
+               errmsg("Column %s can't be exported with a sample",
+                      column_name),
+               errhint("Export the column under another name.")));
+    }
+    pfree(column_name);
+  }
+}
+
+/**
+ * Raises an error unless distinct counts can be sketched for every column
+ * in the columnar files of table. Column groups are written a column at a
+ * time so their files have no sketches.
+ */
+static void validate_distinct_count_columns(const char *table_name,
+                                            Datum *columns,
+                                            int num_of_columns,
+                                            Datum *distinct_count_columns,
+                                            int num_of_distinct_count_columns,
+                                            int layout) {
+  if (num_of_distinct_count_columns > 0 &&
+      layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Distinct counts can't be sketched for column groups")));
+  }
+  Oid relid = DatumGetObjectId(
+      DirectFunctionCall1(regclassin, CStringGetDatum(table_name)));
+  for (int i = 0; i < num_of_distinct_count_columns; i++) {
+    char *column_name = TextDatumGetCString(distinct_count_columns[i]);
+    validate_column_is_exported("Distinct count", column_name, columns,
+                                num_of_columns);
+    Oid type_oid = get_atttype(relid, get_attnum(relid, column_name));
+    if (!distinct_sketch_supports_type(type_oid)) {
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("Distinct counts can't be sketched for column %s of "
+                      "type %s",
+                      column_name, format_type_be(type_oid)),
+               errdetail("The type has no default hash function.")));
+    }
+    pfree(column_name);
+  }
+}
+
+/**
+ * Returns true if an index of relation relid starts with column attnum.
+ */
+static bool has_index_starting_with(Oid relid, AttrNumber attnum) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT 1 FROM pg_index WHERE indrelid = %u "
+                   "AND indkey[0] = %d;",
+                   relid, attnum);
+  int connection = SPI_connect();
+  if (connection < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to connect to database")));
+  }
+  int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/1);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Query execution failed")));
+  }
+  bool has_index = SPI_processed > 0;
+  SPI_finish();
+  pfree(buf.data);
+  return has_index;
+}
+
+/**
+ * Raises an error unless fresh rows of table can be found by fresh_column,
+ * which has to be exported and ordered. Warns if no index starts with the
+ * column, as fresh views then scan the whole table.
+ */
+static void validate_fresh_column(const char *table_name,
+                                  const char *fresh_column, Datum *columns,
+                                  int num_of_columns) {
+  validate_column_is_exported("Fresh", fresh_column, columns,
+                              num_of_columns);
+  Oid relid = DatumGetObjectId(
+      DirectFunctionCall1(regclassin, CStringGetDatum(table_name)));
+  AttrNumber attnum = get_attnum(relid, fresh_column);
+  Oid type_oid = get_atttype(relid, attnum);
+  if (!OidIsValid(lookup_type_cache(type_oid, TYPECACHE_GT_OPR)->gt_opr)) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Fresh column %s of type %s can't be ordered",
+                    fresh_column, format_type_be(type_oid))));
+  }
+  if (!has_index_starting_with(relid, attnum)) {
+    ereport(WARNING,
+            (errmsg("No index of %s starts with fresh column %s", table_name,
+                    fresh_column),
+             errhint("Create an index on the column so that fresh rows are "
+                     "found without scanning the table.")));
+  }
+}
+
+static bool contains_sublink(Node *node, void *context) {
+  if (node == NULL) {
+    return false;
+  }
+  if (IsA(node, SubLink)) {
+    return true;
+  }
+  return raw_expression_tree_walker(node, contains_sublink, context);
+}
+
+/**
+ * Returns true if row_filter parses as a single expression without
+ * subqueries. The filter is pasted into statements run by the export
+ * worker, so anything else could change what those statements read.
+ */
+static bool is_single_expression(const char *row_filter) {
+  List *statements = raw_parser(row_filter, RAW_PARSE_PLPGSQL_EXPR);
+  if (list_length(statements) != 1) {
+    return false;
+  }
+  Node *statement = linitial_node(RawStmt, statements)->stmt;
+  if (!IsA(statement, SelectStmt)) {
+    return false;
+  }
+  // The expression is parsed as the target list of a SELECT without the
+  // SELECT keyword, so any other clause means it isn't an expression.
+  SelectStmt *select = (SelectStmt *)statement;
+  if (select->op != SETOP_NONE || list_length(select->targetList) != 1 ||
+      select->distinctClause != NIL || select->fromClause != NIL ||
+      select->whereClause != NULL || select->groupClause != NIL ||
+      select->havingClause != NULL || select->windowClause != NIL ||
+      select->sortClause != NIL || select->limitOffset != NULL ||
+      select->limitCount != NULL || select->lockingClause != NIL ||
+      select->withClause != NULL || select->intoClause != NULL) {
+    return false;
+  }
+  ResTarget *target = linitial_node(ResTarget, select->targetList);
+  return target->name == NULL && !contains_sublink(target->val, NULL);
+}
+
+/**
+ * Raises an error unless rows of table can be exported under row_filter,
+ * which has to be a boolean expression over columns of the table without
+ * subqueries. Column groups of added columns have to hold the same rows as
+ * earlier files, so their rows can't be filtered.
+ */
+static void validate_row_filter(const char *table_name,
+                                const char *row_filter, int layout) {
+  if (layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Rows of column groups can't be filtered")));
+  }
+  if (!is_single_expression(row_filter)) {
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("Invalid row filter %s", row_filter),
+             errhint("Row filters are single expressions without "
+                     "subqueries.")));
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf, "SELECT 1 FROM %s WHERE (%s) LIMIT 0;", table_name,
+                   row_filter);
+  int connection = SPI_connect();
+  if (connection < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to connect to database")));
+  }
+  // Planning the query raises an error for invalid filters.
+  int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/0);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Query execution failed")));
+  }
+  SPI_finish();
+  pfree(buf.data);
+}
+
+/**
+ * Raises an error unless exported rows of table can be limited to those
+ * whose window_column is within window_interval of each export. Warns if no
+ * index starts with the column, as exports then scan the whole table.
+ */
+static void validate_window(const char *table_name, const char *window_column,
+                            Interval *window_interval, int layout) {
+  if (layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Column groups can't be exported with a window")));
+  }
+  Interval zero;
+  memset(&zero, 0, sizeof(Interval));
+  if (!DatumGetBool(DirectFunctionCall2(interval_gt,
+                                        IntervalPGetDatum(window_interval),
+                                        IntervalPGetDatum(&zero)))) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("Window interval must be positive")));
+  }
+  Oid relid = DatumGetObjectId(
+      DirectFunctionCall1(regclassin, CStringGetDatum(table_name)));
+  AttrNumber attnum = get_attnum(relid, window_column);
+  if (attnum == InvalidAttrNumber) {
+    ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+                    errmsg("Column %s does not exist in table %s",
+                           window_column, table_name)));
+  }
+  Oid type_oid = get_atttype(relid, attnum);
+  if (type_oid != DATEOID && type_oid != TIMESTAMPOID &&
+      type_oid != TIMESTAMPTZOID) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Window column %s of type %s isn't a date or timestamp",
+                    window_column, format_type_be(type_oid))));
+  }
+  if (!has_index_starting_with(relid, attnum)) {
+    ereport(WARNING,
+            (errmsg("No index of %s starts with window column %s",
+                    table_name, window_column),
+             errhint("Create an index on the column so that rows within the "
+                     "window are read without scanning the table.")));
+  }
+}
+
 Datum register_table_export(PG_FUNCTION_ARGS) {
-  // TODO - add validation to ensure table exists
-  // and column types are supported for export
   int num_of_args = PG_NARGS();
-  if (num_of_args != 4) {
+  if (num_of_args != 16) {
     ereport(ERROR, (errcode(ERRCODE_RAISE_EXCEPTION),
                     errmsg("Invalid number of arguments. Expected format is "
                            "register_export(table_name text, columns_to_export "
-                           "text[], export_frequency_hours int)")));
+                           "text[], export_frequency_hours int, chunk_size "
+                           "int, bloom_filter_columns text[], output_format "
+                           "text, layout text, bucket_column text, "
+                           "num_of_buckets int, sample_rate float8, "
+                           "sample_strata_column text, "
+                           "distinct_count_columns text[], "
+                           "fresh_column text, row_filter text, "
+                           "window_column text, window_interval interval)")));
   }
   // Extract table name
   char *table_name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  validate_export_name(table_name);
   // Extract columns to export
   ArrayType *arr = PG_GETARG_ARRAYTYPE_P(1);
   Assert(ARR_NDIM(arr) == 1);
@@ -68,33 +536,253 @@ Datum register_table_export(PG_FUNCTION_ARGS) {
   int num_of_columns;
   deconstruct_array(arr, TEXTOID, -1, false, TYPALIGN_INT, &column_datums, NULL,
                     &num_of_columns);
+  validate_export_columns(table_name, column_datums, num_of_columns);
   char *column_str;
   column_str = get_columns_string(column_datums, num_of_columns);
   elog(LOG, "Created column string  as %s", column_str);
   // Extract export frequency
   int32 export_frequency_hours = PG_GETARG_INT32(2);
   int64 chunk_size = PG_GETARG_INT32(3);
+  // Extract columns to build bloom filters for
+  Datum *bloom_filter_column_datums;
+  int num_of_bloom_filter_columns;
+  deconstruct_array(PG_GETARG_ARRAYTYPE_P(4), TEXTOID, -1, false,
+                    TYPALIGN_INT, &bloom_filter_column_datums, NULL,
+                    &num_of_bloom_filter_columns);
+  validate_bloom_filter_columns(table_name, column_datums, num_of_columns,
+                                bloom_filter_column_datums,
+                                num_of_bloom_filter_columns);
+  char *bloom_filter_column_str = get_columns_string(
+      bloom_filter_column_datums, num_of_bloom_filter_columns);
+  // Extract format of columnar files
+  int output_format =
+      parse_output_format(text_to_cstring(PG_GETARG_TEXT_PP(5)));
+  // Extract layout of columnar files
+  int layout = parse_export_layout(text_to_cstring(PG_GETARG_TEXT_PP(6)));
+  if (layout == EXPORT_LAYOUT_COLUMN_GROUPS) {
+    validate_column_group_layout(table_name, output_format);
+  }
+  // Extract column rows are bucketed on
+  char *bucket_column = text_to_cstring(PG_GETARG_TEXT_PP(7));
+  int32 num_of_buckets = PG_GETARG_INT32(8);
+  validate_bucketing(bucket_column, num_of_buckets, column_datums,
+                     num_of_columns, layout);
+  // Extract sample relation settings
+  float8 sample_rate = PG_GETARG_FLOAT8(9);
+  char *sample_strata_column = text_to_cstring(PG_GETARG_TEXT_PP(10));
+  validate_sample(sample_rate, sample_strata_column, column_datums,
+                  num_of_columns);
+  // Extract columns to sketch distinct counts of
+  Datum *distinct_count_column_datums;
+  int num_of_distinct_count_columns;
+  deconstruct_array(PG_GETARG_ARRAYTYPE_P(11), TEXTOID, -1, false,
+                    TYPALIGN_INT, &distinct_count_column_datums, NULL,
+                    &num_of_distinct_count_columns);
+  validate_distinct_count_columns(
+      table_name, column_datums, num_of_columns, distinct_count_column_datums,
+      num_of_distinct_count_columns, layout);
+  char *distinct_count_column_str = get_columns_string(
+      distinct_count_column_datums, num_of_distinct_count_columns);
+  // Extract column fresh rows are found by
+  char *fresh_column = text_to_cstring(PG_GETARG_TEXT_PP(12));
+  if (fresh_column[0] != '\0') {
+    validate_fresh_column(table_name, fresh_column, column_datums,
+                          num_of_columns);
+  }
+  // Extract predicate and window exported rows are limited to
+  char *row_filter = text_to_cstring(PG_GETARG_TEXT_PP(13));
+  const char *quoted_row_filter = "NULL";
+  if (row_filter[0] != '\0') {
+    validate_row_filter(table_name, row_filter, layout);
+    quoted_row_filter = quote_literal_cstr(row_filter);
+  }
+  char *window_column = text_to_cstring(PG_GETARG_TEXT_PP(14));
+  Interval *window_interval = PG_GETARG_INTERVAL_P(15);
+  const char *quoted_window_interval = "NULL";
+  if (window_column[0] != '\0') {
+    validate_window(table_name, window_column, window_interval, layout);
+    quoted_window_interval = quote_literal_cstr(DatumGetCString(
+        DirectFunctionCall1(interval_out, IntervalPGetDatum(window_interval))));
+  }
 
   StringInfoData buf;
   initStringInfo(&buf);
   appendStringInfo(&buf,
                    "INSERT INTO analytica_exports (table_name, "
                    "columns_to_export, export_frequency_hours, export_status, "
-                   "chunk_size) VALUES ('%s', '{%s}', %d, %d, %ld);",
-                   table_name, column_str, export_frequency_hours, PENDING,
-                   chunk_size);
+                   "chunk_size, bloom_filter_columns, output_format, layout, "
+                   "bucket_column, num_of_buckets, sample_rate, "
+                   "sample_strata_column, distinct_count_columns, "
+                   "fresh_column, row_filter, window_column, "
+                   "window_interval, registered_by) VALUES "
+                   "(%s, '{%s}', %d, %d, " INT64_FORMAT ", '{%s}', %d, %d, "
+                   "NULLIF(%s, ''), %d, %.17g, NULLIF(%s, ''), '{%s}', "
+                   "NULLIF(%s, ''), %s, NULLIF(%s, ''), %s, %u);",
+                   quote_literal_cstr(table_name), column_str,
+                   export_frequency_hours, PENDING, chunk_size,
+                   bloom_filter_column_str, output_format, layout,
+                   quote_literal_cstr(bucket_column), num_of_buckets,
+                   sample_rate, quote_literal_cstr(sample_strata_column),
+                   distinct_count_column_str, quote_literal_cstr(fresh_column),
+                   quoted_row_filter, quote_literal_cstr(window_column),
+                   quoted_window_interval, GetUserId());
 
-  int status = execute_query(buf);
+  int status = execute_query(buf, /*num_of_rows=*/NULL);
   if (status < 0) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
                     errmsg("Query execution failed")));
   }
   pfree(column_str);
+  pfree(bloom_filter_column_str);
+  pfree(distinct_count_column_str);
   elog(LOG, "Scheduled export for table %s with frequency of %d hours",
        table_name, export_frequency_hours);
   PG_RETURN_INT32(1);
 }
 
+/*
+ * Returns a copy of query without trailing semicolons and whitespace, so
+ * that it can be read as a subquery.
+ */
+static char *trim_query(const char *query) {
+  char *trimmed = pstrdup(query);
+  int length = strlen(trimmed);
+  while (length > 0 && (trimmed[length - 1] == ';' ||
+                        isspace((unsigned char)trimmed[length - 1]))) {
+    length -= 1;
+  }
+  trimmed[length] = '\0';
+  return trimmed;
+}
+
+/**
+ * Raises an error unless every column of the result of query can be
+ * exported and has a distinct name. Returns the names of the columns
+ * separated by commas and populates the type of incremental_key, which has
+ * to be one of the columns unless it is empty, in key_type.
+ * Expects SPI connection to be established.
+ */
+static char *validate_query_columns(const char *query,
+                                    const char *incremental_key,
+                                    Oid *key_type) {
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf, "SELECT * FROM (%s) AS " QUERY_SOURCE_ALIAS
+                   " LIMIT 0;", query);
+  int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/0);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("Query registered for export must be a SELECT "
+                           "statement")));
+  }
+  TupleDesc tupdesc = SPI_tuptable->tupdesc;
+  resetStringInfo(&buf);
+  *key_type = InvalidOid;
+  for (int i = 0; i < tupdesc->natts; i++) {
+    Form_pg_attribute attribute = TupleDescAttr(tupdesc, i);
+    const char *column_name = NameStr(attribute->attname);
+    validate_export_column_name(column_name);
+    for (int j = 0; j < i; j++) {
+      if (strcmp(NameStr(TupleDescAttr(tupdesc, j)->attname),
+                 column_name) == 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_DUPLICATE_COLUMN),
+                 errmsg("Query returns more than one column named %s",
+                        column_name),
+                 errhint("Give the columns distinct aliases.")));
+      }
+    }
+    const char *reason = unsupported_column_type_reason(
+        attribute->atttypid, attribute->atttypmod);
+    if (reason != NULL) {
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("Column %s of type %s can't be exported", column_name,
+                      format_type_with_typemod(attribute->atttypid,
+                                               attribute->atttypmod)),
+               errdetail("%s.", reason),
+               errhint("Cast the column to a supported type or remove it "
+                       "from the query.")));
+    }
+    if (strcmp(column_name, incremental_key) == 0) {
+      *key_type = attribute->atttypid;
+    }
+    appendStringInfo(&buf, "%s%s", i > 0 ? "," : "", column_name);
+  }
+  if (incremental_key[0] != '\0' && !OidIsValid(*key_type)) {
+    ereport(ERROR,
+            (errcode(ERRCODE_UNDEFINED_COLUMN),
+             errmsg("Incremental key %s is not a column of the query",
+                    incremental_key)));
+  }
+  return buf.data;
+}
+
+/**
+ * Registers the result of a SELECT statement for export. The columns of
+ * the export are those of the query result, tables the query reads are
+ * fingerprinted together to skip exports while none of them changed. The
+ * export worker runs the query as the role registering it.
+ */
+Datum register_query_export(PG_FUNCTION_ARGS) {
+  char *table_name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  validate_export_name(table_name);
+  char *query = trim_query(text_to_cstring(PG_GETARG_TEXT_PP(1)));
+  int32 export_frequency_hours = PG_GETARG_INT32(2);
+  int64 chunk_size = PG_GETARG_INT32(3);
+  int output_format =
+      parse_output_format(text_to_cstring(PG_GETARG_TEXT_PP(4)));
+  char *incremental_key = text_to_cstring(PG_GETARG_TEXT_PP(5));
+  if (chunk_size <= 0) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("Chunk size must be positive")));
+  }
+
+  int connection = SPI_connect();
+  if (connection < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to connect to database")));
+  }
+  Oid key_type;
+  char *column_str = validate_query_columns(query, incremental_key,
+                                            &key_type);
+  if (OidIsValid(key_type) &&
+      !OidIsValid(lookup_type_cache(key_type, TYPECACHE_GT_OPR)->gt_opr)) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("Incremental key %s of type %s can't be ordered",
+                    incremental_key, format_type_be(key_type))));
+  }
+
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "INSERT INTO analytica_exports (table_name, "
+                   "columns_to_export, export_frequency_hours, export_status, "
+                   "chunk_size, output_format, source_query, "
+                   "incremental_key, registered_by) VALUES "
+                   "(%s, '{%s}', %d, %d, " INT64_FORMAT
+                   ", %d, %s, NULLIF(%s, ''), %u);",
+                   quote_literal_cstr(table_name), column_str,
+                   export_frequency_hours, PENDING, chunk_size, output_format,
+                   quote_literal_cstr(query),
+                   quote_literal_cstr(incremental_key), GetUserId());
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
+  int status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
+  if (status != SPI_OK_INSERT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Query execution failed")));
+  }
+  SPI_finish();
+  elog(LOG, "Scheduled export of query %s as %s with frequency of %d hours",
+       query, table_name, export_frequency_hours);
+  pfree(buf.data);
+  pfree(column_str);
+  pfree(query);
+  PG_RETURN_INT32(1);
+}
+
 Datum unregister_table_export(PG_FUNCTION_ARGS) {
   int num_of_args = PG_NARGS();
   if (num_of_args != 1) {
@@ -109,18 +797,144 @@ Datum unregister_table_export(PG_FUNCTION_ARGS) {
   initStringInfo(&buf);
   appendStringInfo(&buf, "UPDATE analytica_exports        \
 		 SET export_status = %d \
-		 WHERE table_name = '%s';",
-                   INACTIVE, table_name);
+		 WHERE table_name = %s AND " CURRENT_ROLE_EXPORT_SQL ";",
+                   INACTIVE, quote_literal_cstr(table_name),
+                   BOOTSTRAP_SUPERUSERID);
 
-  int status = execute_query(buf);
+  uint64 num_of_rows;
+  int status = execute_query(buf, &num_of_rows);
   if (status < 0) {
     ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
                     errmsg("Failed to unregister table.")));
   }
+  if (num_of_rows == 0) {
+    ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+                    errmsg("Table %s isn't registered for export by the "
+                           "current role",
+                           table_name)));
+  }
 
   elog(LOG,
        "Marked %s table export as inactive. Table data will be deleted at next "
        "available window.",
        table_name);
   PG_RETURN_INT32(1);
-}
\ No newline at end of file
+}
+/**
+ * Changes the columns exported for a registered table. The table is exported
+ * again by the next export, tables in the column group layout only export
+ * the added columns.
+ */
+Datum set_export_columns(PG_FUNCTION_ARGS) {
+  char *table_name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  Datum *column_datums;
+  int num_of_columns;
+  deconstruct_array(PG_GETARG_ARRAYTYPE_P(1), TEXTOID, -1, false,
+                    TYPALIGN_INT, &column_datums, NULL, &num_of_columns);
+  validate_export_columns(table_name, column_datums, num_of_columns);
+  char *column_str = get_columns_string(column_datums, num_of_columns);
+
+  int connection = SPI_connect();
+  if (connection < 0) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to connect to database")));
+  }
+  StringInfoData buf;
+  initStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "SELECT bloom_filter_columns, bucket_column, "
+                   "num_of_buckets, layout, sample_strata_column, "
+                   "distinct_count_columns, fresh_column, sample_rate "
+                   "FROM analytica_exports "
+                   "WHERE table_name = %s AND export_status <> %d "
+                   "AND " CURRENT_ROLE_EXPORT_SQL ";",
+                   quote_literal_cstr(table_name), INACTIVE,
+                   BOOTSTRAP_SUPERUSERID);
+  int status = SPI_execute(buf.data, /*read_only=*/true, /*count=*/1);
+  if (status != SPI_OK_SELECT) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Query execution failed")));
+  }
+  if (SPI_processed == 0) {
+    ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+                    errmsg("Table %s isn't registered for export",
+                           table_name)));
+  }
+  bool isnull;
+  Datum bloom_filter_columns_datum =
+      SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+  if (!isnull) {
+    Datum *bloom_filter_column_datums;
+    int num_of_bloom_filter_columns;
+    deconstruct_array(DatumGetArrayTypeP(bloom_filter_columns_datum),
+                      TEXTOID, -1, false, TYPALIGN_INT,
+                      &bloom_filter_column_datums, NULL,
+                      &num_of_bloom_filter_columns);
+    validate_bloom_filter_columns(table_name, column_datums, num_of_columns,
+                                  bloom_filter_column_datums,
+                                  num_of_bloom_filter_columns);
+  }
+  char *bucket_column =
+      SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2);
+  Datum num_of_buckets_datum =
+      SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 3, &isnull);
+  if (bucket_column != NULL && !isnull) {
+    Datum layout_datum = SPI_getbinval(SPI_tuptable->vals[0],
+                                       SPI_tuptable->tupdesc, 4, &isnull);
+    validate_bucketing(bucket_column, DatumGetInt32(num_of_buckets_datum),
+                       column_datums, num_of_columns,
+                       isnull ? EXPORT_LAYOUT_ROWS
+                              : DatumGetInt32(layout_datum));
+  }
+  char *sample_strata_column =
+      SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 5);
+  Datum sample_rate_datum =
+      SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 8, &isnull);
+  validate_sample(isnull ? 0 : DatumGetFloat8(sample_rate_datum),
+                  sample_strata_column != NULL ? sample_strata_column : "",
+                  column_datums, num_of_columns);
+  Datum distinct_count_columns_datum =
+      SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 6, &isnull);
+  if (!isnull) {
+    Datum *distinct_count_column_datums;
+    int num_of_distinct_count_columns;
+    deconstruct_array(DatumGetArrayTypeP(distinct_count_columns_datum),
+                      TEXTOID, -1, false, TYPALIGN_INT,
+                      &distinct_count_column_datums, NULL,
+                      &num_of_distinct_count_columns);
+    for (int i = 0; i < num_of_distinct_count_columns; i++) {
+      char *column_name = TextDatumGetCString(distinct_count_column_datums[i]);
+      validate_column_is_exported("Distinct count", column_name,
+                                  column_datums, num_of_columns);
+      pfree(column_name);
+    }
+  }
+  char *fresh_column =
+      SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 7);
+  if (fresh_column != NULL) {
+    validate_column_is_exported("Fresh", fresh_column, column_datums,
+                                num_of_columns);
+  }
+
+  // Clearing the fingerprint and completion time makes the next export
+  // pick the table up even though its rows didn't change.
+  resetStringInfo(&buf);
+  appendStringInfo(&buf,
+                   "UPDATE analytica_exports SET columns_to_export = '{%s}', "
+                   "fingerprint = NULL, last_run_completed = NULL "
+                   "WHERE table_name = %s;",
+                   column_str, quote_literal_cstr(table_name));
+  elog(DEBUG1, "Executing SPI_execute query %s", buf.data);
+  status = SPI_execute(buf.data, /*read_only=*/false, /*count=*/0);
+  elog(DEBUG1, "Executed SPI_execute command with status %d", status);
+  if (status != SPI_OK_UPDATE) {
+    ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+                    errmsg("Failed to update exported columns of %s",
+                           table_name)));
+  }
+  SPI_finish();
+  elog(LOG, "Exporting columns {%s} of %s", column_str, table_name);
+  pfree(buf.data);
+  pfree(column_str);
+  PG_RETURN_INT32(1);
+}
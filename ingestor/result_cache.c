@@ -0,0 +1,426 @@
+#include <ctype.h>
+#include <limits.h>
+
+#include "postgres.h"
+
+#include "access/parallel.h"
+#include "catalog/pg_class.h"
+#include "executor/executor.h"
+#include "export_generation.h"
+#include "file_filter.h"
+#include "miscadmin.h"
+#include "optimizer/optimizer.h"
+#include "result_cache.h"
+#include "slot_cache.h"
+#include "storage/ipc.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+
+#define RESULT_CACHE_NAME "pg_analytica result cache"
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ExecutorRun_hook_type prev_executor_run_hook = NULL;
+
+static SlotCache *result_cache = NULL;
+static bool enable_result_cache = true;
+// Sizes are in kB.
+static int result_cache_size = 0;
+static int result_cache_entry_size = 64;
+
+/*
+ * Forwards tuples to the original destination of the query while collecting
+ * them in a buffer to be cached. Collection stops once the result is too
+ * large to be cached.
+ */
+typedef struct _CachingReceiver {
+  DestReceiver pub;
+  DestReceiver *target;
+  StringInfoData tuples;
+  Size max_size;
+  bool overflowed;
+} CachingReceiver;
+
+static int num_result_cache_slots(void) {
+  return result_cache_size / result_cache_entry_size;
+}
+
+static void result_cache_shmem_request(void) {
+  if (prev_shmem_request_hook != NULL) {
+    prev_shmem_request_hook();
+  }
+  RequestAddinShmemSpace(slot_cache_shmem_size(
+      num_result_cache_slots(), (Size)result_cache_entry_size * 1024));
+  slot_cache_request_lock(RESULT_CACHE_NAME);
+}
+
+static void result_cache_shmem_startup(void) {
+  if (prev_shmem_startup_hook != NULL) {
+    prev_shmem_startup_hook();
+  }
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  result_cache =
+      slot_cache_init(RESULT_CACHE_NAME, num_result_cache_slots(),
+                      (Size)result_cache_entry_size * 1024);
+  LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Returns true if expressions of the plan and its children can't change
+ * their result between executions.
+ */
+static bool plan_is_cacheable(Plan *plan) {
+  if (plan == NULL) {
+    return true;
+  }
+  if (contain_mutable_functions((Node *)plan->targetlist) ||
+      contain_mutable_functions((Node *)plan->qual)) {
+    return false;
+  }
+  List *expressions = NIL;
+  ListCell *cell;
+  switch (nodeTag(plan)) {
+  case T_ForeignScan:
+    expressions = ((ForeignScan *)plan)->fdw_exprs;
+    break;
+  case T_Result:
+    expressions = (List *)((Result *)plan)->resconstantqual;
+    break;
+  case T_Limit:
+    expressions = list_make2(((Limit *)plan)->limitOffset,
+                             ((Limit *)plan)->limitCount);
+    break;
+  case T_Hash:
+    expressions = ((Hash *)plan)->hashkeys;
+    break;
+  case T_NestLoop:
+    expressions = ((Join *)plan)->joinqual;
+    break;
+  case T_MergeJoin:
+    expressions = list_concat_copy(((Join *)plan)->joinqual,
+                                   ((MergeJoin *)plan)->mergeclauses);
+    break;
+  case T_HashJoin:
+    expressions = list_concat_copy(((Join *)plan)->joinqual,
+                                   ((HashJoin *)plan)->hashclauses);
+    break;
+  case T_WindowAgg:
+    expressions = list_make2(((WindowAgg *)plan)->startOffset,
+                             ((WindowAgg *)plan)->endOffset);
+    break;
+  case T_Memoize:
+    expressions = ((Memoize *)plan)->param_exprs;
+    break;
+  case T_Append:
+    foreach (cell, ((Append *)plan)->appendplans) {
+      if (!plan_is_cacheable((Plan *)lfirst(cell))) {
+        return false;
+      }
+    }
+    break;
+  case T_MergeAppend:
+    foreach (cell, ((MergeAppend *)plan)->mergeplans) {
+      if (!plan_is_cacheable((Plan *)lfirst(cell))) {
+        return false;
+      }
+    }
+    break;
+  case T_SubqueryScan:
+    if (!plan_is_cacheable(((SubqueryScan *)plan)->subplan)) {
+      return false;
+    }
+    break;
+  case T_Agg:
+  case T_Group:
+  case T_Sort:
+  case T_IncrementalSort:
+  case T_Material:
+  case T_Unique:
+  case T_Gather:
+  case T_GatherMerge:
+    break;
+  default:
+    // Scans of anything but exported tables, functions and modifications
+    // aren't cached.
+    return false;
+  }
+  if (contain_mutable_functions((Node *)expressions)) {
+    return false;
+  }
+  return plan_is_cacheable(plan->lefttree) &&
+         plan_is_cacheable(plan->righttree);
+}
+
+/*
+ * Appends the oid and current generation of every table read by the query.
+ * Returns false if the query reads anything but exported tables.
+ */
+static bool append_table_generations(PlannedStmt *stmt, StringInfo key) {
+  int num_of_tables = 0;
+  ListCell *cell;
+  foreach (cell, stmt->rtable) {
+    RangeTblEntry *rte = (RangeTblEntry *)lfirst(cell);
+    if (rte->rtekind != RTE_RELATION) {
+      continue;
+    }
+    char *relation_name = get_rel_name(rte->relid);
+    size_t prefix_length = strlen(EXPORTED_RELATION_PREFIX);
+    if (get_rel_relkind(rte->relid) != RELKIND_FOREIGN_TABLE ||
+        relation_name == NULL ||
+        strncmp(relation_name, EXPORTED_RELATION_PREFIX, prefix_length) != 0) {
+      return false;
+    }
+    appendStringInfo(key, "%u@" UINT64_FORMAT ";", rte->relid,
+                     get_export_generation(relation_name + prefix_length));
+    num_of_tables += 1;
+  }
+  return num_of_tables > 0;
+}
+
+/*
+ * Appends text of the statement with runs of whitespace collapsed. Text is
+ * used as is if it has comments, escapes or dollar quotes which could make
+ * quotes ambiguous.
+ */
+static void append_normalized_statement(StringInfo key, const char *source,
+                                        int location, int length) {
+  const char *start = source + Max(location, 0);
+  int statement_length = location >= 0 && length > 0 ? length : strlen(start);
+  bool verbatim = false;
+  for (int i = 0; i < statement_length && !verbatim; i += 1) {
+    verbatim = start[i] == '\\' || start[i] == '$' ||
+               (i + 1 < statement_length &&
+                ((start[i] == '-' && start[i + 1] == '-') ||
+                 (start[i] == '/' && start[i + 1] == '*')));
+  }
+  int statement_start = key->len;
+  char quote = '\0';
+  bool pending_space = false;
+  for (int i = 0; i < statement_length; i += 1) {
+    char c = start[i];
+    if (!verbatim && quote == '\0' && isspace((unsigned char)c)) {
+      pending_space = true;
+      continue;
+    }
+    if (pending_space && key->len > statement_start) {
+      appendStringInfoChar(key, ' ');
+    }
+    pending_space = false;
+    if (quote == '\0' && (c == '\'' || c == '"')) {
+      quote = c;
+    } else if (quote == c) {
+      quote = '\0';
+    }
+    appendStringInfoChar(key, c);
+  }
+  while (key->len > statement_start && key->data[key->len - 1] == ';') {
+    key->len -= 1;
+    key->data[key->len] = '\0';
+  }
+}
+
+/*
+ * Builds the cache key of the query. Returns false if the query result
+ * can't be cached. Populates the length of the key up to the table
+ * generations in generations_length.
+ */
+static bool build_result_cache_key(QueryDesc *query_desc, StringInfo key,
+                                   int *generations_length) {
+  PlannedStmt *stmt = query_desc->plannedstmt;
+  if (stmt->commandType != CMD_SELECT || stmt->hasModifyingCTE ||
+      stmt->rowMarks != NIL || stmt->utilityStmt != NULL ||
+      query_desc->sourceText == NULL || query_desc->instrument_options != 0 ||
+      (query_desc->params != NULL && query_desc->params->numParams > 0)) {
+    return false;
+  }
+  initStringInfo(key);
+  // Row level security may give users different results for a query and
+  // relation ids are only unique within a database.
+  appendStringInfo(key, "%u;%u;", MyDatabaseId, GetUserId());
+  if (!append_table_generations(stmt, key)) {
+    return false;
+  }
+  *generations_length = key->len;
+  if (!plan_is_cacheable(stmt->planTree)) {
+    return false;
+  }
+  ListCell *cell;
+  foreach (cell, stmt->subplans) {
+    if (!plan_is_cacheable((Plan *)lfirst(cell))) {
+      return false;
+    }
+  }
+  append_normalized_statement(key, query_desc->sourceText, stmt->stmt_location,
+                              stmt->stmt_len);
+  return true;
+}
+
+/*
+ * Sends tuples of a cached result to the destination of the query instead of
+ * executing the plan.
+ */
+static void send_cached_result(QueryDesc *query_desc, const char *value,
+                               Size value_length) {
+  EState *estate = query_desc->estate;
+  MemoryContext old_context = MemoryContextSwitchTo(estate->es_query_cxt);
+  DestReceiver *dest = query_desc->dest;
+  dest->rStartup(dest, query_desc->operation, query_desc->tupDesc);
+  TupleTableSlot *slot =
+      MakeSingleTupleTableSlot(query_desc->tupDesc, &TTSOpsMinimalTuple);
+  uint64 num_of_tuples = 0;
+  Size offset = 0;
+  while (offset < value_length) {
+    uint32 length;
+    memcpy(&length, value + offset, sizeof(uint32));
+    offset += sizeof(uint32);
+    // Copy so that the tuple is aligned.
+    MinimalTuple tuple = palloc(length);
+    memcpy(tuple, value + offset, length);
+    offset += length;
+    ExecStoreMinimalTuple(tuple, slot, /*shouldFree=*/true);
+    if (!dest->receiveSlot(slot, dest)) {
+      break;
+    }
+    num_of_tuples += 1;
+  }
+  ExecDropSingleTupleTableSlot(slot);
+  dest->rShutdown(dest);
+  estate->es_processed = num_of_tuples;
+  query_desc->already_executed = true;
+  MemoryContextSwitchTo(old_context);
+}
+
+static void caching_receiver_startup(DestReceiver *self, int operation,
+                                     TupleDesc typeinfo) {
+  CachingReceiver *receiver = (CachingReceiver *)self;
+  receiver->target->rStartup(receiver->target, operation, typeinfo);
+}
+
+static bool caching_receiver_receive(TupleTableSlot *slot,
+                                     DestReceiver *self) {
+  CachingReceiver *receiver = (CachingReceiver *)self;
+  if (!receiver->overflowed) {
+    bool should_free;
+    MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot, &should_free);
+    uint32 length = tuple->t_len;
+    if (receiver->tuples.len + sizeof(uint32) + length > receiver->max_size) {
+      receiver->overflowed = true;
+    } else {
+      appendBinaryStringInfo(&receiver->tuples, (char *)&length,
+                             sizeof(uint32));
+      appendBinaryStringInfo(&receiver->tuples, (char *)tuple, length);
+    }
+    if (should_free) {
+      pfree(tuple);
+    }
+  }
+  return receiver->target->receiveSlot(slot, receiver->target);
+}
+
+static void caching_receiver_shutdown(DestReceiver *self) {
+  CachingReceiver *receiver = (CachingReceiver *)self;
+  receiver->target->rShutdown(receiver->target);
+}
+
+static void caching_receiver_destroy(DestReceiver *self) {
+  // Target is destroyed by the owner of the query.
+}
+
+static void run_query(QueryDesc *query_desc, ScanDirection direction,
+                      uint64 count, bool execute_once) {
+  if (prev_executor_run_hook != NULL) {
+    prev_executor_run_hook(query_desc, direction, count, execute_once);
+  } else {
+    standard_ExecutorRun(query_desc, direction, count, execute_once);
+  }
+}
+
+static void result_cache_executor_run(QueryDesc *query_desc,
+                                      ScanDirection direction, uint64 count,
+                                      bool execute_once) {
+  StringInfoData key;
+  int generations_length;
+  // Only complete results of queries run to completion are cached.
+  if (result_cache == NULL || !enable_result_cache || IsParallelWorker() ||
+      count != 0 || !ScanDirectionIsForward(direction) ||
+      !build_result_cache_key(query_desc, &key, &generations_length)) {
+    run_query(query_desc, direction, count, execute_once);
+    return;
+  }
+
+  char *value;
+  Size value_length;
+  if (slot_cache_lookup(result_cache, key.data, key.len, &value,
+                        &value_length)) {
+    elog(DEBUG1, "Serving query result from result cache");
+    send_cached_result(query_desc, value, value_length);
+    pfree(value);
+    pfree(key.data);
+    return;
+  }
+
+  CachingReceiver receiver;
+  memset(&receiver, 0, sizeof(CachingReceiver));
+  receiver.pub.receiveSlot = caching_receiver_receive;
+  receiver.pub.rStartup = caching_receiver_startup;
+  receiver.pub.rShutdown = caching_receiver_shutdown;
+  receiver.pub.rDestroy = caching_receiver_destroy;
+  receiver.pub.mydest = query_desc->dest->mydest;
+  receiver.target = query_desc->dest;
+  receiver.max_size = (Size)result_cache_entry_size * 1024 - key.len;
+  MemoryContext old_context =
+      MemoryContextSwitchTo(query_desc->estate->es_query_cxt);
+  initStringInfo(&receiver.tuples);
+  MemoryContextSwitchTo(old_context);
+
+  query_desc->dest = &receiver.pub;
+  PG_TRY();
+  { run_query(query_desc, direction, count, execute_once); }
+  PG_FINALLY();
+  { query_desc->dest = receiver.target; }
+  PG_END_TRY();
+
+  // Results read while new files were published may mix generations.
+  StringInfoData generations;
+  initStringInfo(&generations);
+  appendStringInfo(&generations, "%u;%u;", MyDatabaseId, GetUserId());
+  bool is_current = append_table_generations(query_desc->plannedstmt,
+                                             &generations) &&
+                    generations.len == generations_length &&
+                    memcmp(generations.data, key.data, generations_length) == 0;
+  if (!receiver.overflowed && is_current) {
+    slot_cache_store(result_cache, key.data, key.len, receiver.tuples.data,
+                     receiver.tuples.len);
+  }
+  pfree(generations.data);
+  pfree(receiver.tuples.data);
+  pfree(key.data);
+}
+
+void result_cache_init(void) {
+  DefineCustomBoolVariable(
+      "pg_analytica.enable_result_cache",
+      "Serve repeated queries on exported tables from the result cache.", NULL,
+      &enable_result_cache, true, PGC_USERSET, 0, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.result_cache_size",
+      "Shared memory used to cache query results on exported tables.", NULL,
+      &result_cache_size, 0, 0, INT_MAX / 1024, PGC_POSTMASTER,
+      GUC_UNIT_KB, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "pg_analytica.result_cache_entry_size",
+      "Largest query result stored in the result cache.", NULL,
+      &result_cache_entry_size, 64, 1, INT_MAX / 1024, PGC_POSTMASTER,
+      GUC_UNIT_KB, NULL, NULL, NULL);
+
+  if (!process_shared_preload_libraries_in_progress ||
+      num_result_cache_slots() == 0) {
+    return;
+  }
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = result_cache_shmem_request;
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = result_cache_shmem_startup;
+  prev_executor_run_hook = ExecutorRun_hook;
+  ExecutorRun_hook = result_cache_executor_run;
+}
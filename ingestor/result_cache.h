@@ -0,0 +1,15 @@
+#ifndef _RESULT_CACHE_H
+#define _RESULT_CACHE_H
+
+#include "postgres.h"
+
+/**
+ * Caches results of read only queries on exported tables in shared memory.
+ * Results are keyed by the normalized query text and the export generation
+ * of every table read by the query so they're invalidated as soon as new
+ * files are published. Requires the library to be in
+ * shared_preload_libraries.
+ */
+extern void result_cache_init(void);
+
+#endif
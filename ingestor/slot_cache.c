@@ -0,0 +1,202 @@
+#include "postgres.h"
+
+#include "common/hashfn.h"
+#include "port/atomics.h"
+#include "slot_cache.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+typedef struct _SlotHeader {
+  bool in_use;
+  uint64 key_hash;
+  uint32 key_length;
+  uint32 value_length;
+  // Value of the cache clock when the entry was last used.
+  pg_atomic_uint64 last_used;
+} SlotHeader;
+
+/* Shared state of a cache, followed by its slots. */
+typedef struct _SlotCacheHeader {
+  LWLock *lock;
+  int num_slots;
+  Size slot_size;
+  pg_atomic_uint64 clock;
+} SlotCacheHeader;
+
+/* Slot holding the entry whose key hashes to key_hash. */
+typedef struct _SlotIndexEntry {
+  uint64 key_hash;
+  int slot;
+} SlotIndexEntry;
+
+struct _SlotCache {
+  SlotCacheHeader *header;
+  // Shared hash table of the slots in use, protected by the cache lock.
+  HTAB *index;
+};
+
+#define SLOT_HEADER_SIZE MAXALIGN(sizeof(SlotHeader))
+#define SLOT_CACHE_HEADER_SIZE MAXALIGN(sizeof(SlotCacheHeader))
+
+static Size slot_stride(const SlotCacheHeader *header) {
+  return SLOT_HEADER_SIZE + MAXALIGN(header->slot_size);
+}
+
+static SlotHeader *get_slot(SlotCache *cache, int slot) {
+  return (SlotHeader *)((char *)cache->header + SLOT_CACHE_HEADER_SIZE +
+                        slot * slot_stride(cache->header));
+}
+
+// Key of a slot is stored at the start of its data followed by the value.
+static char *slot_data(SlotHeader *slot) {
+  return (char *)slot + SLOT_HEADER_SIZE;
+}
+
+static uint64 hash_key(const char *key, Size key_length) {
+  return hash_bytes_extended((const unsigned char *)key, key_length, 0);
+}
+
+static bool slot_has_key(SlotHeader *slot, uint64 key_hash, const char *key,
+                         Size key_length) {
+  return slot->in_use && slot->key_hash == key_hash &&
+         slot->key_length == key_length &&
+         memcmp(slot_data(slot), key, key_length) == 0;
+}
+
+/*
+ * Returns the slot holding the entry with key_hash or -1 if there is none.
+ * Expects the cache lock to be held.
+ */
+static int find_slot(SlotCache *cache, uint64 key_hash) {
+  SlotIndexEntry *entry =
+      hash_search(cache->index, &key_hash, HASH_FIND, NULL);
+  return entry == NULL ? -1 : entry->slot;
+}
+
+/*
+ * Frees slot. Expects the cache lock to be held exclusively.
+ */
+static void release_slot(SlotCache *cache, SlotHeader *slot) {
+  hash_search(cache->index, &slot->key_hash, HASH_REMOVE, NULL);
+  slot->in_use = false;
+}
+
+Size slot_cache_shmem_size(int num_slots, Size slot_size) {
+  Size size = add_size(SLOT_CACHE_HEADER_SIZE,
+                       mul_size(num_slots,
+                                SLOT_HEADER_SIZE + MAXALIGN(slot_size)));
+  return add_size(size,
+                  hash_estimate_size(num_slots, sizeof(SlotIndexEntry)));
+}
+
+void slot_cache_request_lock(const char *name) {
+  RequestNamedLWLockTranche(name, 1);
+}
+
+SlotCache *slot_cache_init(const char *name, int num_slots, Size slot_size) {
+  bool found;
+  SlotCache *cache = MemoryContextAlloc(TopMemoryContext, sizeof(SlotCache));
+  Size header_size = add_size(
+      SLOT_CACHE_HEADER_SIZE,
+      mul_size(num_slots, SLOT_HEADER_SIZE + MAXALIGN(slot_size)));
+  cache->header = ShmemInitStruct(name, header_size, &found);
+  if (!found) {
+    cache->header->lock = &(GetNamedLWLockTranche(name))->lock;
+    cache->header->num_slots = num_slots;
+    cache->header->slot_size = slot_size;
+    pg_atomic_init_u64(&cache->header->clock, 0);
+    for (int i = 0; i < num_slots; i += 1) {
+      SlotHeader *slot = get_slot(cache, i);
+      slot->in_use = false;
+      pg_atomic_init_u64(&slot->last_used, 0);
+    }
+  }
+  char index_name[SHMEM_INDEX_KEYSIZE];
+  snprintf(index_name, sizeof(index_name), "%s index", name);
+  HASHCTL info;
+  info.keysize = sizeof(uint64);
+  info.entrysize = sizeof(SlotIndexEntry);
+  cache->index = ShmemInitHash(index_name, num_slots, num_slots, &info,
+                               HASH_ELEM | HASH_BLOBS);
+  return cache;
+}
+
+bool slot_cache_lookup(SlotCache *cache, const char *key, Size key_length,
+                       char **value, Size *value_length) {
+  uint64 key_hash = hash_key(key, key_length);
+  bool found = false;
+  LWLockAcquire(cache->header->lock, LW_SHARED);
+  int index = find_slot(cache, key_hash);
+  SlotHeader *slot = index < 0 ? NULL : get_slot(cache, index);
+  if (slot != NULL && slot_has_key(slot, key_hash, key, key_length)) {
+    pg_atomic_write_u64(&slot->last_used,
+                        pg_atomic_add_fetch_u64(&cache->header->clock, 1));
+    *value_length = slot->value_length;
+    *value = palloc(slot->value_length);
+    memcpy(*value, slot_data(slot) + key_length, slot->value_length);
+    found = true;
+  }
+  LWLockRelease(cache->header->lock);
+  return found;
+}
+
+bool slot_cache_store(SlotCache *cache, const char *key, Size key_length,
+                      const char *value, Size value_length) {
+  if (key_length + value_length > cache->header->slot_size) {
+    return false;
+  }
+  uint64 key_hash = hash_key(key, key_length);
+  LWLockAcquire(cache->header->lock, LW_EXCLUSIVE);
+  // Entries are replaced in place, including those of other keys with the
+  // same hash.
+  int victim = find_slot(cache, key_hash);
+  if (victim < 0) {
+    for (int i = 0; i < cache->header->num_slots; i += 1) {
+      SlotHeader *slot = get_slot(cache, i);
+      // Prefer free slots over the least recently used entry.
+      if (!slot->in_use) {
+        victim = i;
+        break;
+      }
+      if (victim < 0 ||
+          pg_atomic_read_u64(&slot->last_used) <
+              pg_atomic_read_u64(&get_slot(cache, victim)->last_used)) {
+        victim = i;
+      }
+    }
+  }
+  if (victim >= 0) {
+    SlotHeader *slot = get_slot(cache, victim);
+    if (slot->in_use) {
+      release_slot(cache, slot);
+    }
+    slot->in_use = true;
+    slot->key_hash = key_hash;
+    slot->key_length = key_length;
+    slot->value_length = value_length;
+    memcpy(slot_data(slot), key, key_length);
+    memcpy(slot_data(slot) + key_length, value, value_length);
+    pg_atomic_write_u64(&slot->last_used,
+                        pg_atomic_add_fetch_u64(&cache->header->clock, 1));
+    SlotIndexEntry *entry =
+        hash_search(cache->index, &key_hash, HASH_ENTER, NULL);
+    entry->slot = victim;
+  }
+  LWLockRelease(cache->header->lock);
+  return victim >= 0;
+}
+
+void slot_cache_remove_prefix(SlotCache *cache, const char *prefix,
+                              Size prefix_length) {
+  LWLockAcquire(cache->header->lock, LW_EXCLUSIVE);
+  for (int i = 0; i < cache->header->num_slots; i += 1) {
+    SlotHeader *slot = get_slot(cache, i);
+    if (slot->in_use && slot->key_length >= prefix_length &&
+        memcmp(slot_data(slot), prefix, prefix_length) == 0) {
+      release_slot(cache, slot);
+    }
+  }
+  LWLockRelease(cache->header->lock);
+}
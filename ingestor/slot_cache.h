@@ -0,0 +1,54 @@
+#ifndef _SLOT_CACHE_H
+#define _SLOT_CACHE_H
+
+#include "postgres.h"
+
+/**
+ * Key value cache in shared memory made of a fixed number of equally sized
+ * slots. Each slot holds a key and its value, entries that don't fit in a
+ * slot aren't cached. Slots are found through a shared hash table keyed by
+ * the hash of their key. The least recently used entry is evicted when the
+ * cache is full.
+ */
+typedef struct _SlotCache SlotCache;
+
+/**
+ * Returns shared memory needed for a cache with num_slots slots holding up
+ * to slot_size bytes of key and value each, including its hash table.
+ */
+extern Size slot_cache_shmem_size(int num_slots, Size slot_size);
+
+/**
+ * Requests the lock of a cache, must be called from a shmem_request_hook.
+ */
+extern void slot_cache_request_lock(const char *name);
+
+/**
+ * Creates the cache in shared memory or attaches to it, must be called from
+ * a shmem_startup_hook with AddinShmemInitLock held.
+ */
+extern SlotCache *slot_cache_init(const char *name, int num_slots,
+                                  Size slot_size);
+
+/**
+ * Returns true and populates a palloc'd copy of the value cached for key.
+ */
+extern bool slot_cache_lookup(SlotCache *cache, const char *key,
+                              Size key_length, char **value,
+                              Size *value_length);
+
+/**
+ * Caches value for key evicting the least recently used entry if needed.
+ * Returns false if the entry is too large for a slot.
+ */
+extern bool slot_cache_store(SlotCache *cache, const char *key,
+                             Size key_length, const char *value,
+                             Size value_length);
+
+/**
+ * Removes entries whose key starts with prefix.
+ */
+extern void slot_cache_remove_prefix(SlotCache *cache, const char *prefix,
+                                     Size prefix_length);
+
+#endif
@@ -1,6 +1,293 @@
+-- Run generate_test_data.sql first. Exports start within pg_analytica.naptime
+-- of being registered, set it to a few seconds to run the round trips quickly.
 DROP EXTENSION ingestor;
 CREATE EXTENSION ingestor;
 
+-- Waits for the first export of name since it was registered or its columns
+-- changed.
+CREATE OR REPLACE FUNCTION wait_for_export(name text)
+RETURNS void AS
+$$
+begin
+    for i in 1..3600 loop
+        if exists (select 1 from analytica_exports
+                   where table_name = name and last_run_completed is not null) then
+            return;
+        end if;
+        perform pg_sleep(1);
+    end loop;
+    raise exception 'export of % did not complete', name;
+end
+$$
+language plpgsql;
+
+-- Raises an error unless both queries return the same rows.
+CREATE OR REPLACE FUNCTION assert_same_rows(expected text, actual text)
+RETURNS void AS
+$$
+declare
+    missing bigint;
+    extra bigint;
+begin
+    execute format('select count(*) from ((%s) except all (%s)) t',
+                   expected, actual) into missing;
+    execute format('select count(*) from ((%s) except all (%s)) t',
+                   actual, expected) into extra;
+    if missing > 0 or extra > 0 then
+        raise exception '% rows missing from and % extra rows in: %',
+            missing, extra, actual;
+    end if;
+end
+$$
+language plpgsql;
+
+CREATE OR REPLACE FUNCTION assert_true(description text, condition bool)
+RETURNS void AS
+$$
+begin
+    if condition is not true then
+        raise exception 'failed: %', description;
+    end if;
+end
+$$
+language plpgsql;
+
+-- Each option is exported from its own copy of the orders.
+DROP TABLE IF EXISTS test_orders_lz4;
+DROP TABLE IF EXISTS test_orders_parquet;
+DROP TABLE IF EXISTS test_orders_bucketed;
+CREATE TABLE test_orders_lz4 AS TABLE test_orders;
+CREATE TABLE test_orders_parquet AS TABLE test_orders;
+CREATE TABLE test_orders_bucketed AS TABLE test_orders;
+
+-- Every exported type through Arrow files, in chunks of 1000 rows.
+SELECT register_table_export(
+    'test_orders',
+    '{id,customer_id,quantity,amount,weight,is_gift,order_uuid,note,tags,details,payload,ordered_on,created_at}',
+    24,
+    chunk_size => 1000,
+    output_format => 'arrow',
+    distinct_count_columns => '{customer_id}',
+    fresh_column => 'id'
+);
+
+-- Compressed Arrow files with a file per column.
+SELECT register_table_export(
+    'test_orders_lz4',
+    '{id,customer_id,amount}',
+    24,
+    chunk_size => 5000,
+    output_format => 'arrow_lz4',
+    layout => 'column_groups'
+);
+
+-- Parquet files of some of the rows with bloom filters.
+SELECT register_table_export(
+    'test_orders_parquet',
+    '{id,customer_id,amount,note}',
+    24,
+    chunk_size => 5000,
+    bloom_filter_columns => '{customer_id,note}',
+    row_filter => 'amount > 0'
+);
+
+-- Orders and customers bucketed on the key they are joined on.
+SELECT register_table_export(
+    'test_orders_bucketed',
+    '{id,customer_id,amount}',
+    24,
+    output_format => 'arrow',
+    bucket_column => 'customer_id',
+    num_of_buckets => 4
+);
+SELECT register_table_export(
+    'test_customers',
+    '{customer_id,region}',
+    24,
+    output_format => 'arrow',
+    bucket_column => 'customer_id',
+    num_of_buckets => 4
+);
+
+-- Partitioned table limited to a window, with a stratified sample.
+SELECT register_table_export(
+    'test_events',
+    '{id,user_id,kind,value,created_at}',
+    24,
+    sample_rate => 0.1,
+    sample_strata_column => 'kind',
+    distinct_count_columns => '{user_id}',
+    window_column => 'created_at',
+    window_interval => '30 days'
+);
+
+SELECT register_query_export(
+    'test_order_facts',
+    'SELECT o.id, o.amount, c.region
+     FROM test_orders o JOIN test_customers c USING (customer_id)',
+    24,
+    output_format => 'arrow',
+    incremental_key => 'id'
+);
+
+-- To Launch ingestor background worker
+SELECT ingestor_launch();
+
+SELECT wait_for_export('test_orders');
+SELECT wait_for_export('test_orders_lz4');
+SELECT wait_for_export('test_orders_parquet');
+SELECT wait_for_export('test_orders_bucketed');
+SELECT wait_for_export('test_customers');
+SELECT wait_for_export('test_events');
+SELECT wait_for_export('test_order_facts');
+
+-- Arrow files
+SELECT assert_same_rows(
+    'SELECT * FROM test_orders',
+    'SELECT * FROM analytica_test_orders');
+
+-- analytica_scan matches columns by name, in any order, and returns NULL for
+-- columns that weren't exported.
+SELECT assert_same_rows(
+    'SELECT amount, id, NULL::text FROM test_orders',
+    'SELECT * FROM analytica_scan(''test_orders'')
+     AS t(amount numeric(12, 2), id int, unexported text)');
+DO $$
+begin
+    perform * from analytica_scan('test_orders') as t(id text);
+    raise exception 'analytica_scan returned id as text';
+exception
+    when datatype_mismatch then null;
+end
+$$;
+
+-- Distinct counts
+SELECT assert_true(
+    'approximate distinct customers are within 5%',
+    abs(analytica_approx_count_distinct('test_orders', 'customer_id') -
+        (SELECT count(DISTINCT customer_id) FROM test_orders)) <=
+    0.05 * (SELECT count(DISTINCT customer_id) FROM test_orders));
+SELECT assert_true(
+    'columns without sketches have no distinct count',
+    analytica_approx_count_distinct('test_orders', 'amount') IS NULL);
+
+-- Fresh views return rows added since the export.
+INSERT INTO test_orders (customer_id, amount, note)
+SELECT floor(random() * 1000) + 1, i, 'fresh'
+FROM generate_series(1, 100) AS i;
+SELECT assert_same_rows(
+    'SELECT * FROM test_orders',
+    'SELECT * FROM analytica_test_orders_fresh');
+
+-- Column groups
+SELECT assert_same_rows(
+    'SELECT id, customer_id, amount FROM test_orders_lz4',
+    'SELECT * FROM analytica_test_orders_lz4');
+SELECT set_export_columns('test_orders_lz4', '{id,customer_id,note,tags}');
+SELECT wait_for_export('test_orders_lz4');
+SELECT assert_same_rows(
+    'SELECT id, customer_id, note, tags FROM test_orders_lz4',
+    'SELECT * FROM analytica_test_orders_lz4');
+
+-- Parquet files with a row filter and bloom filters
+SELECT assert_same_rows(
+    'SELECT id, customer_id, amount, note FROM test_orders_parquet
+     WHERE amount > 0',
+    'SELECT * FROM analytica_test_orders_parquet');
+SELECT assert_same_rows(
+    'SELECT id FROM test_orders_parquet WHERE amount > 0 AND customer_id = 17',
+    'SELECT id FROM analytica_test_orders_parquet WHERE customer_id = 17');
+SELECT assert_same_rows(
+    'SELECT id FROM test_orders_parquet WHERE amount > 0 AND note = ''note 3''',
+    'SELECT id FROM analytica_test_orders_parquet WHERE note = ''note 3''');
+SELECT assert_true(
+    'no rows match a value that was never exported',
+    NOT EXISTS (SELECT 1 FROM analytica_test_orders_parquet
+                WHERE customer_id = -1));
+-- Files can't be ruled out outside of planning a query with filters.
+SELECT assert_true(
+    'files may match without filters',
+    bool_and(analytica_file_may_match(d.dir, f)))
+FROM (SELECT format('./pg_analytica/%s/test_orders_parquet', oid) AS dir
+      FROM pg_database WHERE datname = current_database()) d,
+     pg_ls_dir(d.dir) AS f
+WHERE f LIKE '%.parquet';
+
+-- Buckets
+SELECT assert_true(
+    'buckets only hold their rows',
+    NOT EXISTS (
+        SELECT 1
+        FROM generate_series(0, 3) b,
+        LATERAL (SELECT * FROM analytica_scan('test_orders_bucketed', b)
+                 AS t(customer_id int)) o
+        WHERE analytica_bucket(o.customer_id, 4) <> b));
+SELECT assert_same_rows(
+    'SELECT c.region, sum(o.amount) FROM test_orders_bucketed o
+     JOIN test_customers c USING (customer_id) GROUP BY c.region',
+    'SELECT c.region, sum(o.amount)
+     FROM generate_series(0, 3) b,
+     LATERAL (SELECT * FROM analytica_scan(''test_orders_bucketed'', b)
+              AS t(customer_id int, amount numeric(12, 2))) o
+     JOIN LATERAL (SELECT * FROM analytica_scan(''test_customers'', b)
+                   AS t(customer_id int, region text)) c
+         USING (customer_id)
+     GROUP BY c.region');
+
+-- Window, sample and distinct counts of partitions
+SELECT assert_true(
+    'rows older than the window are dropped',
+    NOT EXISTS (SELECT 1 FROM analytica_test_events
+                WHERE created_at < now() - interval '30 days 1 hour'));
+SELECT assert_same_rows(
+    'SELECT * FROM test_events WHERE created_at >= now() - interval ''29 days''',
+    'SELECT * FROM analytica_test_events
+     WHERE created_at >= now() - interval ''29 days''');
+SELECT assert_true(
+    'sample weights estimate the number of exported rows within 10%',
+    abs(sum(sampling_weight) - (SELECT count(*) FROM analytica_test_events)) <=
+    0.1 * (SELECT count(*) FROM analytica_test_events))
+FROM analytica_test_events_sample;
+SELECT assert_true(
+    'rare strata are sampled in full',
+    (SELECT count(*) FROM analytica_test_events_sample WHERE kind = 'refund') =
+    (SELECT count(*) FROM analytica_test_events WHERE kind = 'refund'));
+SELECT assert_true(
+    'approximate distinct users of partitions are within 5%',
+    abs(analytica_approx_count_distinct('test_events', 'user_id',
+                                        '{test_events_0,test_events_1}') -
+        e.users) <= 0.05 * e.users)
+FROM (SELECT count(DISTINCT user_id) AS users
+      FROM (SELECT user_id, created_at FROM test_events_0
+            UNION ALL
+            SELECT user_id, created_at FROM test_events_1) p
+      WHERE created_at >= now() - interval '30 days') e;
+
+-- Queries, exported again once the orders above were added
+SELECT assert_same_rows(
+    'SELECT o.id, o.amount, c.region
+     FROM test_orders o JOIN test_customers c USING (customer_id)
+     WHERE o.note IS DISTINCT FROM ''fresh''',
+    'SELECT * FROM analytica_test_order_facts');
+UPDATE analytica_exports SET last_run_completed = NULL
+WHERE table_name = 'test_order_facts';
+SELECT wait_for_export('test_order_facts');
+SELECT assert_same_rows(
+    'SELECT o.id, o.amount, c.region
+     FROM test_orders o JOIN test_customers c USING (customer_id)',
+    'SELECT * FROM analytica_test_order_facts');
+
+SELECT unregister_table_export('test_orders');
+SELECT unregister_table_export('test_orders_lz4');
+SELECT unregister_table_export('test_orders_parquet');
+SELECT unregister_table_export('test_orders_bucketed');
+SELECT unregister_table_export('test_customers');
+SELECT unregister_table_export('test_events');
+SELECT unregister_table_export('test_order_facts');
+DROP FUNCTION wait_for_export(text);
+DROP FUNCTION assert_same_rows(text, text);
+DROP FUNCTION assert_true(text, bool);
+
 SELECT register_table_export(
     -- table name
     'test_data', 
@@ -9,6 +296,3 @@ SELECT register_table_export(
     -- export_frequency_hours
     7
 );
-
--- To Launch ingestor background worker
-SELECT ingestor_launch();
\ No newline at end of file